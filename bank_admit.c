@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank_admit.h"
+
+// Account numbers are dense, so they are mixed before picking a set
+static uint32_t mixAccount(int account_number) {
+    uint32_t x = (uint32_t)account_number;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static void count(uint64_t *counter) {
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+// Refills a bucket for the time since it was last used and takes one
+// request from it; returns 0 if it is empty
+static int takeToken(double *tokens, double *stamp, double rate, double burst, double now) {
+    double refilled = *tokens + (now - *stamp) * rate;
+
+    *tokens = refilled < burst ? refilled : burst;
+    *stamp = now;
+    if (*tokens < 1.0) {
+        return 0;
+    }
+    *tokens -= 1.0;
+    return 1;
+}
+
+static double burstOf(double rate, double burst) {
+    return burst > 0 ? burst : rate > 1.0 ? rate : 1.0;
+}
+
+void admitDefaults(AdmitConfig *config) {
+    memset(config, 0, sizeof(*config));
+    config->queue_limit = ADMIT_DEFAULT_QUEUE;
+    config->max_wait[ADMIT_INTERACTIVE] = ADMIT_INTERACTIVE_WAIT;
+    config->max_wait[ADMIT_BATCH] = ADMIT_BATCH_WAIT;
+}
+
+int admitInit(BankAdmission *admission, const AdmitConfig *config) {
+    size_t sets = 1;
+
+    memset(admission, 0, sizeof(*admission));
+    admission->config = *config;
+    admission->config.client_burst = burstOf(config->client_rate, config->client_burst);
+    admission->config.account_burst = burstOf(config->account_rate, config->account_burst);
+    if (config->account_rate > 0) {
+        while (sets * ADMIT_WAYS < ADMIT_ACCOUNTS) {
+            sets <<= 1;
+        }
+        admission->accounts = calloc(sets * ADMIT_WAYS, sizeof(AdmitAccount));
+        if (admission->accounts == NULL) {
+            return -1;
+        }
+    }
+    admission->set_mask = sets - 1;
+    pthread_mutex_init(&admission->account_lock, NULL);
+    return 0;
+}
+
+void admitFree(BankAdmission *admission) {
+    pthread_mutex_destroy(&admission->account_lock);
+    free(admission->accounts);
+    admission->accounts = NULL;
+}
+
+void admitClientInit(BankAdmission *admission, TokenBucket *client, double now) {
+    client->tokens = admission->config.client_burst;
+    client->stamp = now;
+}
+
+// The account a request is charged to: the payer of a transfer, nothing for
+// requests that name no existing account or come from a shard router
+static int chargedAccount(const BankRequest *req) {
+    switch (req->op) {
+        case BANK_OP_BALANCE:
+        case BANK_OP_DEPOSIT:
+        case BANK_OP_WITHDRAW:
+        case BANK_OP_TRANSFER:
+            return req->account_number;
+        default:
+            return 0;
+    }
+}
+
+static int takeAccountToken(BankAdmission *admission, int account_number, double now) {
+    const AdmitConfig *config = &admission->config;
+    AdmitAccount *set = admission->accounts + (mixAccount(account_number) & admission->set_mask) * ADMIT_WAYS;
+    AdmitAccount *entry = NULL;
+    int taken;
+
+    pthread_mutex_lock(&admission->account_lock);
+    for (int way = 0; way < ADMIT_WAYS && entry == NULL; way++) {
+        if (set[way].account_number == account_number) {
+            entry = &set[way];
+        }
+    }
+    if (entry == NULL) {
+        entry = &set[0];
+        for (int way = 1; way < ADMIT_WAYS; way++) {
+            if (set[way].stamp < entry->stamp) {
+                entry = &set[way];
+            }
+        }
+        entry->account_number = account_number;
+        entry->tokens = (float)config->account_burst;
+        entry->stamp = now;
+    }
+    double tokens = entry->tokens;
+    taken = takeToken(&tokens, &entry->stamp, config->account_rate, config->account_burst, now);
+    entry->tokens = (float)tokens;
+    pthread_mutex_unlock(&admission->account_lock);
+    return taken;
+}
+
+int admitCheck(BankAdmission *admission, TokenBucket *client, const BankRequest *req, double now) {
+    const AdmitConfig *config = &admission->config;
+    int account_number = chargedAccount(req);
+
+    if (config->client_rate > 0 &&
+        !takeToken(&client->tokens, &client->stamp, config->client_rate, config->client_burst, now)) {
+        count(&admission->stats.shed_client);
+        return BANK_ERR_OVERLOADED;
+    }
+    if (config->account_rate > 0 && account_number != 0 && !takeAccountToken(admission, account_number, now)) {
+        count(&admission->stats.shed_account);
+        return BANK_ERR_OVERLOADED;
+    }
+    return BANK_OK;
+}
+
+int admitQueueInit(AdmitQueue *queue, BankAdmission *admission) {
+    memset(queue, 0, sizeof(*queue));
+    queue->admission = admission;
+    for (int c = 0; c < ADMIT_CLASSES; c++) {
+        queue->ring[c].entries = malloc((size_t)admission->config.queue_limit * sizeof(AdmitEntry));
+        if (queue->ring[c].entries == NULL) {
+            admitQueueFree(queue);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void admitQueueFree(AdmitQueue *queue) {
+    for (int c = 0; c < ADMIT_CLASSES; c++) {
+        free(queue->ring[c].entries);
+        queue->ring[c].entries = NULL;
+    }
+}
+
+int admitPush(AdmitQueue *queue, void *owner, const BankRequest *req, double now) {
+    BankAdmission *admission = queue->admission;
+    size_t limit = (size_t)admission->config.queue_limit;
+    int c = req->priority == BANK_PRIORITY_BATCH ? ADMIT_BATCH : ADMIT_INTERACTIVE;
+    AdmitRing *ring = &queue->ring[c];
+
+    if (ring->count == limit) {
+        count(&admission->stats.shed_queue);
+        return BANK_ERR_OVERLOADED;
+    }
+    AdmitEntry *entry = &ring->entries[(ring->head + ring->count) % limit];
+    entry->owner = owner;
+    entry->queued = now;
+    entry->req = *req;
+    ring->count++;
+    __atomic_add_fetch(&admission->waiting[c], 1, __ATOMIC_RELAXED);
+    count(&admission->stats.admitted);
+    return BANK_OK;
+}
+
+int admitPop(AdmitQueue *queue, double now, AdmitEntry *entry) {
+    BankAdmission *admission = queue->admission;
+    size_t limit = (size_t)admission->config.queue_limit;
+    int c;
+
+    // Interactive requests waiting in other loops hold batch work back here
+    if (queue->ring[ADMIT_INTERACTIVE].count > 0) {
+        c = ADMIT_INTERACTIVE;
+    } else if (queue->ring[ADMIT_BATCH].count > 0 &&
+               __atomic_load_n(&admission->waiting[ADMIT_INTERACTIVE], __ATOMIC_RELAXED) == 0) {
+        c = ADMIT_BATCH;
+    } else {
+        return ADMIT_EMPTY;
+    }
+
+    AdmitRing *ring = &queue->ring[c];
+    *entry = ring->entries[ring->head];
+    ring->head = (ring->head + 1) % limit;
+    ring->count--;
+    __atomic_sub_fetch(&admission->waiting[c], 1, __ATOMIC_RELAXED);
+    if (now - entry->queued > admission->config.max_wait[c]) {
+        count(&admission->stats.shed_late);
+        return ADMIT_LATE;
+    }
+    return ADMIT_SERVE;
+}
+
+size_t admitPending(const AdmitQueue *queue) {
+    return queue->ring[ADMIT_INTERACTIVE].count + queue->ring[ADMIT_BATCH].count;
+}
+
+void admitStatsRead(BankAdmission *admission, AdmitStats *stats) {
+    stats->admitted = __atomic_load_n(&admission->stats.admitted, __ATOMIC_RELAXED);
+    stats->shed_client = __atomic_load_n(&admission->stats.shed_client, __ATOMIC_RELAXED);
+    stats->shed_account = __atomic_load_n(&admission->stats.shed_account, __ATOMIC_RELAXED);
+    stats->shed_queue = __atomic_load_n(&admission->stats.shed_queue, __ATOMIC_RELAXED);
+    stats->shed_late = __atomic_load_n(&admission->stats.shed_late, __ATOMIC_RELAXED);
+}
+
+uint64_t admitShed(const AdmitStats *stats) {
+    return stats->shed_client + stats->shed_account + stats->shed_queue + stats->shed_late;
+}
@@ -0,0 +1,127 @@
+#ifndef BANK_ADMIT_H
+#define BANK_ADMIT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bank_protocol.h"
+
+// Admission control for bankd. Every decoded request passes a token bucket
+// for its client connection and one for its account before it is queued;
+// one over either rate is answered BANK_ERR_OVERLOADED at once instead of
+// waiting. Admitted requests wait in a bounded queue per priority class in
+// their event loop, and are served interactive first: batch requests run
+// only while no loop has an interactive one waiting. A full queue, or a
+// request that waited past its class's limit, is refused the same way, so
+// overload shows up as fast rejections rather than unbounded latency. Every
+// refusal is counted by cause.
+//
+// Account buckets live in a set-associative table like the rules table:
+// fixed at init, the least recently used account in a full set forgotten
+// (and so given a full bucket again).
+#define ADMIT_WAYS 4
+#define ADMIT_ACCOUNTS 65536              // accounts rate limited at once
+#define ADMIT_DEFAULT_QUEUE 4096          // requests queued per class and loop
+#define ADMIT_CLIENT_QUEUED 1024          // a client's queued requests before it is no longer read
+#define ADMIT_INTERACTIVE_WAIT 0.5        // seconds an interactive request may wait to be served
+#define ADMIT_BATCH_WAIT 5.0              // and a batch one
+
+typedef enum {
+    ADMIT_INTERACTIVE = BANK_PRIORITY_INTERACTIVE,
+    ADMIT_BATCH = BANK_PRIORITY_BATCH,
+    ADMIT_CLASSES
+} AdmitClass;
+
+// Rates are requests per second, 0 for no limit; a bucket holds `burst`
+// requests, the rate's worth of a second when 0
+typedef struct {
+    double client_rate;
+    double client_burst;
+    double account_rate;
+    double account_burst;
+    int queue_limit;                      // per class and loop
+    double max_wait[ADMIT_CLASSES];       // seconds
+} AdmitConfig;
+
+typedef struct {
+    double tokens;
+    double stamp;                         // when `tokens` was last refilled
+} TokenBucket;
+
+typedef struct {
+    int32_t account_number;               // 0 marks an empty way
+    float tokens;
+    double stamp;
+} AdmitAccount;
+
+// Counted since admitInit
+typedef struct {
+    uint64_t admitted;
+    uint64_t shed_client;                 // client over its rate
+    uint64_t shed_account;                // account over its rate
+    uint64_t shed_queue;                  // class queue full
+    uint64_t shed_late;                   // waited past the class's limit
+} AdmitStats;
+
+// Shared by every event loop
+typedef struct {
+    AdmitConfig config;
+    pthread_mutex_t account_lock;
+    AdmitAccount *accounts;
+    size_t set_mask;
+    long waiting[ADMIT_CLASSES];          // requests queued in all loops
+    AdmitStats stats;
+} BankAdmission;
+
+typedef struct {
+    void *owner;                          // the connection to answer
+    double queued;                        // when it was admitted
+    BankRequest req;
+} AdmitEntry;
+
+typedef struct {
+    AdmitEntry *entries;
+    size_t head;
+    size_t count;
+} AdmitRing;
+
+// One event loop's queues
+typedef struct {
+    BankAdmission *admission;
+    AdmitRing ring[ADMIT_CLASSES];
+} AdmitQueue;
+
+// What admitPop produced
+#define ADMIT_EMPTY 0                     // nothing may be served now
+#define ADMIT_SERVE 1
+#define ADMIT_LATE 2                      // answer it BANK_ERR_OVERLOADED
+
+void admitDefaults(AdmitConfig *config);
+int admitInit(BankAdmission *admission, const AdmitConfig *config);
+void admitFree(BankAdmission *admission);
+
+// A new client's bucket, full
+void admitClientInit(BankAdmission *admission, TokenBucket *client, double now);
+
+// Charges the request to its client and account. Returns BANK_OK, or
+// BANK_ERR_OVERLOADED (counted) when either is over its rate.
+int admitCheck(BankAdmission *admission, TokenBucket *client, const BankRequest *req, double now);
+
+int admitQueueInit(AdmitQueue *queue, BankAdmission *admission);
+void admitQueueFree(AdmitQueue *queue);
+
+// Queues an admitted request by its priority. Returns BANK_OK, or
+// BANK_ERR_OVERLOADED (counted) when its class's queue is full.
+int admitPush(AdmitQueue *queue, void *owner, const BankRequest *req, double now);
+
+// Takes the next request to serve into `entry`
+int admitPop(AdmitQueue *queue, double now, AdmitEntry *entry);
+
+// Requests in the loop's queues, servable now or not
+size_t admitPending(const AdmitQueue *queue);
+
+void admitStatsRead(BankAdmission *admission, AdmitStats *stats);
+uint64_t admitShed(const AdmitStats *stats);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank_arena.h"
+
+#define POISON_ALLOC 0xCD
+#define POISON_FREE 0xDD
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    unsigned char data[];
+};
+
+void arenaInit(BankArena *arena, size_t block_size) {
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+}
+
+void arenaFree(BankArena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arenaInit(arena, arena->block_size);
+}
+
+// Poisons everything from `block`+`used` to the end of the chain
+static void poisonFrom(ArenaBlock *block, size_t used) {
+#ifdef DEBUG
+    for (; block != NULL; block = block->next, used = 0) {
+        memset(block->data + used, POISON_FREE, block->size - used);
+    }
+#else
+    (void)block;
+    (void)used;
+#endif
+}
+
+static size_t padding(const ArenaBlock *block) {
+    return (size_t)(-(uintptr_t)(block->data + block->used)) & (ARENA_ALIGN - 1);
+}
+
+static int fits(const ArenaBlock *block, size_t size) {
+    return block->used + padding(block) + size <= block->size;
+}
+
+void *arenaAlloc(BankArena *arena, size_t size) {
+    ArenaBlock *block = arena->current;
+
+    if (block == NULL || !fits(block, size)) {
+        // Blocks left over from before the last reset are reused first
+        if (block != NULL && block->next != NULL && block->next->size >= size + ARENA_ALIGN) {
+            block = block->next;
+            block->used = 0;
+        } else {
+            size_t capacity = size + ARENA_ALIGN > arena->block_size ? size + ARENA_ALIGN : arena->block_size;
+            ArenaBlock *fresh = malloc(sizeof(ArenaBlock) + capacity);
+            if (fresh == NULL) {
+                return NULL;
+            }
+            fresh->size = capacity;
+            fresh->used = 0;
+            if (block == NULL) {
+                fresh->next = arena->first;
+                arena->first = fresh;
+            } else {
+                fresh->next = block->next;
+                block->next = fresh;
+            }
+            block = fresh;
+            arena->blocks++;
+        }
+        arena->current = block;
+    }
+
+    size_t pad = padding(block);
+    void *p = block->data + block->used + pad;
+    block->used += pad + size;
+    arena->in_use += pad + size;
+    if (arena->in_use > arena->peak) {
+        arena->peak = arena->in_use;
+    }
+    arena->allocations++;
+#ifdef DEBUG
+    memset(p, POISON_ALLOC, size);
+#endif
+    return p;
+}
+
+void arenaReset(BankArena *arena) {
+    poisonFrom(arena->first, 0);
+    arena->current = arena->first;
+    if (arena->first != NULL) {
+        arena->first->used = 0;
+    }
+    arena->in_use = 0;
+}
+
+ArenaMark arenaMark(const BankArena *arena) {
+    ArenaMark mark = { arena->current, arena->current ? arena->current->used : 0, arena->in_use };
+    return mark;
+}
+
+void arenaRewind(BankArena *arena, ArenaMark mark) {
+    if (mark.block == NULL) {
+        arenaReset(arena);
+        return;
+    }
+    poisonFrom(mark.block, mark.used);
+    arena->current = mark.block;
+    mark.block->used = mark.used;
+    arena->in_use = mark.in_use;
+}
@@ -0,0 +1,45 @@
+#ifndef BANK_ARENA_H
+#define BANK_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator for temporaries that live as long as one request or batch.
+// Allocation advances a pointer through a chain of blocks; arenaReset makes
+// the whole arena reusable in O(1) without returning the blocks, so a steady
+// workload stops calling malloc after its first batch. Built with -DDEBUG
+// (make debug), memory is filled with 0xCD when handed out and 0xDD when
+// reset, so a pointer kept past its scope reads garbage instead of stale data.
+#define ARENA_DEFAULT_BLOCK 65536
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;        // block allocations are carved from
+    size_t block_size;
+    uint64_t allocations;       // served since init
+    uint64_t blocks;            // block mallocs since init
+    size_t in_use;              // bytes handed out since the last reset
+    size_t peak;                // most bytes in use at once
+} BankArena;
+
+// Position to rewind to, for scopes nested inside a request or batch
+typedef struct {
+    ArenaBlock *block;
+    size_t used;
+    size_t in_use;
+} ArenaMark;
+
+void arenaInit(BankArena *arena, size_t block_size);
+void arenaFree(BankArena *arena);
+
+// Returns ARENA_ALIGN-aligned memory, or NULL when out of memory
+void *arenaAlloc(BankArena *arena, size_t size);
+
+void arenaReset(BankArena *arena);
+ArenaMark arenaMark(const BankArena *arena);
+void arenaRewind(BankArena *arena, ArenaMark mark);
+
+#endif
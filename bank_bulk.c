@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bank_bulk.h"
+#include "bank_internal.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define BULK_SSE2 1
+#endif
+
+#define BULK_BLOCK 16
+#define BULK_ROW_FIELDS (BULK_CUSTOMER_FIELDS + 1)   // one more, to notice extra fields
+#define BULK_MAX_ACCOUNT_DIGITS 9
+#define BULK_MAX_WHOLE_DIGITS 15                     // keeps cents well inside int64_t
+
+typedef struct {
+    const char *limit;                               // the end of the file
+    size_t offset;
+    int fields;
+    int nul;
+    const char *field[BULK_ROW_FIELDS];
+    size_t length[BULK_ROW_FIELDS];
+} BulkRow;
+
+typedef struct {
+    const BulkFile *file;
+    BulkKind kind;
+    size_t begin;
+    size_t end;
+    BulkItem *items;
+    long count;
+    long capacity;
+    int failed;                                      // memory ran out
+} BulkTask;
+
+int bulkOpen(BulkFile *file, const char *path) {
+    struct stat st;
+    void *data;
+    int fd = open(path, O_RDONLY);
+
+    file->data = NULL;
+    file->size = 0;
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    if (st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+        file->data = data;
+        file->size = (size_t)st.st_size;
+    }
+    close(fd);
+    return 0;
+}
+
+void bulkClose(BulkFile *file) {
+    if (file->data != NULL) {
+        munmap((void *)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+static int isDigit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+// The value of the `len` digits at text (1 to 15), 0 if any is not a digit.
+// Up to eight are converted at once when eight bytes can be read before `limit`.
+static int parseDigits(const char *text, size_t len, const char *limit, int64_t *value) {
+    int64_t result = 0;
+
+    if (len <= 8 && limit - text >= 8) {
+        uint64_t word;
+        unsigned shift = (unsigned)(8 - len) * 8;
+
+        // The digits move to the top bytes and '0's fill in below them as
+        // leading zeros; byte 0 is then the most significant digit
+        memcpy(&word, text, sizeof(word));
+        word = word << shift | (0x3030303030303030ull & ((1ull << shift) - 1));
+        if (((word & 0xf0f0f0f0f0f0f0f0ull) | (((word + 0x0606060606060606ull) & 0xf0f0f0f0f0f0f0f0ull) >> 4)) !=
+            0x3333333333333333ull) {
+            return 0;
+        }
+        word -= 0x3030303030303030ull;
+        word = word * 10 + (word >> 8);
+        word = ((word & 0x000000ff000000ffull) * (100 + (1000000ull << 32)) +
+                ((word >> 16) & 0x000000ff000000ffull) * (1 + (10000ull << 32))) >> 32;
+        *value = (int64_t)word;
+        return 1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isDigit(text[i])) {
+            return 0;
+        }
+        result = result * 10 + (text[i] - '0');
+    }
+    *value = result;
+    return 1;
+}
+
+static int parseCents(const char *text, size_t len, const char *limit, int64_t *cents) {
+    size_t i = 0;
+    size_t digits;
+    size_t places = 0;
+    int negative = 0;
+    int64_t whole = 0;
+    int64_t fraction = 0;
+    const char *dot;
+
+    if (len > 0 && (text[0] == '-' || text[0] == '+')) {
+        negative = text[0] == '-';
+        i++;
+    }
+    // At most two places, so a point can only be among the last three bytes;
+    // one anywhere else is left among the whole digits to be refused there
+    dot = NULL;
+    for (size_t back = 1; back <= 3 && back <= len - i; back++) {
+        if (text[len - back] == '.') {
+            dot = text + len - back;
+            places = back - 1;
+            break;
+        }
+    }
+    digits = (dot != NULL ? (size_t)(dot - text) : len) - i;
+    if (digits + places == 0 || digits > BULK_MAX_WHOLE_DIGITS ||
+        (digits > 0 && !parseDigits(text + i, digits, limit, &whole))) {
+        return 0;
+    }
+    for (size_t p = 0; p < places; p++) {
+        if (!isDigit(dot[1 + p])) {
+            return 0;
+        }
+        fraction = fraction * 10 + (dot[1 + p] - '0');
+    }
+    if (places == 1) {
+        fraction *= 10;
+    }
+    *cents = negative ? -(whole * 100 + fraction) : whole * 100 + fraction;
+    return 1;
+}
+
+int bulkParseCents(const char *text, size_t len, int64_t *cents) {
+    return parseCents(text, len, text + len, cents);
+}
+
+static int parseAccount(const char *text, size_t len, const char *limit, int *account_number) {
+    int64_t value;
+
+    if (len == 0 || len > BULK_MAX_ACCOUNT_DIGITS || !parseDigits(text, len, limit, &value)) {
+        return 0;
+    }
+    *account_number = (int)value;
+    return 1;
+}
+
+static int checkPosting(const BulkRow *row, BulkItem *item) {
+    if (row->nul || row->fields != 2 ||
+        !parseAccount(row->field[0], row->length[0], row->limit, &item->account_number)) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    if (item->account_number < MIN_ACCOUNT_NUMBER || item->account_number > MAX_ACCOUNT_NUMBER) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (!parseCents(row->field[1], row->length[1], row->limit, &item->cents) || item->cents == 0 ||
+        item->cents > BULK_MAX_AMOUNT_CENTS || item->cents < -BULK_MAX_AMOUNT_CENTS) {
+        return BANK_ERR_INVALID_AMOUNT;
+    }
+    return BANK_OK;
+}
+
+// The checks bankCreateAccount makes, in its order, with fields that would
+// not fit the record refused instead of truncated
+static int checkCustomer(const BulkRow *row, BulkItem *item) {
+    if (row->nul || row->fields != BULK_CUSTOMER_FIELDS) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    for (int f = 0; f < BULK_CUSTOMER_FIELDS; f++) {
+        item->field[f] = row->field[f];
+        item->length[f] = (uint8_t)(row->length[f] < UINT8_MAX ? row->length[f] : UINT8_MAX);
+    }
+    if (row->length[0] == 0 || row->length[0] >= MAX_NAME_LENGTH) {
+        return BANK_ERR_INVALID_NAME;
+    }
+    if (row->length[1] >= MAX_NAME_LENGTH || !validateEmailBytes(row->field[1], row->length[1])) {
+        return BANK_ERR_INVALID_EMAIL;
+    }
+    if (row->length[2] >= PHONE_LENGTH || !validatePhoneBytes(row->field[2], row->length[2])) {
+        return BANK_ERR_INVALID_PHONE;
+    }
+    if (row->length[3] < MIN_PASSWORD_LENGTH) {
+        return BANK_ERR_WEAK_PASSWORD;
+    }
+    if (row->length[3] >= PASSWORD_LENGTH) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    return BANK_OK;
+}
+
+static void addField(BulkRow *row, const char *start, size_t len) {
+    if (row->fields < BULK_ROW_FIELDS) {
+        row->field[row->fields] = start;
+        row->length[row->fields] = len;
+    }
+    row->fields++;
+}
+
+static void finishRow(BulkTask *task, BulkRow *row) {
+    BulkItem *item;
+    int last = row->fields - 1;
+
+    if (last < BULK_ROW_FIELDS && row->length[last] > 0 && row->field[last][row->length[last] - 1] == '\r') {
+        row->length[last]--;
+    }
+    if ((row->fields == 1 && row->length[0] == 0 && !row->nul) || (row->length[0] > 0 && row->field[0][0] == '#')) {
+        return;
+    }
+    if (task->count == task->capacity) {
+        long capacity = task->capacity > 0 ? task->capacity * 2 : 4096;
+        BulkItem *items = realloc(task->items, (size_t)capacity * sizeof(BulkItem));
+        if (items == NULL) {
+            task->failed = 1;
+            return;
+        }
+        task->items = items;
+        task->capacity = capacity;
+    }
+    // Postings only fill what they use; short rows make this the hot path
+    item = &task->items[task->count++];
+    item->offset = row->offset;
+    item->account_number = 0;
+    item->cents = 0;
+    if (task->kind == BULK_POSTINGS) {
+        item->result = checkPosting(row, item);
+    } else {
+        memset(item->length, 0, sizeof(item->length));
+        item->result = checkCustomer(row, item);
+    }
+}
+
+static void startRow(BulkRow *row, size_t offset) {
+    row->offset = offset;
+    row->fields = 0;
+    row->nul = 0;
+}
+
+#ifndef BULK_SSE2
+#define BYTE_ONES 0x0101010101010101ull
+#define BYTE_HIGHS 0x8080808080808080ull
+
+// The high bit of each zero byte of x, and of no other
+static uint64_t zeroBytes(uint64_t x) {
+    uint64_t low = (x & ~BYTE_HIGHS) + ~BYTE_HIGHS;
+    return ~(low | x | ~BYTE_HIGHS);
+}
+
+static unsigned wordMask(const unsigned char *p) {
+    uint64_t word;
+    uint64_t hits;
+
+    memcpy(&word, p, sizeof(word));   // little-endian, as in bank_crc.c
+    hits = zeroBytes(word ^ (BYTE_ONES * ',')) | zeroBytes(word ^ (BYTE_ONES * '\n')) | zeroBytes(word);
+    // Gathers one bit per byte into the top byte, byte 0 lowest
+    return (unsigned)(((hits >> 7) * 0x0102040810204080ull) >> 56);
+}
+#endif
+
+// Bit i set where p[i] is a comma, a newline or a NUL
+static unsigned delimiterMask(const unsigned char *p) {
+#ifdef BULK_SSE2
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(const void *)p);
+    __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(',')),
+                                             _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))),
+                                _mm_cmpeq_epi8(bytes, _mm_setzero_si128()));
+    return (unsigned)_mm_movemask_epi8(hits);
+#else
+    return wordMask(p) | wordMask(p + 8) << 8;
+#endif
+}
+
+// Splits and checks the whole lines in [begin, end)
+static void *checkRange(void *arg) {
+    BulkTask *task = arg;
+    const unsigned char *base = (const unsigned char *)task->file->data;
+    const char *text = task->file->data;
+    size_t pos = task->begin;
+    size_t field_start = pos;
+    BulkRow row;
+
+    row.limit = text + task->file->size;
+    startRow(&row, pos);
+    while (pos < task->end && !task->failed) {
+        size_t block = task->end - pos;
+        unsigned mask;
+
+        if (block >= BULK_BLOCK) {
+            block = BULK_BLOCK;
+            mask = delimiterMask(base + pos);
+        } else {
+            // The last few bytes, padded so the scan never reads past them
+            unsigned char tail[BULK_BLOCK] = {0};
+            memcpy(tail, base + pos, block);
+            mask = delimiterMask(tail) & ((1u << block) - 1);
+        }
+        while (mask != 0) {
+            size_t at = pos + (size_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            if (base[at] == '\0') {
+                row.nul = 1;
+                continue;
+            }
+            addField(&row, text + field_start, at - field_start);
+            field_start = at + 1;
+            if (base[at] == '\n') {
+                finishRow(task, &row);
+                startRow(&row, at + 1);
+            }
+        }
+        pos += block;
+    }
+    if (!task->failed && (field_start < task->end || row.fields > 0 || row.nul)) {
+        addField(&row, text + field_start, task->end - field_start);
+        finishRow(task, &row);
+    }
+    return NULL;
+}
+
+// The offset just past the line holding `at`
+static size_t lineEnd(const BulkFile *file, size_t at) {
+    const char *newline;
+
+    if (at >= file->size) {
+        return file->size;
+    }
+    newline = memchr(file->data + at, '\n', file->size - at);
+    return newline != NULL ? (size_t)(newline - file->data) + 1 : file->size;
+}
+
+int bulkRun(const BulkFile *file, BulkKind kind, int threads, BulkSink sink, void *ctx, BulkStats *stats) {
+    BulkTask tasks[BANK_MAX_THREADS];
+    size_t pos = 0;
+    int result = BANK_OK;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(tasks, 0, sizeof(tasks));
+    threads = bankThreadCount(threads);
+    while (pos < file->size && result == BANK_OK) {
+        size_t end = lineEnd(file, pos + (size_t)threads * BULK_WINDOW_BYTES - 1);
+        size_t from = pos;
+        int count = end - pos < BULK_PARALLEL_MIN ? 1 : threads;
+
+        // Each thread takes an equal share of the window, moved to a line end
+        for (int t = 0; t < count; t++) {
+            size_t to = t == count - 1 ? end : lineEnd(file, pos + (end - pos) * (size_t)(t + 1) / (size_t)count);
+            tasks[t].file = file;
+            tasks[t].kind = kind;
+            tasks[t].begin = from;
+            tasks[t].end = to > end ? end : to < from ? from : to;
+            tasks[t].count = 0;
+            from = tasks[t].end;
+        }
+        bankRunTasks(tasks, sizeof(BulkTask), count, checkRange);
+
+        for (int t = 0; t < count && result == BANK_OK; t++) {
+            if (tasks[t].failed) {
+                result = BANK_ERR_IO;
+                break;
+            }
+            for (long i = 0; i < tasks[t].count; i++) {
+                const BulkItem *item = &tasks[t].items[i];
+                if (item->result == BANK_OK) {
+                    stats->accepted++;
+                    stats->cents += item->cents;
+                } else {
+                    stats->refused++;
+                }
+            }
+            stats->rows += tasks[t].count;
+            if (sink != NULL && tasks[t].count > 0 && sink(ctx, tasks[t].items, tasks[t].count) != 0) {
+                result = BANK_ERR_INVALID_REQUEST;
+            }
+        }
+        stats->bytes += end - pos;
+        pos = end;
+    }
+    for (int t = 0; t < BANK_MAX_THREADS; t++) {
+        free(tasks[t].items);
+    }
+    return result;
+}
+
+long bulkLineOf(const BulkFile *file, BulkLines *lines, size_t offset) {
+    const char *p;
+    const char *end;
+
+    if (lines->line == 0 || offset < lines->offset) {
+        lines->offset = 0;
+        lines->line = 1;
+    }
+    p = file->data + lines->offset;
+    end = file->data + (offset < file->size ? offset : file->size);
+    while (p < end) {
+        const char *newline = memchr(p, '\n', (size_t)(end - p));
+        if (newline == NULL) {
+            break;
+        }
+        lines->line++;
+        p = newline + 1;
+    }
+    lines->offset = offset;
+    return lines->line;
+}
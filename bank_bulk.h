@@ -0,0 +1,85 @@
+#ifndef BANK_BULK_H
+#define BANK_BULK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Bulk input files, parsed straight from a read-only mapping. A file is one
+// row per line, fields separated by commas, with no quoting, so no field can
+// hold a comma; blank lines and lines starting with '#' are skipped, and a
+// trailing '\r' is dropped.
+//
+//   postings:   ACCOUNT,AMOUNT         a deposit, or a withdrawal when negative
+//   customers:  NAME,EMAIL,PHONE,PASSWORD
+//
+// Delimiters are found 16 bytes at a time (SSE2 on x86-64, eight-byte words
+// elsewhere) and digit runs converted eight at a time. Each row is checked as
+// soon as it is split, while its bytes are in cache: amounts are parsed
+// exactly into cents, with at most two decimal places and no exponent, and
+// emails and phone numbers by the rules of validateEmail and validatePhone.
+// Fields too long for an account record are refused rather than cut short,
+// as are rows holding a NUL byte.
+//
+// The file is checked a window at a time, split at line ends over the
+// worker threads; the rows of each window are handed on in file order.
+#define BULK_WINDOW_BYTES (2u << 20)      // bytes per thread per window, so its rows stay in cache
+#define BULK_PARALLEL_MIN (1u << 20)      // smaller windows are checked on one thread
+#define BULK_MAX_AMOUNT_CENTS 100000000   // $1,000,000.00, as the teller screens allow
+#define BULK_CUSTOMER_FIELDS 4
+
+typedef enum {
+    BULK_POSTINGS,
+    BULK_CUSTOMERS
+} BulkKind;
+
+typedef struct {
+    const char *data;
+    size_t size;
+} BulkFile;
+
+// One checked row. Customer fields point into the mapping and are not
+// NUL-terminated.
+typedef struct {
+    size_t offset;                        // where its line starts in the file
+    int result;                           // BANK_OK, or why the row is refused
+    int account_number;                   // postings
+    int64_t cents;                        // postings, negative for withdrawals
+    const char *field[BULK_CUSTOMER_FIELDS];
+    uint8_t length[BULK_CUSTOMER_FIELDS];
+} BulkItem;
+
+typedef struct {
+    uint64_t bytes;
+    long rows;                            // blank lines and comments aside
+    long accepted;
+    long refused;
+    int64_t cents;                        // sum of accepted postings
+} BulkStats;
+
+// Receives each window's rows in file order; non-zero stops the run
+typedef int (*BulkSink)(void *ctx, const BulkItem *items, long count);
+
+// Line numbers of rows, asked for in file order
+typedef struct {
+    size_t offset;
+    long line;
+} BulkLines;
+
+// Maps the file at `path`; 0 or -1 with errno set. An empty file maps to nothing.
+int bulkOpen(BulkFile *file, const char *path);
+void bulkClose(BulkFile *file);
+
+// Checks every row with `threads` workers (0 for every CPU), handing each
+// window to `sink` if it is not NULL. Returns BANK_OK, BANK_ERR_IO if memory
+// ran out, or BANK_ERR_INVALID_REQUEST if the sink stopped the run.
+int bulkRun(const BulkFile *file, BulkKind kind, int threads, BulkSink sink, void *ctx, BulkStats *stats);
+
+// "123", "-45.6", "+0.07": cents, exactly; 0 if the text is not such an amount
+int bulkParseCents(const char *text, size_t len, int64_t *cents);
+
+// The 1-based line number at `offset`, counting on from the last one asked
+long bulkLineOf(const BulkFile *file, BulkLines *lines, size_t offset);
+
+#endif
@@ -0,0 +1,326 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bank_compact.h"
+#include "bank_post.h"
+#include "bank_record.h"
+#include "bank_snapshot.h"
+#include "bank_dormancy.h"
+#include "bank_internal.h"
+
+#define COPY_CHUNK_RECORDS 4096   // records read at a time while copying
+
+struct BankCompaction {
+    BankStorage store;            // the compacted store, written beside the live one
+    int archive_fd;
+    uint64_t archive_base;        // archived accounts committed before this compaction
+    long snapshot;                // records in the store when compaction began
+    long live;                    // records written to the compacted store
+    long archived;
+    long recopied;
+    int64_t *moved;               // per old slot: new slot, or -(archive position + 1)
+    unsigned char *dirty;         // per old slot: written since the compaction began
+    BankIndex index;              // index over the compacted store
+    int copied;
+    int failed;
+    char path[BANK_PATH_LENGTH + sizeof(COMPACT_SUFFIX)];
+};
+
+static off_t archiveOffset(uint64_t position) {
+    return (off_t)sizeof(ArchiveHeader) + (off_t)position * (off_t)sizeof(Account);
+}
+
+static int writeArchiveHeader(int fd, uint64_t count) {
+    ArchiveHeader header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.count = count;
+    return pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && fdatasync(fd) == 0 ? 0 : -1;
+}
+
+// Opens the archive, creating it when missing; returns the fd or -1
+static int openArchive(Bank *bank, int create, uint64_t *count) {
+    char path[BANK_PATH_LENGTH + sizeof(ARCHIVE_SUFFIX)];
+    ArchiveHeader header;
+
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, ARCHIVE_SUFFIX);
+    int fd = storageOpenSide(&bank->storage, path, create ? O_RDWR | O_CREAT : O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+
+    ssize_t n = pread(fd, &header, sizeof(header), 0);
+    if (n == 0 && create) {
+        if (writeArchiveHeader(fd, 0) != 0) {
+            close(fd);
+            return -1;
+        }
+        *count = 0;
+        return fd;
+    }
+    if (n != (ssize_t)sizeof(header) || header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION) {
+        close(fd);
+        return -1;
+    }
+    *count = header.count;
+    return fd;
+}
+
+static int writeAt(int fd, const void *data, size_t len, off_t offset) {
+    return pwrite(fd, data, len, offset) == (ssize_t)len ? 0 : -1;
+}
+
+void compactMarkDirty(BankCompaction *compaction, long slot) {
+    if (slot < compaction->snapshot) {
+        compaction->dirty[slot / 8] |= (unsigned char)(1u << (slot % 8));
+    }
+}
+
+int bankCompactBegin(Bank *bank) {
+    BankCompaction *c;
+
+    if (bank->compaction != NULL || bankPostPending(bank)) {
+        return BANK_ERR_INVALID_REQUEST;   // slot positions must not move under a posting run
+    }
+    if (!storagePersistent(&bank->storage)) {
+        return BANK_ERR_INVALID_REQUEST;   // nothing on disk to rewrite
+    }
+
+    // Another opener would go on writing the old file once the new one is
+    // renamed over it
+    if (bankHoldStore(bank, 1) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+
+    c = calloc(1, sizeof(BankCompaction));
+    if (c == NULL) {
+        bankHoldStore(bank, 0);
+        return BANK_ERR_IO;
+    }
+    c->snapshot = bankRecordCount(bank);
+    c->moved = malloc(((size_t)c->snapshot + 1) * sizeof(int64_t));
+    c->dirty = calloc((size_t)c->snapshot / 8 + 1, 1);
+    c->archive_fd = openArchive(bank, 1, &c->archive_base);
+    snprintf(c->path, sizeof(c->path), "%s%s", bank->accounts_path, COMPACT_SUFFIX);
+    unlink(c->path);
+    // Written in the store's own format, flat or compact, to be renamed over it
+    StorageKind kind = storageKind(&bank->storage) == STORAGE_COMPACT ? STORAGE_COMPACT : STORAGE_FILE;
+    int opened = storageOpen(&c->store, kind, c->path, NULL, sizeof(Account), bankRecordCodec()) == 0;
+    indexInit(&c->index);
+
+    if (c->moved == NULL || c->dirty == NULL || c->archive_fd < 0 || !opened) {
+        if (opened) {
+            storageClose(&c->store);
+            unlink(c->path);
+        }
+        if (c->archive_fd >= 0) {
+            close(c->archive_fd);
+        }
+        free(c->moved);
+        free(c->dirty);
+        free(c);
+        bankHoldStore(bank, 0);
+        return BANK_ERR_IO;
+    }
+    bank->compaction = c;
+    return BANK_OK;
+}
+
+int bankCompactCopy(Bank *bank) {
+    BankCompaction *c = bank->compaction;
+    Account *records, *closed;
+
+    if (c == NULL || c->copied) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    c->copied = 1;
+
+    records = malloc(COPY_CHUNK_RECORDS * sizeof(Account));
+    closed = malloc(COPY_CHUNK_RECORDS * sizeof(Account));
+    c->failed = records == NULL || closed == NULL;
+
+    // Live records are packed in place within the chunk buffer, closed ones
+    // gathered aside, so each chunk costs one read and at most two writes
+    for (long first = 0; first < c->snapshot && !c->failed; first += COPY_CHUNK_RECORDS) {
+        long n = c->snapshot - first < COPY_CHUNK_RECORDS ? c->snapshot - first : COPY_CHUNK_RECORDS;
+        long live = 0, archived = 0;
+
+        if (storageGet(&bank->storage, first, n, records) != 0) {
+            c->failed = 1;
+            break;
+        }
+        for (long i = 0; i < n; i++) {
+            if (records[i].status == ACCOUNT_CLOSED) {
+                c->moved[first + i] = -(int64_t)(c->archived + archived) - 1;
+                closed[archived++] = records[i];
+            } else {
+                c->moved[first + i] = c->live + live;
+                records[live++] = records[i];
+            }
+        }
+
+        if ((live > 0 && storagePut(&c->store, c->live, live, records) != 0) ||
+            (archived > 0 && writeAt(c->archive_fd, closed, (size_t)archived * sizeof(Account),
+                                     archiveOffset(c->archive_base + (uint64_t)c->archived)) != 0)) {
+            c->failed = 1;
+        }
+        c->live += live;
+        c->archived += archived;
+    }
+
+    if (!c->failed && indexBuild(&c->index, &c->store, c->live, 0) != 0) {
+        c->failed = 1;
+    }
+    free(records);
+    free(closed);
+    return c->failed ? BANK_ERR_IO : BANK_OK;
+}
+
+// Brings the copy up to date with writes made while it ran
+static int catchUp(Bank *bank, BankCompaction *c) {
+    Account account;
+    long count = bankRecordCount(bank);
+
+    for (long slot = 0; slot < c->snapshot; slot++) {
+        if ((c->dirty[slot / 8] & (1u << (slot % 8))) == 0) {
+            continue;
+        }
+        if (bankReadRecord(bank, slot, &account) != BANK_OK) {
+            return -1;
+        }
+        int64_t to = c->moved[slot];
+        int written = to >= 0 ? storagePut(&c->store, (long)to, 1, &account)
+                              : writeAt(c->archive_fd, &account, sizeof(account),
+                                        archiveOffset(c->archive_base + (uint64_t)(-to - 1)));
+        if (written != 0) {
+            return -1;
+        }
+        c->recopied++;
+    }
+
+    // Accounts opened meanwhile are appended as they are
+    for (long slot = c->snapshot; slot < count; slot++) {
+        if (bankReadRecord(bank, slot, &account) != BANK_OK ||
+            storagePut(&c->store, c->live, 1, &account) != 0 ||
+            indexAdd(&c->index, c->live, account.account_number, account.email, account.phone,
+                     account.name) != 0) {
+            return -1;
+        }
+        c->live++;
+    }
+    return 0;
+}
+
+int bankCompactFinish(Bank *bank, BankCompactStats *stats) {
+    BankCompaction *c = bank->compaction;
+    int result = BANK_OK;
+
+    if (c == NULL) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    if (!c->copied || c->failed || catchUp(bank, c) != 0 ||
+        storageSync(&c->store) != 0 || fdatasync(c->archive_fd) != 0 ||
+        storageClaim(&c->store, STORAGE_LOCK_EXCLUSIVE) != 0) {   // held from the moment the rename shows it
+        result = BANK_ERR_IO;
+    }
+
+    // The rename is the commit point; the archive header follows it
+    if (result == BANK_OK && rename(c->path, bank->accounts_path) != 0) {
+        result = BANK_ERR_IO;
+    }
+    if (result == BANK_OK) {
+        writeArchiveHeader(c->archive_fd, c->archive_base + (uint64_t)c->archived);
+
+        if (storageAdopt(&bank->storage, &c->store) != 0) {
+            result = BANK_ERR_IO;
+        }
+        bankHoldStore(bank, 0);
+        snapshotRenumbered(bank);
+        if (dormancyRenumbered(bank) != BANK_OK) {
+            result = BANK_ERR_IO;
+        }
+        indexFree(&bank->index);
+        bank->index = c->index;
+        bank->indexed = 1;
+        indexInit(&c->index);
+        indexSave(&bank->index, bank->index_path);
+        replResync(bank);
+    } else {
+        storageClose(&c->store);
+        unlink(c->path);
+        bankHoldStore(bank, 0);
+        // Anything left past the header is dropped by compactRecover
+        (void)ftruncate(c->archive_fd, archiveOffset(c->archive_base));
+    }
+
+    if (stats != NULL) {
+        stats->scanned = c->snapshot;
+        stats->live = c->live;
+        stats->archived = c->archived;
+        stats->recopied = c->recopied;
+    }
+    close(c->archive_fd);
+    indexFree(&c->index);
+    free(c->moved);
+    free(c->dirty);
+    free(c);
+    bank->compaction = NULL;
+    return result;
+}
+
+int bankCompact(Bank *bank, BankCompactStats *stats) {
+    int result = bankCompactBegin(bank);
+    if (result != BANK_OK) {
+        return result;
+    }
+    bankCompactCopy(bank);
+    return bankCompactFinish(bank, stats);
+}
+
+void compactAbandon(Bank *bank) {
+    if (bank->compaction != NULL) {
+        bank->compaction->failed = 1;
+        bankCompactFinish(bank, NULL);
+    }
+}
+
+// Settles a compaction interrupted between writing the archive and updating
+// its header: if the first unacknowledged archived account is gone from the
+// store, the rename happened and the records are kept, otherwise dropped
+void compactRecover(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(COMPACT_SUFFIX)];
+    Account account, live;
+    struct stat st;
+    uint64_t count;
+
+    if (!storagePersistent(&bank->storage)) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, COMPACT_SUFFIX);
+    unlink(path);
+
+    int fd = openArchive(bank, 0, &count);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > archiveOffset(count)) {
+        uint64_t stored = (uint64_t)(st.st_size - (off_t)sizeof(ArchiveHeader)) / sizeof(Account);
+
+        if (stored > count &&
+            pread(fd, &account, sizeof(account), archiveOffset(count)) == (ssize_t)sizeof(account) &&
+            bankFindAccount(bank, account.account_number, &live) == BANK_ERR_NOT_FOUND) {
+            writeArchiveHeader(fd, stored);
+            count = stored;
+        }
+        (void)ftruncate(fd, archiveOffset(count));
+    }
+    close(fd);
+}
@@ -0,0 +1,46 @@
+#ifndef BANK_COMPACT_H
+#define BANK_COMPACT_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Compaction moves closed accounts out of the store into <store>.archive and
+// rewrites the live accounts densely, so scans and index builds cost what
+// the live data costs. The new store is built beside the old one and renamed
+// over it; the archive header is advanced only after the rename, and an
+// interrupted compaction is settled when the store is next opened.
+#define ARCHIVE_SUFFIX ".archive"
+#define COMPACT_SUFFIX ".compact"
+#define ARCHIVE_MAGIC 0x43524142u   // "BARC"
+#define ARCHIVE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;                 // archived accounts, stored after the header
+} ArchiveHeader;
+
+typedef struct {
+    long scanned;                   // records in the store when compaction began
+    long live;                      // records in the compacted store
+    long archived;                  // closed accounts moved to the archive
+    long recopied;                  // records changed while the copy ran
+} BankCompactStats;
+
+// Compacts in one call, for callers with the store to themselves
+int bankCompact(Bank *bank, BankCompactStats *stats);
+
+// The same in three steps, for servers that keep serving meanwhile. Begin and
+// finish run under the lock that serialises access to the bank; the copy runs
+// without it, and records written in the meantime are copied again by finish.
+// Finish always ends the compaction, committing it only if every step worked.
+// Fails with BANK_ERR_INVALID_REQUEST while a posting run is unfinished, and
+// begin with BANK_ERR_IO while another process has the store open; from
+// begin to finish no other process can open it, since it would go on
+// writing the file the rename replaces.
+int bankCompactBegin(Bank *bank);
+int bankCompactCopy(Bank *bank);
+int bankCompactFinish(Bank *bank, BankCompactStats *stats);
+
+#endif
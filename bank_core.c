@@ -0,0 +1,1865 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bank_core.h"
+#include "bank_internal.h"
+#include "bank_shard.h"
+#include "bank_uring.h"
+#include "bank_crc.h"
+#include "bank_record.h"
+#include "bank_snapshot.h"
+#include "bank_daily.h"
+#include "bank_dormancy.h"
+
+#define ADMIN_PASSWORD "admin123"
+#define SCAN_PAGE_RECORDS 128      // records fetched per read while scanning
+#define ASYNC_SCAN_DEPTH 4         // pages kept in flight by the io_uring scanner
+#define ASYNC_LOG_TAG (1ULL << 32) // user_data marking log write completions
+
+struct BankAsyncIO {
+    BankUring ring;
+    int log_fd;                           // O_APPEND, shared with other appenders
+    char *pending;                        // log lines of the open batch
+    size_t pending_len;
+    size_t pending_cap;
+    int dropped;                          // a line could not be buffered
+    char *inflight;                       // buffer owned by the queued log write
+    size_t inflight_len;
+    Account *pages[ASYNC_SCAN_DEPTH];
+    int page_result[ASYNC_SCAN_DEPTH];    // bytes read, or -1 while in flight
+};
+
+static int logTransaction(Bank *bank, int account_number, TransactionType type, double amount,
+                          double balance_after, int related_account, const char *description,
+                          uint64_t key);
+static void logLine(Bank *bank, int account_number, TransactionType type, double amount,
+                    double balance_after, const char *description);
+
+// Simple SHA-256 implementation for password hashing
+void simple_hash(const char *password, char *hash_output) {
+    // This is a simplified hash function for demonstration
+    // In production, use a proper library like OpenSSL or libsodium
+    unsigned long hash = 5381;
+    int c;
+    const char *str = password;
+
+    // DJB2 hash algorithm (simple but effective for demonstration)
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    // Add a salt-like component based on password length and characters
+    unsigned long salt = 0;
+    for (int i = 0; password[i] != '\0'; i++) {
+        salt += (unsigned char)password[i] * (i + 1);
+    }
+    hash ^= salt;
+
+    // Convert to hex string (64 characters to simulate SHA-256 length)
+    snprintf(hash_output, HASH_LENGTH, "%016lx%016lx%016lx%016lx",
+             hash, hash ^ 0xDEADBEEF, hash ^ 0xCAFEBABE, hash ^ 0xFEEDFACE);
+}
+
+void bankRunTasks(void *tasks, size_t task_size, int count, void *(*fn)(void *)) {
+    pthread_t threads[BANK_MAX_TASKS];
+    int started[BANK_MAX_TASKS] = {0};
+    char *base = tasks;
+
+    // Tasks beyond the thread table, or whose thread fails to start, run inline
+    for (int i = 1; i < count; i++) {
+        if (i < BANK_MAX_TASKS && pthread_create(&threads[i], NULL, fn, base + (size_t)i * task_size) == 0) {
+            started[i] = 1;
+        } else {
+            fn(base + (size_t)i * task_size);
+        }
+    }
+    if (count > 0) {
+        fn(base);
+    }
+    for (int i = 1; i < count && i < BANK_MAX_TASKS; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+int bankThreadCount(int requested) {
+    int threads = requested > 0 ? requested : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+    return threads > BANK_MAX_THREADS ? BANK_MAX_THREADS : threads;
+}
+
+// Record I/O: accounts are stored as fixed-size records addressed by slot
+long bankRecordCount(Bank *bank) {
+    return storageCount(&bank->storage);
+}
+
+void bankSealRecord(Account *account) {
+    account->checksum = 0;
+    uint32_t crc = crc32c(0, account, sizeof(*account));
+    account->checksum = crc != 0 ? crc : 1;   // so a zeroed record never passes
+}
+
+int bankRecordIntact(const Account *account) {
+    Account copy;
+
+    memcpy(&copy, account, sizeof(copy));   // padding included, as it was sealed
+    bankSealRecord(&copy);
+    return copy.checksum == account->checksum;
+}
+
+int bankRecordValid(const Bank *bank, const Account *account) {
+    return !bank->sealed || bankRecordIntact(account);
+}
+
+static int sealMarkPath(const Bank *bank, char *path, size_t size) {
+    return snprintf(path, size, "%s%s", bank->accounts_path, SEALED_SUFFIX);
+}
+
+// Marks the store sealed once every record in it is. The records are synced
+// first, so a crash cannot leave the mark ahead of them.
+int bankMarkSealed(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(SEALED_SUFFIX)];
+    int fd;
+
+    if (bank->sealed) {
+        return BANK_OK;
+    }
+    sealMarkPath(bank, path, sizeof(path));
+    if (storageSync(&bank->storage) != 0 ||
+        (fd = storageOpenSide(&bank->storage, path, O_RDWR | O_CREAT)) < 0) {
+        return BANK_ERR_IO;
+    }
+    close(fd);
+    bank->sealed = 1;
+    return BANK_OK;
+}
+
+// A store is sealed from the start when it is created with checksums
+static int openSealMark(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(SEALED_SUFFIX)];
+    int fd;
+
+    sealMarkPath(bank, path, sizeof(path));
+    if ((fd = storageOpenSide(&bank->storage, path, O_RDONLY)) >= 0) {
+        close(fd);
+        bank->sealed = 1;
+        return BANK_OK;
+    }
+    return storageCount(&bank->storage) == 0 ? bankMarkSealed(bank) : BANK_OK;
+}
+
+int bankReadRecord(Bank *bank, long slot, Account *account) {
+    if (storageGet(&bank->storage, slot, 1, account) != 0) {
+        return BANK_ERR_IO;
+    }
+    return bankRecordValid(bank, account) ? BANK_OK : BANK_ERR_CORRUPT;
+}
+
+int bankWriteRecord(Bank *bank, long slot, const Account *account) {
+    Account sealed = *account;
+    int failed;
+
+    // A write outside a locked operation is an operation of its own
+    bankSealRecord(&sealed);
+    failed = snapshotBeforeWrite(bank, slot, 1) != 0 || storagePut(&bank->storage, slot, 1, &sealed) != 0;
+    if (bank->record_locks == 0) {
+        snapshotEndWrite(bank);
+    }
+    if (failed) {
+        return BANK_ERR_IO;
+    }
+    if (bank->compaction != NULL) {
+        compactMarkDirty(bank->compaction, slot);
+    }
+    if (bank->replication != NULL) {
+        replCapture(bank, slot, &sealed);
+    }
+    dormancyNote(bank, slot, &sealed);
+    return BANK_OK;
+}
+
+int bankHoldStore(Bank *bank, int hold) {
+    // The compact engine claims its store exclusively from the start
+    if (!storageFlat(&bank->storage)) {
+        bank->store_holds += hold ? 1 : -1;
+        return BANK_OK;
+    }
+    if (hold) {
+        if (bank->store_holds == 0 && storageClaim(&bank->storage, STORAGE_LOCK_EXCLUSIVE) != 0) {
+            return BANK_ERR_IO;
+        }
+        bank->store_holds++;
+        return BANK_OK;
+    }
+    bank->store_holds--;
+    storageClaim(&bank->storage, bank->store_holds > 0 ? STORAGE_LOCK_EXCLUSIVE : STORAGE_LOCK_SHARED);
+    return BANK_OK;
+}
+
+int bankLockRecord(Bank *bank, long slot) {
+    if (storageLockRecords(&bank->storage, slot, 1, STORAGE_LOCK_EXCLUSIVE) != 0) {
+        return BANK_ERR_IO;
+    }
+    bank->record_locks++;
+    return BANK_OK;
+}
+
+// The last lock released ends the operation its writes belong to
+void bankUnlockRecord(Bank *bank, long slot) {
+    storageLockRecords(&bank->storage, slot, 1, STORAGE_UNLOCK);
+    if (--bank->record_locks == 0) {
+        snapshotEndWrite(bank);
+    }
+}
+
+static int lockPair(Bank *bank, long a, long b) {
+    if (bankLockRecord(bank, a < b ? a : b) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    if (bankLockRecord(bank, a < b ? b : a) != BANK_OK) {
+        bankUnlockRecord(bank, a < b ? a : b);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+static void unlockPair(Bank *bank, long a, long b) {
+    bankUnlockRecord(bank, a);
+    bankUnlockRecord(bank, b);
+}
+
+static long scanPage(const Account *page, long first_slot, long records, int account_number) {
+    for (long i = 0; i < records; i++) {
+        if (page[i].account_number == account_number) {
+            return first_slot + i;
+        }
+    }
+    return -1;
+}
+
+// Delivers one io_uring completion to the log write or scan page it belongs to
+static void asyncComplete(BankAsyncIO *async, uint64_t user_data, int res) {
+    if (user_data == ASYNC_LOG_TAG) {
+        size_t written = res > 0 ? (size_t)res : 0;
+        // Finish short or failed appends synchronously so no log line is lost
+        if (written < async->inflight_len) {
+            (void)write(async->log_fd, async->inflight + written, async->inflight_len - written);
+        }
+        free(async->inflight);
+        async->inflight = NULL;
+    } else {
+        async->page_result[user_data] = res < 0 ? 0 : res;
+    }
+}
+
+static void asyncReap(BankAsyncIO *async, unsigned wait_nr) {
+    uint64_t user_data;
+    int res;
+
+    if (wait_nr > 0) {
+        bankUringSubmit(&async->ring, wait_nr);
+    }
+    while (bankUringComplete(&async->ring, &user_data, &res)) {
+        asyncComplete(async, user_data, res);
+    }
+}
+
+static void asyncDrain(BankAsyncIO *async) {
+    while (async->ring.inflight > 0) {
+        asyncReap(async, 1);
+    }
+}
+
+// Scans the store with several page reads in flight at once
+static long asyncFindSlot(Bank *bank, int account_number) {
+    BankAsyncIO *async = bank->async;
+    long count = bankRecordCount(bank);
+    long pages = (count + SCAN_PAGE_RECORDS - 1) / SCAN_PAGE_RECORDS;
+    long queued = 0, found = -1;
+    size_t page_bytes = SCAN_PAGE_RECORDS * sizeof(Account);
+
+    for (long next = 0; next < pages; next++) {
+        while (queued < pages && queued < next + ASYNC_SCAN_DEPTH) {
+            int i = (int)(queued % ASYNC_SCAN_DEPTH);
+            async->page_result[i] = -1;
+            if (bankUringQueueRead(&async->ring, bank->storage.fd, async->pages[i], page_bytes,
+                                   (uint64_t)queued * page_bytes, (uint64_t)i) != 0) {
+                async->page_result[i] = 0;
+            }
+            queued++;
+        }
+        bankUringSubmit(&async->ring, 0);
+
+        int i = (int)(next % ASYNC_SCAN_DEPTH);
+        while (async->page_result[i] < 0) {
+            asyncReap(async, 1);
+        }
+        if (found == -1) {
+            found = scanPage(async->pages[i], next * SCAN_PAGE_RECORDS,
+                             async->page_result[i] / (long)sizeof(Account), account_number);
+        }
+        if (found != -1) {
+            break;
+        }
+    }
+
+    // Pages still in flight must land before their buffers are reused
+    for (int i = 0; i < ASYNC_SCAN_DEPTH; i++) {
+        while (async->page_result[i] < 0) {
+            asyncReap(async, 1);
+        }
+    }
+    return found;
+}
+
+// Replaces a missing or damaged index with one built from the store
+static void rebuildIndex(Bank *bank) {
+    bank->indexed = indexBuild(&bank->index, &bank->storage, bankRecordCount(bank), 0) == 0;
+    if (bank->indexed && storagePersistent(&bank->storage)) {
+        indexSave(&bank->index, bank->index_path);
+    }
+}
+
+// Finishes checking a loaded index, for uses the store cannot vouch for
+static void settleIndex(Bank *bank) {
+    if (bank->indexed && indexVerify(&bank->index, SIZE_MAX) < 0) {
+        rebuildIndex(bank);
+    }
+}
+
+// Indexes the accounts other processes have added to the store since it
+// was opened or last caught up with; returns whether there were any
+static int catchUp(Bank *bank) {
+    Account page[SCAN_PAGE_RECORDS];
+    long known = bank->indexed ? (long)bank->index.count : bankRecordCount(bank);
+    long count;
+
+    if (!storagePersistent(&bank->storage)) {
+        return 0;
+    }
+    storageRefresh(&bank->storage);
+    count = bankRecordCount(bank);
+    if (count <= known) {
+        return 0;
+    }
+    for (long slot = known; bank->indexed && slot < count; slot += SCAN_PAGE_RECORDS) {
+        long n = count - slot < SCAN_PAGE_RECORDS ? count - slot : SCAN_PAGE_RECORDS;
+        int added = storageGet(&bank->storage, slot, n, page) == 0;
+        for (long i = 0; added && i < n; i++) {
+            added = indexAdd(&bank->index, slot + i, page[i].account_number, page[i].email,
+                             page[i].phone, page[i].name) == 0;
+        }
+        if (!added) {
+            indexFree(&bank->index);
+            bank->indexed = 0;
+        }
+    }
+    return 1;
+}
+
+static long lookupSlot(Bank *bank, int account_number) {
+    Account page[SCAN_PAGE_RECORDS];
+    long count;
+
+    if (bank->indexed) {
+        long slot = indexFindNumber(&bank->index, account_number);
+        if (indexVerified(&bank->index)) {
+            return slot;
+        }
+        // Until it is checked, a hit is confirmed against the store; a miss
+        // cannot be, so it waits for the rest of the check
+        if (slot != -1 && storageGet(&bank->storage, slot, 1, page) == 0 &&
+            page[0].account_number == account_number) {
+            return slot;
+        }
+        settleIndex(bank);
+        if (bank->indexed) {
+            return indexFindNumber(&bank->index, account_number);
+        }
+    }
+    if (bank->async != NULL && storageFlat(&bank->storage)) {
+        return asyncFindSlot(bank, account_number);
+    }
+
+    count = bankRecordCount(bank);
+    for (long slot = 0; slot < count; slot += SCAN_PAGE_RECORDS) {
+        long n = count - slot < SCAN_PAGE_RECORDS ? count - slot : SCAN_PAGE_RECORDS;
+        if (storageGet(&bank->storage, slot, n, page) != 0) {
+            break;
+        }
+        long found = scanPage(page, slot, n, account_number);
+        if (found != -1) {
+            return found;
+        }
+    }
+    return -1;
+}
+
+static long findSlot(Bank *bank, int account_number) {
+    long slot = lookupSlot(bank, account_number);
+
+    // A miss may be an account another process has just created
+    if (slot == -1 && catchUp(bank)) {
+        slot = lookupSlot(bank, account_number);
+    }
+    return slot;
+}
+
+// Hands the batch's pending log lines to the ring as one append. The log is
+// opened O_APPEND, so the kernel places each write at the end of the file
+// whoever else appends to it; one write is kept in flight so this process's
+// batches land in the order they committed.
+static int asyncFlushLog(BankAsyncIO *async) {
+    int result = async->dropped ? BANK_ERR_IO : BANK_OK;
+
+    async->dropped = 0;
+    if (async->pending_len == 0) {
+        return result;
+    }
+
+    asyncReap(async, 0);
+    while (async->inflight != NULL) {
+        asyncReap(async, 1);
+    }
+
+    async->inflight = async->pending;
+    async->inflight_len = async->pending_len;
+    if (bankUringQueueWrite(&async->ring, async->log_fd, async->pending, async->pending_len, 0,
+                            ASYNC_LOG_TAG) != 0) {
+        asyncReap(async, 1);
+        if (bankUringQueueWrite(&async->ring, async->log_fd, async->pending, async->pending_len, 0,
+                                ASYNC_LOG_TAG) != 0) {
+            async->inflight = NULL;
+            return BANK_ERR_IO;
+        }
+    }
+    async->pending = NULL;
+    async->pending_len = 0;
+    async->pending_cap = 0;
+
+    return bankUringSubmit(&async->ring, 0) == 0 ? result : BANK_ERR_IO;
+}
+
+// A line that cannot be buffered is dropped and the commit reports BANK_ERR_IO
+static void asyncAppendLog(BankAsyncIO *async, const char *line, size_t len) {
+    if (async->pending_len + len > async->pending_cap) {
+        size_t cap = async->pending_cap ? async->pending_cap * 2 : 4096;
+        while (cap < async->pending_len + len) {
+            cap *= 2;
+        }
+        char *grown = realloc(async->pending, cap);
+        if (grown == NULL) {
+            async->dropped = 1;
+            return;
+        }
+        async->pending = grown;
+        async->pending_cap = cap;
+    }
+    memcpy(async->pending + async->pending_len, line, len);
+    async->pending_len += len;
+}
+
+int bankAttachUring(Bank *bank, unsigned entries) {
+    BankAsyncIO *async = calloc(1, sizeof(BankAsyncIO));
+    if (async == NULL) {
+        return BANK_ERR_IO;
+    }
+
+    fflush(bank->log);
+    // Writes are queued at offset 0 and placed by O_APPEND, which a memory
+    // store's descriptor may only get here
+    async->log_fd = storageOpenSide(&bank->storage, bank->log_path, O_WRONLY | O_APPEND);
+    if (async->log_fd < 0) {
+        free(async);
+        return BANK_ERR_IO;
+    }
+    if (fcntl(async->log_fd, F_SETFL, fcntl(async->log_fd, F_GETFL) | O_APPEND) != 0 ||
+        bankUringInit(&async->ring, entries) != 0) {
+        close(async->log_fd);
+        free(async);
+        return BANK_ERR_IO;
+    }
+
+    for (int i = 0; i < ASYNC_SCAN_DEPTH; i++) {
+        async->pages[i] = malloc(SCAN_PAGE_RECORDS * sizeof(Account));
+        if (async->pages[i] == NULL) {
+            bankUringExit(&async->ring);
+            close(async->log_fd);
+            for (int j = 0; j < i; j++) {
+                free(async->pages[j]);
+            }
+            free(async);
+            return BANK_ERR_IO;
+        }
+    }
+
+    bank->async = async;
+    return BANK_OK;
+}
+
+static void detachUring(Bank *bank) {
+    BankAsyncIO *async = bank->async;
+
+    asyncFlushLog(async);
+    asyncDrain(async);
+    bankUringExit(&async->ring);
+    close(async->log_fd);
+    for (int i = 0; i < ASYNC_SCAN_DEPTH; i++) {
+        free(async->pages[i]);
+    }
+    free(async->pending);
+    free(async);
+    bank->async = NULL;
+}
+
+// Closed account numbers stay taken after compaction archives the accounts
+#define RETIRED_BYTES ((MAX_ACCOUNT_NUMBER - MIN_ACCOUNT_NUMBER) / 8 + 1)
+
+static void retireNumber(Bank *bank, int account_number) {
+    int bit = account_number - MIN_ACCOUNT_NUMBER;
+    if (bit >= 0 && account_number <= MAX_ACCOUNT_NUMBER) {
+        bank->retired[bit / 8] |= (unsigned char)(1u << (bit % 8));
+    }
+}
+
+static int isRetired(const Bank *bank, int account_number) {
+    int bit = account_number - MIN_ACCOUNT_NUMBER;
+    return bit >= 0 && account_number <= MAX_ACCOUNT_NUMBER && (bank->retired[bit / 8] & (1u << (bit % 8)));
+}
+
+// Rebuilds in-memory state derived from the journal
+static void replayJournal(Bank *bank) {
+    JournalReader reader;
+    JournalRecord record;
+
+    // Shared-locked, so a record being appended is not read torn and passed
+    // over: the legs carry on from exactly where this stops
+    if (storageLockJournal(&bank->storage, STORAGE_LOCK_SHARED) != 0) {
+        return;
+    }
+    if (journalReaderOpen(&reader, &bank->storage) != 0) {
+        storageLockJournal(&bank->storage, STORAGE_UNLOCK);
+        return;
+    }
+    while (journalReaderNext(&reader, &record)) {
+        // Only client operations take retry keys (batch postings derive their
+        // own), and a transfer journals both legs under one key: the debit is
+        // the reply
+        if (record.idempotency_key != 0 &&
+            (record.type == TRANSACTION_DEPOSIT || record.type == TRANSACTION_WITHDRAWAL ||
+             record.type == TRANSACTION_TRANSFER_OUT || record.type == TRANSACTION_PREPARED)) {
+            idemRemember(&bank->idempotency, record.idempotency_key, record.type, record.account_number,
+                         record.related_account, record.amount, BANK_OK, record.balance_after);
+        }
+        if (record.type == TRANSACTION_CLOSED) {
+            retireNumber(bank, record.account_number);
+        }
+        if (record.type == TRANSACTION_WITHDRAWAL || record.type == TRANSACTION_TRANSFER_OUT) {
+            rulesRecord(&bank->rules, record.account_number, record.timestamp, record.amount,
+                        record.type == TRANSACTION_TRANSFER_OUT ? record.related_account : 0);
+        }
+        if (shardLegRecord(&record)) {
+            shardReplay(bank, &record);
+        }
+    }
+    shardReplayed(bank, reader.offset);
+    journalReaderClose(&reader);
+    storageLockJournal(&bank->storage, STORAGE_UNLOCK);
+}
+
+// Journal hook: every batch this process writes or copies, under the
+// journal lock
+static void journalWritten(void *context, const void *records, size_t count) {
+    Bank *bank = context;
+
+    if (bank->daily != NULL) {
+        dailyWritten(bank, records, count);
+    }
+    shardWritten(bank, records, count);
+}
+
+int bankOpenStorage(Bank *bank, StorageKind kind, const char *accounts_path, const char *log_path) {
+    memset(bank, 0, sizeof(*bank));
+    bank->storage.fd = -1;
+    bank->storage.journal_fd = -1;
+    arenaInit(&bank->scratch, ARENA_DEFAULT_BLOCK);
+    snprintf(bank->accounts_path, sizeof(bank->accounts_path), "%s",
+             accounts_path ? accounts_path : FILENAME);
+    snprintf(bank->log_path, sizeof(bank->log_path), "%s",
+             log_path ? log_path : TRANSACTION_LOG);
+    snprintf(bank->journal_path, sizeof(bank->journal_path), "%s%s", bank->accounts_path, JOURNAL_SUFFIX);
+
+    if (storageOpen(&bank->storage, kind, bank->accounts_path, bank->journal_path, sizeof(Account),
+                    bankRecordCodec()) != 0) {
+        arenaFree(&bank->scratch);
+        return BANK_ERR_IO;
+    }
+
+    bank->log = storageOpenStream(&bank->storage, bank->log_path, "a");
+    if (bank->log == NULL) {
+        storageClose(&bank->storage);
+        arenaFree(&bank->scratch);
+        return BANK_ERR_IO;
+    }
+
+    if (openSealMark(bank) != BANK_OK ||
+        journalOpen(&bank->journal, &bank->storage) != 0 || snapshotOpen(bank) != BANK_OK ||
+        dailyOpen(bank) != BANK_OK || dormancyOpen(bank) != BANK_OK ||
+        idemInit(&bank->idempotency, IDEM_DEFAULT_CAPACITY) != 0 ||
+        rulesInit(&bank->rules, RULES_DEFAULT_ACCOUNTS) != 0 ||
+        (bank->retired = calloc(RETIRED_BYTES, 1)) == NULL) {
+        bankClose(bank);
+        return BANK_ERR_IO;
+    }
+    replayJournal(bank);
+    bank->journal.written = journalWritten;
+    bank->journal.written_context = bank;
+
+    // Reuse the saved index when it still matches the store, else rebuild it.
+    // A reused one is checked a little per batch from here on (see findSlot).
+    // Stores that do not outlive the process keep it in memory only.
+    snprintf(bank->index_path, sizeof(bank->index_path), "%s%s", bank->accounts_path, INDEX_SUFFIX);
+    indexInit(&bank->index);
+    if (storagePersistent(&bank->storage) &&
+        indexLoad(&bank->index, bank->index_path, &bank->storage, bankRecordCount(bank)) == 0) {
+        bank->indexed = 1;
+    } else {
+        rebuildIndex(bank);
+    }
+    compactRecover(bank);
+
+    if (schedOpen(bank) != BANK_OK) {
+        bankClose(bank);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+int bankOpen(Bank *bank, const char *accounts_path, const char *log_path) {
+    return bankOpenStorage(bank, STORAGE_FILE, accounts_path, log_path);
+}
+
+int bankOpenDir(Bank *bank, StorageKind kind, const char *data_dir) {
+    char accounts_path[BANK_PATH_LENGTH];
+    char log_path[BANK_PATH_LENGTH];
+
+    if (data_dir == NULL || data_dir[0] == '\0') {
+        data_dir = getenv(BANK_DATA_DIR_ENV);
+    }
+    if (data_dir == NULL || data_dir[0] == '\0') {
+        data_dir = ".";
+    }
+    if (snprintf(accounts_path, sizeof(accounts_path), "%s/%s", data_dir, FILENAME) >= (int)sizeof(accounts_path) ||
+        snprintf(log_path, sizeof(log_path), "%s/%s", data_dir, TRANSACTION_LOG) >= (int)sizeof(log_path)) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    if (kind != STORAGE_MEMORY && mkdir(data_dir, 0755) != 0 && errno != EEXIST) {
+        return BANK_ERR_IO;
+    }
+    return bankOpenStorage(bank, kind, accounts_path, log_path);
+}
+
+void bankClose(Bank *bank) {
+    replClose(bank);
+    compactAbandon(bank);
+    if (bank->async != NULL) {
+        detachUring(bank);
+    }
+    if (bank->log != NULL) {
+        fclose(bank->log);
+        bank->log = NULL;
+    }
+    schedClose(bank);
+    if (bank->indexed && bank->index.dirty && storagePersistent(&bank->storage)) {
+        indexSave(&bank->index, bank->index_path);
+    }
+    indexFree(&bank->index);
+    bank->indexed = 0;
+    journalClose(&bank->journal);
+    dailyClose(bank);
+    dormancyClose(bank);
+    snapshotClose(bank);
+    storageClose(&bank->storage);
+    idemFree(&bank->idempotency);
+    rulesFree(&bank->rules);
+    shardClose(bank);
+    free(bank->retired);
+    bank->retired = NULL;
+    bankTraceStop(bank);
+    arenaFree(&bank->scratch);
+}
+
+void bankBeginBatch(Bank *bank) {
+    traceOp(bank, traceBegin(bank), TRACE_BEGIN, BANK_OK, 0, 0, 0.0, 0);
+    bank->batch_depth++;
+}
+
+static int commitBatch(Bank *bank) {
+    if (bank->batch_depth > 0) {
+        bank->batch_depth--;
+    }
+    if (bank->batch_depth > 0) {
+        return BANK_OK;
+    }
+    arenaReset(&bank->scratch);
+    if (journalFlush(&bank->journal) != 0) {
+        return BANK_ERR_IO;
+    }
+    if (bank->journal_sync) {
+        bank->journal_sync = 0;
+        if (journalSync(&bank->journal) != 0) {
+            return BANK_ERR_IO;
+        }
+    }
+    if (bank->replication != NULL) {
+        replPublish(bank);
+    }
+    if (bank->indexed && indexVerify(&bank->index, INDEX_VERIFY_BLOCKS) < 0) {
+        rebuildIndex(bank);
+    }
+    if (bank->async != NULL) {
+        return asyncFlushLog(bank->async);
+    }
+    if (bank->log != NULL && fflush(bank->log) != 0) {
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+int bankCommitBatch(Bank *bank) {
+    uint64_t began = traceBegin(bank);
+    int result = commitBatch(bank);
+
+    traceOp(bank, began, TRACE_COMMIT, result, 0, 0, 0.0, 0);
+    if (bank->batch_depth == 0) {
+        traceFlush(bank);
+    }
+    return result;
+}
+
+const char *bankResultMessage(int result) {
+    switch (result) {
+        case BANK_OK: return "Success";
+        case BANK_ERR_IO: return "Unable to access database!";
+        case BANK_ERR_NOT_FOUND: return "Account not found!";
+        case BANK_ERR_AUTH: return "Authentication failed!";
+        case BANK_ERR_INVALID_AMOUNT: return "Invalid amount!";
+        case BANK_ERR_INSUFFICIENT_FUNDS: return "Insufficient funds!";
+        case BANK_ERR_SAME_ACCOUNT: return "Cannot transfer to the same account!";
+        case BANK_ERR_INVALID_EMAIL: return "Invalid email format!";
+        case BANK_ERR_INVALID_PHONE: return "Invalid phone format! Use digits only (10-15 digits).";
+        case BANK_ERR_INVALID_NAME: return "Name cannot be empty!";
+        case BANK_ERR_WEAK_PASSWORD: return "Password must be at least 6 characters long!";
+        case BANK_ERR_INVALID_REQUEST: return "Invalid request!";
+        case BANK_ERR_LOCKED: return "Account temporarily locked after too many failed logins!";
+        case BANK_ERR_RISK_LIMIT: return "Transaction blocked by account activity limits!";
+        case BANK_ERR_ACCOUNT_SUSPENDED: return "Account is suspended!";
+        case BANK_ERR_ACCOUNT_CLOSED: return "Account is closed!";
+        case BANK_ERR_BALANCE_REMAINING: return "Withdraw or transfer the remaining balance first!";
+        case BANK_ERR_TRANSFER_PENDING: return "A transfer on this account is still being settled!";
+        case BANK_ERR_READ_ONLY: return "This server is a read-only replica!";
+        case BANK_ERR_CORRUPT: return "Account record failed its checksum!";
+        case BANK_ERR_SNAPSHOT_TOO_OLD: return "The report ran too long to stay consistent; run it again!";
+        case BANK_ERR_OVERLOADED: return "The server is busy; try again shortly!";
+        default: return "Unknown error!";
+    }
+}
+
+int generateAccountNumber(Bank *bank) {
+    int first = MIN_ACCOUNT_NUMBER, last = MAX_ACCOUNT_NUMBER;
+    int account_number;
+
+    if (bank->shards > 1) {
+        bankShardRange(bank->shard, bank->shards, &first, &last);
+    }
+    do {
+        account_number = first + (rand() % (last - first + 1));
+    } while (isRetired(bank, account_number) || findSlot(bank, account_number) != -1);
+
+    return account_number;
+}
+
+static int findAccount(Bank *bank, int account_number, Account *account) {
+    long slot = findSlot(bank, account_number);
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    return bankReadRecord(bank, slot, account);
+}
+
+int bankFindAccount(Bank *bank, int account_number, Account *account) {
+    uint64_t began = traceBegin(bank);
+    int result = findAccount(bank, account_number, account);
+    traceOp(bank, began, TRACE_FIND, result, account_number, 0, 0.0, 0);
+    return result;
+}
+
+static int createAccount(Bank *bank, const char *name, const char *email, const char *phone,
+                         const char *password, Account *created) {
+    Account new_account;
+
+    if (name == NULL || name[0] == '\0') {
+        return BANK_ERR_INVALID_NAME;
+    }
+    if (!validateEmail(email)) {
+        return BANK_ERR_INVALID_EMAIL;
+    }
+    if (!validatePhone(phone)) {
+        return BANK_ERR_INVALID_PHONE;
+    }
+    if (strlen(password) < MIN_PASSWORD_LENGTH) {
+        return BANK_ERR_WEAK_PASSWORD;
+    }
+
+    // The number is drawn and the record added under the append lock, so
+    // processes adding accounts at once neither share a number nor a slot
+    if (storageLockAppend(&bank->storage, STORAGE_LOCK_EXCLUSIVE) != 0) {
+        return BANK_ERR_IO;
+    }
+    catchUp(bank);
+
+    memset(&new_account, 0, sizeof(new_account));
+    new_account.account_number = generateAccountNumber(bank);
+    snprintf(new_account.name, sizeof(new_account.name), "%s", name);
+    snprintf(new_account.email, sizeof(new_account.email), "%s", email);
+    snprintf(new_account.phone, sizeof(new_account.phone), "%s", phone);
+
+    // Set initial values
+    new_account.balance = 0.0;
+    new_account.status = ACCOUNT_ACTIVE;
+    new_account.created_date = time(NULL);
+    new_account.last_accessed = time(NULL);
+    new_account.failed_login_attempts = 0;
+
+    // Hash the password before storing
+    simple_hash(password, new_account.password_hash);
+
+    // Journaled first: an appended slot cannot be taken back if the journal
+    // write then failed
+    if (logTransaction(bank, new_account.account_number, TRANSACTION_ACCOUNT_CREATED,
+                       0.0, 0.0, 0, "Account created", 0) != BANK_OK) {
+        storageLockAppend(&bank->storage, STORAGE_UNLOCK);
+        return BANK_ERR_IO;
+    }
+    long slot = bankRecordCount(bank);
+    if (bankWriteRecord(bank, slot, &new_account) != BANK_OK) {
+        storageLockAppend(&bank->storage, STORAGE_UNLOCK);
+        return BANK_ERR_IO;
+    }
+    if (bank->indexed && indexAdd(&bank->index, slot, new_account.account_number, new_account.email,
+                                  new_account.phone, new_account.name) != 0) {
+        // Out of memory: drop to scanning rather than serve a stale index
+        indexFree(&bank->index);
+        bank->indexed = 0;
+    }
+
+    storageLockAppend(&bank->storage, STORAGE_UNLOCK);
+
+    if (created != NULL) {
+        *created = new_account;
+    }
+    return BANK_OK;
+}
+
+int bankCreateAccount(Bank *bank, const char *name, const char *email, const char *phone,
+                      const char *password, Account *created) {
+    uint64_t began = traceBegin(bank);
+    Account account;
+    int result = createAccount(bank, name, email, phone, password, &account);
+
+    traceOp(bank, began, TRACE_CREATE, result, result == BANK_OK ? account.account_number : 0, 0, 0.0, 0);
+    if (result == BANK_OK && created != NULL) {
+        *created = account;
+    }
+    return result;
+}
+
+// One entry per slot in <store>.logins. The account number guards against
+// slots renumbered by compaction; a mismatched entry is ignored.
+typedef struct {
+    int32_t account_number;
+    int32_t reserved;
+    int64_t failed_at;
+} LoginEntry;
+
+static int openLogins(Bank *bank, int flags) {
+    char path[BANK_PATH_LENGTH + sizeof(LOGINS_SUFFIX)];
+
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, LOGINS_SUFFIX);
+    return storageOpenSide(&bank->storage, path, flags);
+}
+
+// Time of the account's last failed sign-in, or -1 when none was recorded
+static time_t lastLoginFailure(Bank *bank, long slot, int account_number) {
+    LoginEntry entry;
+    int fd = openLogins(bank, O_RDONLY);
+    ssize_t got;
+
+    if (fd < 0) {
+        return -1;
+    }
+    got = pread(fd, &entry, sizeof(entry), (off_t)slot * (off_t)sizeof(entry));
+    close(fd);
+    if (got != (ssize_t)sizeof(entry) || entry.account_number != account_number) {
+        return -1;
+    }
+    return (time_t)entry.failed_at;
+}
+
+static int noteLoginFailure(Bank *bank, long slot, int account_number, time_t now) {
+    LoginEntry entry;
+    int fd = openLogins(bank, O_RDWR | O_CREAT);
+    ssize_t put;
+
+    if (fd < 0) {
+        return BANK_ERR_IO;
+    }
+    memset(&entry, 0, sizeof(entry));
+    entry.account_number = account_number;
+    entry.failed_at = (int64_t)now;
+    put = pwrite(fd, &entry, sizeof(entry), (off_t)slot * (off_t)sizeof(entry));
+    close(fd);
+    return put == (ssize_t)sizeof(entry) ? BANK_OK : BANK_ERR_IO;
+}
+
+static int authenticateAt(Bank *bank, long slot, const char *password) {
+    char input_hash[HASH_LENGTH];
+    Account account;
+    time_t now = time(NULL);
+
+    int loaded = bankReadRecord(bank, slot, &account);
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+
+    // Failures are counted in the record and timed in <store>.logins, both
+    // under the record lock, so the lockout survives restarts and covers every
+    // front-end without touching last_accessed, which dormancy reads. A store
+    // without a timing entry falls back to last_accessed. A replica honours
+    // the primary's count but keeps no count of its own.
+    if (account.failed_login_attempts >= MAX_LOGIN_ATTEMPTS) {
+        time_t failed_at = lastLoginFailure(bank, slot, account.account_number);
+        if (now - (failed_at >= 0 ? failed_at : account.last_accessed) < LOGIN_LOCKOUT_SECONDS) {
+            return BANK_ERR_LOCKED;
+        }
+    }
+
+    // Hash the input password
+    simple_hash(password, input_hash);
+    if (strcmp(account.password_hash, input_hash) != 0) {
+        if (!bank->read_only) {
+            account.failed_login_attempts++;
+            noteLoginFailure(bank, slot, account.account_number, now);
+            bankWriteRecord(bank, slot, &account);
+        }
+        return BANK_ERR_AUTH;
+    }
+
+    if (account.failed_login_attempts != 0 && !bank->read_only) {
+        account.failed_login_attempts = 0;
+        return bankWriteRecord(bank, slot, &account);
+    }
+    return BANK_OK;
+}
+
+static int authenticate(Bank *bank, int account_number, const char *password) {
+    long slot = findSlot(bank, account_number);
+    int result;
+
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = authenticateAt(bank, slot, password);
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+int bankAuthenticate(Bank *bank, int account_number, const char *password) {
+    uint64_t began = traceBegin(bank);
+    int result = authenticate(bank, account_number, password);
+    traceOp(bank, began, TRACE_AUTH, result, account_number, 0, 0.0, 0);
+    return result;
+}
+
+int bankAuthenticateAdmin(const char *password) {
+    char admin_hash[HASH_LENGTH];
+    char input_hash[HASH_LENGTH];
+
+    // Hash the admin password and check
+    simple_hash(ADMIN_PASSWORD, admin_hash);
+    simple_hash(password, input_hash);
+
+    return strcmp(input_hash, admin_hash) == 0 ? BANK_OK : BANK_ERR_AUTH;
+}
+
+static int touchAccount(Bank *bank, int account_number, Account *account) {
+    long slot = findSlot(bank, account_number);
+    int result;
+
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    // Dormancy is counted in months: checks close together are one access,
+    // not a record write each
+    result = bankReadRecord(bank, slot, account);
+    if (result == BANK_OK && time(NULL) - account->last_accessed >= ACCESS_COALESCE_SECONDS) {
+        account->last_accessed = time(NULL);
+        result = bankWriteRecord(bank, slot, account);
+    }
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+int bankTouchAccount(Bank *bank, int account_number, Account *account) {
+    uint64_t began = traceBegin(bank);
+    int result = touchAccount(bank, account_number, account);
+    traceOp(bank, began, TRACE_TOUCH, result, account_number, 0, 0.0, 0);
+    return result;
+}
+
+// Unindexed fallback: compares every record the way the index would
+static int scanSearch(Bank *bank, IndexField field, const char *key, int prefix,
+                      Account *results, int max_results) {
+    BankAccountIter accounts;
+    Account account;
+    size_t key_len = strlen(key);
+    int found = 0;
+
+    if (bankAccountsOpen(bank, &accounts) != BANK_OK) {
+        return 0;
+    }
+    while (found < max_results && bankAccountsNext(&accounts, &account)) {
+        const char *stored = field == INDEX_EMAIL ? account.email
+                           : field == INDEX_PHONE ? account.phone : account.name;
+        if (prefix ? strncasecmp(stored, key, key_len) == 0 : strcasecmp(stored, key) == 0) {
+            results[found++] = account;
+        }
+    }
+    bankAccountsClose(&accounts);
+    return found;
+}
+
+static int searchAccounts(Bank *bank, IndexField field, const char *key, int prefix,
+                          Account *results, int max_results) {
+    ArenaMark mark = arenaMark(&bank->scratch);
+    uint32_t *slots;
+    int found = 0;
+
+    if (max_results <= 0 || key == NULL) {
+        return 0;
+    }
+    settleIndex(bank);
+    if (!bank->indexed) {
+        return scanSearch(bank, field, key, prefix, results, max_results);
+    }
+
+    slots = arenaAlloc(&bank->scratch, (size_t)max_results * sizeof(uint32_t));
+    if (slots == NULL) {
+        return 0;
+    }
+    size_t matches = indexSearch(&bank->index, field, key, prefix, slots, (size_t)max_results);
+    for (size_t i = 0; i < matches; i++) {
+        if (bankReadRecord(bank, slots[i], &results[found]) == BANK_OK) {
+            found++;
+        }
+    }
+    arenaRewind(&bank->scratch, mark);
+    return found;
+}
+
+int bankSearchAccounts(Bank *bank, IndexField field, const char *key, int prefix,
+                       Account *results, int max_results) {
+    uint64_t began = traceBegin(bank);
+    int found = searchAccounts(bank, field, key, prefix, results, max_results);
+    TraceRecord record;
+
+    if (began != 0) {
+        // The key itself is personal; replay searches for the first match's
+        memset(&record, 0, sizeof(record));
+        record.op = TRACE_SEARCH;
+        record.related = (int32_t)field | (prefix ? 1 << 8 : 0);
+        record.count = key != NULL ? (int32_t)strlen(key) : 0;
+        record.account_number = found > 0 ? results[0].account_number : 0;
+        record.result = found;
+        traceEnd(bank, began, &record);
+    }
+    return found;
+}
+
+// Returns 1 when `key` was already used, with the original outcome in
+// *result; a key reused for a different request is BANK_ERR_INVALID_REQUEST
+static int replayKeyed(Bank *bank, uint64_t key, TransactionType op, int account_number,
+                       int related_account, double amount, int *result, Account *updated) {
+    const IdemEntry *entry;
+
+    if (key == 0 || (entry = idemLookup(&bank->idempotency, key)) == NULL) {
+        return 0;
+    }
+    if (entry->op != (int)op || entry->account_number != account_number ||
+        entry->related_account != related_account || entry->amount != amount) {
+        *result = BANK_ERR_INVALID_REQUEST;
+        return 1;
+    }
+
+    *result = entry->result;
+    if (updated != NULL && bankFindAccount(bank, account_number, updated) == BANK_OK) {
+        updated->balance = entry->balance;
+    }
+    return 1;
+}
+
+// Records the outcome of a keyed request; I/O failures stay retryable
+static void rememberKeyed(Bank *bank, uint64_t key, TransactionType op, int account_number,
+                          int related_account, double amount, int result, double balance) {
+    if (key != 0 && result != BANK_ERR_IO) {
+        idemRemember(&bank->idempotency, key, op, account_number, related_account, amount, result, balance);
+    }
+}
+
+// Money moves and credential changes need an active account
+static int requireActive(const Account *account) {
+    switch (account->status) {
+        case ACCOUNT_ACTIVE: return BANK_OK;
+        case ACCOUNT_SUSPENDED: return BANK_ERR_ACCOUNT_SUSPENDED;
+        default: return BANK_ERR_ACCOUNT_CLOSED;
+    }
+}
+
+// Runs the velocity rules over an outflow about to be applied. Flagged
+// outflows go through with a marker on their journal and log description.
+static int screenOutflow(Bank *bank, int account_number, double amount, int payee,
+                         char *description, size_t size) {
+    if (rulesCheck(&bank->rules, account_number, time(NULL), amount, payee) == 0) {
+        return BANK_OK;
+    }
+    if (bank->rules.config.action == RULES_REJECT) {
+        bank->rules.rejected++;
+        return BANK_ERR_RISK_LIMIT;
+    }
+    bank->rules.flagged++;
+    size_t len = strlen(description);
+    snprintf(description + len, size - len, " [flagged]");
+    return BANK_OK;
+}
+
+long bankFindSlot(Bank *bank, int account_number) {
+    return findSlot(bank, account_number);
+}
+
+int bankRequireActive(const Account *account) {
+    return requireActive(account);
+}
+
+int bankScreenOutflow(Bank *bank, int account_number, double amount, int payee,
+                      char *description, size_t size) {
+    return screenOutflow(bank, account_number, amount, payee, description, size);
+}
+
+int bankReplayKeyed(Bank *bank, uint64_t key, TransactionType op, int account_number,
+                    int related_account, double amount, int *result, Account *updated) {
+    return replayKeyed(bank, key, op, account_number, related_account, amount, result, updated);
+}
+
+void bankRememberKeyed(Bank *bank, uint64_t key, TransactionType op, int account_number,
+                       int related_account, double amount, int result, double balance) {
+    rememberKeyed(bank, key, op, account_number, related_account, amount, result, balance);
+}
+
+static int depositAt(Bank *bank, uint64_t key, long slot, int account_number, double amount,
+                     Account *account) {
+    int loaded = bankReadRecord(bank, slot, account);
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+    if (requireActive(account) != BANK_OK) {
+        return requireActive(account);
+    }
+
+    Account before = *account;
+    account->balance += amount;
+    account->last_accessed = time(NULL);
+
+    if (bankWriteRecord(bank, slot, account) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+
+    if (logTransaction(bank, account_number, TRANSACTION_DEPOSIT, amount,
+                       account->balance, 0, "Cash deposit", key) != BANK_OK) {
+        // Unjournaled, so it did not happen
+        bankWriteRecord(bank, slot, &before);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+static int applyDeposit(Bank *bank, uint64_t key, int account_number, double amount, Account *account) {
+    long slot;
+    int result;
+
+    if (amount <= 0) {
+        return BANK_ERR_INVALID_AMOUNT;
+    }
+
+    slot = findSlot(bank, account_number);
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = depositAt(bank, key, slot, account_number, amount, account);
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+static int depositKeyed(Bank *bank, uint64_t key, int account_number, double amount, Account *updated) {
+    Account account;
+    int result;
+
+    if (replayKeyed(bank, key, TRANSACTION_DEPOSIT, account_number, 0, amount, &result, updated)) {
+        return result;
+    }
+
+    account.balance = 0.0;
+    result = applyDeposit(bank, key, account_number, amount, &account);
+    rememberKeyed(bank, key, TRANSACTION_DEPOSIT, account_number, 0, amount, result, account.balance);
+    if (result == BANK_OK && updated != NULL) {
+        *updated = account;
+    }
+    return result;
+}
+
+int bankDepositKeyed(Bank *bank, uint64_t key, int account_number, double amount, Account *updated) {
+    uint64_t began = traceBegin(bank);
+    int result = depositKeyed(bank, key, account_number, amount, updated);
+    traceOp(bank, began, TRACE_DEPOSIT, result, account_number, 0, amount, (int64_t)key);
+    return result;
+}
+
+int bankDeposit(Bank *bank, int account_number, double amount, Account *updated) {
+    return bankDepositKeyed(bank, 0, account_number, amount, updated);
+}
+
+static int withdrawAt(Bank *bank, uint64_t key, long slot, int account_number, double amount,
+                      Account *account) {
+    int loaded = bankReadRecord(bank, slot, account);
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+    if (requireActive(account) != BANK_OK) {
+        return requireActive(account);
+    }
+
+    if (amount > account->balance) {
+        return BANK_ERR_INSUFFICIENT_FUNDS;
+    }
+
+    char desc[100] = "Cash withdrawal";
+    int screened = screenOutflow(bank, account_number, amount, 0, desc, sizeof(desc));
+    if (screened != BANK_OK) {
+        return screened;
+    }
+
+    Account before = *account;
+    account->balance -= amount;
+    account->last_accessed = time(NULL);
+
+    if (bankWriteRecord(bank, slot, account) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+
+    if (logTransaction(bank, account_number, TRANSACTION_WITHDRAWAL, amount,
+                       account->balance, 0, desc, key) != BANK_OK) {
+        bankWriteRecord(bank, slot, &before);
+        return BANK_ERR_IO;
+    }
+    rulesRecord(&bank->rules, account_number, account->last_accessed, amount, 0);
+    return BANK_OK;
+}
+
+static int applyWithdraw(Bank *bank, uint64_t key, int account_number, double amount, Account *account) {
+    long slot;
+    int result;
+
+    if (amount <= 0) {
+        return BANK_ERR_INVALID_AMOUNT;
+    }
+
+    slot = findSlot(bank, account_number);
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = withdrawAt(bank, key, slot, account_number, amount, account);
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+static int withdrawKeyed(Bank *bank, uint64_t key, int account_number, double amount, Account *updated) {
+    Account account;
+    int result;
+
+    if (replayKeyed(bank, key, TRANSACTION_WITHDRAWAL, account_number, 0, amount, &result, updated)) {
+        return result;
+    }
+
+    account.balance = 0.0;
+    result = applyWithdraw(bank, key, account_number, amount, &account);
+    rememberKeyed(bank, key, TRANSACTION_WITHDRAWAL, account_number, 0, amount, result, account.balance);
+    if (result == BANK_OK && updated != NULL) {
+        *updated = account;
+    }
+    return result;
+}
+
+int bankWithdrawKeyed(Bank *bank, uint64_t key, int account_number, double amount, Account *updated) {
+    uint64_t began = traceBegin(bank);
+    int result = withdrawKeyed(bank, key, account_number, amount, updated);
+    traceOp(bank, began, TRACE_WITHDRAW, result, account_number, 0, amount, (int64_t)key);
+    return result;
+}
+
+int bankWithdraw(Bank *bank, int account_number, double amount, Account *updated) {
+    return bankWithdrawKeyed(bank, 0, account_number, amount, updated);
+}
+
+static int transferAt(Bank *bank, uint64_t key, long from_slot, long to_slot, int from_account,
+                      int to_account, double amount, int screen, Account *from_acc, Account *to_acc) {
+    char desc[100];
+    char in_desc[100];
+
+    int loaded = bankReadRecord(bank, from_slot, from_acc);
+    if (loaded == BANK_OK) {
+        loaded = bankReadRecord(bank, to_slot, to_acc);
+    }
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+    if (requireActive(from_acc) != BANK_OK) {
+        return requireActive(from_acc);
+    }
+    if (requireActive(to_acc) != BANK_OK) {
+        return requireActive(to_acc);
+    }
+
+    if (amount > from_acc->balance) {
+        return BANK_ERR_INSUFFICIENT_FUNDS;
+    }
+
+    snprintf(desc, sizeof(desc), "Transfer to account %d", to_account);
+    if (screen) {
+        int screened = screenOutflow(bank, from_account, amount, to_account, desc, sizeof(desc));
+        if (screened != BANK_OK) {
+            return screened;
+        }
+    }
+
+    Account from_before = *from_acc, to_before = *to_acc;
+    from_acc->balance -= amount;
+    to_acc->balance += amount;
+    from_acc->last_accessed = time(NULL);
+    to_acc->last_accessed = time(NULL);
+
+    if (bankWriteRecord(bank, from_slot, from_acc) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    if (bankWriteRecord(bank, to_slot, to_acc) != BANK_OK) {
+        bankWriteRecord(bank, from_slot, &from_before);
+        return BANK_ERR_IO;
+    }
+
+    // Both legs reach the journal in one write, or neither does
+    JournalRecord legs[2];
+    snprintf(in_desc, sizeof(in_desc), "Transfer from account %d", from_account);
+    bankFillJournalRecord(&legs[0], key, from_account, TRANSACTION_TRANSFER_OUT, amount,
+                          from_acc->balance, to_account, desc);
+    bankFillJournalRecord(&legs[1], key, to_account, TRANSACTION_TRANSFER_IN, amount,
+                          to_acc->balance, from_account, in_desc);
+    if (bankAppendJournal(bank, legs, 2) != BANK_OK) {
+        bankWriteRecord(bank, from_slot, &from_before);
+        bankWriteRecord(bank, to_slot, &to_before);
+        return BANK_ERR_IO;
+    }
+
+    logLine(bank, from_account, TRANSACTION_TRANSFER_OUT, amount, from_acc->balance, desc);
+    rulesRecord(&bank->rules, from_account, from_acc->last_accessed, amount, to_account);
+    logLine(bank, to_account, TRANSACTION_TRANSFER_IN, amount, to_acc->balance, in_desc);
+    return BANK_OK;
+}
+
+// Client transfers are screened by the velocity rules; standing orders,
+// agreed in advance, are not, though they still count towards the limits
+static int applyTransfer(Bank *bank, uint64_t key, int from_account, int to_account, double amount,
+                         int screen, Account *from_acc, Account *to_acc) {
+    long from_slot, to_slot;
+    int result;
+
+    if (amount <= 0) {
+        return BANK_ERR_INVALID_AMOUNT;
+    }
+    if (from_account == to_account) {
+        return BANK_ERR_SAME_ACCOUNT;
+    }
+
+    from_slot = findSlot(bank, from_account);
+    to_slot = findSlot(bank, to_account);
+    if (from_slot == -1 || to_slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (lockPair(bank, from_slot, to_slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = transferAt(bank, key, from_slot, to_slot, from_account, to_account, amount, screen,
+                        from_acc, to_acc);
+    unlockPair(bank, from_slot, to_slot);
+    return result;
+}
+
+static int transferKeyed(Bank *bank, uint64_t key, int from_account, int to_account, double amount,
+                         Account *from_updated, Account *to_updated) {
+    Account from_acc, to_acc;
+    int result;
+
+    if (replayKeyed(bank, key, TRANSACTION_TRANSFER_OUT, from_account, to_account, amount, &result,
+                    from_updated)) {
+        if (to_updated != NULL) {
+            bankFindAccount(bank, to_account, to_updated);
+        }
+        return result;
+    }
+
+    from_acc.balance = 0.0;
+    result = applyTransfer(bank, key, from_account, to_account, amount, 1, &from_acc, &to_acc);
+    rememberKeyed(bank, key, TRANSACTION_TRANSFER_OUT, from_account, to_account, amount, result,
+                  from_acc.balance);
+    if (result == BANK_OK) {
+        if (from_updated != NULL) {
+            *from_updated = from_acc;
+        }
+        if (to_updated != NULL) {
+            *to_updated = to_acc;
+        }
+    }
+    return result;
+}
+
+int bankTransferKeyed(Bank *bank, uint64_t key, int from_account, int to_account, double amount,
+                      Account *from_updated, Account *to_updated) {
+    uint64_t began = traceBegin(bank);
+    int result = transferKeyed(bank, key, from_account, to_account, amount, from_updated, to_updated);
+    traceOp(bank, began, TRACE_TRANSFER, result, from_account, to_account, amount, (int64_t)key);
+    return result;
+}
+
+int bankApplyTransfer(Bank *bank, uint64_t key, int from_account, int to_account, double amount) {
+    Account from_acc, to_acc;
+    return applyTransfer(bank, key, from_account, to_account, amount, 0, &from_acc, &to_acc);
+}
+
+int bankTransfer(Bank *bank, int from_account, int to_account, double amount,
+                 Account *from_updated, Account *to_updated) {
+    return bankTransferKeyed(bank, 0, from_account, to_account, amount, from_updated, to_updated);
+}
+
+static int changePasswordAt(Bank *bank, long slot, const char *old_password, const char *new_password) {
+    Account account;
+    char old_hash[HASH_LENGTH];
+
+    int loaded = bankReadRecord(bank, slot, &account);
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+
+    if (requireActive(&account) != BANK_OK) {
+        return requireActive(&account);
+    }
+
+    // Hash the input password and compare
+    simple_hash(old_password, old_hash);
+    if (strcmp(account.password_hash, old_hash) != 0) {
+        return BANK_ERR_AUTH;
+    }
+
+    if (strlen(new_password) < MIN_PASSWORD_LENGTH) {
+        return BANK_ERR_WEAK_PASSWORD;
+    }
+
+    // Hash the new password
+    simple_hash(new_password, account.password_hash);
+    account.last_accessed = time(NULL);
+
+    return bankWriteRecord(bank, slot, &account);
+}
+
+static int changePassword(Bank *bank, int account_number, const char *old_password,
+                          const char *new_password) {
+    long slot = findSlot(bank, account_number);
+    int result;
+
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = changePasswordAt(bank, slot, old_password, new_password);
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+int bankChangePassword(Bank *bank, int account_number, const char *old_password,
+                       const char *new_password) {
+    uint64_t began = traceBegin(bank);
+    int result = changePassword(bank, account_number, old_password, new_password);
+    traceOp(bank, began, TRACE_PASSWORD, result, account_number, 0, 0.0, 0);
+    return result;
+}
+
+static int changeStatusAt(Bank *bank, long slot, int account_number, AccountStatus to,
+                          TransactionType event, const char *description) {
+    Account account;
+
+    int loaded = bankReadRecord(bank, slot, &account);
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+    if (account.status == ACCOUNT_CLOSED) {
+        return BANK_ERR_ACCOUNT_CLOSED;
+    }
+    if (account.status == to) {
+        return to == ACCOUNT_SUSPENDED ? BANK_ERR_ACCOUNT_SUSPENDED : BANK_ERR_INVALID_REQUEST;
+    }
+    // Cents below half are rounding residue, not money left behind
+    if (to == ACCOUNT_CLOSED && account.balance >= 0.005) {
+        return BANK_ERR_BALANCE_REMAINING;
+    }
+    if (to == ACCOUNT_CLOSED && bankPendingTransfers(bank, account_number) > 0) {
+        return BANK_ERR_TRANSFER_PENDING;
+    }
+
+    Account before = account;
+    account.status = to;
+    account.last_accessed = time(NULL);
+    if (bankWriteRecord(bank, slot, &account) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    if (logTransaction(bank, account_number, event, 0.0, account.balance, 0, description, 0) != BANK_OK) {
+        bankWriteRecord(bank, slot, &before);
+        return BANK_ERR_IO;
+    }
+    if (to == ACCOUNT_CLOSED) {
+        retireNumber(bank, account_number);
+    }
+    return BANK_OK;
+}
+
+int bankSuspendIdle(Bank *bank, long slot, time_t idle_before, Account *account) {
+    int result;
+
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = bankReadRecord(bank, slot, account);
+    if (result == BANK_OK && (account->status != ACCOUNT_ACTIVE || account->last_accessed >= idle_before)) {
+        result = BANK_ERR_INVALID_REQUEST;
+    }
+    if (result == BANK_OK) {
+        result = changeStatusAt(bank, slot, account->account_number, ACCOUNT_SUSPENDED, TRANSACTION_SUSPENDED,
+                                "Account suspended: dormant");
+    }
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+// Moves an account to status `to` and journals the change as `event`
+static int changeStatus(Bank *bank, int account_number, AccountStatus to, TransactionType event,
+                        const char *description) {
+    uint64_t began = traceBegin(bank);
+    long slot = findSlot(bank, account_number);
+    int result;
+
+    if (slot == -1) {
+        result = BANK_ERR_NOT_FOUND;
+    } else if (bankLockRecord(bank, slot) != BANK_OK) {
+        result = BANK_ERR_IO;
+    } else {
+        result = changeStatusAt(bank, slot, account_number, to, event, description);
+        bankUnlockRecord(bank, slot);
+    }
+    traceOp(bank, began, to == ACCOUNT_ACTIVE ? TRACE_REACTIVATE : to == ACCOUNT_CLOSED ? TRACE_CLOSE : TRACE_SUSPEND,
+            result, account_number, 0, 0.0, 0);
+    return result;
+}
+
+int bankSuspendAccount(Bank *bank, int account_number) {
+    return changeStatus(bank, account_number, ACCOUNT_SUSPENDED, TRANSACTION_SUSPENDED, "Account suspended");
+}
+
+int bankReactivateAccount(Bank *bank, int account_number) {
+    return changeStatus(bank, account_number, ACCOUNT_ACTIVE, TRANSACTION_REACTIVATED, "Account reactivated");
+}
+
+int bankCloseAccount(Bank *bank, int account_number) {
+    return changeStatus(bank, account_number, ACCOUNT_CLOSED, TRANSACTION_CLOSED, "Account closed");
+}
+
+int bankAccountsOpen(Bank *bank, BankAccountIter *it) {
+    it->slot = 0;
+    it->buffered = 0;
+    it->position = 0;
+    it->result = bankSnapshotOpen(bank, &it->snapshot);
+    return it->result;
+}
+
+int bankAccountsNext(BankAccountIter *it, Account *account) {
+    if (it->position == it->buffered) {
+        long remaining = it->snapshot.count - it->slot;
+        int n = remaining < ITER_PAGE_RECORDS ? (int)remaining : ITER_PAGE_RECORDS;
+        if (n <= 0 || it->result != BANK_OK) {
+            return 0;
+        }
+        it->result = bankSnapshotRead(&it->snapshot, it->slot, n, it->page);
+        if (it->result != BANK_OK) {
+            return 0;
+        }
+        it->slot += n;
+        it->buffered = n;
+        it->position = 0;
+    }
+    *account = it->page[it->position++];
+    return 1;
+}
+
+void bankAccountsClose(BankAccountIter *it) {
+    bankSnapshotClose(&it->snapshot);
+}
+
+int bankHistoryOpen(Bank *bank, int account_number, BankHistoryIter *it) {
+    // Queued appends must reach the file before it is read back
+    if (bank->async != NULL) {
+        asyncFlushLog(bank->async);
+        asyncDrain(bank->async);
+    }
+    it->account_number = account_number;
+    it->bank = bank;
+    it->traced = traceStamp(bank);
+    it->lines = 0;
+    if (bank->log != NULL) {
+        fflush(bank->log);
+    }
+    it->log = storageOpenStream(&bank->storage, bank->log_path, "r");
+    if (it->log == NULL) {
+        traceOp(bank, traceBegin(bank), TRACE_HISTORY, BANK_ERR_IO, account_number, 0, 0.0, 0);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+const char *bankHistoryNext(BankHistoryIter *it) {
+    while (fgets(it->line, sizeof(it->line), it->log)) {
+        int acc_num;
+        if (sscanf(it->line, "Account: %d", &acc_num) == 1 && acc_num == it->account_number) {
+            it->lines++;
+            return it->line;
+        }
+    }
+    return NULL;
+}
+
+void bankHistoryClose(BankHistoryIter *it) {
+    TraceRecord record;
+
+    if (it->log != NULL) {
+        fclose(it->log);
+        it->log = NULL;
+        memset(&record, 0, sizeof(record));
+        record.op = TRACE_HISTORY;
+        record.account_number = it->account_number;
+        record.count = it->lines;
+        traceSpan(it->bank, it->traced, &record);
+    }
+}
+
+const char *transactionTypeName(TransactionType type) {
+    switch (type) {
+        case TRANSACTION_DEPOSIT: return "DEPOSIT";
+        case TRANSACTION_WITHDRAWAL: return "WITHDRAWAL";
+        case TRANSACTION_TRANSFER_OUT: return "TRANSFER OUT";
+        case TRANSACTION_TRANSFER_IN: return "TRANSFER IN";
+        case TRANSACTION_ACCOUNT_CREATED: return "ACCOUNT CREATED";
+        case TRANSACTION_INTEREST: return "INTEREST";
+        case TRANSACTION_FEE: return "FEE";
+        case TRANSACTION_SUSPENDED: return "SUSPENDED";
+        case TRANSACTION_REACTIVATED: return "REACTIVATED";
+        case TRANSACTION_CLOSED: return "ACCOUNT CLOSED";
+        case TRANSACTION_TRANSFER_CANCELLED: return "TRANSFER CANCELLED";
+        case TRANSACTION_PREPARED: return "PREPARED";
+        case TRANSACTION_RESOLVED: return "RESOLVED";
+        default: return "UNKNOWN";
+    }
+}
+
+const char *accountStatusName(AccountStatus status) {
+    switch (status) {
+        case ACCOUNT_ACTIVE: return "Active";
+        case ACCOUNT_SUSPENDED: return "Suspended";
+        case ACCOUNT_CLOSED: return "Closed";
+        default: return "Unknown";
+    }
+}
+
+void bankFillJournalRecord(JournalRecord *record, uint64_t key, int account_number, TransactionType type,
+                           double amount, double balance_after, int related_account, const char *description) {
+    memset(record, 0, sizeof(*record));
+    record->idempotency_key = key;
+    record->timestamp = (int64_t)time(NULL);
+    record->amount = amount;
+    record->balance_after = balance_after;
+    record->account_number = account_number;
+    record->related_account = related_account;
+    record->type = type;
+    snprintf(record->description, sizeof(record->description), "%s", description);
+}
+
+size_t bankFormatLogLine(char *line, size_t size, const char *datetime, int account_number,
+                         TransactionType type, double amount, double balance_after,
+                         const char *description) {
+    int len = snprintf(line, size, "Account: %d | %s | %-15s | $%-10.2f | Balance: $%-10.2f | %s\n",
+                       account_number, datetime, transactionTypeName(type), amount,
+                       balance_after, description);
+    if (len < 0) {
+        return 0;
+    }
+    return (size_t)len < size ? (size_t)len : size - 1;
+}
+
+void bankAppendLog(Bank *bank, const char *text, size_t len) {
+    if (bank->log == NULL) {
+        return;
+    }
+    if (bank->async != NULL) {
+        asyncAppendLog(bank->async, text, len);
+        if (bank->batch_depth == 0) {
+            asyncFlushLog(bank->async);
+        }
+        return;
+    }
+    fwrite(text, 1, len, bank->log);
+    if (bank->batch_depth == 0) {
+        fflush(bank->log);
+    }
+}
+
+int bankAppendJournal(Bank *bank, JournalRecord *records, int count) {
+    size_t mark = bank->journal.pending_len;
+
+    for (int i = 0; i < count; i++) {
+        if (journalAppend(&bank->journal, &records[i]) != 0) {
+            journalDiscard(&bank->journal, mark);
+            return BANK_ERR_IO;
+        }
+    }
+    // Other processes look cross-shard legs up in the journal, so a leg's
+    // record is written before its account lock is let go, in a batch too
+    if ((bank->batch_depth == 0 || shardLegRecord(&records[0])) && journalFlush(&bank->journal) != 0) {
+        journalDiscard(&bank->journal, mark);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+static void logLine(Bank *bank, int account_number, TransactionType type, double amount,
+                    double balance_after, const char *description) {
+    char datetime[50];
+    char line[LOG_LINE_LENGTH];
+
+    getCurrentDateTime(datetime);
+    bankAppendLog(bank, line, bankFormatLogLine(line, sizeof(line), datetime, account_number, type,
+                                                amount, balance_after, description));
+}
+
+int bankLogTransaction(Bank *bank, int account_number, TransactionType type, double amount,
+                       double balance_after, int related_account, const char *description,
+                       uint64_t key, int flags) {
+    JournalRecord record;
+
+    bankFillJournalRecord(&record, key, account_number, type, amount, balance_after,
+                          related_account, description);
+    record.flags = flags;
+    if (bankAppendJournal(bank, &record, 1) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    logLine(bank, account_number, type, amount, balance_after, description);
+    return BANK_OK;
+}
+
+static int logTransaction(Bank *bank, int account_number, TransactionType type, double amount,
+                          double balance_after, int related_account, const char *description,
+                          uint64_t key) {
+    return bankLogTransaction(bank, account_number, type, amount, balance_after, related_account,
+                              description, key, 0);
+}
+
+void getCurrentDateTime(char *buffer) {
+    time_t now = time(NULL);
+    strftime(buffer, 50, "%Y-%m-%d %H:%M:%S", localtime(&now));
+}
+
+int validateEmailBytes(const char *email, size_t len) {
+    // Simple email validation: contains @ and .
+    const char *at = memchr(email, '@', len);
+    const char *dot = NULL;
+
+    for (size_t i = len; i > 0 && dot == NULL; i--) {
+        if (email[i - 1] == '.') {
+            dot = &email[i - 1];
+        }
+    }
+    if (at && dot && at < dot && at != email && dot != email + len - 1) {
+        return 1;
+    }
+    return 0;
+}
+
+int validateEmail(const char *email) {
+    return validateEmailBytes(email, strlen(email));
+}
+
+int validatePhoneBytes(const char *phone, size_t len) {
+    if (len < 10 || len > 15) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (!isdigit((unsigned char)phone[i]) && phone[i] != '+' && phone[i] != '-' && phone[i] != ' ') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int validatePhone(const char *phone) {
+    return validatePhoneBytes(phone, strlen(phone));
+}
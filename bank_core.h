@@ -0,0 +1,309 @@
+#ifndef BANK_CORE_H
+#define BANK_CORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bank_storage.h"
+#include "bank_journal.h"
+#include "bank_idem.h"
+#include "bank_index.h"
+#include "bank_rules.h"
+#include "bank_arena.h"
+
+// File names inside the data directory. The directory is chosen at open:
+// given explicitly, or from $BANK_DATA_DIR, or the working directory.
+#define FILENAME "bank_accounts.dat"
+#define TRANSACTION_LOG "transactions.log"
+#define BANK_DATA_DIR_ENV "BANK_DATA_DIR"
+#define MAX_ACCOUNTS 10000
+#define MIN_ACCOUNT_NUMBER 100000
+#define MAX_ACCOUNT_NUMBER 999999
+#define MIN_BALANCE 0
+#define MAX_NAME_LENGTH 100
+#define PASSWORD_LENGTH 50
+#define MIN_PASSWORD_LENGTH 6
+#define HASH_LENGTH 65  // SHA-256 produces 64 hex characters + null terminator
+#define PHONE_LENGTH 20
+#define MAX_LOGIN_ATTEMPTS 3
+#define LOGIN_LOCKOUT_SECONDS 900  // sign-in refused this long after the last failure
+#define LOGINS_SUFFIX ".logins"    // side file timing each slot's last failed sign-in
+#define ACCESS_COALESCE_SECONDS 3600  // a balance check this soon after the last access is not written back
+#define BANK_PATH_LENGTH 256
+#define LOG_LINE_LENGTH 500
+
+// Account status
+typedef enum {
+    ACCOUNT_ACTIVE = 1,
+    ACCOUNT_SUSPENDED = 0,
+    ACCOUNT_CLOSED = -1
+} AccountStatus;
+
+// Transaction types
+typedef enum {
+    TRANSACTION_DEPOSIT,
+    TRANSACTION_WITHDRAWAL,
+    TRANSACTION_TRANSFER_OUT,
+    TRANSACTION_TRANSFER_IN,
+    TRANSACTION_ACCOUNT_CREATED,
+    TRANSACTION_INTEREST,
+    TRANSACTION_FEE,
+    TRANSACTION_SUSPENDED,
+    TRANSACTION_REACTIVATED,
+    TRANSACTION_CLOSED,
+    TRANSACTION_TRANSFER_CANCELLED,   // debit of an aborted cross-shard transfer returned
+    TRANSACTION_PREPARED,             // journal only: cross-shard credit held for the payee
+    TRANSACTION_RESOLVED              // journal only: cross-shard leg settled with no money moving
+} TransactionType;
+
+// Account structure
+typedef struct {
+    int account_number;
+    char name[MAX_NAME_LENGTH];
+    char email[MAX_NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    double balance;
+    char password_hash[HASH_LENGTH];  // Changed to store hash
+    AccountStatus status;
+    time_t created_date;
+    time_t last_accessed;
+    int failed_login_attempts;
+    uint32_t checksum;                // CRC32C of the record with this field zero; never 0 once sealed
+} Account;
+
+// Transaction structure
+typedef struct {
+    int transaction_id;
+    int account_number;
+    TransactionType type;
+    double amount;
+    double balance_after;
+    int related_account;  // For transfers
+    time_t timestamp;
+    char description[100];
+} Transaction;
+
+// Result codes returned by every core operation
+typedef enum {
+    BANK_OK = 0,
+    BANK_ERR_IO,
+    BANK_ERR_NOT_FOUND,
+    BANK_ERR_AUTH,
+    BANK_ERR_INVALID_AMOUNT,
+    BANK_ERR_INSUFFICIENT_FUNDS,
+    BANK_ERR_SAME_ACCOUNT,
+    BANK_ERR_INVALID_EMAIL,
+    BANK_ERR_INVALID_PHONE,
+    BANK_ERR_INVALID_NAME,
+    BANK_ERR_WEAK_PASSWORD,
+    BANK_ERR_INVALID_REQUEST,
+    BANK_ERR_LOCKED,
+    BANK_ERR_RISK_LIMIT,
+    BANK_ERR_ACCOUNT_SUSPENDED,
+    BANK_ERR_ACCOUNT_CLOSED,
+    BANK_ERR_BALANCE_REMAINING,
+    BANK_ERR_TRANSFER_PENDING,
+    BANK_ERR_READ_ONLY,
+    BANK_ERR_CORRUPT,
+    BANK_ERR_SNAPSHOT_TOO_OLD,
+    BANK_ERR_OVERLOADED
+} BankResult;
+
+// Optional io_uring backend state (see bankAttachUring)
+typedef struct BankAsyncIO BankAsyncIO;
+
+// Standing order store and timer wheel (see bank_sched.h)
+typedef struct BankScheduler BankScheduler;
+
+// Compaction in progress (see bank_compact.h)
+typedef struct BankCompaction BankCompaction;
+
+// Cross-shard transfer legs awaiting resolution (see bank_shard.h)
+typedef struct BankTwoPhase BankTwoPhase;
+
+// Journal shipping to replicas, or from a primary (see bank_repl.h)
+typedef struct BankReplication BankReplication;
+
+// Version file behind snapshot reads (see bank_snapshot.h)
+typedef struct BankVersions BankVersions;
+
+// The versions one snapshot has gathered from the version file, by slot
+typedef struct SnapshotImages SnapshotImages;
+
+// Per-day totals counted from the journal (see bank_daily.h)
+typedef struct BankDaily BankDaily;
+
+// Accounts filed by month of last access (see bank_dormancy.h)
+typedef struct BankDormancy BankDormancy;
+
+// Operations recorded for replay (see bank_trace.h)
+typedef struct BankTrace BankTrace;
+
+// Handle to an open account store and its transaction log
+typedef struct {
+    BankStorage storage;                  // account records by slot, and the journal bytes
+    FILE *log;                            // transaction log, opened for append
+    int batch_depth;                      // > 0 while log flushes are deferred
+    int journal_sync;                     // the batch prepared a leg: its commit syncs the journal
+    BankAsyncIO *async;                   // io_uring log appends and page reads, or NULL
+    Journal journal;                      // binary record of every mutation
+    IdemTable idempotency;                // recent retry keys and their outcomes
+    RulesEngine rules;                    // velocity limits on withdrawals and transfers
+    BankIndex index;                      // number/email/phone/name lookups
+    int indexed;                          // 0 if the index could not be built; lookups then scan
+    BankScheduler *scheduler;             // standing orders
+    BankCompaction *compaction;           // non-NULL while the store is being compacted
+    int store_holds;                      // compaction and replication keeping other processes off
+    unsigned char *retired;               // bitmap of closed account numbers, never reissued
+    int shard;                            // range new account numbers are drawn from,
+    int shards;                           // when the store is one shard of several
+    BankTwoPhase *twophase;               // prepared cross-shard legs, NULL while there are none
+    BankReplication *replication;         // primary or replica side, NULL when not replicated
+    int read_only;                        // a replica: requests that change the store are refused
+    int sealed;                           // the store is marked sealed: every record carries a checksum
+    BankVersions *versions;               // record versions kept for pinned snapshots
+    int record_locks;                     // records this bank holds locked; its operation ends at 0
+    BankDaily *daily;                     // materialized daily aggregates
+    BankDormancy *dormancy;               // last access month of every account, for dormancy sweeps
+    BankTrace *trace;                     // workload trace being written, or NULL
+    BankArena scratch;                    // temporaries of the current batch, reset at commit
+    char accounts_path[BANK_PATH_LENGTH];
+    char log_path[BANK_PATH_LENGTH];
+    char journal_path[BANK_PATH_LENGTH + sizeof(JOURNAL_SUFFIX)];
+    char index_path[BANK_PATH_LENGTH + sizeof(INDEX_SUFFIX)];
+} Bank;
+
+// Every account as of one moment: operations that finished before it was
+// pinned, none of those after, and never part of one. Pinning waits for the
+// operations under way to finish; reading never holds up a writer.
+typedef struct {
+    Bank *bank;
+    uint64_t seq;                         // operations up to this one are visible
+    long count;                           // records in the store then
+    int reader;                           // entry in the version file's reader table
+    SnapshotImages *images;               // versions it needs gathered so far, by slot
+} BankSnapshot;
+
+#define ITER_PAGE_RECORDS 32
+
+// Sequential reader over every account record, in one snapshot
+typedef struct {
+    BankSnapshot snapshot;
+    int result;                           // BANK_OK, or why iteration stopped early
+    long slot;                            // next record to fetch from the store
+    int buffered;
+    int position;
+    Account page[ITER_PAGE_RECORDS];
+} BankAccountIter;
+
+// Sequential reader over the log lines of one account
+typedef struct {
+    FILE *log;
+    int account_number;
+    char line[LOG_LINE_LENGTH];
+    Bank *bank;
+    uint64_t traced;                      // when it was opened, if the bank is traced
+    int lines;                            // lines returned
+} BankHistoryIter;
+
+// Store lifecycle. bankOpen uses the flat-file engine; bankOpenStorage picks
+// the engine; bankOpenDir keeps FILENAME and TRANSACTION_LOG in `data_dir`
+// (NULL for the default above), creating the directory if needed.
+int bankOpen(Bank *bank, const char *accounts_path, const char *log_path);
+int bankOpenStorage(Bank *bank, StorageKind kind, const char *accounts_path, const char *log_path);
+int bankOpenDir(Bank *bank, StorageKind kind, const char *data_dir);
+void bankClose(Bank *bank);
+const char *bankResultMessage(int result);
+
+// Batching: operations between begin and commit share a single log flush
+void bankBeginBatch(Bank *bank);
+int bankCommitBatch(Bank *bank);
+
+// Switches log appends and account page scans to io_uring. Log writes are then
+// queued at commit and completed in the background; returns BANK_ERR_IO when
+// the kernel does not offer io_uring, leaving the synchronous path in place.
+int bankAttachUring(Bank *bank, unsigned entries);
+
+// Account operations (no terminal I/O; results are reported through return codes)
+int bankFindAccount(Bank *bank, int account_number, Account *account);
+int bankCreateAccount(Bank *bank, const char *name, const char *email, const char *phone,
+                      const char *password, Account *created);
+int bankAuthenticate(Bank *bank, int account_number, const char *password);
+int bankAuthenticateAdmin(const char *password);
+int bankTouchAccount(Bank *bank, int account_number, Account *account);
+int bankDeposit(Bank *bank, int account_number, double amount, Account *updated);
+int bankWithdraw(Bank *bank, int account_number, double amount, Account *updated);
+int bankTransfer(Bank *bank, int from_account, int to_account, double amount,
+                 Account *from_updated, Account *to_updated);
+int bankChangePassword(Bank *bank, int account_number, const char *old_password,
+                       const char *new_password);
+
+// Account lifecycle. A suspended account can be reactivated; closing needs a
+// zero balance and no cross-shard transfer in flight, and is final. Only active accounts accept deposits,
+// withdrawals, transfers and password changes.
+int bankSuspendAccount(Bank *bank, int account_number);
+int bankReactivateAccount(Bank *bank, int account_number);
+int bankCloseAccount(Bank *bank, int account_number);
+
+// Finds accounts by email, phone or name; `prefix` matches keys starting with
+// `key`. Email and name matching ignores case. Fills up to `max_results`
+// accounts and returns how many were found.
+int bankSearchAccounts(Bank *bank, IndexField field, const char *key, int prefix,
+                       Account *results, int max_results);
+
+// Keyed variants for clients that retry: a non-zero key is applied at most
+// once. A retry returns the original result without touching the store; its
+// `updated` record is re-read and carries the originally reported balance.
+// A key reused for a different operation or account is rejected.
+int bankDepositKeyed(Bank *bank, uint64_t key, int account_number, double amount, Account *updated);
+int bankWithdrawKeyed(Bank *bank, uint64_t key, int account_number, double amount, Account *updated);
+int bankTransferKeyed(Bank *bank, uint64_t key, int from_account, int to_account, double amount,
+                      Account *from_updated, Account *to_updated);
+
+// Record checksums. bankWriteRecord seals every record it writes; code that
+// writes records itself seals them first. A record is intact if it matches
+// its checksum. A store created with checksums, or sealed throughout by
+// bankadm fsck --quarantine, is marked by <store>.sealed, and there reads of
+// a record that is not intact fail with BANK_ERR_CORRUPT. An unmarked store
+// predates checksums: its records are taken as they are, whatever their
+// padding holds, and sealed when next written.
+#define SEALED_SUFFIX ".sealed"
+void bankSealRecord(Account *account);
+int bankRecordIntact(const Account *account);
+int bankRecordValid(const Bank *bank, const Account *account);
+int bankMarkSealed(Bank *bank);
+
+// Snapshot reads: records [slot, slot + n) of the first `count` as the
+// snapshot sees them. Fails with BANK_ERR_SNAPSHOT_TOO_OLD once versions it
+// needed have been lost to writers; pin a fresh one and start over.
+int bankSnapshotOpen(Bank *bank, BankSnapshot *snapshot);
+int bankSnapshotRead(BankSnapshot *snapshot, long slot, long n, Account *records);
+void bankSnapshotClose(BankSnapshot *snapshot);
+
+// Iteration
+int bankAccountsOpen(Bank *bank, BankAccountIter *it);
+int bankAccountsNext(BankAccountIter *it, Account *account);
+void bankAccountsClose(BankAccountIter *it);
+int bankHistoryOpen(Bank *bank, int account_number, BankHistoryIter *it);
+const char *bankHistoryNext(BankHistoryIter *it);
+void bankHistoryClose(BankHistoryIter *it);
+
+// Utility functions
+int generateAccountNumber(Bank *bank);
+void getCurrentDateTime(char *buffer);
+const char *transactionTypeName(TransactionType type);
+const char *accountStatusName(AccountStatus status);
+
+// Password hashing functions
+void sha256_hash(const char *input, char *output);
+void simple_hash(const char *password, char *hash_output);
+
+// Validation functions. The Bytes forms check `len` bytes that need not end
+// in a NUL, by the same rules.
+int validateEmail(const char *email);
+int validatePhone(const char *phone);
+int validateEmailBytes(const char *email, size_t len);
+int validatePhoneBytes(const char *phone, size_t len);
+
+#endif
@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <string.h>
+
+#include "bank_crc.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC_HARDWARE 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78u   // reflected Castagnoli polynomial
+
+static uint32_t table[8][256];
+static int hardware;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void crcInit(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        table[0][i] = crc;
+    }
+    // table[k] advances a byte followed by k zero bytes
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+        }
+    }
+#ifdef CRC_HARDWARE
+    __builtin_cpu_init();
+    hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint32_t crcSoftware(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+        lo ^= crc;   // little-endian byte order, as on every platform this runs on
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^ table[5][(lo >> 16) & 0xff] ^
+              table[4][lo >> 24] ^ table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^
+              table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef CRC_HARDWARE
+__attribute__((target("sse4.2")))
+static uint32_t crcHardware(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t wide = crc;
+
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)wide;
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&once, crcInit);
+    crc = ~crc;
+#ifdef CRC_HARDWARE
+    if (hardware) {
+        return ~crcHardware(crc, data, len);
+    }
+#endif
+    return ~crcSoftware(crc, data, len);
+}
+
+const char *crc32cImplementation(void) {
+    pthread_once(&once, crcInit);
+    return hardware ? "sse4.2" : "software";
+}
@@ -0,0 +1,18 @@
+#ifndef BANK_CRC_H
+#define BANK_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli), the checksum on account records and journal entries.
+// x86-64 CPUs with SSE4.2 compute it with the crc32 instruction, eight bytes
+// at a time; elsewhere a slicing-by-8 table does the same work in software.
+// The choice is made once, at the first call.
+
+// Extends `crc`, a previous result or 0 to start, over `len` bytes
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+// "sse4.2" or "software"
+const char *crc32cImplementation(void);
+
+#endif
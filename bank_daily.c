@@ -0,0 +1,486 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bank_daily.h"
+#include "bank_internal.h"
+
+#define DAILY_READ_ROWS 64   // rows fetched per read by range queries
+
+// The header takes the space of one row; row N, for day first_day + N,
+// follows at (N + 1) * DAILY_ROW_BYTES. Days between two busy ones are holes
+// that read back as rows never written.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t types;
+    uint32_t row_bytes;
+    uint64_t journal_id;          // journal the table counts
+    uint64_t lsn;                 // every record before this position is counted
+    uint64_t generation;          // drawn by each rebuild, so rows cached before it are dropped
+    int64_t first_day;            // days since 1970-01-01
+    int64_t days;                 // rows in use
+} DailyHeader;
+
+typedef struct {
+    int64_t day;
+    uint64_t lsn;                 // records before this position are counted here, 0 if never written
+    DailyTotal totals[DAILY_TYPES];
+    unsigned char reserved[DAILY_ROW_BYTES - 2 * sizeof(int64_t) - DAILY_TYPES * sizeof(DailyTotal)];
+} DailyRow;
+
+struct BankDaily {
+    int fd;
+    DailyHeader *header;          // mapped, so every process sees the same one
+    uint64_t lsn;                 // header position and generation the cached rows go with
+    uint64_t generation;
+    int cached;
+    DailyRow rows[DAILY_CACHE_ROWS];
+    int dirty[DAILY_CACHE_ROWS];
+    int64_t day;                  // local day of the last timestamp seen, and its bounds
+    int64_t day_start;
+    int64_t day_end;
+};
+
+// A rebuild's rows, covering every day from first_day on
+typedef struct {
+    DailyRow *rows;
+    int64_t first_day;
+    int64_t days;
+    int64_t capacity;
+} DailyTable;
+
+// Days since 1970-01-01 of a Gregorian date
+static int64_t civilDays(int64_t year, int month, int mday) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + mday - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static int civilDate(int64_t days) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    return (int)((yoe + era * 400 + (month <= 2)) * 10000 + month * 100 + mday);
+}
+
+static int64_t dateDays(int date) {
+    return civilDays(date / 10000, date / 100 % 100, date % 100);
+}
+
+// Local calendar day of a timestamp. Records come in time order, so the
+// bounds of the last day seen answer almost every call.
+static int64_t dayOf(BankDaily *d, int64_t timestamp) {
+    time_t when = (time_t)timestamp;
+    struct tm tm;
+
+    if (timestamp >= d->day_start && timestamp < d->day_end) {
+        return d->day;
+    }
+    if (localtime_r(&when, &tm) == NULL) {
+        return 0;
+    }
+    d->day = civilDays(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    d->day_start = (int64_t)mktime(&tm);
+    tm.tm_mday++;
+    tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    d->day_end = (int64_t)mktime(&tm);
+    if (timestamp < d->day_start || timestamp >= d->day_end) {
+        d->day_start = d->day_end = 0;   // no local midnight that day: nothing cached
+    }
+    return d->day;
+}
+
+static int countable(const JournalRecord *record) {
+    return record->type >= 0 && record->type < DAILY_TYPES && record->type != TRANSACTION_PREPARED &&
+           record->type != TRANSACTION_RESOLVED && !(record->flags & JOURNAL_VOID);
+}
+
+static void addRecord(DailyRow *row, const JournalRecord *record) {
+    double amount = record->amount;
+    row->totals[record->type].count++;
+    row->totals[record->type].cents += (int64_t)(amount * 100.0 + (amount < 0 ? -0.5 : 0.5));
+    row->lsn = record->lsn + sizeof(JournalRecord);
+}
+
+static off_t rowOffset(const DailyHeader *header, int64_t day) {
+    return (off_t)(day - header->first_day + 1) * DAILY_ROW_BYTES;
+}
+
+// ---- rebuild ----
+
+// Widens the table to take `day`, zero-filling the new rows
+static int coverDay(DailyTable *table, int64_t day) {
+    if (table->days > 0 && day >= table->first_day && day < table->first_day + table->days) {
+        return 0;
+    }
+    int64_t low = table->days == 0 || day < table->first_day ? day : table->first_day;
+    int64_t high = table->days == 0 || day >= table->first_day + table->days ? day + 1
+                                                                              : table->first_day + table->days;
+    int64_t shift = table->days == 0 ? 0 : table->first_day - low;
+
+    if (high - low > table->capacity) {
+        int64_t capacity = (high - low) * 2;
+        DailyRow *rows = calloc((size_t)capacity, sizeof(DailyRow));
+        if (rows == NULL) {
+            return -1;
+        }
+        if (table->days > 0) {
+            memcpy(rows + shift, table->rows, (size_t)table->days * sizeof(DailyRow));
+        }
+        free(table->rows);
+        table->rows = rows;
+        table->capacity = capacity;
+    } else if (shift > 0) {
+        memmove(table->rows + shift, table->rows, (size_t)table->days * sizeof(DailyRow));
+        memset(table->rows, 0, (size_t)shift * sizeof(DailyRow));
+    }
+    table->first_day = low;
+    table->days = high - low;
+    return 0;
+}
+
+// Recounts the journal into a new table. Called under the journal lock. The
+// header is marked invalid until the rows are all written, so a crash part
+// way leaves a table the next open rebuilds.
+static int rebuildTable(Bank *bank) {
+    BankDaily *d = bank->daily;
+    DailyHeader *h = d->header;
+    DailyTable table;
+    JournalReader reader;
+    JournalRecord record;
+    struct timespec ts;
+    int failed;
+
+    memset(&table, 0, sizeof(table));
+    failed = journalReaderOpen(&reader, &bank->storage) != 0;
+    while (!failed && journalReaderNext(&reader, &record)) {
+        if (!countable(&record)) {
+            continue;
+        }
+        int64_t day = dayOf(d, record.timestamp);
+        if (coverDay(&table, day) != 0) {
+            failed = 1;
+            break;
+        }
+        DailyRow *row = &table.rows[day - table.first_day];
+        row->day = day;
+        addRecord(row, &record);
+    }
+    uint64_t end = reader.offset;
+    journalReaderClose(&reader);
+
+    d->cached = 0;
+    h->magic = 0;
+    if (failed || ftruncate(d->fd, DAILY_ROW_BYTES) != 0) {
+        free(table.rows);
+        return BANK_ERR_IO;
+    }
+    for (int64_t i = 0; i < table.days; i++) {
+        if (table.rows[i].lsn != 0) {
+            table.rows[i].lsn = end;
+        }
+    }
+    size_t len = (size_t)table.days * sizeof(DailyRow);
+    failed = len > 0 && pwrite(d->fd, table.rows, len, DAILY_ROW_BYTES) != (ssize_t)len;
+    free(table.rows);
+    if (failed) {
+        return BANK_ERR_IO;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memset(h, 0, sizeof(*h));
+    h->version = DAILY_VERSION;
+    h->types = DAILY_TYPES;
+    h->row_bytes = DAILY_ROW_BYTES;
+    h->journal_id = bank->journal.id;
+    h->lsn = end;
+    h->generation = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    h->first_day = table.first_day;
+    h->days = table.days;
+    h->magic = DAILY_MAGIC;
+    d->lsn = h->lsn;
+    d->generation = h->generation;
+    return BANK_OK;
+}
+
+// ---- incremental counting ----
+
+// Under the journal lock: whether the table counts this journal, dropping
+// rows cached before another process or a rebuild changed it
+static int tableUsable(Bank *bank) {
+    BankDaily *d = bank->daily;
+    const DailyHeader *h = d->header;
+
+    if (h->magic != DAILY_MAGIC || h->version != DAILY_VERSION || h->types != DAILY_TYPES ||
+        h->row_bytes != DAILY_ROW_BYTES || h->journal_id != bank->journal.id ||
+        h->lsn < sizeof(JournalHeader) || h->lsn > storageJournalSize(&bank->storage)) {
+        return 0;
+    }
+    if (h->lsn != d->lsn || h->generation != d->generation) {
+        d->cached = 0;
+    }
+    return 1;
+}
+
+// Writes the changed rows back, then lets the header cover them
+static int writeRows(BankDaily *d) {
+    DailyHeader *h = d->header;
+
+    for (int i = 0; i < d->cached; i++) {
+        if (!d->dirty[i]) {
+            continue;
+        }
+        if (pwrite(d->fd, &d->rows[i], sizeof(DailyRow), rowOffset(h, d->rows[i].day)) != (ssize_t)sizeof(DailyRow)) {
+            return -1;
+        }
+        if (d->rows[i].day - h->first_day >= h->days) {
+            h->days = d->rows[i].day - h->first_day + 1;
+        }
+        d->dirty[i] = 0;
+    }
+    return 0;
+}
+
+// The cached row for `day`, loaded if need be; -1 if only a rebuild can
+// count the day (it comes before the first row, or its row is not the day's)
+static int rowFor(BankDaily *d, int64_t day) {
+    DailyHeader *h = d->header;
+
+    for (int i = d->cached - 1; i >= 0; i--) {
+        if (d->rows[i].day == day) {
+            return i;
+        }
+    }
+    if (d->cached == DAILY_CACHE_ROWS) {
+        if (writeRows(d) != 0) {
+            return -1;
+        }
+        d->cached = 0;
+    }
+    if (h->days == 0) {
+        h->first_day = day;
+    }
+    if (day < h->first_day) {
+        return -1;
+    }
+
+    DailyRow *row = &d->rows[d->cached];
+    memset(row, 0, sizeof(*row));
+    if (day < h->first_day + h->days) {
+        if (pread(d->fd, row, sizeof(*row), rowOffset(h, day)) != (ssize_t)sizeof(*row) ||
+            (row->lsn != 0 && row->day != day)) {
+            return -1;
+        }
+    }
+    row->day = day;
+    d->dirty[d->cached] = 0;
+    return d->cached++;
+}
+
+static int countRecord(BankDaily *d, const JournalRecord *record) {
+    if (!countable(record)) {
+        return 0;
+    }
+    int i = rowFor(d, dayOf(d, record->timestamp));
+    if (i < 0) {
+        return -1;
+    }
+    if (record->lsn >= d->rows[i].lsn) {   // else counted before a crash cut the batch short
+        addRecord(&d->rows[i], record);
+        d->dirty[i] = 1;
+    }
+    return 0;
+}
+
+// Counts the journal from `lsn` to its end and moves the header there
+static int countFrom(Bank *bank, uint64_t lsn) {
+    BankDaily *d = bank->daily;
+    JournalReader reader;
+    JournalRecord record;
+    int failed = journalReaderOpen(&reader, &bank->storage) != 0;
+
+    journalReaderSeek(&reader, lsn);
+    while (!failed && journalReaderNext(&reader, &record)) {
+        failed = countRecord(d, &record) != 0;
+    }
+    uint64_t end = reader.offset;
+    journalReaderClose(&reader);
+    if (failed || writeRows(d) != 0) {
+        return -1;
+    }
+    d->header->lsn = d->lsn = end;
+    return 0;
+}
+
+// Under the journal lock: brings the table up to the end of the journal
+static int syncTable(Bank *bank) {
+    if (!tableUsable(bank)) {
+        return rebuildTable(bank);
+    }
+    uint64_t lsn = bank->daily->header->lsn;
+    if (lsn < storageJournalSize(&bank->storage) && countFrom(bank, lsn) != 0) {
+        return rebuildTable(bank);
+    }
+    return BANK_OK;
+}
+
+// A table left behind by a process that died between its journal write and
+// its count is caught up from the journal instead, this batch included
+void dailyWritten(Bank *bank, const void *records, size_t count) {
+    BankDaily *d = bank->daily;
+    JournalRecord record;
+    int failed = 0;
+
+    if (count == 0) {
+        return;
+    }
+    memcpy(&record, records, sizeof(record));
+    if (!tableUsable(bank) || d->header->lsn != record.lsn) {
+        syncTable(bank);
+        return;
+    }
+    for (size_t i = 0; i < count && !failed; i++) {
+        memcpy(&record, (const unsigned char *)records + i * sizeof(record), sizeof(record));
+        failed = countRecord(d, &record) != 0;
+    }
+    if (failed || writeRows(d) != 0) {
+        rebuildTable(bank);
+        return;
+    }
+    d->header->lsn = d->lsn = record.lsn + sizeof(JournalRecord);
+}
+
+// ---- open and close ----
+
+int dailyOpen(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(DAILY_SUFFIX)];
+    BankDaily *d = calloc(1, sizeof(*d));
+    struct stat st;
+
+    if (d == NULL) {
+        return BANK_ERR_IO;
+    }
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, DAILY_SUFFIX);
+    d->fd = storageOpenSide(&bank->storage, path, O_RDWR | O_CREAT);
+    if (d->fd < 0) {
+        free(d);
+        return BANK_ERR_IO;
+    }
+    if (storageLockJournal(&bank->storage, STORAGE_LOCK_EXCLUSIVE) != 0) {
+        close(d->fd);
+        free(d);
+        return BANK_ERR_IO;
+    }
+    if (fstat(d->fd, &st) == 0 && (st.st_size >= DAILY_ROW_BYTES || ftruncate(d->fd, DAILY_ROW_BYTES) == 0)) {
+        void *map = mmap(NULL, DAILY_ROW_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, d->fd, 0);
+        if (map != MAP_FAILED) {
+            d->header = map;
+            bank->daily = d;
+            syncTable(bank);   // else the next batch tries again
+        }
+    }
+    storageLockJournal(&bank->storage, STORAGE_UNLOCK);
+    if (d->header == NULL) {
+        close(d->fd);
+        free(d);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+void dailyClose(Bank *bank) {
+    BankDaily *d = bank->daily;
+
+    if (d == NULL) {
+        return;
+    }
+    munmap(d->header, DAILY_ROW_BYTES);
+    close(d->fd);
+    free(d);
+    bank->daily = NULL;
+}
+
+// ---- queries ----
+
+int bankDailyRange(Bank *bank, int from_date, int to_date, BankDay *days, int max) {
+    DailyRow rows[DAILY_READ_ROWS];
+    int found = 0;
+
+    if (bank->daily == NULL || max < 0) {
+        return -1;
+    }
+    if (max > DAILY_RANGE_MAX) {
+        max = DAILY_RANGE_MAX;
+    }
+    if (journalFlush(&bank->journal) != 0 || storageLockJournal(&bank->storage, STORAGE_LOCK_EXCLUSIVE) != 0) {
+        return -1;
+    }
+    const DailyHeader *h = bank->daily->header;
+    if (syncTable(bank) != BANK_OK) {
+        storageLockJournal(&bank->storage, STORAGE_UNLOCK);
+        return -1;
+    }
+
+    int64_t from = dateDays(from_date) > h->first_day ? dateDays(from_date) : h->first_day;
+    int64_t to = dateDays(to_date) < h->first_day + h->days - 1 ? dateDays(to_date) : h->first_day + h->days - 1;
+    for (int64_t day = from; day <= to && found < max; day += DAILY_READ_ROWS) {
+        int64_t n = to - day + 1 < DAILY_READ_ROWS ? to - day + 1 : DAILY_READ_ROWS;
+        ssize_t got = pread(bank->daily->fd, rows, (size_t)n * sizeof(DailyRow), rowOffset(h, day));
+        if (got < 0) {
+            found = -1;
+            break;
+        }
+        // Rows past the end of the file were never written
+        for (int64_t i = 0; i < got / (ssize_t)sizeof(DailyRow) && found < max; i++) {
+            if (rows[i].lsn != 0 && rows[i].day == day + i) {
+                days[found].date = civilDate(rows[i].day);
+                memcpy(days[found].totals, rows[i].totals, sizeof(days[found].totals));
+                found++;
+            }
+        }
+    }
+    storageLockJournal(&bank->storage, STORAGE_UNLOCK);
+    return found;
+}
+
+int bankDailyRebuild(Bank *bank) {
+    int result;
+
+    if (bank->daily == NULL) {
+        return BANK_ERR_IO;
+    }
+    if (journalFlush(&bank->journal) != 0 || storageLockJournal(&bank->storage, STORAGE_LOCK_EXCLUSIVE) != 0) {
+        return BANK_ERR_IO;
+    }
+    result = rebuildTable(bank);
+    storageLockJournal(&bank->storage, STORAGE_UNLOCK);
+    return result;
+}
+
+int64_t bankDayCredits(const BankDay *day) {
+    return day->totals[TRANSACTION_DEPOSIT].cents + day->totals[TRANSACTION_TRANSFER_IN].cents +
+           day->totals[TRANSACTION_TRANSFER_CANCELLED].cents + day->totals[TRANSACTION_INTEREST].cents;
+}
+
+int64_t bankDayDebits(const BankDay *day) {
+    return day->totals[TRANSACTION_WITHDRAWAL].cents + day->totals[TRANSACTION_TRANSFER_OUT].cents +
+           day->totals[TRANSACTION_FEE].cents;
+}
@@ -0,0 +1,61 @@
+#ifndef BANK_DAILY_H
+#define BANK_DAILY_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Materialized per-day totals for dashboards, kept in <store>.daily: for
+// every local calendar day, the count and sum of each transaction type, so
+// "deposits today" or net flow per day reads one row per day instead of
+// parsing transactions.log. Each journal batch is counted as it is written,
+// under the journal lock, so every process sharing the store keeps the one
+// table. A row notes the journal position it has counted up to and the file
+// the position the whole table has, so a batch a crash left uncounted is
+// caught up from the journal by the next one, never counted twice. The table
+// is rebuilt from the journal when it is missing, belongs to another
+// journal, or entries were voided.
+//
+// Journal-only records (cross-shard legs prepared or settled with no money
+// moving) and voided ones are not counted. The store has no account types;
+// status changes are counted per day as the SUSPENDED, REACTIVATED and
+// CLOSED types alongside ACCOUNT_CREATED.
+#define DAILY_SUFFIX ".daily"
+#define DAILY_MAGIC 0x594c4944u            // "DILY"
+#define DAILY_VERSION 1
+#define DAILY_TYPES (TRANSACTION_RESOLVED + 1)
+#define DAILY_ROW_BYTES 256
+#define DAILY_CACHE_ROWS 16                // rows a process keeps between batches
+#define DAILY_RANGE_MAX 3660               // days one bankDailyRange call returns
+
+typedef struct {
+    int64_t count;
+    int64_t cents;
+} DailyTotal;
+
+// One day of activity, by TransactionType
+typedef struct {
+    int date;                              // YYYYMMDD
+    DailyTotal totals[DAILY_TYPES];
+} BankDay;
+
+int dailyOpen(Bank *bank);
+void dailyClose(Bank *bank);
+
+// Journal hook: counts a batch just written, under the journal lock
+void dailyWritten(Bank *bank, const void *records, size_t count);
+
+// Days with activity from `from_date` to `to_date` (YYYYMMDD, inclusive), in
+// order, at most `max` (up to DAILY_RANGE_MAX). Returns the number filled,
+// or -1 on an I/O error; a full result means later days may follow.
+int bankDailyRange(Bank *bank, int from_date, int to_date, BankDay *days, int max);
+
+// Recounts the whole table from the journal
+int bankDailyRebuild(Bank *bank);
+
+// Money credited to and debited from accounts on the day, in cents; transfers
+// between accounts of the store appear on both sides
+int64_t bankDayCredits(const BankDay *day);
+int64_t bankDayDebits(const BankDay *day);
+
+#endif
@@ -0,0 +1,418 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bank_dormancy.h"
+#include "bank_internal.h"
+
+#define DORMANCY_HEADER_BYTES 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;               // slots [0, count) have words
+    uint64_t generation;          // drawn by each rescan, so processes sort their buckets again
+} DormancyHeader;
+
+// Slots filed under one month. Entries are dropped lazily: one is live only
+// while `where` still names this month for its slot.
+typedef struct {
+    uint32_t *slots;
+    size_t count;
+    size_t capacity;
+} DormancyBucket;
+
+struct BankDormancy {
+    int fd;
+    int locked;                   // this process holds the file lock
+    unsigned char *map;
+    size_t map_len;
+    DormancyHeader *header;
+    uint16_t *words;              // one per slot, in the mapping
+    size_t mapped_slots;
+    uint64_t generation;          // of the words the buckets were sorted from
+    size_t sorted;                // slots [0, sorted) are filed
+    uint16_t *where;              // per filed slot: the word it is filed under
+    size_t where_cap;
+    DormancyBucket *buckets;      // by month; 0 holds slots with no word yet
+    size_t bucket_count;
+};
+
+// Calendar month, UTC, counting January 1970 as 1
+static uint16_t monthOf(int64_t when) {
+    int64_t days = (when > 0 ? when / 86400 : 0) + 719468;
+    int64_t era = days / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t months = (yoe + era * 400 + (month <= 2) - 1970) * 12 + month;
+    return months < 0x7fff ? (uint16_t)months : 0x7fff;
+}
+
+static uint16_t wordOf(const Account *account) {
+    return (uint16_t)(monthOf((int64_t)account->last_accessed) |
+                      (account->status != ACCOUNT_ACTIVE ? DORMANCY_INACTIVE : 0));
+}
+
+static int lockFile(BankDormancy *d, short type) {
+    struct flock lock;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(d->fd, F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    d->locked = type != F_UNLCK;
+    return 0;
+}
+
+// Maps at least `slots` words, growing the file under its lock. The file
+// never shrinks, so other processes' mappings stay valid.
+static int mapSlots(BankDormancy *d, size_t slots) {
+    size_t len = DORMANCY_HEADER_BYTES +
+                 (slots / DORMANCY_GROW_SLOTS + 1) * DORMANCY_GROW_SLOTS * sizeof(uint16_t);
+    int held = d->locked;
+    struct stat st;
+    int failed;
+
+    if (!held && lockFile(d, F_WRLCK) != 0) {
+        return -1;
+    }
+    failed = fstat(d->fd, &st) != 0 || ((size_t)st.st_size < len && ftruncate(d->fd, (off_t)len) != 0);
+    if (!failed && (size_t)st.st_size > len) {
+        len = (size_t)st.st_size;
+    }
+    if (!held) {
+        lockFile(d, F_UNLCK);
+    }
+    void *map = failed ? MAP_FAILED : mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, d->fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    if (d->map != NULL) {
+        munmap(d->map, d->map_len);
+    }
+    d->map = map;
+    d->map_len = len;
+    d->header = map;
+    d->words = (uint16_t *)(void *)(d->map + DORMANCY_HEADER_BYTES);
+    d->mapped_slots = (len - DORMANCY_HEADER_BYTES) / sizeof(uint16_t);
+    return 0;
+}
+
+static void raiseCount(DormancyHeader *header, uint64_t count) {
+    uint64_t seen = __atomic_load_n(&header->count, __ATOMIC_RELAXED);
+    while (seen < count &&
+           !__atomic_compare_exchange_n(&header->count, &seen, count, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Words for records [from, to), read from the store
+static int readWords(Bank *bank, long from, long to) {
+    BankDormancy *d = bank->dormancy;
+    Account *records = malloc(DORMANCY_SCAN_RECORDS * sizeof(Account));
+    int failed = records == NULL || ((size_t)to > d->mapped_slots && mapSlots(d, (size_t)to) != 0);
+
+    for (long base = from; base < to && !failed; base += DORMANCY_SCAN_RECORDS) {
+        long n = to - base < DORMANCY_SCAN_RECORDS ? to - base : DORMANCY_SCAN_RECORDS;
+        failed = storageGet(&bank->storage, base, n, records) != 0;
+        for (long i = 0; i < n && !failed; i++) {
+            __atomic_store_n(&d->words[base + i], wordOf(&records[i]), __ATOMIC_RELAXED);
+        }
+        if (!failed) {
+            raiseCount(d->header, (uint64_t)(base + n));
+        }
+    }
+    free(records);
+    return failed ? -1 : 0;
+}
+
+// Starts the words over from the records, under the file lock
+static int rescan(Bank *bank) {
+    DormancyHeader *h = bank->dormancy->header;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h->magic = 0;
+    h->count = 0;
+    h->version = DORMANCY_VERSION;
+    h->generation = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    if (readWords(bank, 0, storageCount(&bank->storage)) != 0) {
+        return -1;
+    }
+    h->magic = DORMANCY_MAGIC;
+    return 0;
+}
+
+// ---- buckets ----
+
+static int fileSlot(BankDormancy *d, size_t slot, uint16_t word) {
+    d->where[slot] = word;
+    if (word & DORMANCY_INACTIVE) {
+        return 0;
+    }
+    if (word >= d->bucket_count) {
+        size_t count = (size_t)word + 13;   // a year ahead
+        DormancyBucket *grown = realloc(d->buckets, count * sizeof(DormancyBucket));
+        if (grown == NULL) {
+            return -1;
+        }
+        memset(grown + d->bucket_count, 0, (count - d->bucket_count) * sizeof(DormancyBucket));
+        d->buckets = grown;
+        d->bucket_count = count;
+    }
+    DormancyBucket *bucket = &d->buckets[word];
+    if (bucket->count == bucket->capacity) {
+        size_t capacity = bucket->capacity ? bucket->capacity * 2 : 64;
+        uint32_t *grown = realloc(bucket->slots, capacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        bucket->slots = grown;
+        bucket->capacity = capacity;
+    }
+    bucket->slots[bucket->count++] = (uint32_t)slot;
+    return 0;
+}
+
+static void freeBuckets(BankDormancy *d) {
+    for (size_t i = 0; i < d->bucket_count; i++) {
+        free(d->buckets[i].slots);
+    }
+    free(d->buckets);
+    free(d->where);
+    d->buckets = NULL;
+    d->bucket_count = 0;
+    d->where = NULL;
+    d->where_cap = 0;
+    d->sorted = 0;
+}
+
+// Files slots [sorted, count) under their words, after every slot when the
+// words were rescanned since this process last sorted them
+static int fileNew(BankDormancy *d) {
+    size_t count = (size_t)__atomic_load_n(&d->header->count, __ATOMIC_RELAXED);
+
+    if (d->generation != d->header->generation) {
+        freeBuckets(d);
+        d->generation = d->header->generation;
+    }
+    if (count > d->mapped_slots && mapSlots(d, count) != 0) {
+        return -1;
+    }
+    if (count > d->where_cap) {
+        size_t cap = count + DORMANCY_GROW_SLOTS;
+        uint16_t *grown = realloc(d->where, cap * sizeof(uint16_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        d->where = grown;
+        d->where_cap = cap;
+    }
+    for (; d->sorted < count; d->sorted++) {
+        if (fileSlot(d, d->sorted, __atomic_load_n(&d->words[d->sorted], __ATOMIC_RELAXED)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// ---- open and close ----
+
+int dormancyOpen(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(DORMANCY_SUFFIX)];
+    BankDormancy *d = calloc(1, sizeof(*d));
+    long records = storageCount(&bank->storage);
+    int failed;
+
+    if (d == NULL) {
+        return BANK_ERR_IO;
+    }
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, DORMANCY_SUFFIX);
+    d->fd = storageOpenSide(&bank->storage, path, O_RDWR | O_CREAT);
+    if (d->fd < 0 || lockFile(d, F_WRLCK) != 0) {
+        if (d->fd >= 0) {
+            close(d->fd);
+        }
+        free(d);
+        return BANK_ERR_IO;
+    }
+    bank->dormancy = d;
+
+    // Records appended without going through a bank, or dropped as a torn
+    // tail, since the words were last written
+    failed = mapSlots(d, (size_t)records) != 0;
+    if (!failed && (d->header->magic != DORMANCY_MAGIC || d->header->version != DORMANCY_VERSION)) {
+        failed = rescan(bank) != 0;
+    } else if (!failed) {
+        if (d->header->count > (uint64_t)records) {
+            d->header->count = (uint64_t)records;
+        }
+        failed = readWords(bank, (long)d->header->count, records) != 0;
+    }
+    lockFile(d, F_UNLCK);
+    if (failed || fileNew(d) != 0) {
+        dormancyClose(bank);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+void dormancyClose(Bank *bank) {
+    BankDormancy *d = bank->dormancy;
+
+    if (d == NULL) {
+        return;
+    }
+    freeBuckets(d);
+    if (d->map != NULL) {
+        munmap(d->map, d->map_len);
+    }
+    close(d->fd);
+    free(d);
+    bank->dormancy = NULL;
+}
+
+void dormancyNote(Bank *bank, long slot, const Account *account) {
+    BankDormancy *d = bank->dormancy;
+    uint16_t word = wordOf(account);
+
+    if (d == NULL || slot < 0 || ((size_t)slot >= d->mapped_slots && mapSlots(d, (size_t)slot + 1) != 0)) {
+        return;
+    }
+    if (__atomic_load_n(&d->words[slot], __ATOMIC_RELAXED) != word) {
+        __atomic_store_n(&d->words[slot], word, __ATOMIC_RELAXED);
+    }
+    raiseCount(d->header, (uint64_t)slot + 1);
+    if ((size_t)slot < d->sorted && d->where[slot] != word) {
+        fileSlot(d, (size_t)slot, word);
+    }
+}
+
+int dormancyRenumbered(Bank *bank) {
+    BankDormancy *d = bank->dormancy;
+    int result;
+
+    if (d == NULL || lockFile(d, F_WRLCK) != 0) {
+        return BANK_ERR_IO;
+    }
+    result = rescan(bank) == 0 ? BANK_OK : BANK_ERR_IO;
+    lockFile(d, F_UNLCK);
+    return result == BANK_OK && fileNew(d) == 0 ? BANK_OK : BANK_ERR_IO;
+}
+
+// ---- sweeps ----
+
+// Checks one filed candidate; returns BANK_OK, or BANK_ERR_IO to keep it filed
+static int sweepSlot(Bank *bank, long slot, time_t cutoff, int dry_run, Account *found, int max,
+                     BankDormancyStats *stats) {
+    Account account;
+    int result;
+
+    if (dry_run) {
+        if (bankReadRecord(bank, slot, &account) != BANK_OK) {
+            return BANK_ERR_IO;
+        }
+        result = account.status == ACCOUNT_ACTIVE && account.last_accessed < cutoff ? BANK_OK
+                                                                                  : BANK_ERR_INVALID_REQUEST;
+    } else {
+        result = bankSuspendIdle(bank, slot, cutoff, &account);
+    }
+
+    if (result == BANK_OK) {
+        if (found != NULL && stats->dormant < max) {
+            found[stats->dormant] = account;
+        }
+        stats->dormant++;
+        stats->suspended += !dry_run;
+        return BANK_OK;
+    }
+    if (result == BANK_ERR_INVALID_REQUEST) {
+        stats->recent++;
+        dormancyNote(bank, slot, &account);   // refile under what the record says
+        return BANK_OK;
+    }
+    return result;
+}
+
+int bankSweepDormant(Bank *bank, int months, time_t now, int dry_run, Account *found, int max,
+                     BankDormancyStats *stats) {
+    BankDormancy *d = bank->dormancy;
+    int result = BANK_OK;
+    long committed = 0;
+    struct tm tm;
+
+    memset(stats, 0, sizeof(*stats));
+    if (d == NULL) {
+        return BANK_ERR_IO;
+    }
+    if (months < 1 || localtime_r(&now, &tm) == NULL) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    if (!dry_run && bank->read_only) {
+        return BANK_ERR_READ_ONLY;
+    }
+    tm.tm_mon -= months;
+    tm.tm_isdst = -1;
+    time_t cutoff = mktime(&tm);
+
+    storageRefresh(&bank->storage);
+    if (readWords(bank, (long)d->header->count, storageCount(&bank->storage)) != 0 || fileNew(d) != 0) {
+        return BANK_ERR_IO;
+    }
+
+    // Newest month first: a slot another process has used since is refiled
+    // under a later month, one this walk has passed
+    if (!dry_run) {
+        bankBeginBatch(bank);
+    }
+    uint16_t last = monthOf((int64_t)cutoff);
+    for (long b = last < d->bucket_count ? last : (long)d->bucket_count - 1; b >= 0; b--) {
+        size_t kept = 0;
+
+        if (d->buckets[b].count > 0) {
+            stats->months++;
+        }
+        for (size_t i = 0; i < d->buckets[b].count; i++) {
+            uint32_t slot = d->buckets[b].slots[i];
+            if (d->where[slot] != b) {
+                continue;   // refiled since
+            }
+            uint16_t word = __atomic_load_n(&d->words[slot], __ATOMIC_RELAXED);
+            if (word != b) {
+                fileSlot(d, slot, word);
+                continue;
+            }
+            stats->candidates++;
+            int swept = sweepSlot(bank, (long)slot, cutoff, dry_run, found, max, stats);
+            if (swept != BANK_OK) {
+                result = swept;
+            }
+            if (stats->suspended - committed == DORMANCY_BATCH) {
+                committed = stats->suspended;
+                bankCommitBatch(bank);
+                bankBeginBatch(bank);
+            }
+            if (d->where[slot] == b) {
+                d->buckets[b].slots[kept++] = slot;
+            }
+        }
+        d->buckets[b].count = kept;
+    }
+    if (!dry_run && bankCommitBatch(bank) != BANK_OK) {
+        result = BANK_ERR_IO;
+    }
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef BANK_DORMANCY_H
+#define BANK_DORMANCY_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Dormant-account sweeps without reading every record. <store>.access holds
+// one word per slot: the calendar month (UTC) of the account's last access,
+// with a bit set while it is not active. The file is shared by every process
+// with the store open, which map it, and a record write changes the word
+// only when the month or activity does, so a busy account costs one update
+// a month. Each process sorts the active slots into buckets by month; a
+// sweep walks the buckets older than its cutoff and nothing else, and checks
+// each candidate's record under its lock before suspending it.
+//
+// Words are 0 for slots never seen, as after records were appended without
+// going through the bank; those are read at open, and swept as candidates
+// until they are.
+#define DORMANCY_SUFFIX ".access"
+#define DORMANCY_MAGIC 0x53434341u        // "ACCS"
+#define DORMANCY_VERSION 1
+#define DORMANCY_INACTIVE 0x8000u         // word bit: the account is suspended or closed
+#define DORMANCY_GROW_SLOTS 65536         // words the file grows by
+#define DORMANCY_SCAN_RECORDS 4096        // records read at a time when rebuilding
+#define DORMANCY_BATCH 1024               // suspensions per committed batch
+
+typedef struct {
+    long months;                          // buckets walked
+    long candidates;                      // accounts filed in them
+    long dormant;                         // of those, active and unused since the cutoff
+    long suspended;                       // of those, suspended by this sweep
+    long recent;                          // used since they were filed, or no longer active
+} BankDormancyStats;
+
+int dormancyOpen(Bank *bank);
+void dormancyClose(Bank *bank);
+
+// Record writes: files the account under the month of its last access
+void dormancyNote(Bank *bank, long slot, const Account *account);
+
+// Slots now name other records (compaction): every word is read again
+int dormancyRenumbered(Bank *bank);
+
+// Suspends every active account not accessed since `months` calendar months
+// before `now`, committing DORMANCY_BATCH at a time. With `dry_run` nothing
+// changes, and up to `max` candidates are written to `found` (which may be
+// NULL) for review.
+int bankSweepDormant(Bank *bank, int months, time_t now, int dry_run, Account *found, int max,
+                     BankDormancyStats *stats);
+
+#endif
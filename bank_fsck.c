@@ -0,0 +1,382 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bank_fsck.h"
+#include "bank_daily.h"
+#include "bank_internal.h"
+
+typedef struct {
+    FsckItemKind kind;
+    uint64_t position;
+    int account_number;
+} FsckItem;
+
+typedef struct {
+    Bank *bank;
+    int quarantine;
+    long first;                     // record slots [first, last)
+    long last;
+    uint64_t from;                  // journal bytes [from, to)
+    uint64_t to;
+    FsckItem *items;                // what failed, in order
+    size_t item_count;
+    size_t item_cap;
+    long unsealed;
+    long sealed;
+    uint64_t void_entries;
+    uint64_t bytes;
+    int failed;
+} FsckTask;
+
+static int noteItem(FsckTask *task, FsckItemKind kind, uint64_t position, int account_number) {
+    if (task->item_count == task->item_cap) {
+        size_t cap = task->item_cap ? task->item_cap * 2 : 64;
+        FsckItem *grown = realloc(task->items, cap * sizeof(FsckItem));
+        if (grown == NULL) {
+            return -1;
+        }
+        task->items = grown;
+        task->item_cap = cap;
+    }
+    task->items[task->item_count++] = (FsckItem){ kind, position, account_number };
+    return 0;
+}
+
+static void checkRecords(FsckTask *task, unsigned char *buffer) {
+    BankStorage *storage = &task->bank->storage;
+    long per_read = FSCK_CHUNK_BYTES / sizeof(Account);
+
+    for (long slot = task->first; slot < task->last && !task->failed; slot += per_read) {
+        long n = task->last - slot < per_read ? task->last - slot : per_read;
+        if (storageGet(storage, slot, n, buffer) != 0) {
+            task->failed = 1;
+            break;
+        }
+        task->bytes += (uint64_t)n * sizeof(Account);
+
+        for (long i = 0; i < n && !task->failed; i++) {
+            Account account;
+            memcpy(&account, buffer + (size_t)i * sizeof(Account), sizeof(account));
+            if (bankRecordIntact(&account)) {
+                continue;
+            }
+            if (!task->bank->sealed) {
+                task->unsealed++;
+                if (task->quarantine) {
+                    bankSealRecord(&account);
+                    task->failed = storagePut(storage, slot + i, 1, &account) != 0;
+                    task->sealed++;
+                }
+            } else {
+                task->failed = noteItem(task, FSCK_RECORD, (uint64_t)(slot + i), account.account_number) != 0;
+            }
+        }
+    }
+}
+
+static void checkEntries(FsckTask *task, unsigned char *buffer) {
+    BankStorage *storage = &task->bank->storage;
+    size_t per_read = FSCK_CHUNK_BYTES - FSCK_CHUNK_BYTES % sizeof(JournalRecord);
+
+    for (uint64_t at = task->from; at < task->to && !task->failed; at += per_read) {
+        size_t len = task->to - at < per_read ? (size_t)(task->to - at) : per_read;
+        if (storageJournalRead(storage, buffer, len, at) != len) {
+            task->failed = 1;
+            break;
+        }
+        task->bytes += len;
+
+        for (size_t i = 0; i < len / sizeof(JournalRecord) && !task->failed; i++) {
+            JournalRecord record;
+            uint64_t lsn = at + i * sizeof(JournalRecord);
+            memcpy(&record, buffer + i * sizeof(JournalRecord), sizeof(record));
+            if (record.lsn != lsn || !journalIntact(&record)) {
+                task->failed = noteItem(task, FSCK_ENTRY, lsn, record.account_number) != 0;
+            } else if (record.flags & JOURNAL_VOID) {
+                task->void_entries++;
+            }
+        }
+    }
+}
+
+static void *checkRange(void *arg) {
+    FsckTask *task = arg;
+    unsigned char *buffer = malloc(FSCK_CHUNK_BYTES);
+
+    if (buffer == NULL) {
+        task->failed = 1;
+        return NULL;
+    }
+    checkRecords(task, buffer);
+    checkEntries(task, buffer);
+    free(buffer);
+    return NULL;
+}
+
+// ---- quarantine ----
+
+static int writeAll(int fd, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int saveItem(int fd, FsckItemKind kind, uint64_t position, const void *data, size_t len) {
+    QuarantineHeader header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = QUARANTINE_MAGIC;
+    header.kind = kind;
+    header.position = position;
+    header.quarantined_at = (int64_t)time(NULL);
+    header.length = len;
+    return writeAll(fd, &header, sizeof(header)) != 0 || writeAll(fd, data, len) != 0 ? -1 : 0;
+}
+
+typedef struct {
+    int account_number;
+    double balance;
+} KnownBalance;
+
+static int compareKnown(const void *a, const void *b) {
+    int x = ((const KnownBalance *)a)->account_number, y = ((const KnownBalance *)b)->account_number;
+    return (x > y) - (x < y);
+}
+
+// The last balance the journal recorded for each of `known`, sorted by number
+static void lastBalances(Bank *bank, KnownBalance *known, size_t count) {
+    JournalReader reader;
+    JournalRecord record;
+
+    qsort(known, count, sizeof(KnownBalance), compareKnown);
+    if (journalReaderOpen(&reader, &bank->storage) != 0) {
+        return;
+    }
+    while (journalReaderNext(&reader, &record)) {
+        KnownBalance key = { record.account_number, 0.0 };
+        KnownBalance *found = bsearch(&key, known, count, sizeof(KnownBalance), compareKnown);
+        if (found != NULL) {
+            found->balance = record.balance_after;
+        }
+    }
+    journalReaderClose(&reader);
+}
+
+// A suspended record in place of a corrupt one: the number if no other slot
+// holds it, and the balance the journal last recorded for it
+static int standIn(Bank *bank, long slot, int account_number, const KnownBalance *known, size_t count) {
+    Account account;
+    KnownBalance key = { account_number, 0.0 };
+    const KnownBalance *found = bsearch(&key, known, count, sizeof(KnownBalance), compareKnown);
+    long holder = bankFindSlot(bank, account_number);
+
+    memset(&account, 0, sizeof(account));
+    if (account_number >= MIN_ACCOUNT_NUMBER && account_number <= MAX_ACCOUNT_NUMBER &&
+        (holder == -1 || holder == slot)) {
+        account.account_number = account_number;
+        account.balance = found != NULL ? found->balance : 0.0;
+    }
+    snprintf(account.name, sizeof(account.name), "Quarantined record %ld", slot);
+    account.status = ACCOUNT_SUSPENDED;
+    account.created_date = account.last_accessed = time(NULL);
+    return bankWriteRecord(bank, slot, &account);
+}
+
+static int voidEntry(Bank *bank, uint64_t lsn) {
+    JournalRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.lsn = lsn;
+    record.timestamp = (int64_t)time(NULL);
+    record.type = TRANSACTION_RESOLVED;   // journal-only, so never shown as money moving
+    record.flags = JOURNAL_VOID;
+    snprintf(record.description, sizeof(record.description), "Quarantined by fsck");
+    journalSeal(&record);
+    return storageJournalWrite(&bank->storage, &record, sizeof(record), lsn);
+}
+
+static int quarantineItems(Bank *bank, const FsckItem *items, size_t count, uint64_t torn_bytes,
+                           BankFsckStats *stats) {
+    char path[BANK_PATH_LENGTH + sizeof(QUARANTINE_SUFFIX)];
+    unsigned char raw[sizeof(Account) > sizeof(JournalRecord) ? sizeof(Account) : sizeof(JournalRecord)];
+    KnownBalance *known = malloc((count ? count : 1) * sizeof(KnownBalance));
+    long records = storageCount(&bank->storage);
+    size_t known_count = 0;
+    int failed = known == NULL;
+
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, QUARANTINE_SUFFIX);
+    int fd = failed ? -1 : storageOpenSide(&bank->storage, path, O_WRONLY | O_CREAT | O_APPEND);
+    failed |= fd < 0;
+
+    // Everything is saved, and on disk, before anything is overwritten
+    for (size_t i = 0; i < count && !failed; i++) {
+        if (items[i].kind == FSCK_RECORD) {
+            failed = storageGet(&bank->storage, (long)items[i].position, 1, raw) != 0 ||
+                     saveItem(fd, FSCK_RECORD, items[i].position, raw, sizeof(Account)) != 0;
+            known[known_count++] = (KnownBalance){ items[i].account_number, 0.0 };
+        } else {
+            failed = storageJournalRead(&bank->storage, raw, sizeof(JournalRecord), items[i].position) !=
+                         sizeof(JournalRecord) ||
+                     saveItem(fd, FSCK_ENTRY, items[i].position, raw, sizeof(JournalRecord)) != 0;
+        }
+    }
+    if (!failed && torn_bytes > 0) {
+        uint64_t offset = (uint64_t)records * sizeof(Account);
+        failed = pread(bank->storage.fd, raw, (size_t)torn_bytes, (off_t)offset) != (ssize_t)torn_bytes ||
+                 saveItem(fd, FSCK_TAIL, offset, raw, (size_t)torn_bytes) != 0;
+    }
+    if (fd >= 0) {
+        failed |= fsync(fd) != 0;
+        close(fd);
+    }
+
+    // Void entries first, so the balances come from intact ones only
+    for (size_t i = 0; i < count && !failed; i++) {
+        if (items[i].kind == FSCK_ENTRY) {
+            failed = voidEntry(bank, items[i].position) != 0;
+            stats->quarantined++;
+        }
+    }
+    if (!failed && known_count > 0) {
+        lastBalances(bank, known, known_count);
+    }
+    for (size_t i = 0; i < count && !failed; i++) {
+        if (items[i].kind == FSCK_RECORD) {
+            failed = standIn(bank, (long)items[i].position, items[i].account_number, known, known_count) !=
+                     BANK_OK;
+            stats->quarantined++;
+        }
+    }
+    if (!failed && torn_bytes > 0) {
+        failed = storageTruncate(&bank->storage, records) != 0;
+        stats->quarantined++;
+    }
+    free(known);
+
+    if (failed || storageSync(&bank->storage) != 0 || storageJournalSync(&bank->storage) != 0) {
+        return BANK_ERR_IO;
+    }
+
+    // The daily totals counted the entries now void
+    if (known_count < count && bankDailyRebuild(bank) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+
+    // The index was built from the damaged keys
+    if (known_count > 0) {
+        bank->indexed = indexBuild(&bank->index, &bank->storage, records, 0) == 0;
+        if (bank->indexed && storagePersistent(&bank->storage)) {
+            indexSave(&bank->index, bank->index_path);
+        }
+    }
+    return BANK_OK;
+}
+
+int bankFsck(Bank *bank, int threads, int quarantine, BankFsckStats *stats) {
+    FsckTask tasks[BANK_MAX_THREADS];
+    FsckItem *items = NULL;
+    size_t item_count = 0;
+    long records = storageCount(&bank->storage);
+    uint64_t entries;
+    struct stat st;
+    int failed = 0, result = BANK_OK;
+
+    memset(stats, 0, sizeof(*stats));
+    if (bank->read_only && quarantine) {
+        return BANK_ERR_READ_ONLY;
+    }
+    if (journalFlush(&bank->journal) != 0) {
+        return BANK_ERR_IO;
+    }
+    entries = (bank->journal.end - sizeof(JournalHeader)) / sizeof(JournalRecord);
+    if (storageFlat(&bank->storage) && fstat(bank->storage.fd, &st) == 0 &&
+        (uint64_t)st.st_size > (uint64_t)records * sizeof(Account)) {
+        stats->torn_bytes = (uint64_t)st.st_size - (uint64_t)records * sizeof(Account);
+    }
+
+    // Each thread takes an equal share of the records and of the entries
+    threads = bankThreadCount(threads);
+    memset(tasks, 0, sizeof(tasks));
+    for (int t = 0; t < threads; t++) {
+        tasks[t].bank = bank;
+        tasks[t].quarantine = quarantine;
+        tasks[t].first = (long)((uint64_t)records * (uint64_t)t / (uint64_t)threads);
+        tasks[t].last = (long)((uint64_t)records * (uint64_t)(t + 1) / (uint64_t)threads);
+        tasks[t].from = sizeof(JournalHeader) + entries * (uint64_t)t / (uint64_t)threads * sizeof(JournalRecord);
+        tasks[t].to = sizeof(JournalHeader) + entries * (uint64_t)(t + 1) / (uint64_t)threads * sizeof(JournalRecord);
+    }
+    bankRunTasks(tasks, sizeof(FsckTask), threads, checkRange);
+
+    // Records of every task first, then entries, each in position order
+    for (int t = 0; t < threads; t++) {
+        failed |= tasks[t].failed;
+        item_count += tasks[t].item_count;
+    }
+    items = malloc((item_count ? item_count : 1) * sizeof(FsckItem));
+    failed |= items == NULL;
+    item_count = 0;
+    for (int kind = FSCK_RECORD; kind <= FSCK_ENTRY && !failed; kind++) {
+        for (int t = 0; t < threads; t++) {
+            for (size_t i = 0; i < tasks[t].item_count; i++) {
+                if (tasks[t].items[i].kind == (FsckItemKind)kind) {
+                    items[item_count++] = tasks[t].items[i];
+                }
+            }
+        }
+    }
+    for (int t = 0; t < threads; t++) {
+        stats->unsealed += tasks[t].unsealed;
+        stats->sealed += tasks[t].sealed;
+        stats->void_entries += tasks[t].void_entries;
+        stats->bytes += tasks[t].bytes;
+        free(tasks[t].items);
+    }
+    if (failed) {
+        free(items);
+        return BANK_ERR_IO;
+    }
+
+    stats->records = records;
+    stats->entries = entries;
+    for (size_t i = 0; i < item_count; i++) {
+        if (items[i].kind == FSCK_RECORD) {
+            stats->corrupt_records++;
+        } else {
+            stats->corrupt_entries++;
+        }
+        if (stats->issue_count < FSCK_REPORT_MAX) {
+            stats->issues[stats->issue_count++] =
+                (BankFsckIssue){ items[i].kind, items[i].position, items[i].account_number };
+        }
+    }
+    if (stats->torn_bytes > 0 && stats->issue_count < FSCK_REPORT_MAX) {
+        stats->issues[stats->issue_count++] = (BankFsckIssue){ FSCK_TAIL, (uint64_t)records * sizeof(Account), 0 };
+    }
+
+    if (quarantine && (item_count > 0 || stats->torn_bytes > 0)) {
+        result = quarantineItems(bank, items, item_count, stats->torn_bytes, stats);
+    }
+    if (quarantine && result == BANK_OK) {
+        result = bankMarkSealed(bank);
+    }
+    free(items);
+    return result;
+}
@@ -0,0 +1,67 @@
+#ifndef BANK_FSCK_H
+#define BANK_FSCK_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Integrity check of a store and its journal. Every account record and
+// journal entry is read back and tested against its CRC32C, with the work
+// split across threads in large sequential reads so it runs at the speed of
+// the disk. It also finds a partial record left at the end of the store by
+// a torn append.
+//
+// Quarantining moves what failed aside, into <store>.quarantine, before
+// touching it: a corrupt record is replaced by a suspended stand-in holding
+// the account's last journaled balance, a corrupt journal entry by a void
+// one at the same LSN, and a torn tail is cut off. In a store not yet marked
+// sealed, a record failing its checksum is taken to predate checksums: it
+// counts as unsealed rather than corrupt, and quarantining seals it and then
+// marks the store. The store must not be in use by another process meanwhile.
+#define QUARANTINE_SUFFIX ".quarantine"
+#define QUARANTINE_MAGIC 0x4e525142u   // "BQRN"
+#define FSCK_CHUNK_BYTES (1u << 20)    // bytes per read
+#define FSCK_REPORT_MAX 32             // problems listed individually
+
+typedef enum {
+    FSCK_RECORD = 1,                // position is a slot
+    FSCK_ENTRY = 2,                 // position is an LSN
+    FSCK_TAIL = 3                   // position is the byte offset of a partial record
+} FsckItemKind;
+
+// Precedes the raw bytes of each item in the quarantine file
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;                  // FsckItemKind
+    uint64_t position;
+    int64_t quarantined_at;
+    uint64_t length;
+} QuarantineHeader;
+
+typedef struct {
+    FsckItemKind kind;
+    uint64_t position;
+    int account_number;             // as read, so possibly damaged itself
+} BankFsckIssue;
+
+typedef struct {
+    long records;
+    long unsealed;                  // written before checksums
+    long corrupt_records;
+    uint64_t torn_bytes;            // partial record at the end of the store
+    uint64_t entries;
+    uint64_t corrupt_entries;       // failed the checksum, or not at their own LSN
+    uint64_t void_entries;          // blanked by an earlier quarantine
+    long quarantined;               // items moved aside by this run
+    long sealed;                    // unsealed records sealed by this run
+    uint64_t bytes;                 // read
+    BankFsckIssue issues[FSCK_REPORT_MAX];   // the first problems, records before entries
+    int issue_count;
+} BankFsckStats;
+
+// Checks the open store on `threads` threads (0 for every CPU). With
+// `quarantine`, also repairs as described above. Returns BANK_OK when the
+// check ran, whatever it found, and BANK_ERR_IO when it could not.
+int bankFsck(Bank *bank, int threads, int quarantine, BankFsckStats *stats);
+
+#endif
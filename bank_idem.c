@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank_idem.h"
+
+// 64-bit finaliser (splitmix64) so sequential client keys spread across sets
+static uint64_t mixKey(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+int idemInit(IdemTable *table, size_t capacity) {
+    size_t sets = 1;
+
+    memset(table, 0, sizeof(*table));
+    while (sets * IDEM_WAYS < capacity) {
+        sets <<= 1;
+    }
+    table->entries = calloc(sets * IDEM_WAYS, sizeof(IdemEntry));
+    if (table->entries == NULL) {
+        return -1;
+    }
+    table->set_mask = sets - 1;
+    return 0;
+}
+
+void idemFree(IdemTable *table) {
+    free(table->entries);
+    memset(table, 0, sizeof(*table));
+}
+
+static IdemEntry *idemSet(IdemTable *table, uint64_t key) {
+    return table->entries + (mixKey(key) & table->set_mask) * IDEM_WAYS;
+}
+
+const IdemEntry *idemLookup(IdemTable *table, uint64_t key) {
+    IdemEntry *set = idemSet(table, key);
+
+    for (int way = 0; way < IDEM_WAYS; way++) {
+        if (set[way].key == key) {
+            table->hits++;
+            return &set[way];
+        }
+    }
+    table->misses++;
+    return NULL;
+}
+
+void idemRemember(IdemTable *table, uint64_t key, int op, int account_number, int related_account,
+                  double amount, int result, double balance) {
+    IdemEntry *set = idemSet(table, key);
+    IdemEntry *victim = &set[0];
+
+    for (int way = 0; way < IDEM_WAYS; way++) {
+        if (set[way].key == key || set[way].key == 0) {
+            victim = &set[way];
+            break;
+        }
+        // Unsigned distance from the clock orders stamps correctly across wraparound
+        if (table->clock - set[way].stamp > table->clock - victim->stamp) {
+            victim = &set[way];
+        }
+    }
+    if (victim->key != 0 && victim->key != key) {
+        table->evictions++;
+    }
+
+    victim->key = key;
+    victim->stamp = table->clock++;
+    victim->op = op;
+    victim->account_number = account_number;
+    victim->related_account = related_account;
+    victim->amount = amount;
+    victim->result = result;
+    victim->balance = balance;
+}
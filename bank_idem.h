@@ -0,0 +1,40 @@
+#ifndef BANK_IDEM_H
+#define BANK_IDEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded table of recently seen idempotency keys and the result each one
+// produced. Set-associative: a key hashes to one set of IDEM_WAYS entries, so
+// a probe touches a fixed, small amount of memory; when a set is full the
+// oldest entry in it is replaced. Memory never grows past the initial size.
+#define IDEM_WAYS 4
+#define IDEM_DEFAULT_CAPACITY 65536
+
+typedef struct {
+    uint64_t key;               // 0 marks an empty way
+    uint32_t stamp;             // insertion clock, oldest way is evicted first
+    int32_t account_number;
+    int32_t related_account;    // payee of a transfer, payer of a prepared credit, else 0
+    int32_t result;             // BankResult of the original execution
+    int32_t op;                 // operation the key was first used for
+    double amount;              // amount the key was first used with
+    double balance;             // balance reported by the original execution
+} IdemEntry;
+
+typedef struct {
+    IdemEntry *entries;
+    size_t set_mask;
+    uint32_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} IdemTable;
+
+int idemInit(IdemTable *table, size_t capacity);
+void idemFree(IdemTable *table);
+const IdemEntry *idemLookup(IdemTable *table, uint64_t key);
+void idemRemember(IdemTable *table, uint64_t key, int op, int account_number, int related_account,
+                  double amount, int result, double balance);
+
+#endif
@@ -0,0 +1,943 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bank_core.h"
+#include "bank_internal.h"
+#include "bank_index.h"
+
+#define BUILD_PAGE_RECORDS 1024   // records read at a time while building
+
+// The file is this header, a checksum per block, then the blocks: records,
+// key pool, the sorted arrays and both hash tables, each padded to 8 bytes
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t record_size;         // sizeof(Account) the index was built against
+    uint64_t count;
+    uint64_t pool_len;
+    uint64_t number_buckets;
+    uint64_t email_buckets;
+    uint64_t blocks;              // checksums following the header
+    int32_t last_account;         // account number in the last indexed slot
+    int32_t reserved;
+    uint64_t checksum;            // of the header, with this field zero, and the checksums
+} IndexFileHeader;
+
+// Offsets of the tables from the start of the blocks
+typedef struct {
+    size_t records;
+    size_t pool;
+    size_t sorted[INDEX_SORTED_FIELDS];
+    size_t by_number;
+    size_t by_email;
+    size_t end;
+} IndexLayout;
+
+static uint64_t mixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t hashString(const char *s) {
+    uint64_t h = 0xcbf29ce484222325ULL;   // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 0x100000001b3ULL;
+    }
+    return mixHash(h);
+}
+
+static const char *keyOf(const BankIndex *index, uint32_t slot, int field) {
+    return index->pool + index->records[slot].key[field];
+}
+
+// Normalized form stored and searched: lowercase for email and name
+static void normalizeKey(char *out, size_t size, const char *key, int field) {
+    size_t i = 0;
+    for (; key[i] != '\0' && i + 1 < size; i++) {
+        out[i] = field == INDEX_PHONE ? key[i] : (char)tolower((unsigned char)key[i]);
+    }
+    out[i] = '\0';
+}
+
+void indexInit(BankIndex *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+// Whether `p` points into the file the index was loaded from
+static int inMap(const BankIndex *index, const void *p) {
+    uintptr_t at = (uintptr_t)p, base = (uintptr_t)index->map;
+    return index->map != NULL && at >= base && at < base + index->map_len;
+}
+
+// Heap copy of `len` bytes of a mapped table, with room for `cap`
+static void *copyOut(const void *data, size_t len, size_t cap) {
+    void *copy = malloc(cap ? cap : 1);
+    if (copy != NULL) {
+        memcpy(copy, data, len);
+    }
+    return copy;
+}
+
+void indexFree(BankIndex *index) {
+    if (!inMap(index, index->records)) {
+        free(index->records);
+    }
+    if (!inMap(index, index->pool)) {
+        free(index->pool);
+    }
+    if (!index->by_number.borrowed) {
+        free(index->by_number.buckets);
+    }
+    if (!index->by_email.borrowed) {
+        free(index->by_email.buckets);
+    }
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        if (!inMap(index, index->sorted[f])) {
+            free(index->sorted[f]);
+        }
+        free(index->delta[f]);
+    }
+    if (index->map != NULL) {
+        munmap(index->map, index->map_len);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+// ---- hash tables ----
+
+static int hashInsert(IndexHash *table, uint64_t hash, uint32_t slot);
+
+static int hashReserve(IndexHash *table, size_t entries) {
+    size_t size = 16;
+    while (size < entries * 2) {
+        size <<= 1;
+    }
+    if (table->buckets != NULL && size <= table->mask + 1) {
+        return 0;
+    }
+
+    IndexHash grown = { calloc(size, sizeof(IndexBucket)), size - 1, 0, 0 };
+    if (grown.buckets == NULL) {
+        return -1;
+    }
+    if (table->buckets != NULL) {
+        for (size_t i = 0; i <= table->mask; i++) {
+            if (table->buckets[i].slot_plus_one != 0) {
+                hashInsert(&grown, table->buckets[i].hash, table->buckets[i].slot_plus_one - 1);
+            }
+        }
+        if (!table->borrowed) {
+            free(table->buckets);
+        }
+    }
+    *table = grown;
+    return 0;
+}
+
+static int hashInsert(IndexHash *table, uint64_t hash, uint32_t slot) {
+    if (hashReserve(table, table->used + 1) != 0) {
+        return -1;
+    }
+    size_t i = hash & table->mask;
+    while (table->buckets[i].slot_plus_one != 0) {
+        i = (i + 1) & table->mask;
+    }
+    table->buckets[i].hash = hash;
+    table->buckets[i].slot_plus_one = slot + 1;
+    table->used++;
+    return 0;
+}
+
+static int hashAll(BankIndex *index) {
+    free(index->by_number.buckets);
+    free(index->by_email.buckets);
+    memset(&index->by_number, 0, sizeof(index->by_number));
+    memset(&index->by_email, 0, sizeof(index->by_email));
+    if (hashReserve(&index->by_number, index->count) != 0 ||
+        hashReserve(&index->by_email, index->count) != 0) {
+        return -1;
+    }
+    for (size_t slot = 0; slot < index->count; slot++) {
+        hashInsert(&index->by_number, mixHash((uint64_t)(uint32_t)index->records[slot].account_number),
+                   (uint32_t)slot);
+        hashInsert(&index->by_email, hashString(keyOf(index, (uint32_t)slot, INDEX_EMAIL)), (uint32_t)slot);
+    }
+    return 0;
+}
+
+long indexFindNumber(const BankIndex *index, int account_number) {
+    const IndexHash *table = &index->by_number;
+    uint64_t hash = mixHash((uint64_t)(uint32_t)account_number);
+
+    if (table->buckets == NULL) {
+        return -1;
+    }
+    for (size_t i = hash & table->mask; table->buckets[i].slot_plus_one != 0; i = (i + 1) & table->mask) {
+        uint32_t slot = table->buckets[i].slot_plus_one - 1;
+        if (table->buckets[i].hash == hash && slot < index->count &&
+            index->records[slot].account_number == account_number) {
+            return (long)slot;
+        }
+    }
+    return -1;
+}
+
+// ---- sorting ----
+
+static int compareSlots(const BankIndex *index, int field, uint32_t a, uint32_t b) {
+    int c = strcmp(keyOf(index, a, field), keyOf(index, b, field));
+    if (c != 0) {
+        return c;
+    }
+    return (a > b) - (a < b);
+}
+
+static void mergeRuns(const BankIndex *index, int field, const uint32_t *left, size_t left_n,
+                      const uint32_t *right, size_t right_n, uint32_t *out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < left_n && j < right_n) {
+        out[k++] = compareSlots(index, field, left[i], right[j]) <= 0 ? left[i++] : right[j++];
+    }
+    while (i < left_n) {
+        out[k++] = left[i++];
+    }
+    while (j < right_n) {
+        out[k++] = right[j++];
+    }
+}
+
+// Build-time sort entry: the first 8 key bytes, big-endian, decide most
+// comparisons without following the slot into the key pool
+typedef struct {
+    uint64_t prefix;
+    uint32_t slot;
+    uint32_t reserved;
+} SortEntry;
+
+static uint64_t keyPrefix(const char *key) {
+    uint64_t prefix = 0;
+    int i = 0;
+    for (; i < 8 && key[i] != '\0'; i++) {
+        prefix = (prefix << 8) | (unsigned char)key[i];
+    }
+    return prefix << (8 * (8 - i));
+}
+
+static int compareEntries(const BankIndex *index, int field, const SortEntry *a, const SortEntry *b) {
+    if (a->prefix != b->prefix) {
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+    // Equal prefixes: only keys of 8+ bytes can still differ
+    if ((a->prefix & 0xff) != 0) {
+        int c = strcmp(keyOf(index, a->slot, field) + 8, keyOf(index, b->slot, field) + 8);
+        if (c != 0) {
+            return c;
+        }
+    }
+    return (a->slot > b->slot) - (a->slot < b->slot);
+}
+
+static void mergeEntries(const BankIndex *index, int field, const SortEntry *left, size_t left_n,
+                         const SortEntry *right, size_t right_n, SortEntry *out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < left_n && j < right_n) {
+        out[k++] = compareEntries(index, field, &left[i], &right[j]) <= 0 ? left[i++] : right[j++];
+    }
+    memcpy(out + k, left + i, (left_n - i) * sizeof(SortEntry));
+    k += left_n - i;
+    memcpy(out + k, right + j, (right_n - j) * sizeof(SortEntry));
+}
+
+// Bottom-up merge sort; the result ends up back in `entries`
+static void sortEntries(const BankIndex *index, int field, SortEntry *entries, SortEntry *scratch, size_t n) {
+    SortEntry *src = entries, *dst = scratch;
+
+    for (size_t width = 1; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            mergeEntries(index, field, src + lo, mid - lo, src + mid, hi - mid, dst + lo);
+        }
+        SortEntry *t = src; src = dst; dst = t;
+    }
+    if (src != entries) {
+        memcpy(entries, src, n * sizeof(SortEntry));
+    }
+}
+
+// ---- parallel build ----
+
+typedef struct {
+    BankIndex *index;
+    BankStorage *storage;
+    size_t first;
+    size_t last;
+    char *pool;                   // keys of this range, rebased when merged
+    size_t pool_len;
+    size_t pool_cap;
+    int failed;
+} ReadTask;
+
+typedef struct {
+    BankIndex *index;
+    int field;                    // sorted field, or -1 to build the hash tables
+    SortEntry *entries;
+    SortEntry *scratch;
+    size_t lo;
+    size_t mid;
+    size_t hi;
+    int failed;
+} SortTask;
+
+
+static uint32_t poolPut(char **pool, size_t *len, size_t *cap, const char *key, int field) {
+    size_t need = strlen(key) + 1;
+    if (*len + need > *cap) {
+        size_t grown_cap = *cap ? *cap * 2 : 4096;
+        while (grown_cap < *len + need) {
+            grown_cap *= 2;
+        }
+        char *grown = realloc(*pool, grown_cap);
+        if (grown == NULL) {
+            return UINT32_MAX;
+        }
+        *pool = grown;
+        *cap = grown_cap;
+    }
+    uint32_t offset = (uint32_t)*len;
+    normalizeKey(*pool + *len, need, key, field);
+    *len += need;
+    return offset;
+}
+
+static int putRecord(IndexRecord *record, char **pool, size_t *len, size_t *cap, int account_number,
+                     const char *email, const char *phone, const char *name) {
+    record->account_number = account_number;
+    record->key[INDEX_EMAIL] = poolPut(pool, len, cap, email, INDEX_EMAIL);
+    record->key[INDEX_PHONE] = poolPut(pool, len, cap, phone, INDEX_PHONE);
+    record->key[INDEX_NAME] = poolPut(pool, len, cap, name, INDEX_NAME);
+    for (int f = 0; f < INDEX_FIELDS; f++) {
+        if (record->key[f] == UINT32_MAX) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *readRange(void *arg) {
+    ReadTask *task = arg;
+    Account *page = malloc(BUILD_PAGE_RECORDS * sizeof(Account));
+
+    if (page == NULL) {
+        task->failed = 1;
+        return NULL;
+    }
+    for (size_t slot = task->first; slot < task->last && !task->failed; slot += BUILD_PAGE_RECORDS) {
+        size_t want = task->last - slot < BUILD_PAGE_RECORDS ? task->last - slot : BUILD_PAGE_RECORDS;
+        if (storageGet(task->storage, (long)slot, (long)want, page) != 0) {
+            task->failed = 1;
+            break;
+        }
+        for (size_t i = 0; i < want; i++) {
+            Account *acc = &page[i];
+            acc->email[sizeof(acc->email) - 1] = '\0';
+            acc->phone[sizeof(acc->phone) - 1] = '\0';
+            acc->name[sizeof(acc->name) - 1] = '\0';
+            if (putRecord(&task->index->records[slot + i], &task->pool, &task->pool_len, &task->pool_cap,
+                          acc->account_number, acc->email, acc->phone, acc->name) != 0) {
+                task->failed = 1;
+                break;
+            }
+        }
+    }
+    free(page);
+    return NULL;
+}
+
+static int hashAll(BankIndex *index);
+
+static void *sortRange(void *arg) {
+    SortTask *task = arg;
+    if (task->field < 0) {
+        task->failed = hashAll(task->index) != 0;
+    } else if (task->mid == task->hi) {
+        sortEntries(task->index, task->field, task->entries + task->lo, task->scratch + task->lo,
+                    task->hi - task->lo);
+    } else {
+        mergeEntries(task->index, task->field, task->entries + task->lo, task->mid - task->lo,
+                     task->entries + task->mid, task->hi - task->mid, task->scratch + task->lo);
+        memcpy(task->entries + task->lo, task->scratch + task->lo, (task->hi - task->lo) * sizeof(SortEntry));
+    }
+    return NULL;
+}
+
+// Sorts every sorted field: each thread sorts one run per field, then
+// neighbouring runs are merged pairwise until one run is left. The hash
+// tables are filled by one more task alongside the first round.
+static int sortAll(BankIndex *index, int threads) {
+    size_t n = index->count;
+    size_t bounds[BANK_MAX_THREADS + 1];
+    SortTask tasks[2 * BANK_MAX_THREADS + 1];
+    SortEntry *entries[INDEX_SORTED_FIELDS], *scratch[INDEX_SORTED_FIELDS];
+    int runs = threads, count = 0, failed = 0;
+
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        entries[f] = malloc((n ? n : 1) * sizeof(SortEntry));
+        scratch[f] = malloc((n ? n : 1) * sizeof(SortEntry));
+        failed |= entries[f] == NULL || scratch[f] == NULL;
+    }
+    for (int f = 0; f < INDEX_SORTED_FIELDS && !failed; f++) {
+        for (size_t i = 0; i < n; i++) {
+            entries[f][i].slot = (uint32_t)i;
+            entries[f][i].prefix = keyPrefix(keyOf(index, (uint32_t)i, f));
+        }
+    }
+
+    if (!failed) {
+        for (int r = 0; r <= runs; r++) {
+            bounds[r] = n * (size_t)r / (size_t)runs;
+        }
+        memset(tasks, 0, sizeof(tasks));
+        tasks[count++] = (SortTask){ index, -1, NULL, NULL, 0, 0, 0, 0 };
+        for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+            for (int r = 0; r < runs; r++) {
+                tasks[count++] = (SortTask){ index, f, entries[f], scratch[f], bounds[r], bounds[r + 1],
+                                             bounds[r + 1], 0 };
+            }
+        }
+        bankRunTasks(tasks, sizeof(SortTask), count, sortRange);
+        failed = tasks[0].failed;
+    }
+
+    for (int width = 1; width < runs && !failed; width *= 2) {
+        count = 0;
+        for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+            for (int r = 0; r + width < runs; r += 2 * width) {
+                int end = r + 2 * width < runs ? r + 2 * width : runs;
+                tasks[count++] = (SortTask){ index, f, entries[f], scratch[f],
+                                             bounds[r], bounds[r + width], bounds[end], 0 };
+            }
+        }
+        bankRunTasks(tasks, sizeof(SortTask), count, sortRange);
+    }
+
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        for (size_t i = 0; i < n && !failed; i++) {
+            index->sorted[f][i] = entries[f][i].slot;
+        }
+        free(entries[f]);
+        free(scratch[f]);
+    }
+    index->sorted_count = failed ? 0 : n;
+    return failed ? -1 : 0;
+}
+
+static int reserveRecords(BankIndex *index, size_t count) {
+    if (count <= index->capacity) {
+        return 0;
+    }
+    size_t capacity = index->capacity ? index->capacity : 1024;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    IndexRecord *grown = inMap(index, index->records)
+        ? copyOut(index->records, index->count * sizeof(IndexRecord), capacity * sizeof(IndexRecord))
+        : realloc(index->records, capacity * sizeof(IndexRecord));
+    if (grown == NULL) {
+        return -1;
+    }
+    index->records = grown;
+    index->capacity = capacity;
+    return 0;
+}
+
+static int allocSorted(BankIndex *index, size_t count) {
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        free(index->sorted[f]);
+        index->sorted[f] = malloc((count ? count : 1) * sizeof(uint32_t));
+        if (index->delta[f] == NULL) {
+            index->delta[f] = malloc(INDEX_DELTA_MAX * sizeof(uint32_t));
+        }
+        if (index->sorted[f] == NULL || index->delta[f] == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int indexBuild(BankIndex *index, BankStorage *storage, long count, int threads) {
+    ReadTask tasks[BANK_MAX_THREADS];
+
+    threads = count < INDEX_PARALLEL_MIN ? 1 : bankThreadCount(threads);
+
+    indexFree(index);
+    if (reserveRecords(index, (size_t)count) != 0 || allocSorted(index, (size_t)count) != 0) {
+        indexFree(index);
+        return -1;
+    }
+    index->count = (size_t)count;
+
+    memset(tasks, 0, sizeof(tasks));
+    for (int t = 0; t < threads; t++) {
+        tasks[t].index = index;
+        tasks[t].storage = storage;
+        tasks[t].first = (size_t)count * (size_t)t / (size_t)threads;
+        tasks[t].last = (size_t)count * (size_t)(t + 1) / (size_t)threads;
+    }
+    bankRunTasks(tasks, sizeof(ReadTask), threads, readRange);
+
+    // Concatenate the per-thread pools and rebase their offsets
+    int failed = 0;
+    for (int t = 0; t < threads; t++) {
+        failed |= tasks[t].failed;
+        index->pool_len += tasks[t].pool_len;
+    }
+    index->pool_cap = index->pool_len ? index->pool_len : 1;
+    index->pool = failed ? NULL : malloc(index->pool_cap);
+    if (index->pool != NULL) {
+        size_t base = 0;
+        for (int t = 0; t < threads; t++) {
+            memcpy(index->pool + base, tasks[t].pool, tasks[t].pool_len);
+            for (size_t slot = tasks[t].first; slot < tasks[t].last; slot++) {
+                for (int f = 0; f < INDEX_FIELDS; f++) {
+                    index->records[slot].key[f] += (uint32_t)base;
+                }
+            }
+            base += tasks[t].pool_len;
+        }
+    }
+    for (int t = 0; t < threads; t++) {
+        free(tasks[t].pool);
+    }
+
+    if (index->pool == NULL || sortAll(index, threads) != 0) {
+        indexFree(index);
+        return -1;
+    }
+    index->dirty = 1;
+    return 0;
+}
+
+// ---- incremental updates ----
+
+static size_t lowerBound(const BankIndex *index, int field, const uint32_t *slots, size_t n,
+                         const char *key) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(keyOf(index, slots[mid], field), key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Folds the side list into the sorted arrays
+static int mergeDelta(BankIndex *index) {
+    if (index->delta_count == 0) {
+        return 0;
+    }
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        uint32_t *merged = malloc(index->count * sizeof(uint32_t));
+        if (merged == NULL) {
+            return -1;
+        }
+        mergeRuns(index, f, index->sorted[f], index->sorted_count, index->delta[f], index->delta_count, merged);
+        if (!inMap(index, index->sorted[f])) {
+            free(index->sorted[f]);
+        }
+        index->sorted[f] = merged;
+    }
+    index->sorted_count = index->count;
+    index->delta_count = 0;
+    return 0;
+}
+
+int indexAdd(BankIndex *index, long slot, int account_number, const char *email,
+             const char *phone, const char *name) {
+    // Changes land in the mapping's pages, so checking it has to finish first
+    if ((size_t)slot != index->count || indexVerify(index, SIZE_MAX) != 1 ||
+        reserveRecords(index, index->count + 1) != 0) {
+        return -1;
+    }
+    if (index->delta_count == INDEX_DELTA_MAX && mergeDelta(index) != 0) {
+        return -1;
+    }
+    if (inMap(index, index->pool)) {
+        char *pool = copyOut(index->pool, index->pool_len, index->pool_len * 2 + 4096);
+        if (pool == NULL) {
+            return -1;
+        }
+        index->pool = pool;
+        index->pool_cap = index->pool_len * 2 + 4096;
+    }
+
+    IndexRecord *record = &index->records[slot];
+    if (putRecord(record, &index->pool, &index->pool_len, &index->pool_cap,
+                  account_number, email, phone, name) != 0) {
+        return -1;
+    }
+    index->count++;
+
+    if (hashInsert(&index->by_number, mixHash((uint64_t)(uint32_t)account_number), (uint32_t)slot) != 0 ||
+        hashInsert(&index->by_email, hashString(keyOf(index, (uint32_t)slot, INDEX_EMAIL)), (uint32_t)slot) != 0) {
+        index->count--;
+        return -1;
+    }
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        uint32_t *delta = index->delta[f];
+        size_t at = lowerBound(index, f, delta, index->delta_count, keyOf(index, (uint32_t)slot, f));
+        memmove(delta + at + 1, delta + at, (index->delta_count - at) * sizeof(uint32_t));
+        delta[at] = (uint32_t)slot;
+    }
+    index->delta_count++;
+    index->dirty = 1;
+    return 0;
+}
+
+// ---- queries ----
+
+static int keyMatches(const char *stored, const char *key, size_t key_len, int prefix) {
+    return prefix ? strncmp(stored, key, key_len) == 0 : strcmp(stored, key) == 0;
+}
+
+static size_t searchSorted(const BankIndex *index, int field, const uint32_t *slots, size_t n,
+                           const char *key, int prefix, uint32_t *out, size_t max) {
+    size_t key_len = strlen(key), found = 0;
+    for (size_t i = lowerBound(index, field, slots, n, key); i < n && found < max; i++) {
+        if (!keyMatches(keyOf(index, slots[i], field), key, key_len, prefix)) {
+            break;
+        }
+        out[found++] = slots[i];
+    }
+    return found;
+}
+
+size_t indexSearch(const BankIndex *index, IndexField field, const char *key, int prefix,
+                   uint32_t *slots, size_t max) {
+    char normalized[MAX_NAME_LENGTH];
+    size_t found = 0;
+
+    normalizeKey(normalized, sizeof(normalized), key, field);
+
+    if (field == INDEX_EMAIL && !prefix) {
+        const IndexHash *table = &index->by_email;
+        uint64_t hash = hashString(normalized);
+        if (table->buckets == NULL) {
+            return 0;
+        }
+        for (size_t i = hash & table->mask; table->buckets[i].slot_plus_one != 0 && found < max;
+             i = (i + 1) & table->mask) {
+            uint32_t slot = table->buckets[i].slot_plus_one - 1;
+            if (table->buckets[i].hash == hash && strcmp(keyOf(index, slot, INDEX_EMAIL), normalized) == 0) {
+                slots[found++] = slot;
+            }
+        }
+        return found;
+    }
+
+    if (field == INDEX_EMAIL) {
+        size_t key_len = strlen(normalized);
+        for (size_t slot = 0; slot < index->count && found < max; slot++) {
+            if (keyMatches(keyOf(index, (uint32_t)slot, INDEX_EMAIL), normalized, key_len, 1)) {
+                slots[found++] = (uint32_t)slot;
+            }
+        }
+        return found;
+    }
+
+    found = searchSorted(index, field, index->sorted[field], index->sorted_count, normalized, prefix,
+                         slots, max);
+    found += searchSorted(index, field, index->delta[field], index->delta_count, normalized, prefix,
+                          slots + found, max - found);
+    return found;
+}
+
+// ---- persistence ----
+
+static int writeFully(int fd, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static size_t align8(size_t len) {
+    return (len + 7) & ~(size_t)7;
+}
+
+static void layoutOf(IndexLayout *layout, size_t count, size_t pool_len, size_t number_buckets,
+                     size_t email_buckets) {
+    layout->records = 0;
+    layout->pool = align8(count * sizeof(IndexRecord));
+    layout->sorted[0] = layout->pool + align8(pool_len);
+    for (int f = 1; f < INDEX_SORTED_FIELDS; f++) {
+        layout->sorted[f] = layout->sorted[f - 1] + align8(count * sizeof(uint32_t));
+    }
+    layout->by_number = layout->sorted[INDEX_SORTED_FIELDS - 1] + align8(count * sizeof(uint32_t));
+    layout->by_email = layout->by_number + number_buckets * sizeof(IndexBucket);
+    layout->end = layout->by_email + email_buckets * sizeof(IndexBucket);
+}
+
+// Word-at-a-time multiply-xor hash; `len` is a multiple of 8
+static uint64_t checksumWords(uint64_t sum, const unsigned char *p, size_t len) {
+    for (size_t i = 0; i < len; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        sum = (sum ^ word) * 0x9e3779b97f4a7c15ULL;
+        sum ^= sum >> 29;
+    }
+    return sum;
+}
+
+static uint64_t blockChecksum(const unsigned char *blocks, size_t len, size_t block) {
+    size_t at = block * INDEX_BLOCK_BYTES;
+    size_t n = len - at < INDEX_BLOCK_BYTES ? len - at : INDEX_BLOCK_BYTES;
+    return checksumWords(mixHash(block + 1), blocks + at, n);
+}
+
+static uint64_t headerChecksum(const IndexFileHeader *header, const uint64_t *checksums) {
+    IndexFileHeader copy = *header;
+    copy.checksum = 0;
+    uint64_t sum = checksumWords(mixHash(INDEX_MAGIC), (const unsigned char *)&copy, sizeof(copy));
+    return checksumWords(sum, (const unsigned char *)checksums, (size_t)header->blocks * sizeof(uint64_t));
+}
+
+// Streams the blocks to the file, checksumming them on the way
+typedef struct {
+    int fd;
+    uint64_t *checksums;
+    size_t written;
+    int failed;
+} IndexWriter;
+
+static void writeBlocks(IndexWriter *w, const unsigned char *p, size_t len) {
+    while (len > 0 && !w->failed) {
+        size_t block = w->written / INDEX_BLOCK_BYTES;
+        size_t room = INDEX_BLOCK_BYTES - w->written % INDEX_BLOCK_BYTES;
+        size_t n = len < room ? len : room;
+        uint64_t sum = w->written % INDEX_BLOCK_BYTES == 0 ? mixHash(block + 1) : w->checksums[block];
+        w->checksums[block] = checksumWords(sum, p, n);
+        w->failed |= writeFully(w->fd, p, n);
+        w->written += n;
+        p += n;
+        len -= n;
+    }
+}
+
+static void writeSection(IndexWriter *w, const void *data, size_t len) {
+    unsigned char tail[8] = { 0 };
+    size_t whole = len & ~(size_t)7;
+
+    writeBlocks(w, data, whole);
+    if (len > whole) {
+        memcpy(tail, (const unsigned char *)data + whole, len - whole);
+        writeBlocks(w, tail, sizeof(tail));
+    }
+}
+
+int indexSave(BankIndex *index, const char *path) {
+    char tmp_path[BANK_PATH_LENGTH + 32];
+    IndexFileHeader header;
+    IndexLayout layout;
+    IndexWriter w;
+    int fd;
+
+    // A loaded index is only rewritten once it is known to be intact
+    if (indexVerify(index, SIZE_MAX) != 1 || mergeDelta(index) != 0) {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
+    header.record_size = sizeof(Account);
+    header.count = index->count;
+    header.pool_len = index->pool_len;
+    header.number_buckets = index->by_number.buckets ? index->by_number.mask + 1 : 0;
+    header.email_buckets = index->by_email.buckets ? index->by_email.mask + 1 : 0;
+    header.last_account = index->count ? index->records[index->count - 1].account_number : 0;
+    layoutOf(&layout, index->count, index->pool_len, (size_t)header.number_buckets,
+             (size_t)header.email_buckets);
+    header.blocks = (layout.end + INDEX_BLOCK_BYTES - 1) / INDEX_BLOCK_BYTES;
+
+    memset(&w, 0, sizeof(w));
+    w.checksums = calloc(header.blocks ? (size_t)header.blocks : 1, sizeof(uint64_t));
+    if (w.checksums == NULL) {
+        return -1;
+    }
+
+    // Write beside the live file and rename, so a crash never leaves half an
+    // index. The blocks go first; the header and checksums, once known, last.
+    // Each process sharing the store writes its own temporary.
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+    w.fd = fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(w.checksums);
+        return -1;
+    }
+    w.failed = lseek(fd, (off_t)(sizeof(header) + header.blocks * sizeof(uint64_t)), SEEK_SET) < 0;
+    writeSection(&w, index->records, index->count * sizeof(IndexRecord));
+    writeSection(&w, index->pool, index->pool_len);
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        writeSection(&w, index->sorted[f], index->count * sizeof(uint32_t));
+    }
+    writeSection(&w, index->by_number.buckets, (size_t)header.number_buckets * sizeof(IndexBucket));
+    writeSection(&w, index->by_email.buckets, (size_t)header.email_buckets * sizeof(IndexBucket));
+
+    header.checksum = headerChecksum(&header, w.checksums);
+    if (!w.failed && lseek(fd, 0, SEEK_SET) == 0) {
+        w.failed |= writeFully(fd, &header, sizeof(header));
+        w.failed |= writeFully(fd, w.checksums, (size_t)header.blocks * sizeof(uint64_t));
+    } else {
+        w.failed = 1;
+    }
+    free(w.checksums);
+    if (close(fd) != 0 || w.failed || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    index->dirty = 0;
+    return 0;
+}
+
+// Whether a mapped file of `len` bytes, starting with `header`, is a whole
+// index of up to `count` records. Sizes are bounded before they are added up.
+static int headerValid(const IndexFileHeader *header, const unsigned char *map, size_t len, long count,
+                       IndexLayout *layout) {
+    size_t table_bytes;
+
+    if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION ||
+        header->record_size != sizeof(Account) || header->count == 0 || header->count > (uint64_t)count ||
+        header->pool_len > len || header->blocks > len / sizeof(uint64_t) ||
+        header->number_buckets > len / sizeof(IndexBucket) || header->email_buckets > len / sizeof(IndexBucket) ||
+        header->number_buckets < header->count || header->email_buckets < header->count ||
+        (header->number_buckets & (header->number_buckets - 1)) != 0 ||
+        (header->email_buckets & (header->email_buckets - 1)) != 0) {
+        return 0;
+    }
+    layoutOf(layout, (size_t)header->count, (size_t)header->pool_len, (size_t)header->number_buckets,
+             (size_t)header->email_buckets);
+    table_bytes = sizeof(*header) + (size_t)header->blocks * sizeof(uint64_t);
+    return header->blocks == (layout->end + INDEX_BLOCK_BYTES - 1) / INDEX_BLOCK_BYTES &&
+           len == table_bytes + layout->end &&
+           header->checksum == headerChecksum(header, (const uint64_t *)(map + sizeof(*header)));
+}
+
+int indexLoad(BankIndex *index, const char *path, BankStorage *storage, long count) {
+    IndexFileHeader header;
+    IndexLayout layout;
+    Account account;
+    struct stat st;
+    unsigned char *map;
+    int in;
+
+    indexFree(index);
+    in = open(path, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    if (fstat(in, &st) != 0 || (size_t)st.st_size < sizeof(header)) {
+        close(in);
+        return -1;
+    }
+    // Private and writable: tables change in place once checked, never the file
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, in, 0);
+    close(in);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    memcpy(&header, map, sizeof(header));
+    if (!headerValid(&header, map, (size_t)st.st_size, count, &layout) ||
+        storageGet(storage, (long)header.count - 1, 1, &account) != 0 ||
+        account.account_number != header.last_account) {
+        // ...and the last indexed slot must still hold the account it held when saved
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    unsigned char *blocks = map + sizeof(header) + (size_t)header.blocks * sizeof(uint64_t);
+    index->map = map;
+    index->map_len = (size_t)st.st_size;
+    index->checksums = (const uint64_t *)(map + sizeof(header));
+    index->blocks = blocks;
+    index->blocks_len = layout.end;
+    index->records = (IndexRecord *)(blocks + layout.records);
+    index->count = index->capacity = (size_t)header.count;
+    index->pool = (char *)(blocks + layout.pool);
+    index->pool_len = index->pool_cap = (size_t)header.pool_len;
+    for (int f = 0; f < INDEX_SORTED_FIELDS; f++) {
+        index->sorted[f] = (uint32_t *)(blocks + layout.sorted[f]);
+        index->delta[f] = malloc(INDEX_DELTA_MAX * sizeof(uint32_t));
+        if (index->delta[f] == NULL) {
+            indexFree(index);
+            return -1;
+        }
+    }
+    index->sorted_count = index->count;
+    index->by_number = (IndexHash){ (IndexBucket *)(blocks + layout.by_number),
+                                    (size_t)header.number_buckets - 1, index->count, 1 };
+    index->by_email = (IndexHash){ (IndexBucket *)(blocks + layout.by_email),
+                                   (size_t)header.email_buckets - 1, index->count, 1 };
+
+    // Catch up with records appended after the index was saved
+    for (long slot = (long)index->count; slot < count; slot++) {
+        if (storageGet(storage, slot, 1, &account) != 0) {
+            indexFree(index);
+            return -1;
+        }
+        account.email[sizeof(account.email) - 1] = '\0';
+        account.phone[sizeof(account.phone) - 1] = '\0';
+        account.name[sizeof(account.name) - 1] = '\0';
+        if (indexAdd(index, slot, account.account_number, account.email, account.phone, account.name) != 0) {
+            indexFree(index);
+            return -1;
+        }
+    }
+    index->dirty = index->count != header.count;
+    return 0;
+}
+
+int indexVerify(BankIndex *index, size_t max_blocks) {
+    size_t blocks = (index->blocks_len + INDEX_BLOCK_BYTES - 1) / INDEX_BLOCK_BYTES;
+
+    if (index->map == NULL) {
+        return 1;
+    }
+    for (; index->verified < blocks && max_blocks > 0; index->verified++, max_blocks--) {
+        if (blockChecksum(index->blocks, index->blocks_len, index->verified) != index->checksums[index->verified]) {
+            return -1;
+        }
+    }
+    return index->verified == blocks;
+}
+
+int indexVerified(const BankIndex *index) {
+    return index->map == NULL ||
+           index->verified == (index->blocks_len + INDEX_BLOCK_BYTES - 1) / INDEX_BLOCK_BYTES;
+}
@@ -0,0 +1,110 @@
+#ifndef BANK_INDEX_H
+#define BANK_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bank_storage.h"
+
+// In-memory indexes over the account store, saved next to it so a restart
+// only has to index records appended since the last save. Account number and
+// email are hashed for exact lookups; phone and name are kept in key order for
+// exact and prefix lookups. Email and name keys are lowercased, so searches on
+// them ignore case.
+//
+// The saved file holds every table in its in-memory layout, hash tables
+// included, and is mapped rather than read at startup: the tables point into
+// the mapping and are copied out only once they have to grow. Its contents
+// are checksummed in blocks that are checked after the bank is open, a few
+// per batch, so opening costs the same whatever the size of the store.
+#define INDEX_SUFFIX ".index"
+#define INDEX_MAGIC 0x58444e42u    // "BNDX"
+#define INDEX_VERSION 2
+#define INDEX_BLOCK_BYTES (1u << 20)   // bytes covered by one checksum
+#define INDEX_VERIFY_BLOCKS 1      // blocks checked per committed batch
+#define INDEX_DELTA_MAX 4096       // new records kept in a side list before a merge
+#define INDEX_PARALLEL_MIN 16384   // smaller stores are indexed on one thread
+
+// Searchable fields; the first INDEX_SORTED_FIELDS are kept in sorted order
+typedef enum {
+    INDEX_PHONE = 0,
+    INDEX_NAME = 1,
+    INDEX_EMAIL = 2
+} IndexField;
+
+#define INDEX_SORTED_FIELDS 2
+#define INDEX_FIELDS 3
+
+// Keys of one account slot, as offsets into the key pool
+typedef struct {
+    int32_t account_number;
+    uint32_t key[INDEX_FIELDS];
+} IndexRecord;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t slot_plus_one;    // 0 marks an empty bucket
+    uint32_t reserved;
+} IndexBucket;
+
+// Open-addressing table from a key hash to a slot; equal hashes may repeat
+typedef struct {
+    IndexBucket *buckets;
+    size_t mask;
+    size_t used;
+    int borrowed;              // buckets live in the mapped file
+} IndexHash;
+
+typedef struct {
+    IndexRecord *records;      // indexed by slot
+    size_t count;
+    size_t capacity;
+    char *pool;                // NUL-terminated normalized keys
+    size_t pool_len;
+    size_t pool_cap;
+    IndexHash by_number;
+    IndexHash by_email;
+    uint32_t *sorted[INDEX_SORTED_FIELDS];  // slots [0, sorted_count) in key order
+    size_t sorted_count;
+    uint32_t *delta[INDEX_SORTED_FIELDS];   // slots added since, also in key order
+    size_t delta_count;
+    int dirty;                 // changed since it was loaded or saved
+    unsigned char *map;        // the file it was loaded from, mapped copy-on-write
+    size_t map_len;
+    const uint64_t *checksums; // per block of `blocks`, in the mapping
+    const unsigned char *blocks;
+    size_t blocks_len;
+    size_t verified;           // leading blocks found intact
+} BankIndex;
+
+void indexInit(BankIndex *index);
+void indexFree(BankIndex *index);
+
+// Indexes the first `count` records of `storage`, splitting the reads and
+// sorts across up to `threads` threads (0 picks the CPU count)
+int indexBuild(BankIndex *index, BankStorage *storage, long count, int threads);
+
+// Maps a saved index and indexes any records appended after it was written.
+// Fails if the file is missing or does not describe this store; its contents
+// are trusted only once indexVerify has checked them.
+int indexLoad(BankIndex *index, const char *path, BankStorage *storage, long count);
+int indexSave(BankIndex *index, const char *path);
+
+// Checks up to `max_blocks` more checksum blocks of a loaded index. Returns
+// 1 once the whole file has been checked, 0 while blocks remain, and -1 if
+// one does not match, after which the index must be rebuilt.
+int indexVerify(BankIndex *index, size_t max_blocks);
+int indexVerified(const BankIndex *index);
+
+int indexAdd(BankIndex *index, long slot, int account_number, const char *email,
+             const char *phone, const char *name);
+
+// Slot holding `account_number`, or -1
+long indexFindNumber(const BankIndex *index, int account_number);
+
+// Writes up to `max` matching slots, in key order for phone and name.
+// Email prefix searches walk the in-memory keys rather than a sorted list.
+size_t indexSearch(const BankIndex *index, IndexField field, const char *key, int prefix,
+                   uint32_t *slots, size_t max);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef BANK_INTERNAL_H
+#define BANK_INTERNAL_H
+
+#include "bank_core.h"
+#include "bank_trace.h"
+
+// Helpers shared by the core library's modules; front-ends use bank_core.h
+
+#define BANK_MAX_THREADS 16   // worker threads used by parallel passes
+#define BANK_MAX_TASKS 64
+
+// Runs fn over `count` task structs of `task_size` bytes, one thread each
+// (the caller's thread takes the first), and returns when all have finished
+void bankRunTasks(void *tasks, size_t task_size, int count, void *(*fn)(void *));
+
+// `requested` threads, or the online CPU count for 0, capped at BANK_MAX_THREADS
+int bankThreadCount(int requested);
+
+// Record I/O: accounts are fixed-size records addressed by slot
+long bankRecordCount(Bank *bank);
+int bankReadRecord(Bank *bank, long slot, Account *account);
+int bankWriteRecord(Bank *bank, long slot, const Account *account);
+
+// Record locks against other processes sharing the store (see
+// storageLockRecords), held across one read-modify-write and never while
+// waiting on a user. Two records are always locked lower slot first.
+int bankLockRecord(Bank *bank, long slot);
+void bankUnlockRecord(Bank *bank, long slot);
+
+// Keeps other processes off the store while a compaction or a replication
+// primary needs it to itself: `hold` 1 takes a hold, failing with
+// BANK_ERR_IO while another process has the store open, and 0 drops one.
+// Dropping also renews the claim on the store's current file.
+int bankHoldStore(Bank *bank, int hold);
+
+// Transaction log pieces, for modules that prepare entries in bulk. Text
+// passed to bankAppendLog is flushed with the batch, like logTransaction.
+void bankFillJournalRecord(JournalRecord *record, uint64_t key, int account_number, TransactionType type,
+                           double amount, double balance_after, int related_account, const char *description);
+size_t bankFormatLogLine(char *line, size_t size, const char *datetime, int account_number,
+                         TransactionType type, double amount, double balance_after,
+                         const char *description);
+void bankAppendLog(Bank *bank, const char *text, size_t len);
+
+// The core's own checks and bookkeeping, for modules that move money the
+// way its operations do: slot lookup, status and velocity checks, retry keys,
+// and journal plus log entries with JOURNAL_* flags
+long bankFindSlot(Bank *bank, int account_number);
+int bankRequireActive(const Account *account);
+int bankScreenOutflow(Bank *bank, int account_number, double amount, int payee,
+                      char *description, size_t size);
+int bankReplayKeyed(Bank *bank, uint64_t key, TransactionType op, int account_number,
+                    int related_account, double amount, int *result, Account *updated);
+void bankRememberKeyed(Bank *bank, uint64_t key, TransactionType op, int account_number,
+                       int related_account, double amount, int result, double balance);
+int bankLogTransaction(Bank *bank, int account_number, TransactionType type, double amount,
+                       double balance_after, int related_account, const char *description,
+                       uint64_t key, int flags);
+
+// Journals an operation's records, written out at once unless a batch holds
+// them for its commit. BANK_ERR_IO keeps none of them, and the caller undoes
+// the operation: an unjournaled change must not stand.
+int bankAppendJournal(Bank *bank, JournalRecord *records, int count);
+
+// Suspends the account in `slot` if it is active and unused since
+// `idle_before`, as one locked operation; BANK_ERR_INVALID_REQUEST if it is
+// not. `account` receives the record as it was read, or as suspended.
+int bankSuspendIdle(Bank *bank, long slot, time_t idle_before, Account *account);
+
+// Transfer journaled under `key` without consulting or filling the client
+// idempotency table; for jobs that track their own progress
+int bankApplyTransfer(Bank *bank, uint64_t key, int from_account, int to_account, double amount);
+
+// Standing order store, opened and closed with the bank
+int schedOpen(Bank *bank);
+void schedClose(Bank *bank);
+
+// Cross-shard legs: rebuilt from prepared and resolving journal records at
+// open, up to `lsn`, then kept up to date with each batch this process
+// writes and, before every lookup, with what other processes appended.
+// Freed at close.
+int shardLegRecord(const JournalRecord *record);
+void shardReplay(Bank *bank, const JournalRecord *record);
+void shardReplayed(Bank *bank, uint64_t lsn);
+void shardWritten(Bank *bank, const void *records, size_t count);
+void shardClose(Bank *bank);
+
+// Replication hooks: a primary captures the records written by a batch and
+// ships them with its journal at commit; a compaction makes replicas start
+// over from a fresh copy; close stops the replication threads
+void replCapture(Bank *bank, long slot, const Account *account);
+void replPublish(Bank *bank);
+void replResync(Bank *bank);
+void replClose(Bank *bank);
+
+// Tracing hooks (see bank_trace.h). traceBegin stamps the start of an
+// operation, 0 when the bank is not traced; traceEnd or traceOp records it
+// unless another traced operation made it. Spans other operations run inside,
+// like reading a history, are stamped with traceStamp and recorded with
+// traceSpan. traceFlush writes what is buffered.
+uint64_t traceBegin(Bank *bank);
+void traceEnd(Bank *bank, uint64_t began, TraceRecord *record);
+void traceOp(Bank *bank, uint64_t began, int op, int result, int account_number, int related, double amount,
+             int64_t arg);
+uint64_t traceStamp(Bank *bank);
+void traceSpan(Bank *bank, uint64_t began, TraceRecord *record);
+void traceFlush(Bank *bank);
+
+// Compaction hooks: record writes made while a copy runs, drop a compaction
+// still open at close, and settle one interrupted by a crash
+void compactMarkDirty(BankCompaction *compaction, long slot);
+void compactAbandon(Bank *bank);
+void compactRecover(Bank *bank);
+
+#endif
@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bank_journal.h"
+#include "bank_crc.h"
+
+#define UPGRADE_BATCH 4096   // records rewritten per read while upgrading a journal
+
+// Distinct across the journals of one machine, which is all replication needs
+static uint64_t newJournalId(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec) ^ ((uint64_t)getpid() << 40)) | 1;
+}
+
+static int writeHeader(BankStorage *storage, uint64_t id) {
+    JournalHeader header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.version = JOURNAL_VERSION;
+    header.id = id;
+    return storageJournalWrite(storage, &header, sizeof(header), 0);
+}
+
+void journalSeal(JournalRecord *record) {
+    record->checksum = 0;
+    record->checksum = crc32c(0, record, sizeof(*record));
+}
+
+int journalIntact(const JournalRecord *record) {
+    JournalRecord copy = *record;
+    journalSeal(&copy);
+    return copy.checksum == record->checksum;
+}
+
+// Version 1 records had four more description bytes where the checksum now
+// is: the description is cut to fit and each record sealed, in place, so
+// every LSN stays the same. Rerunning an interrupted upgrade is harmless.
+static int upgradeJournal(BankStorage *storage, uint64_t end, uint64_t id) {
+    JournalRecord *records = malloc(UPGRADE_BATCH * sizeof(JournalRecord));
+    int failed = records == NULL;
+
+    for (uint64_t at = sizeof(JournalHeader); at < end && !failed; at += UPGRADE_BATCH * sizeof(JournalRecord)) {
+        size_t len = end - at < UPGRADE_BATCH * sizeof(JournalRecord) ? (size_t)(end - at)
+                                                                       : UPGRADE_BATCH * sizeof(JournalRecord);
+        failed = storageJournalRead(storage, records, len, at) != len;
+        for (size_t i = 0; i < len / sizeof(JournalRecord) && !failed; i++) {
+            records[i].description[JOURNAL_DESCRIPTION_LENGTH - 1] = '\0';
+            journalSeal(&records[i]);
+        }
+        failed = failed || storageJournalWrite(storage, records, len, at) != 0;
+    }
+    free(records);
+    return failed || storageJournalSync(storage) != 0 || writeHeader(storage, id) != 0 ? -1 : 0;
+}
+
+static int openJournal(Journal *journal, BankStorage *storage) {
+    JournalHeader header;
+    uint64_t size = storageJournalSize(storage);
+
+    memset(journal, 0, sizeof(*journal));
+    if (size < sizeof(JournalHeader)) {
+        journal->id = newJournalId();
+        if (storageJournalTruncate(storage, 0) != 0 || writeHeader(storage, journal->id) != 0) {
+            return -1;
+        }
+        journal->storage = storage;
+        journal->end = sizeof(JournalHeader);
+        return 0;
+    }
+
+    if (storageJournalRead(storage, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != JOURNAL_MAGIC || header.version < 1 || header.version > JOURNAL_VERSION) {
+        return -1;
+    }
+
+    // Drop a record torn by a crash mid-append
+    uint64_t body = size - sizeof(JournalHeader);
+    journal->end = sizeof(JournalHeader) + body - body % sizeof(JournalRecord);
+    if (size != journal->end && storageJournalTruncate(storage, journal->end) != 0) {
+        return -1;
+    }
+
+    // Journals written before ids existed get one now
+    journal->id = header.id != 0 ? header.id : newJournalId();
+    if (header.version < JOURNAL_VERSION) {
+        if (upgradeJournal(storage, journal->end, journal->id) != 0) {
+            return -1;
+        }
+    } else if (header.id == 0 && writeHeader(storage, journal->id) != 0) {
+        return -1;
+    }
+    journal->storage = storage;
+    return 0;
+}
+
+// Under the append lock, so a tail being written by another process is not
+// mistaken for a torn one
+int journalOpen(Journal *journal, BankStorage *storage) {
+    int result;
+
+    if (storageLockJournal(storage, STORAGE_LOCK_EXCLUSIVE) != 0) {
+        return -1;
+    }
+    result = openJournal(journal, storage);
+    storageLockJournal(storage, STORAGE_UNLOCK);
+    return result;
+}
+
+void journalClose(Journal *journal) {
+    if (journal->storage != NULL) {
+        journalFlush(journal);
+    }
+    free(journal->pending);
+    memset(journal, 0, sizeof(*journal));
+}
+
+int journalAppend(Journal *journal, JournalRecord *record) {
+    if (journal->pending_len + sizeof(JournalRecord) > journal->pending_cap) {
+        size_t cap = journal->pending_cap ? journal->pending_cap * 2 : 64 * sizeof(JournalRecord);
+        unsigned char *grown = realloc(journal->pending, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        journal->pending = grown;
+        journal->pending_cap = cap;
+    }
+
+    record->lsn = journal->end + journal->pending_len;
+    journalSeal(record);
+    memcpy(journal->pending + journal->pending_len, record, sizeof(JournalRecord));
+    journal->pending_len += sizeof(JournalRecord);
+    return 0;
+}
+
+void journalDiscard(Journal *journal, size_t mark) {
+    if (mark < journal->pending_len) {
+        journal->pending_len = mark;
+    }
+}
+
+// Another process sharing the journal has appended since this one last
+// wrote: the batch moves to the new end, its records renumbered. A torn
+// record the other left behind is written over.
+static void followEnd(Journal *journal) {
+    uint64_t size = storageJournalSize(journal->storage);
+    uint64_t end;
+
+    if (size <= journal->end) {
+        return;
+    }
+    end = size - (size - sizeof(JournalHeader)) % sizeof(JournalRecord);
+    for (size_t offset = 0; offset < journal->pending_len; offset += sizeof(JournalRecord)) {
+        JournalRecord record;
+        memcpy(&record, journal->pending + offset, sizeof(record));
+        record.lsn = end + offset;
+        journalSeal(&record);
+        memcpy(journal->pending + offset, &record, sizeof(record));
+    }
+    journal->end = end;
+}
+
+int journalFlush(Journal *journal) {
+    int result = 0;
+
+    if (journal->pending_len == 0) {
+        return 0;
+    }
+    if (storageLockJournal(journal->storage, STORAGE_LOCK_EXCLUSIVE) != 0) {
+        return -1;
+    }
+    followEnd(journal);
+    if (storageJournalWrite(journal->storage, journal->pending, journal->pending_len, journal->end) != 0) {
+        result = -1;
+    } else {
+        journal->end += journal->pending_len;
+        if (journal->written != NULL) {
+            journal->written(journal->written_context, journal->pending, journal->pending_len / sizeof(JournalRecord));
+        }
+        journal->pending_len = 0;
+    }
+    storageLockJournal(journal->storage, STORAGE_UNLOCK);
+    return result;
+}
+
+int journalSync(Journal *journal) {
+    return storageJournalSync(journal->storage);
+}
+
+int journalReset(Journal *journal, uint64_t id) {
+    if (journal->pending_len != 0 || storageJournalTruncate(journal->storage, 0) != 0 ||
+        writeHeader(journal->storage, id) != 0) {
+        return -1;
+    }
+    journal->id = id;
+    journal->end = sizeof(JournalHeader);
+    return 0;
+}
+
+int journalCopy(Journal *journal, const void *records, size_t len) {
+    JournalRecord first;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (len % sizeof(JournalRecord) != 0) {
+        return -1;
+    }
+    memcpy(&first, records, sizeof(first));
+    if (journal->pending_len != 0 || first.lsn != journal->end ||
+        storageJournalWrite(journal->storage, records, len, journal->end) != 0) {
+        return -1;
+    }
+    journal->end += len;
+    if (journal->written != NULL) {
+        journal->written(journal->written_context, records, len / sizeof(JournalRecord));
+    }
+    return 0;
+}
+
+#define READER_BATCH 256   // records fetched per read
+
+int journalReaderOpen(JournalReader *reader, BankStorage *storage) {
+    memset(reader, 0, sizeof(*reader));
+    reader->offset = sizeof(JournalHeader);
+    reader->storage = storage;
+    reader->buffer = malloc(READER_BATCH * sizeof(JournalRecord));
+    return reader->buffer != NULL ? 0 : -1;
+}
+
+void journalReaderSeek(JournalReader *reader, uint64_t lsn) {
+    reader->offset = lsn < sizeof(JournalHeader) ? sizeof(JournalHeader) : lsn;
+    reader->buffered = 0;
+    reader->position = 0;
+}
+
+int journalReaderNext(JournalReader *reader, JournalRecord *record) {
+    for (;;) {
+        if (reader->position + sizeof(JournalRecord) > reader->buffered) {
+            size_t n = storageJournalRead(reader->storage, reader->buffer, READER_BATCH * sizeof(JournalRecord),
+                                          reader->offset);
+            if (n < sizeof(JournalRecord)) {
+                return 0;
+            }
+            reader->buffered = n - n % sizeof(JournalRecord);
+            reader->position = 0;
+        }
+
+        memcpy(record, reader->buffer + reader->position, sizeof(JournalRecord));
+        reader->position += sizeof(JournalRecord);
+        reader->offset += sizeof(JournalRecord);
+        if (!journalIntact(record)) {
+            reader->corrupt++;
+        } else if (!(record->flags & JOURNAL_VOID)) {
+            return 1;
+        }
+    }
+}
+
+void journalReaderClose(JournalReader *reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
@@ -0,0 +1,94 @@
+#ifndef BANK_JOURNAL_H
+#define BANK_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bank_storage.h"
+
+// Binary journal of every committed mutation. transactions.log stays the
+// human-readable audit trail; this file is what the core replays at startup.
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_MAGIC 0x4a4b4e42u   // "BNKJ"
+#define JOURNAL_VERSION 2         // 1: no checksums, upgraded in place when opened
+#define JOURNAL_DESCRIPTION_LENGTH 60
+#define JOURNAL_PREPARED 0x1       // record belongs to a cross-shard transfer leg
+#define JOURNAL_VOID 0x2           // found corrupt and blanked by an integrity check; readers skip it
+#define JOURNAL_RESULT_SHIFT 8     // flag bits 8-15: BankResult an aborted leg reports
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t id;                  // drawn at creation; a replica's copy carries its primary's
+} JournalHeader;
+
+// One journaled mutation. The LSN is the record's byte offset in the file,
+// so it is unique, monotonic and directly seekable. The checksum is a CRC32C
+// of the record with the checksum itself zero, set as the record is appended.
+typedef struct {
+    uint64_t lsn;
+    uint64_t idempotency_key;     // client-supplied retry key, 0 if none
+    int64_t timestamp;
+    double amount;
+    double balance_after;
+    int32_t account_number;
+    int32_t related_account;
+    int32_t type;                 // TransactionType
+    int32_t flags;                // JOURNAL_* bits
+    char description[JOURNAL_DESCRIPTION_LENGTH];
+    uint32_t checksum;
+} JournalRecord;
+
+typedef struct {
+    BankStorage *storage;         // engine holding the journal bytes, NULL when closed
+    uint64_t id;                  // from the header
+    uint64_t end;                 // LSN the next record will receive
+    unsigned char *pending;       // records of the open batch
+    size_t pending_len;
+    size_t pending_cap;
+    // Called with every batch just written, flushed or copied, before the
+    // journal lock is released; set after journalOpen
+    void (*written)(void *context, const void *records, size_t count);
+    void *written_context;
+} Journal;
+
+typedef struct {
+    BankStorage *storage;
+    uint64_t offset;              // LSN of the next record returned
+    unsigned char *buffer;
+    size_t buffered;
+    size_t position;
+    uint64_t corrupt;             // records skipped for failing their checksum
+} JournalReader;
+
+int journalOpen(Journal *journal, BankStorage *storage);
+void journalClose(Journal *journal);
+
+// Appends are buffered until journalFlush, which writes them with one call
+int journalAppend(Journal *journal, JournalRecord *record);
+int journalFlush(Journal *journal);
+
+// Drops the records appended since pending_len was `mark`, so a failed
+// operation leaves nothing for a later flush to write
+void journalDiscard(Journal *journal, size_t mark);
+
+// Forces flushed records to stable storage
+int journalSync(Journal *journal);
+
+void journalSeal(JournalRecord *record);
+int journalIntact(const JournalRecord *record);
+
+// Replication: a replica empties its journal under its primary's id, then
+// appends the primary's records verbatim, so every LSN means the same on
+// both. The copied records must start at the journal's end.
+int journalReset(Journal *journal, uint64_t id);
+int journalCopy(Journal *journal, const void *records, size_t len);
+
+// Sequential reader starting at the first record. Records that fail their
+// checksum, and void ones, are passed over.
+int journalReaderOpen(JournalReader *reader, BankStorage *storage);
+void journalReaderSeek(JournalReader *reader, uint64_t lsn);
+int journalReaderNext(JournalReader *reader, JournalRecord *record);
+void journalReaderClose(JournalReader *reader);
+
+#endif
@@ -0,0 +1,448 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bank_post.h"
+#include "bank_snapshot.h"
+#include "bank_internal.h"
+
+#define REDO_SLOTS (2 * POST_CHUNK_RECORDS)   // power of two, twice the chunk size
+
+// Progress of the current or last run, rewritten after every chunk
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    char run_id[POST_RUN_LENGTH];
+    int32_t kind;
+    int32_t done;
+    double amount;
+    uint64_t end_slot;            // accounts that existed when the run began
+    uint64_t next_slot;           // first slot not yet posted
+    uint64_t chunk_lsn;           // journal end when the chunk at next_slot began
+    uint64_t posted;
+    uint64_t skipped;
+    double total;
+} PostCheckpoint;
+
+// Postings of the interrupted chunk that reached the journal before the crash.
+// They are not posted again; an account whose record missed the write-back
+// takes the posting now, on top of whatever tellers did to it since.
+typedef struct {
+    int32_t account_number;
+    int32_t used;
+    double amount;
+    double balance_after;
+    int32_t touched;              // a later entry moved the balance
+    double touched_from;          // the balance that entry started from
+} RedoEntry;
+
+typedef struct {
+    Bank *bank;
+    const BankPosting *posting;
+    const RedoEntry *redo;        // NULL unless resuming
+    uint64_t run_key;
+    const char *datetime;
+    char description[JOURNAL_DESCRIPTION_LENGTH];
+    long first;                   // slot range of this task within the chunk
+    long last;
+    Account *records;
+    JournalRecord *entries;
+    size_t entry_count;
+    char *log;
+    size_t log_len;
+    size_t log_cap;
+    long posted;
+    long skipped;
+    double total;
+    int write_back;               // second phase: store the updated records
+    int failed;
+} PostTask;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t runKey(const char *run_id) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*run_id) {
+        h ^= (unsigned char)*run_id++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Idempotency key of one account's posting within a run
+static uint64_t postKey(uint64_t run_key, int account_number) {
+    uint64_t key = mix64(run_key ^ ((uint64_t)(uint32_t)account_number * 0x9e3779b97f4a7c15ULL));
+    return key != 0 ? key : 1;
+}
+
+static long redoIndex(const RedoEntry *redo, int account_number) {
+    size_t i = mix64((uint64_t)(uint32_t)account_number) & (REDO_SLOTS - 1);
+    while (redo[i].used) {
+        if (redo[i].account_number == account_number) {
+            return (long)i;
+        }
+        i = (i + 1) & (REDO_SLOTS - 1);
+    }
+    return -1;
+}
+
+static const RedoEntry *redoFind(const RedoEntry *redo, int account_number) {
+    long i = redoIndex(redo, account_number);
+    return i >= 0 ? &redo[i] : NULL;
+}
+
+// What an entry did to its account's balance
+static double balanceEffect(const JournalRecord *record) {
+    if (record->flags & JOURNAL_VOID) {
+        return 0.0;
+    }
+    switch (record->type) {
+        case TRANSACTION_DEPOSIT:
+        case TRANSACTION_TRANSFER_IN:
+        case TRANSACTION_INTEREST:
+        case TRANSACTION_TRANSFER_CANCELLED:
+            return record->amount;
+        case TRANSACTION_WITHDRAWAL:
+        case TRANSACTION_TRANSFER_OUT:
+        case TRANSACTION_FEE:
+            return -record->amount;
+        default:
+            return 0.0;
+    }
+}
+
+// Reads the journal from the interrupted chunk to its end: the chunk's
+// postings, and for each account the first entry after its posting that
+// moved the balance. Tellers can only have reached the chunk's records after
+// the crash released their locks, so that entry shows whether the record
+// had taken the posting: it started from the journaled balance if it had.
+static RedoEntry *loadRedo(Bank *bank, const PostCheckpoint *cp, TransactionType type) {
+    JournalReader reader;
+    JournalRecord record;
+    uint64_t run_key = runKey(cp->run_id);
+    size_t count = 0;
+    RedoEntry *redo = calloc(REDO_SLOTS, sizeof(RedoEntry));
+
+    if (redo == NULL || journalReaderOpen(&reader, &bank->storage) != 0) {
+        free(redo);
+        return NULL;
+    }
+    journalReaderSeek(&reader, cp->chunk_lsn);
+    while (journalReaderNext(&reader, &record)) {
+        if (record.type != (int32_t)type ||
+            record.idempotency_key != postKey(run_key, record.account_number)) {
+            double effect = balanceEffect(&record);
+            long i = count > 0 && effect != 0.0 ? redoIndex(redo, record.account_number) : -1;
+            if (i >= 0 && !redo[i].touched) {
+                redo[i].touched = 1;
+                redo[i].touched_from = record.balance_after - effect;
+            }
+            continue;
+        }
+        if (count == POST_CHUNK_RECORDS) {
+            continue;
+        }
+        size_t i = mix64((uint64_t)(uint32_t)record.account_number) & (REDO_SLOTS - 1);
+        while (redo[i].used && redo[i].account_number != record.account_number) {
+            i = (i + 1) & (REDO_SLOTS - 1);
+        }
+        count += !redo[i].used;
+        redo[i].used = 1;
+        redo[i].account_number = record.account_number;
+        redo[i].amount = record.amount;
+        redo[i].balance_after = record.balance_after;
+    }
+    journalReaderClose(&reader);
+    return redo;
+}
+
+// Applies the posting to one account; returns the amount, or 0 to skip it
+static double postingAmount(const BankPosting *posting, const Account *account) {
+    if (account->status != ACCOUNT_ACTIVE) {
+        return 0.0;
+    }
+    if (posting->kind == POST_INTEREST) {
+        // Percent of the balance, rounded to the cent
+        long long cents = (long long)(account->balance * posting->amount + 0.5);
+        return cents > 0 ? cents / 100.0 : 0.0;
+    }
+    return account->balance >= posting->amount ? posting->amount : 0.0;
+}
+
+static int appendLine(PostTask *task, const Account *account, TransactionType type, double amount) {
+    if (task->log_len + LOG_LINE_LENGTH > task->log_cap) {
+        size_t cap = task->log_cap ? task->log_cap * 2 : 64 * LOG_LINE_LENGTH;
+        char *grown = realloc(task->log, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        task->log = grown;
+        task->log_cap = cap;
+    }
+    task->log_len += bankFormatLogLine(task->log + task->log_len, task->log_cap - task->log_len,
+                                       task->datetime, account->account_number, type, amount,
+                                       account->balance, task->description);
+    return 0;
+}
+
+static void *postRange(void *arg) {
+    PostTask *task = arg;
+    size_t count = (size_t)(task->last - task->first);
+    TransactionType type = task->posting->kind == POST_INTEREST ? TRANSACTION_INTEREST : TRANSACTION_FEE;
+
+    if (task->write_back) {
+        task->failed = storagePut(&task->bank->storage, task->first, (long)count, task->records) != 0;
+        return NULL;
+    }
+
+    if (storageGet(&task->bank->storage, task->first, (long)count, task->records) != 0) {
+        task->failed = 1;
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        Account *account = &task->records[i];
+        const RedoEntry *done;
+
+        // A corrupt record is written back untouched, for bankadm fsck to find
+        if (!bankRecordValid(task->bank, account)) {
+            task->skipped++;
+            continue;
+        }
+
+        done = task->redo != NULL ? redoFind(task->redo, account->account_number) : NULL;
+        if (done != NULL) {
+            // Journaled before the interruption: not posted again. Untouched
+            // since, the record is set to the journaled balance; touched, it
+            // takes the posting only if the teller's entry started without it.
+            if (!done->touched) {
+                account->balance = done->balance_after;
+            } else if (done->touched_from - done->balance_after >= 0.005 ||
+                       done->balance_after - done->touched_from >= 0.005) {
+                account->balance += type == TRANSACTION_INTEREST ? done->amount : -done->amount;
+            }
+            bankSealRecord(account);
+            task->posted++;
+            task->total += done->amount;
+            continue;
+        }
+
+        double amount = postingAmount(task->posting, account);
+        if (amount <= 0.0) {
+            task->skipped++;
+            continue;
+        }
+        account->balance += type == TRANSACTION_INTEREST ? amount : -amount;
+        bankSealRecord(account);
+        bankFillJournalRecord(&task->entries[task->entry_count++], postKey(task->run_key, account->account_number),
+                              account->account_number, type, amount, account->balance, 0, task->description);
+        if (appendLine(task, account, type, amount) != 0) {
+            task->failed = 1;
+            return NULL;
+        }
+        task->posted++;
+        task->total += amount;
+    }
+    return NULL;
+}
+
+static int saveCheckpoint(int fd, const PostCheckpoint *cp) {
+    if (pwrite(fd, cp, sizeof(*cp), 0) != (ssize_t)sizeof(*cp) || fdatasync(fd) != 0) {
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+// Posts slots [first, last) with the work split across `threads` tasks
+static int postChunk(Bank *bank, const BankPosting *posting, PostCheckpoint *cp, const RedoEntry *redo,
+                     Account *records, JournalRecord *entries, int threads, long first, long last) {
+    PostTask tasks[BANK_MAX_THREADS];
+    char datetime[50];
+    long count = last - first;
+    int result = BANK_OK;
+
+    getCurrentDateTime(datetime);
+    memset(tasks, 0, sizeof(tasks));
+    for (int t = 0; t < threads; t++) {
+        PostTask *task = &tasks[t];
+        task->bank = bank;
+        task->posting = posting;
+        task->redo = redo;
+        task->run_key = runKey(cp->run_id);
+        task->datetime = datetime;
+        snprintf(task->description, sizeof(task->description), "%s %s",
+                 posting->kind == POST_INTEREST ? "Interest" : "Fee", cp->run_id);
+        task->first = first + count * t / threads;
+        task->last = first + count * (t + 1) / threads;
+        task->records = records + (task->first - first);
+        task->entries = entries + (task->first - first);
+    }
+    bankRunTasks(tasks, sizeof(PostTask), threads, postRange);
+
+    for (int t = 0; t < threads; t++) {
+        if (tasks[t].failed) {
+            result = BANK_ERR_IO;
+        }
+    }
+
+    // Write-ahead: the chunk's journal entries are durable before any balance
+    // changes, so a crash in between is repaired from the journal on resume
+    if (result == BANK_OK) {
+        bankBeginBatch(bank);
+        for (int t = 0; t < threads; t++) {
+            for (size_t i = 0; i < tasks[t].entry_count; i++) {
+                if (journalAppend(&bank->journal, &tasks[t].entries[i]) != 0) {
+                    result = BANK_ERR_IO;
+                }
+            }
+            bankAppendLog(bank, tasks[t].log, tasks[t].log_len);
+        }
+        if (bankCommitBatch(bank) != BANK_OK || journalSync(&bank->journal) != 0) {
+            result = BANK_ERR_IO;
+        }
+    }
+
+    if (result == BANK_OK) {
+        for (int t = 0; t < threads; t++) {
+            tasks[t].write_back = 1;
+        }
+        bankRunTasks(tasks, sizeof(PostTask), threads, postRange);
+        for (int t = 0; t < threads; t++) {
+            if (tasks[t].failed) {
+                result = BANK_ERR_IO;
+            }
+            cp->posted += (uint64_t)tasks[t].posted;
+            cp->skipped += (uint64_t)tasks[t].skipped;
+            cp->total += tasks[t].total;
+        }
+        if (result == BANK_OK && storageSync(&bank->storage) != 0) {
+            result = BANK_ERR_IO;
+        }
+    }
+
+    for (int t = 0; t < threads; t++) {
+        free(tasks[t].log);
+    }
+    return result;
+}
+
+int bankPostPending(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(POST_SUFFIX)];
+    PostCheckpoint cp;
+
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, POST_SUFFIX);
+    int fd = storageOpenSide(&bank->storage, path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    int pending = pread(fd, &cp, sizeof(cp), 0) == (ssize_t)sizeof(cp) && cp.magic == POST_MAGIC &&
+                  cp.version == POST_VERSION && !cp.done;
+    close(fd);
+    return pending;
+}
+
+int bankPostBatch(Bank *bank, const BankPosting *posting, BankPostStats *stats) {
+    char path[BANK_PATH_LENGTH + sizeof(POST_SUFFIX)];
+    PostCheckpoint cp;
+    RedoEntry *redo = NULL;
+    int fd, result = BANK_OK;
+
+    memset(stats, 0, sizeof(*stats));
+    if (posting->amount <= 0 || posting->run_id[0] == '\0' ||
+        (posting->kind != POST_INTEREST && posting->kind != POST_FEE)) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, POST_SUFFIX);
+    fd = storageOpenSide(&bank->storage, path, O_RDWR | O_CREAT);
+    if (fd < 0) {
+        return BANK_ERR_IO;
+    }
+
+    int have_checkpoint = pread(fd, &cp, sizeof(cp), 0) == (ssize_t)sizeof(cp) &&
+                          cp.magic == POST_MAGIC && cp.version == POST_VERSION;
+    int same_run = have_checkpoint && strncmp(cp.run_id, posting->run_id, POST_RUN_LENGTH) == 0;
+
+    if (same_run && (cp.kind != (int32_t)posting->kind || cp.amount != posting->amount)) {
+        result = BANK_ERR_INVALID_REQUEST;   // a run name always means the same posting
+    } else if (have_checkpoint && !same_run && !cp.done) {
+        result = BANK_ERR_INVALID_REQUEST;   // finish or discard the other run first
+    } else if (same_run && !cp.done) {
+        redo = loadRedo(bank, &cp, posting->kind == POST_INTEREST ? TRANSACTION_INTEREST : TRANSACTION_FEE);
+        if (redo == NULL) {
+            result = BANK_ERR_IO;
+        }
+    } else if (!same_run) {
+        memset(&cp, 0, sizeof(cp));
+        cp.magic = POST_MAGIC;
+        cp.version = POST_VERSION;
+        snprintf(cp.run_id, sizeof(cp.run_id), "%s", posting->run_id);
+        cp.kind = (int32_t)posting->kind;
+        cp.amount = posting->amount;
+        cp.end_slot = (uint64_t)bankRecordCount(bank);
+        cp.chunk_lsn = bank->journal.end;
+        result = saveCheckpoint(fd, &cp);
+    }
+
+    stats->first_slot = (long)cp.next_slot;
+    stats->already_done = result == BANK_OK && same_run && cp.done;
+
+    if (result == BANK_OK && !cp.done) {
+        int threads = bankThreadCount(posting->threads);
+        Account *records = malloc(POST_CHUNK_RECORDS * sizeof(Account));
+        JournalRecord *entries = malloc(POST_CHUNK_RECORDS * sizeof(JournalRecord));
+
+        if (records == NULL || entries == NULL) {
+            result = BANK_ERR_IO;
+        }
+        while (result == BANK_OK && cp.next_slot < cp.end_slot) {
+            long first = (long)cp.next_slot;
+            long last = cp.end_slot - cp.next_slot > POST_CHUNK_RECORDS ? first + POST_CHUNK_RECORDS
+                                                                       : (long)cp.end_slot;
+            // Tellers in other processes wait for the chunk, not the run
+            if (storageLockRecords(&bank->storage, first, last - first, STORAGE_LOCK_EXCLUSIVE) != 0) {
+                result = BANK_ERR_IO;
+                break;
+            }
+            // The chunk is one operation to snapshot readers
+            result = snapshotBeforeWrite(bank, first, last - first) != 0
+                   ? BANK_ERR_IO
+                   : postChunk(bank, posting, &cp, redo, records, entries,
+                               last - first < threads ? 1 : threads, first, last);
+            snapshotEndWrite(bank);
+            storageLockRecords(&bank->storage, first, last - first, STORAGE_UNLOCK);
+            if (result == BANK_OK) {
+                cp.next_slot = (uint64_t)last;
+                cp.chunk_lsn = bank->journal.end;
+                result = saveCheckpoint(fd, &cp);
+                stats->scanned += last - first;
+            }
+            // Only the chunk that was interrupted can have journaled postings
+            free(redo);
+            redo = NULL;
+        }
+        if (result == BANK_OK) {
+            cp.done = 1;
+            result = saveCheckpoint(fd, &cp);
+        }
+        free(records);
+        free(entries);
+    }
+
+    stats->posted = (long)cp.posted;
+    stats->skipped = (long)cp.skipped;
+    stats->total = cp.total;
+    free(redo);
+    close(fd);
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef BANK_POST_H
+#define BANK_POST_H
+
+#include "bank_core.h"
+
+// Batch posting of interest or a fee to every active account in one pass over
+// the store. The pass works in chunks; after each chunk a checkpoint beside
+// the store records how far the run got. A run interrupted part way resumes
+// from its checkpoint, and a run that finished is never applied twice.
+#define POST_SUFFIX ".posting"
+#define POST_MAGIC 0x54534f50u      // "POST"
+#define POST_VERSION 1
+#define POST_CHUNK_RECORDS 65536    // records posted between checkpoints
+#define POST_RUN_LENGTH 32
+
+typedef enum {
+    POST_INTEREST,
+    POST_FEE
+} PostKind;
+
+typedef struct {
+    PostKind kind;
+    double amount;                  // interest: percent of the balance; fee: flat charge
+    char run_id[POST_RUN_LENGTH];   // names the run, e.g. "2026-10-interest"
+    int threads;                    // 0 uses every CPU
+} BankPosting;
+
+typedef struct {
+    long scanned;                   // records examined by this call
+    long first_slot;                // > 0 when an interrupted run was resumed
+    long posted;                    // totals for the whole run so far
+    long skipped;                   // inactive, no interest due, or balance below the fee
+    double total;
+    int already_done;               // the run had completed before this call
+} BankPostStats;
+
+// Posts `posting` to every account that existed when the run first started.
+// Fails with BANK_ERR_INVALID_REQUEST while a different run is unfinished.
+int bankPostBatch(Bank *bank, const BankPosting *posting, BankPostStats *stats);
+
+// 1 while a run is unfinished; its checkpoint refers to record positions
+int bankPostPending(Bank *bank);
+
+#endif
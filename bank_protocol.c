@@ -0,0 +1,335 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank_protocol.h"
+#include "bank_shard.h"
+#include "bank_repl.h"
+
+// Little-endian field helpers; the wire format never depends on host layout
+static void putU32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t getU32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putU64(unsigned char *p, uint64_t v) {
+    putU32(p, (uint32_t)v);
+    putU32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t getU64(const unsigned char *p) {
+    return (uint64_t)getU32(p) | ((uint64_t)getU32(p + 4) << 32);
+}
+
+static void putF64(unsigned char *p, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    putU64(p, bits);
+}
+
+static double getF64(const unsigned char *p) {
+    uint64_t bits = getU64(p);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static size_t putString(unsigned char *p, const char *s, size_t max_length) {
+    size_t len = strlen(s);
+    if (len >= max_length) {
+        len = max_length - 1;
+    }
+    p[0] = (unsigned char)len;
+    memcpy(p + 1, s, len);
+    return len + 1;
+}
+
+static int getString(const unsigned char **p, const unsigned char *end, char *out, size_t max_length) {
+    if (*p >= end) {
+        return -1;
+    }
+    size_t len = **p;
+    if (len >= max_length || (size_t)(end - *p) < len + 1) {
+        return -1;
+    }
+    memcpy(out, *p + 1, len);
+    out[len] = '\0';
+    *p += len + 1;
+    return 0;
+}
+
+void bankBufferInit(BankBuffer *buf) {
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+void bankBufferFree(BankBuffer *buf) {
+    free(buf->data);
+    bankBufferInit(buf);
+}
+
+int bankBufferReserve(BankBuffer *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) {
+        return 0;
+    }
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap < buf->len + extra) {
+        cap *= 2;
+    }
+    unsigned char *data = realloc(buf->data, cap);
+    if (data == NULL) {
+        return -1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+void bankBufferConsume(BankBuffer *buf, size_t count) {
+    if (count >= buf->len) {
+        buf->len = 0;
+        return;
+    }
+    memmove(buf->data, buf->data + count, buf->len - count);
+    buf->len -= count;
+}
+
+// Request payload: op u8 (BANK_OP_BATCH in the top bit), tag u32, account i32,
+// related i32, amount f64, idempotency key u64, password str, then
+// name/email/phone strings for CREATE
+int bankEncodeRequest(BankBuffer *out, const BankRequest *req) {
+    if (bankBufferReserve(out, BANK_MAX_FRAME) != 0) {
+        return -1;
+    }
+
+    unsigned char *frame = out->data + out->len;
+    unsigned char *p = frame + BANK_FRAME_HEADER;
+
+    *p++ = (unsigned char)(req->op | (req->priority == BANK_PRIORITY_BATCH ? BANK_OP_BATCH : 0));
+    putU32(p, req->tag); p += 4;
+    putU32(p, (uint32_t)req->account_number); p += 4;
+    putU32(p, (uint32_t)req->related_account); p += 4;
+    putF64(p, req->amount); p += 8;
+    putU64(p, req->idempotency_key); p += 8;
+    p += putString(p, req->password, sizeof(req->password));
+    if (req->op == BANK_OP_CREATE) {
+        p += putString(p, req->name, sizeof(req->name));
+        p += putString(p, req->email, sizeof(req->email));
+        p += putString(p, req->phone, sizeof(req->phone));
+    }
+
+    putU32(frame, (uint32_t)(p - frame - BANK_FRAME_HEADER));
+    out->len += (size_t)(p - frame);
+    return 0;
+}
+
+int bankDecodeRequest(const unsigned char *data, size_t len, BankRequest *req, size_t *consumed) {
+    if (len < BANK_FRAME_HEADER) {
+        return 0;
+    }
+    uint32_t size = getU32(data);
+    if (size < 29 || size > BANK_MAX_FRAME) {
+        return -1;
+    }
+    if (len < BANK_FRAME_HEADER + size) {
+        return 0;
+    }
+
+    const unsigned char *p = data + BANK_FRAME_HEADER;
+    const unsigned char *end = p + size;
+
+    memset(req, 0, sizeof(*req));
+    req->op = *p & ~BANK_OP_BATCH;
+    req->priority = *p++ & BANK_OP_BATCH ? BANK_PRIORITY_BATCH : BANK_PRIORITY_INTERACTIVE;
+    req->tag = getU32(p); p += 4;
+    req->account_number = (int32_t)getU32(p); p += 4;
+    req->related_account = (int32_t)getU32(p); p += 4;
+    req->amount = getF64(p); p += 8;
+    req->idempotency_key = getU64(p); p += 8;
+    if (getString(&p, end, req->password, sizeof(req->password)) != 0) {
+        return -1;
+    }
+    if (req->op == BANK_OP_CREATE &&
+        (getString(&p, end, req->name, sizeof(req->name)) != 0 ||
+         getString(&p, end, req->email, sizeof(req->email)) != 0 ||
+         getString(&p, end, req->phone, sizeof(req->phone)) != 0)) {
+        return -1;
+    }
+
+    *consumed = BANK_FRAME_HEADER + size;
+    return 1;
+}
+
+// Response payload: status u8, tag u32, account i32, balance f64
+#define RESPONSE_SIZE 17
+
+int bankEncodeResponse(BankBuffer *out, const BankResponse *resp) {
+    if (bankBufferReserve(out, BANK_FRAME_HEADER + RESPONSE_SIZE) != 0) {
+        return -1;
+    }
+
+    unsigned char *p = out->data + out->len;
+    putU32(p, RESPONSE_SIZE); p += 4;
+    *p++ = resp->status;
+    putU32(p, resp->tag); p += 4;
+    putU32(p, (uint32_t)resp->account_number); p += 4;
+    putF64(p, resp->balance);
+
+    out->len += BANK_FRAME_HEADER + RESPONSE_SIZE;
+    return 0;
+}
+
+int bankDecodeResponse(const unsigned char *data, size_t len, BankResponse *resp, size_t *consumed) {
+    if (len < BANK_FRAME_HEADER) {
+        return 0;
+    }
+    uint32_t size = getU32(data);
+    if (size != RESPONSE_SIZE) {
+        return -1;
+    }
+    if (len < BANK_FRAME_HEADER + size) {
+        return 0;
+    }
+
+    const unsigned char *p = data + BANK_FRAME_HEADER;
+    resp->status = *p++;
+    resp->tag = getU32(p); p += 4;
+    resp->account_number = (int32_t)getU32(p); p += 4;
+    resp->balance = getF64(p);
+
+    *consumed = BANK_FRAME_HEADER + size;
+    return 1;
+}
+
+void bankExecuteRequest(Bank *bank, const BankRequest *req, BankResponse *resp) {
+    Account account;
+    int result;
+
+    resp->tag = req->tag;
+    resp->account_number = req->account_number;
+    resp->balance = 0.0;
+    account.balance = 0.0;
+
+    if (bank->read_only && req->op != BANK_OP_PING && req->op != BANK_OP_BALANCE &&
+        req->op != BANK_OP_REPLICA_STATUS) {
+        resp->status = BANK_ERR_READ_ONLY;
+        return;
+    }
+
+    // Every operation on an existing account is authorised by its password
+    if (req->op == BANK_OP_PREPARE_CREDIT || req->op == BANK_OP_RESOLVE) {
+        result = bankAuthenticateAdmin(req->password);
+    } else if (req->op != BANK_OP_PING && req->op != BANK_OP_CREATE && req->op != BANK_OP_REPLICA_STATUS) {
+        result = bankAuthenticate(bank, req->account_number, req->password);
+    } else {
+        result = BANK_OK;
+    }
+    if (result != BANK_OK) {
+        resp->status = (uint8_t)result;
+        return;
+    }
+
+    switch (req->op) {
+        case BANK_OP_PING:
+            result = BANK_OK;
+            break;
+        case BANK_OP_CREATE:
+            result = bankCreateAccount(bank, req->name, req->email, req->phone, req->password, &account);
+            if (result == BANK_OK) {
+                resp->account_number = account.account_number;
+            }
+            break;
+        case BANK_OP_BALANCE:
+            result = bankFindAccount(bank, req->account_number, &account);
+            break;
+        case BANK_OP_DEPOSIT:
+            result = bankDepositKeyed(bank, req->idempotency_key, req->account_number, req->amount, &account);
+            break;
+        case BANK_OP_WITHDRAW:
+            result = bankWithdrawKeyed(bank, req->idempotency_key, req->account_number, req->amount, &account);
+            break;
+        case BANK_OP_TRANSFER:
+            result = bankTransferKeyed(bank, req->idempotency_key, req->account_number,
+                                       req->related_account, req->amount, &account, NULL);
+            break;
+        case BANK_OP_PREPARE_DEBIT:
+            result = bankPrepareDebit(bank, req->idempotency_key, req->account_number,
+                                      req->related_account, req->amount, &account);
+            break;
+        case BANK_OP_PREPARE_CREDIT:
+            result = bankPrepareCredit(bank, req->idempotency_key, req->account_number,
+                                       req->related_account, req->amount);
+            break;
+        case BANK_OP_RESOLVE:
+            result = bankResolveTransfer(bank, req->idempotency_key, req->related_account, &account);
+            break;
+        case BANK_OP_REPLICA_STATUS: {
+            BankReplicaStatus status;
+            uint64_t behind;
+
+            if (!bank->read_only) {
+                result = BANK_ERR_INVALID_REQUEST;
+                break;
+            }
+            bankReplicaStatus(bank, &status);
+            behind = status.primary_lsn > status.applied_lsn
+                         ? (status.primary_lsn - status.applied_lsn) / sizeof(JournalRecord) : 0;
+            resp->account_number = behind > INT32_MAX ? INT32_MAX : (int32_t)behind;
+            account.balance = status.lag_seconds;
+            result = BANK_OK;
+            break;
+        }
+        default:
+            result = BANK_ERR_INVALID_REQUEST;
+            break;
+    }
+
+    resp->status = (uint8_t)result;
+    if (result == BANK_OK && req->op != BANK_OP_PING) {
+        resp->balance = account.balance;
+    }
+}
+
+// A batch that failed to commit may not have kept what its replies report
+// done, so those replies report BANK_ERR_IO instead
+static void failReplies(BankBuffer *out, size_t from) {
+    for (size_t off = from; off + BANK_FRAME_HEADER + RESPONSE_SIZE <= out->len;
+         off += BANK_FRAME_HEADER + RESPONSE_SIZE) {
+        if (out->data[off + BANK_FRAME_HEADER] == BANK_OK) {
+            out->data[off + BANK_FRAME_HEADER] = BANK_ERR_IO;
+        }
+    }
+}
+
+int bankServeBatch(Bank *bank, const unsigned char *in, size_t len, size_t *consumed,
+                   BankBuffer *out) {
+    BankRequest req;
+    BankResponse resp;
+    size_t offset = 0, used;
+    size_t replies = out->len;
+    int served = 0;
+    int rc;
+
+    bankBeginBatch(bank);
+    while ((rc = bankDecodeRequest(in + offset, len - offset, &req, &used)) == 1) {
+        bankExecuteRequest(bank, &req, &resp);
+        if (bankEncodeResponse(out, &resp) != 0) {
+            rc = -1;
+            break;
+        }
+        offset += used;
+        served++;
+    }
+    if (bankCommitBatch(bank) != BANK_OK) {
+        failReplies(out, replies);
+    }
+
+    *consumed = offset;
+    return rc < 0 ? -1 : served;
+}
@@ -0,0 +1,97 @@
+#ifndef BANK_PROTOCOL_H
+#define BANK_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Wire format: every frame is a 4-byte little-endian payload length followed
+// by the payload. Clients may pipeline any number of requests; replies carry
+// the request tag so they can be matched without waiting on each one.
+#define BANK_FRAME_HEADER 4
+#define BANK_MAX_FRAME 1024
+
+// Request opcodes
+typedef enum {
+    BANK_OP_PING = 0,
+    BANK_OP_CREATE = 1,
+    BANK_OP_BALANCE = 2,
+    BANK_OP_DEPOSIT = 3,
+    BANK_OP_WITHDRAW = 4,
+    BANK_OP_TRANSFER = 5,
+    // Steps of a cross-shard transfer, sent by the router to the shards
+    // (see bank_shard.h); the transaction id travels as the idempotency key
+    BANK_OP_PREPARE_DEBIT = 6,
+    BANK_OP_PREPARE_CREDIT = 7,
+    BANK_OP_RESOLVE = 8,
+    // Replication lag of a replica (see bank_repl.h): the reply's balance is
+    // the lag in seconds, its account number the journal records still to apply
+    BANK_OP_REPLICA_STATUS = 9
+} BankOpcode;
+
+// Set in the opcode byte of a request that may wait behind interactive ones
+// (see bank_admit.h); decoded into BankRequest.priority
+#define BANK_OP_BATCH 0x80
+
+typedef enum {
+    BANK_PRIORITY_INTERACTIVE = 0,   // tellers and customers
+    BANK_PRIORITY_BATCH = 1          // uploads and other bulk work
+} BankPriority;
+
+// Decoded request
+typedef struct {
+    uint8_t op;
+    uint8_t priority;          // BankPriority
+    uint32_t tag;
+    int32_t account_number;
+    int32_t related_account;   // recipient for transfers, payer for PREPARE_CREDIT,
+                               // BankResult deciding a RESOLVE
+    double amount;
+    uint64_t idempotency_key;  // non-zero makes a mutation safe to retry
+    char password[PASSWORD_LENGTH];
+    char name[MAX_NAME_LENGTH];    // CREATE only
+    char email[MAX_NAME_LENGTH];   // CREATE only
+    char phone[PHONE_LENGTH];      // CREATE only
+} BankRequest;
+
+// Decoded response
+typedef struct {
+    uint32_t tag;
+    uint8_t status;            // BankResult
+    int32_t account_number;
+    double balance;
+} BankResponse;
+
+// Growable byte buffer used for coalescing frames
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} BankBuffer;
+
+void bankBufferInit(BankBuffer *buf);
+void bankBufferFree(BankBuffer *buf);
+int bankBufferReserve(BankBuffer *buf, size_t extra);
+void bankBufferConsume(BankBuffer *buf, size_t count);
+
+// Encoding appends one complete frame to the buffer; decoding returns 1 when a
+// frame was decoded, 0 when more bytes are needed and -1 on a malformed frame.
+int bankEncodeRequest(BankBuffer *out, const BankRequest *req);
+int bankDecodeRequest(const unsigned char *data, size_t len, BankRequest *req, size_t *consumed);
+int bankEncodeResponse(BankBuffer *out, const BankResponse *resp);
+int bankDecodeResponse(const unsigned char *data, size_t len, BankResponse *resp, size_t *consumed);
+
+// Executes one decoded request against the store. Cross-shard steps other
+// than the debit are authorised by the admin password, not an account's.
+// A replica answers pings, balances and its status, and refuses the rest.
+void bankExecuteRequest(Bank *bank, const BankRequest *req, BankResponse *resp);
+
+// Executes every complete frame in `in` as one batch, appending all replies
+// to `out`. Returns the number of requests served or -1 on a malformed frame;
+// `consumed` is set to the bytes of `in` that were used. If the batch fails to
+// commit, replies that reported success report BANK_ERR_IO.
+int bankServeBatch(Bank *bank, const unsigned char *in, size_t len, size_t *consumed,
+                   BankBuffer *out);
+
+#endif
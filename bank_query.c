@@ -0,0 +1,302 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bank_query.h"
+#include "bank_internal.h"
+
+// Candidates carry only their position; the page's records are read at the end
+typedef struct {
+    double key;
+    long slot;
+} QueryRow;
+
+typedef struct {
+    BankSnapshot *snapshot;
+    const BankQuery *query;
+    const BankQueryCursor *cursor;
+    long first;                     // slots [first, last)
+    long last;
+    QueryRow *heap;                 // the best `max` so far, worst at the root
+    Account *page;                  // records being scanned
+    int size;
+    int max;
+    BankQueryStats stats;
+    int failed;
+} QueryTask;
+
+void bankQueryInit(BankQuery *query) {
+    memset(query, 0, sizeof(*query));
+    query->min_balance = -DBL_MAX;
+    query->max_balance = DBL_MAX;
+    query->accessed_from = INT64_MIN;
+    query->accessed_to = INT64_MAX;
+    query->order = QUERY_ORDER_STORE;
+}
+
+static unsigned statusBit(AccountStatus status) {
+    switch (status) {
+        case ACCOUNT_ACTIVE: return QUERY_ACTIVE;
+        case ACCOUNT_SUSPENDED: return QUERY_SUSPENDED;
+        case ACCOUNT_CLOSED: return QUERY_CLOSED;
+    }
+    return 0;
+}
+
+static int matches(const BankQuery *query, const Account *account) {
+    return (query->statuses == 0 || (query->statuses & statusBit(account->status)) != 0) &&
+           account->balance >= query->min_balance && account->balance <= query->max_balance &&
+           (int64_t)account->last_accessed >= query->accessed_from &&
+           (int64_t)account->last_accessed <= query->accessed_to;
+}
+
+static double sortKey(const BankQuery *query, const Account *account, long slot) {
+    switch (query->order) {
+        case QUERY_ORDER_BALANCE: return account->balance;
+        case QUERY_ORDER_CREATED: return (double)account->created_date;
+        case QUERY_ORDER_STORE: break;
+    }
+    return (double)slot;
+}
+
+// Whether (key_a, slot_a) is listed before (key_b, slot_b); slots break ties
+static int listedBefore(const BankQuery *query, double key_a, long slot_a, double key_b, long slot_b) {
+    if (key_a != key_b) {
+        return query->descending ? key_a > key_b : key_a < key_b;
+    }
+    return slot_a < slot_b;
+}
+
+static int rowBefore(const BankQuery *query, const QueryRow *a, const QueryRow *b) {
+    return listedBefore(query, a->key, a->slot, b->key, b->slot);
+}
+
+static void siftDown(const BankQuery *query, QueryRow *heap, int size, int i) {
+    for (;;) {
+        int worst = i, left = 2 * i + 1, right = left + 1;
+        if (left < size && rowBefore(query, &heap[worst], &heap[left])) {
+            worst = left;
+        }
+        if (right < size && rowBefore(query, &heap[worst], &heap[right])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        QueryRow swap = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = swap;
+        i = worst;
+    }
+}
+
+static void offer(QueryTask *task, double key, long slot) {
+    const BankQuery *query = task->query;
+    QueryRow *heap = task->heap;
+
+    if (task->size < task->max) {
+        int i = task->size++;
+        heap[i] = (QueryRow){ key, slot };
+        while (i > 0 && rowBefore(query, &heap[(i - 1) / 2], &heap[i])) {
+            QueryRow swap = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = swap;
+            i = (i - 1) / 2;
+        }
+    } else if (listedBefore(query, key, slot, heap[0].key, heap[0].slot)) {
+        heap[0] = (QueryRow){ key, slot };
+        siftDown(query, heap, task->size, 0);
+    }
+}
+
+static void *scanRange(void *arg) {
+    QueryTask *task = arg;
+    const BankQuery *query = task->query;
+    const BankQueryCursor *cursor = task->cursor;
+    Account *page = task->page;
+
+    for (long slot = task->first; slot < task->last; slot += QUERY_CHUNK_RECORDS) {
+        long n = task->last - slot < QUERY_CHUNK_RECORDS ? task->last - slot : QUERY_CHUNK_RECORDS;
+        if (bankSnapshotRead(task->snapshot, slot, n, page) != BANK_OK) {
+            task->failed = 1;
+            break;
+        }
+        task->stats.scanned += n;
+        for (long i = 0; i < n; i++) {
+            const Account *account = &page[i];
+            if (!matches(query, account)) {
+                continue;
+            }
+            if (!bankRecordValid(task->snapshot->bank, account)) {
+                task->stats.corrupt++;
+                continue;
+            }
+            task->stats.matched++;
+            task->stats.matched_balance += account->balance;
+
+            double key = sortKey(query, account, slot + i);
+            if (!cursor->started || listedBefore(query, cursor->key, cursor->slot, key, slot + i)) {
+                offer(task, key, slot + i);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Store order, ascending: read from the cursor on until the page is full
+static int listInStoreOrder(BankSnapshot *snapshot, const BankQuery *query, BankQueryCursor *cursor,
+                            Account *rows, int max, BankQueryStats *stats) {
+    long count = snapshot->count;
+    Account *page = arenaAlloc(&snapshot->bank->scratch, QUERY_CHUNK_RECORDS * sizeof(Account));
+    long slot = cursor->started ? cursor->slot + 1 : 0;
+    int from_start = slot == 0;
+    int found = 0;
+
+    if (page == NULL) {
+        return -1;
+    }
+    while (slot < count && found < max) {
+        long n = count - slot < QUERY_CHUNK_RECORDS ? count - slot : QUERY_CHUNK_RECORDS;
+        if (bankSnapshotRead(snapshot, slot, n, page) != BANK_OK) {
+            return -1;
+        }
+        long i = 0;
+        for (; i < n && found < max; i++) {
+            if (!matches(query, &page[i])) {
+                continue;
+            }
+            if (!bankRecordValid(snapshot->bank, &page[i])) {
+                stats->corrupt++;
+                continue;
+            }
+            stats->matched++;
+            stats->matched_balance += page[i].balance;
+            rows[found++] = page[i];
+            cursor->started = 1;
+            cursor->key = (double)(slot + i);
+            cursor->slot = slot + i;
+        }
+        stats->scanned += i;
+        slot += i;
+    }
+    stats->complete = from_start && slot >= count;
+    return found;
+}
+
+static int listSorted(BankSnapshot *snapshot, const BankQuery *query, BankQueryCursor *cursor, Account *rows,
+                      int max, BankQueryStats *stats) {
+    BankArena *scratch = &snapshot->bank->scratch;
+    QueryTask tasks[BANK_MAX_THREADS];
+    long count = snapshot->count;
+    int threads = count < QUERY_PARALLEL_MIN ? 1 : bankThreadCount(query->threads);
+    int failed = 0, total;
+
+    memset(tasks, 0, sizeof(tasks));
+    for (int t = 0; t < threads; t++) {
+        tasks[t].snapshot = snapshot;
+        tasks[t].query = query;
+        tasks[t].cursor = cursor;
+        tasks[t].first = count * t / threads;
+        tasks[t].last = count * (t + 1) / threads;
+        tasks[t].max = max;
+        // Carved out here: the arena is not for the scanning threads to touch
+        tasks[t].heap = arenaAlloc(scratch, (size_t)max * sizeof(QueryRow));
+        tasks[t].page = arenaAlloc(scratch, QUERY_CHUNK_RECORDS * sizeof(Account));
+        failed |= tasks[t].heap == NULL || tasks[t].page == NULL;
+    }
+    if (!failed) {
+        bankRunTasks(tasks, sizeof(QueryTask), threads, scanRange);
+    }
+
+    // Each thread's best `max`, together, hold the overall best `max`: fold
+    // them into one heap, then empty it worst first from the back of the page
+    QueryTask merged = { .query = query, .max = max };
+    merged.heap = arenaAlloc(scratch, (size_t)max * sizeof(QueryRow));
+    failed |= merged.heap == NULL;
+    for (int t = 0; t < threads; t++) {
+        failed |= tasks[t].failed;
+        for (int i = 0; i < tasks[t].size && !failed; i++) {
+            offer(&merged, tasks[t].heap[i].key, tasks[t].heap[i].slot);
+        }
+        stats->scanned += tasks[t].stats.scanned;
+        stats->matched += tasks[t].stats.matched;
+        stats->matched_balance += tasks[t].stats.matched_balance;
+        stats->corrupt += tasks[t].stats.corrupt;
+    }
+
+    total = failed ? 0 : merged.size;
+    QueryRow last = total > 0 ? merged.heap[0] : (QueryRow){ 0.0, 0 };
+    for (int i = total - 1; i >= 0 && !failed; i--) {
+        failed = bankSnapshotRead(snapshot, merged.heap[0].slot, 1, &rows[i]) != BANK_OK;
+        merged.heap[0] = merged.heap[--merged.size];
+        siftDown(query, merged.heap, merged.size, 0);
+    }
+    if (failed) {
+        return -1;
+    }
+    if (total > 0) {
+        cursor->started = 1;
+        cursor->key = last.key;
+        cursor->slot = last.slot;
+    }
+    stats->complete = 1;
+    return total;
+}
+
+// Scan pages and heaps come from the bank's scratch arena and are given
+// back when the page is built
+static int runQuery(Bank *bank, const BankQuery *query, BankQueryCursor *cursor, Account *rows, int max,
+                    BankQueryStats *stats) {
+    ArenaMark mark = arenaMark(&bank->scratch);
+    BankSnapshot snapshot;
+    int found;
+
+    memset(stats, 0, sizeof(*stats));
+    if (max <= 0) {
+        return 0;
+    }
+    if (max > QUERY_PAGE_MAX) {
+        max = QUERY_PAGE_MAX;
+    }
+
+    // The page and its totals come from one snapshot, so a transfer under
+    // way is counted on neither side or on both
+    if (bankSnapshotOpen(bank, &snapshot) != BANK_OK) {
+        return -1;
+    }
+    if (query->order == QUERY_ORDER_STORE && !query->descending) {
+        found = listInStoreOrder(&snapshot, query, cursor, rows, max, stats);
+    } else {
+        found = listSorted(&snapshot, query, cursor, rows, max, stats);
+    }
+    bankSnapshotClose(&snapshot);
+    arenaRewind(&bank->scratch, mark);
+    return found;
+}
+
+int bankQuery(Bank *bank, const BankQuery *query, BankQueryCursor *cursor, Account *rows, int max,
+              BankQueryStats *stats) {
+    uint64_t began = traceBegin(bank);
+    int next_page = cursor->started;
+    int found = runQuery(bank, query, cursor, rows, max, stats);
+    TraceRecord record;
+
+    if (began != 0) {
+        memset(&record, 0, sizeof(record));
+        record.op = TRACE_QUERY;
+        record.related = (int32_t)(query->statuses | (unsigned)query->order << TRACE_QUERY_ORDER_SHIFT |
+                                   (query->descending ? TRACE_QUERY_DESCENDING : 0) |
+                                   (next_page ? TRACE_QUERY_NEXT_PAGE : 0) |
+                                   (unsigned)query->threads << TRACE_QUERY_THREADS_SHIFT);
+        record.count = max;
+        record.amount = query->min_balance;
+        record.limit = query->max_balance;
+        record.arg = query->accessed_to != INT64_MAX ? (int64_t)time(NULL) - query->accessed_to : 0;
+        record.result = found;
+        traceEnd(bank, began, &record);
+    }
+    return found;
+}
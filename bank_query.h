@@ -0,0 +1,68 @@
+#ifndef BANK_QUERY_H
+#define BANK_QUERY_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Filtered, ordered listings of the store for administrators, one page at a
+// time. A page is the first `max` matching accounts that come after the
+// cursor in the requested order, so paging and top-K are the same query: the
+// store is read in parallel chunks and each thread keeps only its best `max`
+// candidates in a bounded heap, never the whole bank. Listing in store order
+// stops reading as soon as the page is full.
+//
+// Each page, with its totals, is read from one snapshot (bank_snapshot.h),
+// so operations under way are seen whole or not at all. Pages follow keyset
+// order (sort key, then slot), so an account changed between two pages may
+// move past the cursor or behind it.
+#define QUERY_PAGE_MAX 1000
+#define QUERY_CHUNK_RECORDS 4096       // records read at a time
+#define QUERY_PARALLEL_MIN 65536       // smaller stores are scanned on one thread
+
+// Status filter bits
+#define QUERY_ACTIVE 0x1
+#define QUERY_SUSPENDED 0x2
+#define QUERY_CLOSED 0x4
+
+typedef enum {
+    QUERY_ORDER_STORE,              // slot order, as the accounts were opened
+    QUERY_ORDER_BALANCE,
+    QUERY_ORDER_CREATED
+} QueryOrder;
+
+typedef struct {
+    unsigned statuses;              // QUERY_* bits, 0 for any status
+    double min_balance;             // inclusive bounds
+    double max_balance;
+    int64_t accessed_from;          // last_accessed bounds, inclusive
+    int64_t accessed_to;
+    QueryOrder order;
+    int descending;
+    int threads;                    // 0 uses every CPU
+} BankQuery;
+
+// Where the previous page ended; zeroed for the first page
+typedef struct {
+    int started;
+    double key;
+    long slot;
+} BankQueryCursor;
+
+typedef struct {
+    long scanned;                   // records read
+    long matched;                   // of those, accounts passing the filters
+    double matched_balance;
+    long corrupt;                   // records skipped for failing their checksum
+    int complete;                   // the whole store was read, so matched counts every match
+} BankQueryStats;
+
+// No filters, store order
+void bankQueryInit(BankQuery *query);
+
+// Fills up to `max` (at most QUERY_PAGE_MAX) accounts and moves the cursor
+// past the last one. Returns the number filled, or -1 on a read error.
+int bankQuery(Bank *bank, const BankQuery *query, BankQueryCursor *cursor, Account *rows, int max,
+              BankQueryStats *stats);
+
+#endif
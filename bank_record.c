@@ -0,0 +1,197 @@
+#include <string.h>
+
+#include "bank_record.h"
+#include "bank_crc.h"
+
+// ---- encoding ----
+
+static unsigned char *putVarint(unsigned char *p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    return p;
+}
+
+static unsigned char *putSigned(unsigned char *p, int64_t value) {
+    return putVarint(p, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static unsigned char *putString(unsigned char *p, const char *text, size_t size) {
+    size_t len = 0;
+    while (len < size - 1 && text[len] != '\0') {
+        len++;
+    }
+    p = putVarint(p, len);
+    memcpy(p, text, len);
+    return p + len;
+}
+
+static unsigned char *putFixed(unsigned char *p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        *p++ = (unsigned char)(value >> (8 * i));
+    }
+    return p;
+}
+
+static int hexDigit(char c) {
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Whether the hash is 64 lowercase hex digits, as simple_hash writes it
+static int digestHash(const char *hash) {
+    for (int i = 0; i < 2 * RECORD_DIGEST_BYTES; i++) {
+        if (hexDigit(hash[i]) < 0) {
+            return 0;
+        }
+    }
+    return hash[2 * RECORD_DIGEST_BYTES] == '\0';
+}
+
+size_t recordEncode(const Account *account, unsigned char *out) {
+    unsigned char flags = 0;
+    unsigned char *p = out + 1;
+    uint64_t balance;
+
+    if (account->checksum != 0) {
+        flags |= RECORD_SEALED;
+        if (!bankRecordIntact(account)) {
+            flags |= RECORD_DAMAGED;
+        }
+    }
+    p = putSigned(p, account->account_number);
+    p = putString(p, account->name, sizeof(account->name));
+    p = putString(p, account->email, sizeof(account->email));
+    p = putString(p, account->phone, sizeof(account->phone));
+    memcpy(&balance, &account->balance, sizeof(balance));
+    p = putFixed(p, balance, 8);
+    if (digestHash(account->password_hash)) {
+        flags |= RECORD_RAW_HASH;
+        for (int i = 0; i < RECORD_DIGEST_BYTES; i++) {
+            *p++ = (unsigned char)(hexDigit(account->password_hash[2 * i]) << 4 |
+                                   hexDigit(account->password_hash[2 * i + 1]));
+        }
+    } else {
+        p = putString(p, account->password_hash, sizeof(account->password_hash));
+    }
+    p = putSigned(p, account->status);
+    p = putSigned(p, (int64_t)account->created_date);
+    p = putSigned(p, (int64_t)account->last_accessed);
+    p = putSigned(p, account->failed_login_attempts);
+    out[0] = flags;
+    return (size_t)(putFixed(p, crc32c(0, out, (size_t)(p - out)), 4) - out);
+}
+
+// ---- decoding ----
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    int bad;
+} RecordReader;
+
+static uint64_t getVarint(RecordReader *r) {
+    uint64_t value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->p >= r->end) {
+            break;
+        }
+        unsigned char byte = *r->p++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    r->bad = 1;
+    return 0;
+}
+
+static int64_t getSigned(RecordReader *r) {
+    uint64_t value = getVarint(r);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint64_t getFixed(RecordReader *r, int bytes) {
+    uint64_t value = 0;
+
+    if (r->end - r->p < bytes) {
+        r->bad = 1;
+        return 0;
+    }
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)*r->p++ << (8 * i);
+    }
+    return value;
+}
+
+static void getString(RecordReader *r, char *text, size_t size) {
+    uint64_t len = getVarint(r);
+
+    if (len > (uint64_t)(r->end - r->p)) {
+        r->bad = 1;
+        return;
+    }
+    memcpy(text, r->p, len < size - 1 ? (size_t)len : size - 1);
+    r->p += len;
+    r->bad |= len > size - 1;
+}
+
+int recordDecode(const unsigned char *in, size_t len, Account *account) {
+    static const char hex[] = "0123456789abcdef";
+    RecordReader r = { in + 1, len >= 5 ? in + len - 4 : in + 1, len < 5 };
+    unsigned char flags = len > 0 ? in[0] : 0;
+    uint64_t balance;
+
+    memset(account, 0, sizeof(*account));
+    if (!r.bad) {
+        r.bad = crc32c(0, in, len - 4) != (uint32_t)(in[len - 4] | in[len - 3] << 8 | in[len - 2] << 16 |
+                                                     (uint32_t)in[len - 1] << 24);
+    }
+    account->account_number = (int)getSigned(&r);
+    getString(&r, account->name, sizeof(account->name));
+    getString(&r, account->email, sizeof(account->email));
+    getString(&r, account->phone, sizeof(account->phone));
+    balance = getFixed(&r, 8);
+    memcpy(&account->balance, &balance, sizeof(balance));
+    if (flags & RECORD_RAW_HASH) {
+        for (int i = 0; i < RECORD_DIGEST_BYTES && !r.bad; i++) {
+            unsigned byte = (unsigned)getFixed(&r, 1);
+            account->password_hash[2 * i] = hex[byte >> 4];
+            account->password_hash[2 * i + 1] = hex[byte & 0xf];
+        }
+    } else {
+        getString(&r, account->password_hash, sizeof(account->password_hash));
+    }
+    account->status = (AccountStatus)getSigned(&r);
+    account->created_date = (time_t)getSigned(&r);
+    account->last_accessed = (time_t)getSigned(&r);
+    account->failed_login_attempts = (int)getSigned(&r);
+    r.bad |= r.p != r.end;
+
+    if (r.bad || (flags & RECORD_DAMAGED)) {
+        // Sealed, then spoiled, so bankRecordIntact rejects it
+        bankSealRecord(account);
+        account->checksum = account->checksum == 1 ? 2 : account->checksum ^ 1;
+        return -1;
+    }
+    if (flags & RECORD_SEALED) {
+        bankSealRecord(account);
+    }
+    return 0;
+}
+
+static size_t encodeAccount(const void *record, unsigned char *out) {
+    return recordEncode(record, out);
+}
+
+static int decodeAccount(const unsigned char *in, size_t len, void *record) {
+    return recordDecode(in, len, record);
+}
+
+static const StorageCodec account_codec = { RECORD_MAX_ENCODED, encodeAccount, decodeAccount };
+
+const StorageCodec *bankRecordCodec(void) {
+    return &account_codec;
+}
@@ -0,0 +1,48 @@
+#ifndef BANK_RECORD_H
+#define BANK_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Portable encoding of an account record, used by the compact storage engine
+// (see bank_storage.h). Fields are written one by one in a fixed order, so
+// the bytes do not depend on the compiler's struct layout or the machine's
+// byte order:
+//
+//   flags            1 byte, RECORD_*
+//   account_number   zigzag varint
+//   name, email,     varint length, then the bytes
+//   phone
+//   balance          8 bytes, IEEE 754 binary64, little-endian
+//   password_hash    32 raw bytes when it is 64 lowercase hex digits,
+//                    else varint length and the bytes
+//   status           zigzag varint
+//   created_date,    zigzag varints
+//   last_accessed
+//   failed_logins    zigzag varint
+//   crc              4 bytes little-endian, CRC32C of everything before it
+//
+// Decoding rebuilds the struct with zeroed padding and seals it afresh, so a
+// record that decodes cleanly passes bankRecordIntact. One that does not, or
+// that was already damaged when it was encoded, comes back failing it.
+#define RECORD_FORMAT_VERSION 1
+#define RECORD_RAW_HASH 0x1         // password_hash stored as 32 raw bytes
+#define RECORD_SEALED 0x2           // the record carried a checksum
+#define RECORD_DAMAGED 0x4          // the record failed its checksum when encoded
+#define RECORD_DIGEST_BYTES 32
+#define RECORD_MAX_ENCODED 448      // longest encoding of any Account
+
+// Writes the encoding of `account` to `out`, which holds RECORD_MAX_ENCODED
+// bytes, and returns its length
+size_t recordEncode(const Account *account, unsigned char *out);
+
+// Fills `account` from `len` encoded bytes. Returns 0, or -1 if the bytes
+// are damaged; `account` is filled either way.
+int recordDecode(const unsigned char *in, size_t len, Account *account);
+
+// The codec the core hands to storageOpen
+const StorageCodec *bankRecordCodec(void);
+
+#endif
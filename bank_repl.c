@@ -0,0 +1,798 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "bank_repl.h"
+#include "bank_protocol.h"
+#include "bank_daily.h"
+#include "bank_internal.h"
+
+// A connected replica, served by a thread of its own
+typedef struct ReplPeer {
+    struct ReplPeer *next;
+    BankReplication *repl;
+    int fd;
+    pthread_t thread;
+    BankBuffer queue;            // frames published and not yet sent
+    int registered;              // receives published frames
+    int dropped;                 // fell too far behind, or the store was replaced
+    int done;                    // the thread has finished; joined by the listener
+} ReplPeer;
+
+struct BankReplication {
+    Bank *bank;
+    pthread_mutex_t *lock;       // the owner's lock around the bank
+    pthread_mutex_t mutex;       // everything below that the threads share
+    pthread_cond_t wake;
+    int primary;
+    int stopping;
+    int fd;                      // listening socket, or the connection to the primary
+    pthread_t thread;            // accepts replicas, or follows the primary
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+    // Primary. `registered` changes under the bank lock as well, so the
+    // capture hook can read it holding that alone.
+    ReplPeer *peers;
+    int registered;
+    uint64_t published;          // journal end already shipped
+    BankBuffer images;           // ReplImages written since
+    BankBuffer frame;
+
+    // Replica
+    BankReplicaStatus status;
+    int64_t contact;             // CLOCK_REALTIME ns the primary was last heard from
+    long snapshot_count;         // records in the copy being received
+};
+
+static int64_t realtimeNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int sendFully(int fd, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int recvFully(int fd, void *data, size_t len) {
+    unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void setTimeouts(int fd) {
+    struct timeval tv = {REPL_TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static void initFrame(ReplFrame *frame, ReplFrameType type) {
+    memset(frame, 0, sizeof(*frame));
+    frame->magic = REPL_MAGIC;
+    frame->type = type;
+}
+
+static BankReplication *replOpen(Bank *bank, const char *socket_path, pthread_mutex_t *lock, int primary) {
+    BankReplication *r;
+
+    if (bank->replication != NULL || strlen(socket_path) >= sizeof(r->path) ||
+        (r = calloc(1, sizeof(BankReplication))) == NULL) {
+        return NULL;
+    }
+    r->bank = bank;
+    r->lock = lock;
+    r->primary = primary;
+    r->fd = -1;
+    snprintf(r->path, sizeof(r->path), "%s", socket_path);
+    pthread_mutex_init(&r->mutex, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    bankBufferInit(&r->images);
+    bankBufferInit(&r->frame);
+    return r;
+}
+
+static void replFree(BankReplication *r) {
+    pthread_mutex_destroy(&r->mutex);
+    pthread_cond_destroy(&r->wake);
+    bankBufferFree(&r->images);
+    bankBufferFree(&r->frame);
+    free(r);
+}
+
+// ---- primary ----
+
+void replCapture(Bank *bank, long slot, const Account *account) {
+    BankReplication *r = bank->replication;
+    ReplImage image;
+
+    if (r == NULL || !r->primary || r->registered == 0) {
+        return;
+    }
+    memset(&image, 0, sizeof(image));
+    image.slot = slot;
+    image.account = *account;
+    if (bankBufferReserve(&r->images, sizeof(image)) != 0) {
+        replResync(bank);
+        return;
+    }
+    memcpy(r->images.data + r->images.len, &image, sizeof(image));
+    r->images.len += sizeof(image);
+}
+
+// Peers that lose a frame must start over from a fresh copy
+static void dropPeers(BankReplication *r) {
+    for (ReplPeer *peer = r->peers; peer != NULL; peer = peer->next) {
+        peer->dropped = 1;
+        bankBufferFree(&peer->queue);
+    }
+    pthread_cond_broadcast(&r->wake);
+}
+
+void replResync(Bank *bank) {
+    BankReplication *r = bank->replication;
+
+    if (r != NULL && r->primary) {
+        pthread_mutex_lock(&r->mutex);
+        dropPeers(r);
+        pthread_mutex_unlock(&r->mutex);
+        r->images.len = 0;
+    }
+}
+
+// Ships the journal flushed and the records written since the last call
+void replPublish(Bank *bank) {
+    BankReplication *r = bank->replication;
+    uint64_t end = bank->journal.end;
+    ReplFrame frame;
+
+    if (r == NULL || !r->primary) {
+        return;
+    }
+    if (r->registered == 0 || (end == r->published && r->images.len == 0)) {
+        pthread_mutex_lock(&r->mutex);
+        r->published = end;
+        pthread_mutex_unlock(&r->mutex);
+        r->images.len = 0;
+        return;
+    }
+
+    size_t journal_len = (size_t)(end - r->published);
+    initFrame(&frame, REPL_BATCH);
+    frame.journal_id = bank->journal.id;
+    frame.from = r->published;
+    frame.lsn = end;
+    frame.commit_time = realtimeNs();
+    frame.count = (int64_t)(r->images.len / sizeof(ReplImage));
+    frame.length = journal_len + r->images.len;
+
+    r->frame.len = 0;
+    int built = bankBufferReserve(&r->frame, sizeof(frame) + frame.length) == 0;
+    if (built) {
+        unsigned char *p = r->frame.data;
+        memcpy(p, &frame, sizeof(frame));
+        built = storageJournalRead(&bank->storage, p + sizeof(frame), journal_len, r->published) == journal_len;
+        if (r->images.len > 0) {
+            memcpy(p + sizeof(frame) + journal_len, r->images.data, r->images.len);
+        }
+        r->frame.len = sizeof(frame) + frame.length;
+    }
+
+    pthread_mutex_lock(&r->mutex);
+    if (!built) {
+        dropPeers(r);
+    }
+    for (ReplPeer *peer = r->peers; built && peer != NULL; peer = peer->next) {
+        if (!peer->registered || peer->dropped) {
+            continue;
+        }
+        if (peer->queue.len + r->frame.len > REPL_QUEUE_LIMIT ||
+            bankBufferReserve(&peer->queue, r->frame.len) != 0) {
+            peer->dropped = 1;
+            bankBufferFree(&peer->queue);
+            continue;
+        }
+        memcpy(peer->queue.data + peer->queue.len, r->frame.data, r->frame.len);
+        peer->queue.len += r->frame.len;
+    }
+    r->published = end;
+    pthread_cond_broadcast(&r->wake);
+    pthread_mutex_unlock(&r->mutex);
+    r->images.len = 0;
+}
+
+static int sendFrame(int fd, const ReplFrame *frame, const void *payload) {
+    if (sendFully(fd, frame, sizeof(*frame)) != 0) {
+        return -1;
+    }
+    return frame->length > 0 ? sendFully(fd, payload, (size_t)frame->length) : 0;
+}
+
+// The journal the replica is missing, then every record, each chunk read
+// under the bank lock. Records written meanwhile are also in the live
+// stream queued behind the copy, which settles them in order.
+static int sendSnapshot(ReplPeer *peer, uint64_t id, uint64_t from, uint64_t end, long count) {
+    BankReplication *r = peer->repl;
+    Bank *bank = r->bank;
+    size_t size = REPL_JOURNAL_CHUNK > REPL_RECORD_CHUNK * sizeof(ReplImage)
+                      ? REPL_JOURNAL_CHUNK : REPL_RECORD_CHUNK * sizeof(ReplImage);
+    unsigned char *chunk = malloc(size);
+    Account *records = malloc(REPL_RECORD_CHUNK * sizeof(Account));
+    ReplFrame frame;
+    int failed = chunk == NULL || records == NULL;
+
+    initFrame(&frame, REPL_SNAPSHOT);
+    frame.journal_id = id;
+    frame.from = from;
+    frame.lsn = end;
+    frame.head = end;
+    frame.count = count;
+    failed = failed || sendFrame(peer->fd, &frame, NULL) != 0;
+
+    for (uint64_t offset = from; offset < end && !failed; offset += frame.length) {
+        size_t n = end - offset < REPL_JOURNAL_CHUNK ? (size_t)(end - offset) : REPL_JOURNAL_CHUNK;
+        n -= n % sizeof(JournalRecord);
+        pthread_mutex_lock(r->lock);
+        failed = storageJournalRead(&bank->storage, chunk, n, offset) != n;
+        pthread_mutex_unlock(r->lock);
+
+        initFrame(&frame, REPL_BATCH);
+        frame.journal_id = id;
+        frame.from = offset;
+        frame.lsn = offset + n;
+        frame.head = end;
+        frame.length = n;
+        failed = failed || n == 0 || sendFrame(peer->fd, &frame, chunk) != 0;
+    }
+
+    for (long first = 0; first < count && !failed; first += REPL_RECORD_CHUNK) {
+        long n = count - first < REPL_RECORD_CHUNK ? count - first : REPL_RECORD_CHUNK;
+        ReplImage *images = (ReplImage *)chunk;
+
+        pthread_mutex_lock(r->lock);
+        failed = storageGet(&bank->storage, first, n, records) != 0;
+        pthread_mutex_unlock(r->lock);
+        for (long i = 0; i < n && !failed; i++) {
+            memset(&images[i], 0, sizeof(images[i]));
+            images[i].slot = first + i;
+            images[i].account = records[i];
+            // The replica's store is sealed from the start; the primary's
+            // may still hold records from before checksums
+            if (!bank->sealed && !bankRecordIntact(&records[i])) {
+                bankSealRecord(&images[i].account);
+            }
+        }
+
+        initFrame(&frame, REPL_BATCH);
+        frame.journal_id = id;
+        frame.from = end;
+        frame.lsn = end;
+        frame.head = end;
+        frame.count = n;
+        frame.length = (uint64_t)n * sizeof(ReplImage);
+        failed = failed || sendFrame(peer->fd, &frame, chunk) != 0;
+    }
+
+    initFrame(&frame, REPL_SYNCED);
+    frame.journal_id = id;
+    frame.from = end;
+    frame.lsn = end;
+    frame.head = end;
+    frame.count = count;
+    failed = failed || sendFrame(peer->fd, &frame, NULL) != 0;
+
+    free(chunk);
+    free(records);
+    return failed ? -1 : 0;
+}
+
+// Stamps each frame with the primary's current position as it goes out
+static void stampHead(BankBuffer *out, uint64_t head) {
+    ReplFrame frame;
+
+    for (size_t offset = 0; offset + sizeof(frame) <= out->len; offset += sizeof(frame) + frame.length) {
+        memcpy(&frame, out->data + offset, sizeof(frame));
+        frame.head = head;
+        memcpy(out->data + offset, &frame, sizeof(frame));
+    }
+}
+
+// Sends the queue as frames are published, and a heartbeat when idle
+static void streamToPeer(ReplPeer *peer) {
+    BankReplication *r = peer->repl;
+    BankBuffer out;
+    ReplFrame frame;
+    struct timespec deadline;
+
+    bankBufferInit(&out);
+    pthread_mutex_lock(&r->mutex);
+    while (!peer->dropped && !r->stopping) {
+        if (peer->queue.len == 0) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += REPL_HEARTBEAT_SECONDS;
+            if (pthread_cond_timedwait(&r->wake, &r->mutex, &deadline) != ETIMEDOUT ||
+                peer->queue.len > 0 || peer->dropped) {
+                continue;
+            }
+            initFrame(&frame, REPL_HEARTBEAT);
+            frame.lsn = r->published;
+            frame.commit_time = realtimeNs();
+            if (bankBufferReserve(&peer->queue, sizeof(frame)) != 0) {
+                break;
+            }
+            memcpy(peer->queue.data, &frame, sizeof(frame));
+            peer->queue.len = sizeof(frame);
+        }
+
+        BankBuffer swap = out;
+        out = peer->queue;
+        peer->queue = swap;
+        uint64_t head = r->published;
+        pthread_mutex_unlock(&r->mutex);
+
+        stampHead(&out, head);
+        int failed = sendFully(peer->fd, out.data, out.len) != 0;
+        out.len = 0;
+
+        pthread_mutex_lock(&r->mutex);
+        if (failed) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&r->mutex);
+    bankBufferFree(&out);
+}
+
+static void *servePeer(void *arg) {
+    ReplPeer *peer = arg;
+    BankReplication *r = peer->repl;
+    Bank *bank = r->bank;
+    ReplFrame hello;
+
+    setTimeouts(peer->fd);
+    if (recvFully(peer->fd, &hello, sizeof(hello)) == 0 && hello.magic == REPL_MAGIC &&
+        hello.type == REPL_HELLO) {
+        // From here on every published batch is queued for the replica,
+        // behind the copy sent below
+        pthread_mutex_lock(r->lock);
+        pthread_mutex_lock(&r->mutex);
+        peer->registered = 1;
+        r->registered++;
+        uint64_t end = r->published;
+        pthread_mutex_unlock(&r->mutex);
+        uint64_t id = bank->journal.id;
+        long count = bankRecordCount(bank);
+        pthread_mutex_unlock(r->lock);
+
+        // A replica holding a prefix of this journal is sent the rest;
+        // anything else, all of it
+        uint64_t from = hello.journal_id == id && hello.lsn >= sizeof(JournalHeader) && hello.lsn <= end &&
+                                (hello.lsn - sizeof(JournalHeader)) % sizeof(JournalRecord) == 0
+                            ? hello.lsn : sizeof(JournalHeader);
+        if (sendSnapshot(peer, id, from, end, count) == 0) {
+            streamToPeer(peer);
+        }
+
+        pthread_mutex_lock(r->lock);
+        pthread_mutex_lock(&r->mutex);
+        peer->registered = 0;
+        r->registered--;
+        bankBufferFree(&peer->queue);
+        pthread_mutex_unlock(&r->mutex);
+        pthread_mutex_unlock(r->lock);
+    }
+
+    // The replica sees the end at once and reconnects for a fresh copy
+    shutdown(peer->fd, SHUT_RDWR);
+    pthread_mutex_lock(&r->mutex);
+    peer->done = 1;
+    pthread_mutex_unlock(&r->mutex);
+    return NULL;
+}
+
+// Joins finished peer threads, or every peer when stopping
+static void reapPeers(BankReplication *r, int all) {
+    pthread_mutex_lock(&r->mutex);
+    ReplPeer **link = &r->peers;
+    while (*link != NULL) {
+        ReplPeer *peer = *link;
+        if (!peer->done && !all) {
+            link = &peer->next;
+            continue;
+        }
+        *link = peer->next;
+        pthread_mutex_unlock(&r->mutex);
+        pthread_join(peer->thread, NULL);
+        close(peer->fd);
+        bankBufferFree(&peer->queue);
+        free(peer);
+        pthread_mutex_lock(&r->mutex);
+    }
+    pthread_mutex_unlock(&r->mutex);
+}
+
+static void *acceptReplicas(void *arg) {
+    BankReplication *r = arg;
+
+    while (1) {
+        int fd = accept(r->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        reapPeers(r, 0);
+
+        ReplPeer *peer = calloc(1, sizeof(ReplPeer));
+        pthread_mutex_lock(&r->mutex);
+        int stopping = r->stopping;
+        if (peer != NULL && !stopping) {
+            peer->repl = r;
+            peer->fd = fd;
+            bankBufferInit(&peer->queue);
+            if (pthread_create(&peer->thread, NULL, servePeer, peer) == 0) {
+                peer->next = r->peers;
+                r->peers = peer;
+                peer = NULL;
+                fd = -1;
+            }
+        }
+        pthread_mutex_unlock(&r->mutex);
+        free(peer);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (stopping) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int bankReplicationListen(Bank *bank, const char *socket_path, pthread_mutex_t *lock) {
+    BankReplication *r = replOpen(bank, socket_path, lock, 1);
+    struct sockaddr_un addr;
+
+    if (r == NULL) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    // Batches are shipped with images of the records this bank wrote, so
+    // no other process may write the store
+    if (bankHoldStore(bank, 1) != BANK_OK) {
+        replFree(r);
+        return BANK_ERR_IO;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", r->path);
+    unlink(r->path);
+
+    r->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    r->published = bank->journal.end;
+    if (r->fd < 0 || bind(r->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(r->fd, 16) != 0) {
+        if (r->fd >= 0) {
+            close(r->fd);
+        }
+        replFree(r);
+        bankHoldStore(bank, 0);
+        return BANK_ERR_IO;
+    }
+    bank->replication = r;
+    if (pthread_create(&r->thread, NULL, acceptReplicas, r) != 0) {
+        bank->replication = NULL;
+        close(r->fd);
+        replFree(r);
+        bankHoldStore(bank, 0);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+// ---- replica ----
+
+// The text log line the primary wrote for a journaled record
+static void logRecord(Bank *bank, const JournalRecord *record) {
+    char datetime[50];
+    char line[LOG_LINE_LENGTH];
+    time_t when = (time_t)record->timestamp;
+
+    if (record->type == TRANSACTION_PREPARED || record->type == TRANSACTION_RESOLVED) {
+        return;   // journal only
+    }
+    strftime(datetime, sizeof(datetime), "%Y-%m-%d %H:%M:%S", localtime(&when));
+    bankAppendLog(bank, line, bankFormatLogLine(line, sizeof(line), datetime, record->account_number,
+                                                (TransactionType)record->type, record->amount,
+                                                record->balance_after, record->description));
+}
+
+// Empties the journal and the log regenerated from it, to be refilled from
+// the primary's journal
+static int resetJournal(Bank *bank, uint64_t id) {
+    if (journalReset(&bank->journal, id) != 0 || bankDailyRebuild(bank) != BANK_OK) {
+        return -1;
+    }
+    if (bank->log != NULL && (fflush(bank->log) != 0 || ftruncate(fileno(bank->log), 0) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int applyBatch(Bank *bank, const ReplFrame *frame, const unsigned char *payload) {
+    size_t journal_len = (size_t)(frame->lsn - frame->from);
+    JournalRecord record;
+    ReplImage image;
+    int failed = 0;
+
+    if (frame->from != bank->journal.end || frame->lsn < frame->from || frame->count < 0 ||
+        frame->length != journal_len + (uint64_t)frame->count * sizeof(ReplImage)) {
+        return -1;
+    }
+
+    bankBeginBatch(bank);
+    if (journalCopy(&bank->journal, payload, journal_len) != 0) {
+        failed = 1;
+    }
+    for (size_t offset = 0; offset < journal_len && !failed; offset += sizeof(record)) {
+        memcpy(&record, payload + offset, sizeof(record));
+        logRecord(bank, &record);
+    }
+    for (int64_t i = 0; i < frame->count && !failed; i++) {
+        memcpy(&image, payload + journal_len + (size_t)i * sizeof(image), sizeof(image));
+        long count = bankRecordCount(bank);
+        if (image.slot < 0 || image.slot > count ||
+            bankWriteRecord(bank, (long)image.slot, &image.account) != BANK_OK) {
+            failed = 1;
+            break;
+        }
+        // Records only ever move in a compaction, which sends a fresh copy
+        if (image.slot == count && bank->indexed &&
+            indexAdd(&bank->index, (long)image.slot, image.account.account_number, image.account.email,
+                     image.account.phone, image.account.name) != 0) {
+            indexFree(&bank->index);
+            bank->indexed = 0;
+        }
+    }
+    if (bankCommitBatch(bank) != BANK_OK) {
+        failed = 1;
+    }
+    return failed ? -1 : 0;
+}
+
+// Applies one frame from the primary under the bank lock
+static int applyFrame(BankReplication *r, const ReplFrame *frame, const unsigned char *payload) {
+    Bank *bank = r->bank;
+    int failed = 0;
+
+    pthread_mutex_lock(r->lock);
+    switch (frame->type) {
+        case REPL_SNAPSHOT:
+            // Until the copy is complete lookups scan the store
+            if ((frame->journal_id != bank->journal.id || frame->from != bank->journal.end) &&
+                resetJournal(bank, frame->journal_id) != 0) {
+                failed = 1;
+            }
+            indexFree(&bank->index);
+            bank->indexed = 0;
+            r->snapshot_count = (long)frame->count;
+            break;
+        case REPL_BATCH:
+            failed = applyBatch(bank, frame, payload) != 0;
+            break;
+        case REPL_SYNCED:
+            // The primary may have fewer records than this copy held before
+            if (bankRecordCount(bank) > r->snapshot_count &&
+                storageTruncate(&bank->storage, r->snapshot_count) != 0) {
+                failed = 1;
+            } else if (indexBuild(&bank->index, &bank->storage, bankRecordCount(bank), 0) == 0) {
+                bank->indexed = 1;
+                if (storagePersistent(&bank->storage)) {
+                    indexSave(&bank->index, bank->index_path);
+                }
+            }
+            break;
+        case REPL_HEARTBEAT:
+            break;
+        default:
+            failed = 1;
+            break;
+    }
+    uint64_t applied = bank->journal.end;
+    pthread_mutex_unlock(r->lock);
+
+    int64_t now = realtimeNs();
+    pthread_mutex_lock(&r->mutex);
+    r->contact = now;
+    r->status.applied_lsn = applied;
+    r->status.primary_lsn = frame->type == REPL_HEARTBEAT ? frame->lsn : frame->head;
+    if (frame->type == REPL_SNAPSHOT) {
+        r->status.synced = 0;
+        r->status.snapshots++;
+    } else if (frame->type == REPL_SYNCED) {
+        r->status.synced = 1;
+    } else if (frame->type == REPL_BATCH && frame->commit_time != 0) {
+        r->status.lag_seconds = (now - frame->commit_time) / 1e9;
+        r->status.batches++;
+    }
+    if (frame->type == REPL_HEARTBEAT && frame->lsn == applied) {
+        r->status.lag_seconds = 0.0;
+    }
+    pthread_mutex_unlock(&r->mutex);
+    return failed ? -1 : 0;
+}
+
+// Reads and applies frames until the connection fails
+static void followPrimary(BankReplication *r, int fd) {
+    BankBuffer payload;
+    ReplFrame frame;
+
+    initFrame(&frame, REPL_HELLO);
+    pthread_mutex_lock(r->lock);
+    frame.journal_id = r->bank->journal.id;
+    frame.lsn = r->bank->journal.end;
+    pthread_mutex_unlock(r->lock);
+    if (sendFully(fd, &frame, sizeof(frame)) != 0) {
+        return;
+    }
+
+    bankBufferInit(&payload);
+    while (recvFully(fd, &frame, sizeof(frame)) == 0 && frame.magic == REPL_MAGIC) {
+        payload.len = 0;
+        if (frame.length > 0 &&
+            (bankBufferReserve(&payload, (size_t)frame.length) != 0 ||
+             recvFully(fd, payload.data, (size_t)frame.length) != 0)) {
+            break;
+        }
+        if (applyFrame(r, &frame, payload.data) != 0) {
+            pthread_mutex_lock(&r->mutex);
+            r->status.resyncs++;
+            pthread_mutex_unlock(&r->mutex);
+            break;
+        }
+    }
+    bankBufferFree(&payload);
+}
+
+static int connectPrimary(const char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *followReplication(void *arg) {
+    BankReplication *r = arg;
+    struct timespec pause = {REPL_HEARTBEAT_SECONDS, 0};
+
+    pthread_mutex_lock(&r->mutex);
+    while (!r->stopping) {
+        pthread_mutex_unlock(&r->mutex);
+        int fd = connectPrimary(r->path);
+
+        pthread_mutex_lock(&r->mutex);
+        if (fd >= 0 && !r->stopping) {
+            r->fd = fd;
+            r->status.connected = 1;
+            pthread_mutex_unlock(&r->mutex);
+
+            setTimeouts(fd);
+            followPrimary(r, fd);
+
+            pthread_mutex_lock(&r->mutex);
+            r->fd = -1;
+            r->status.connected = 0;
+            r->status.synced = 0;
+        }
+        pthread_mutex_unlock(&r->mutex);
+        if (fd >= 0) {
+            close(fd);
+        }
+        nanosleep(&pause, NULL);
+        pthread_mutex_lock(&r->mutex);
+    }
+    pthread_mutex_unlock(&r->mutex);
+    return NULL;
+}
+
+int bankReplicaFollow(Bank *bank, const char *socket_path, pthread_mutex_t *lock) {
+    BankReplication *r = replOpen(bank, socket_path, lock, 0);
+
+    if (r == NULL) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    r->contact = realtimeNs();
+    r->status.applied_lsn = bank->journal.end;
+    bank->replication = r;
+    bank->read_only = 1;
+    if (pthread_create(&r->thread, NULL, followReplication, r) != 0) {
+        bank->replication = NULL;
+        bank->read_only = 0;
+        replFree(r);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+void bankReplicaStatus(Bank *bank, BankReplicaStatus *status) {
+    BankReplication *r = bank->replication;
+
+    memset(status, 0, sizeof(*status));
+    if (r == NULL || r->primary) {
+        return;
+    }
+    pthread_mutex_lock(&r->mutex);
+    *status = r->status;
+    if (!status->connected) {
+        status->lag_seconds = (realtimeNs() - r->contact) / 1e9;
+    }
+    pthread_mutex_unlock(&r->mutex);
+}
+
+// Stops the threads; the caller does not hold the bank lock
+void replClose(Bank *bank) {
+    BankReplication *r = bank->replication;
+
+    if (r == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&r->mutex);
+    r->stopping = 1;
+    if (r->fd >= 0) {
+        shutdown(r->fd, SHUT_RDWR);
+    }
+    for (ReplPeer *peer = r->peers; peer != NULL; peer = peer->next) {
+        shutdown(peer->fd, SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&r->wake);
+    pthread_mutex_unlock(&r->mutex);
+
+    pthread_join(r->thread, NULL);
+    if (r->primary) {
+        reapPeers(r, 1);
+        close(r->fd);
+        unlink(r->path);
+        bankHoldStore(bank, 0);
+    }
+    bank->replication = NULL;
+    bank->read_only = 0;
+    replFree(r);
+}
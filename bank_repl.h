@@ -0,0 +1,83 @@
+#ifndef BANK_REPL_H
+#define BANK_REPL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Primary/replica replication between processes on one machine. The primary
+// ships each committed batch to its replicas over a Unix socket: the journal
+// bytes the batch appended, verbatim, and an image of every account record it
+// wrote. A replica keeps its primary's journal at the same offsets, so its
+// position is its own journal's end, regenerates the text log from the
+// journal records, and writes the images into its own store. A replica that
+// connects, or reconnects after falling behind or a compaction on the
+// primary, is first sent the journal it is missing and a copy of every
+// record, then the live stream.
+//
+// Replicas serve reads only: balances over the protocol, and the store, log
+// and journal in their data directory for history and reporting. Both sides
+// exchange raw records, so they must run on the same machine and build.
+#define REPL_MAGIC 0x4c504552u             // "REPL"
+#define REPL_HEARTBEAT_SECONDS 1           // an idle primary still reports its position
+#define REPL_TIMEOUT_SECONDS 5             // silence after which the other side is presumed gone
+#define REPL_QUEUE_LIMIT (64u << 20)       // unsent bytes after which a replica is dropped
+#define REPL_JOURNAL_CHUNK (1u << 20)      // journal bytes per frame while catching up
+#define REPL_RECORD_CHUNK 4096             // records per frame while copying the store
+
+typedef enum {
+    REPL_HELLO = 1,      // replica to primary: its journal id and end
+    REPL_SNAPSHOT = 2,   // a copy of the store follows; `count` records
+    REPL_BATCH = 3,      // journal bytes [from, lsn), then `count` ReplImages
+    REPL_SYNCED = 4,     // the copy is complete
+    REPL_HEARTBEAT = 5   // the primary's position while idle
+} ReplFrameType;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;               // ReplFrameType
+    uint64_t journal_id;
+    uint64_t from;               // LSN of the first journal byte in the payload
+    uint64_t lsn;                // journal end once the frame is applied
+    uint64_t head;               // the primary's journal end when the frame was sent
+    int64_t commit_time;         // CLOCK_REALTIME ns of the primary's commit, 0 while copying
+    int64_t count;
+    uint64_t length;             // payload bytes after the frame
+} ReplFrame;
+
+typedef struct {
+    int64_t slot;
+    Account account;
+} ReplImage;
+
+typedef struct {
+    int connected;
+    int synced;                  // the copy of the store is complete
+    uint64_t applied_lsn;        // this replica's journal end
+    uint64_t primary_lsn;        // the primary's, as last reported
+    double lag_seconds;          // commit-to-apply delay of the latest batch, 0 once caught up;
+                                 // while disconnected, time since the primary was last heard
+    uint64_t batches;
+    uint64_t snapshots;
+    uint64_t resyncs;            // frames that could not be applied; each drops the connection
+                                 // and the replica starts over from a fresh copy
+} BankReplicaStatus;
+
+// Both sides run a thread of their own and take `lock`, the mutex the
+// caller holds around every other use of the bank, to reach the store. They
+// are stopped by bankClose.
+
+// Primary: accepts replicas on `socket_path`. Replicas see only what this
+// bank writes, so no other process may have the store open: listening fails
+// with BANK_ERR_IO while one does, and keeps others from opening it.
+int bankReplicationListen(Bank *bank, const char *socket_path, pthread_mutex_t *lock);
+
+// Replica: follows the primary listening on `socket_path`, reconnecting
+// whenever the connection drops, and refuses requests that change the store
+int bankReplicaFollow(Bank *bank, const char *socket_path, pthread_mutex_t *lock);
+
+// Zeroed unless `bank` is a replica
+void bankReplicaStatus(Bank *bank, BankReplicaStatus *status);
+
+#endif
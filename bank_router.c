@@ -0,0 +1,691 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "bank_router.h"
+
+#define ROUTER_READ_CHUNK 65536
+
+// Replies being collected: forwarded requests and prepared legs, tagged
+// (request << 1) and (transfer << 1 | 1), or resolutions, tagged
+// (decision << 1 | leg)
+enum {
+    PHASE_FORWARD,
+    PHASE_SETTLE
+};
+
+static int reserveArray(void **array, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) {
+        return 0;
+    }
+    size_t grown = *cap ? *cap : 64;
+    while (grown < need) {
+        grown *= 2;
+    }
+    void *data = realloc(*array, grown * size);
+    if (data == NULL) {
+        return -1;
+    }
+    *array = data;
+    *cap = grown;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Shard connections
+// ---------------------------------------------------------------------------
+
+static int connectShard(const char *path) {
+    struct sockaddr_un addr;
+    size_t len = strlen(path);
+    int fd;
+
+    if (len >= sizeof(addr.sun_path)) {
+        return -1;   // a truncated path would name another socket
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, len + 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Returns the number of shards connected
+static int reconnectShards(BankRouter *router) {
+    char path[BANK_PATH_LENGTH + 32];
+    int connected = 0;
+
+    for (int k = 0; k < router->shards; k++) {
+        RouterShard *shard = &router->shard[k];
+        if (shard->fd < 0) {
+            snprintf(path, sizeof(path), ROUTER_SHARD_SOCKET, router->dir, k);
+            shard->fd = connectShard(path);
+        }
+        connected += shard->fd >= 0;
+    }
+    return connected;
+}
+
+// Requests still queued or unanswered on a lost connection keep the
+// BANK_ERR_IO status they were given when routed
+static void dropShard(RouterShard *shard) {
+    if (shard->fd >= 0) {
+        close(shard->fd);
+        shard->fd = -1;
+    }
+    shard->tx.len = 0;
+    shard->rx.len = 0;
+    shard->expected = 0;
+}
+
+static void forward(BankRouter *router, int k, const BankRequest *req) {
+    RouterShard *shard = &router->shard[k];
+
+    if (shard->fd >= 0 && bankEncodeRequest(&shard->tx, req) == 0) {
+        shard->expected++;
+        router->forwarded++;
+    }
+}
+
+static void deliver(BankRouter *router, const BankResponse *resp) {
+    size_t index = resp->tag >> 1;
+    int leg = (int)(resp->tag & 1);
+
+    if (router->phase == PHASE_SETTLE) {
+        if (index < router->decision_count && resp->status == BANK_OK) {
+            router->decisions[index].settled |= 1 << leg;
+        }
+    } else if (leg == 1) {
+        if (index < router->transfer_count) {
+            router->transfers[index].credit_status = resp->status;
+        }
+    } else if (index < router->reply_cap) {
+        BankResponse *reply = &router->replies[index];
+        reply->status = resp->status;
+        reply->account_number = resp->account_number;
+        reply->balance = resp->balance;
+    }
+}
+
+static int sendPending(RouterShard *shard) {
+    size_t off = 0;
+    while (off < shard->tx.len) {
+        ssize_t n = write(shard->fd, shard->tx.data + off, shard->tx.len - off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    bankBufferConsume(&shard->tx, off);
+    return 0;
+}
+
+static int receive(BankRouter *router, RouterShard *shard) {
+    BankResponse resp;
+    size_t used;
+
+    while (1) {
+        if (bankBufferReserve(&shard->rx, ROUTER_READ_CHUNK) != 0) {
+            return -1;
+        }
+        ssize_t n = read(shard->fd, shard->rx.data + shard->rx.len, shard->rx.cap - shard->rx.len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        shard->rx.len += (size_t)n;
+    }
+
+    size_t off = 0;
+    int rc = 1;
+    while (shard->expected > 0 &&
+           (rc = bankDecodeResponse(shard->rx.data + off, shard->rx.len - off, &resp, &used)) == 1) {
+        deliver(router, &resp);
+        shard->expected--;
+        off += used;
+    }
+    bankBufferConsume(&shard->rx, off);
+    return shard->expected > 0 && rc < 0 ? -1 : 0;
+}
+
+// Sends everything queued for the shards and collects every reply, all
+// shards at once. A shard that fails is disconnected.
+static void exchange(BankRouter *router) {
+    struct pollfd fds[SHARD_MAX];
+    int owner[SHARD_MAX];
+
+    while (1) {
+        int n = 0;
+        for (int k = 0; k < router->shards; k++) {
+            RouterShard *shard = &router->shard[k];
+            if (shard->fd < 0 || (shard->tx.len == 0 && shard->expected == 0)) {
+                continue;
+            }
+            fds[n].fd = shard->fd;
+            fds[n].events = (short)((shard->tx.len > 0 ? POLLOUT : 0) | (shard->expected > 0 ? POLLIN : 0));
+            fds[n].revents = 0;
+            owner[n++] = k;
+        }
+        if (n == 0) {
+            return;
+        }
+
+        if (poll(fds, (nfds_t)n, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            for (int i = 0; i < n; i++) {
+                dropShard(&router->shard[owner[i]]);
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            RouterShard *shard = &router->shard[owner[i]];
+            if ((fds[i].revents & POLLOUT) && sendPending(shard) != 0) {
+                dropShard(shard);
+                continue;
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && receive(router, shard) != 0) {
+                dropShard(shard);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Decision log
+// ---------------------------------------------------------------------------
+
+static void logAppend(BankRouter *router, RouterState state, uint64_t txid, int from_account,
+                      int to_account, int result) {
+    RouterLogRecord record;
+
+    if (bankBufferReserve(&router->log_pending, sizeof(record)) != 0) {
+        return;   // the write below then fails for want of the record
+    }
+    memset(&record, 0, sizeof(record));
+    record.magic = ROUTER_LOG_MAGIC;
+    record.state = state;
+    record.txid = txid;
+    record.from_account = from_account;
+    record.to_account = to_account;
+    record.result = result;
+    memcpy(router->log_pending.data + router->log_pending.len, &record, sizeof(record));
+    router->log_pending.len += sizeof(record);
+}
+
+// With `durable` set the records are on disk before this returns: a
+// BEGIN must outlive a crash before its prepares go out, a DECIDED before
+// its commits
+static int logWrite(BankRouter *router, size_t expected_records, int durable) {
+    size_t len = router->log_pending.len;
+    const unsigned char *data = router->log_pending.data;
+
+    router->log_pending.len = 0;
+    if (len != expected_records * sizeof(RouterLogRecord)) {
+        return -1;
+    }
+    while (len > 0) {
+        ssize_t n = write(router->log_fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+        router->log_size += (uint64_t)n;
+    }
+    return durable && fdatasync(router->log_fd) != 0 ? -1 : 0;
+}
+
+// Makes a rename in the router's directory durable
+static int syncDir(const BankRouter *router) {
+    int fd = open(router->dir, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+// Replaces the log with one holding only the unsettled decisions. The new
+// log is written aside, synced and renamed over the old one, and the rename
+// synced, so a crash leaves one or the other.
+static int rewriteLog(BankRouter *router) {
+    char path[sizeof(router->log_path) + 4];
+
+    snprintf(path, sizeof(path), "%s.new", router->log_path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    int old_fd = router->log_fd;
+    router->log_fd = fd;
+    router->log_size = 0;
+    for (size_t i = 0; i < router->unsettled_count; i++) {
+        const RouterDecision *d = &router->unsettled[i];
+        logAppend(router, ROUTER_DECIDED, d->txid, d->from_account, d->to_account, d->result);
+    }
+    if (logWrite(router, router->unsettled_count, 1) != 0 || rename(path, router->log_path) != 0) {
+        close(fd);
+        unlink(path);
+        router->log_fd = old_fd;
+        return -1;
+    }
+    if (old_fd >= 0) {
+        close(old_fd);
+    }
+    return syncDir(router);
+}
+
+// ---------------------------------------------------------------------------
+// Two-phase commit
+// ---------------------------------------------------------------------------
+
+// Tells both legs of every decision the outcome; decisions a shard did not
+// acknowledge are kept to be retried
+static void settle(BankRouter *router) {
+    BankRequest req;
+    size_t done = 0;
+
+    memset(&req, 0, sizeof(req));
+    req.op = BANK_OP_RESOLVE;
+    snprintf(req.password, sizeof(req.password), "%s", router->admin_password);
+
+    router->phase = PHASE_SETTLE;
+    for (size_t i = 0; i < router->decision_count; i++) {
+        const RouterDecision *d = &router->decisions[i];
+        for (int leg = 0; leg < 2; leg++) {
+            if (d->settled & (1 << leg)) {
+                continue;
+            }
+            req.tag = (uint32_t)(i << 1 | (size_t)leg);
+            req.account_number = leg ? d->to_account : d->from_account;
+            req.related_account = d->result;
+            req.idempotency_key = d->txid;
+            forward(router, bankShardOf(req.account_number, router->shards), &req);
+        }
+    }
+    exchange(router);
+
+    for (size_t i = 0; i < router->decision_count; i++) {
+        const RouterDecision *d = &router->decisions[i];
+        if (d->settled == 3) {
+            logAppend(router, ROUTER_DONE, d->txid, d->from_account, d->to_account, d->result);
+            done++;
+        } else if (reserveArray((void **)&router->unsettled, &router->unsettled_cap,
+                                router->unsettled_count + 1, sizeof(RouterDecision)) == 0) {
+            router->unsettled[router->unsettled_count++] = *d;
+        }
+    }
+    logWrite(router, done, 0);   // a lost DONE only means the legs are told again
+    router->decision_count = 0;
+}
+
+static void retryUnsettled(BankRouter *router) {
+    if (reserveArray((void **)&router->decisions, &router->decision_cap, router->unsettled_count,
+                     sizeof(RouterDecision)) != 0) {
+        return;
+    }
+    memcpy(router->decisions, router->unsettled, router->unsettled_count * sizeof(RouterDecision));
+    router->decision_count = router->unsettled_count;
+    router->unsettled_count = 0;
+    settle(router);
+}
+
+static uint64_t nextTxid(BankRouter *router) {
+    router->next_txid += SHARD_MAX;
+    return router->next_txid;
+}
+
+// Sends both prepares of every cross-shard transfer in the batch, once
+// they are logged as begun
+static void prepareTransfers(BankRouter *router) {
+    BankRequest req;
+
+    for (size_t i = 0; i < router->transfer_count; i++) {
+        const RouterTransfer *t = &router->transfers[i];
+        logAppend(router, ROUTER_BEGIN, t->txid, t->from_account, t->to_account, 0);
+    }
+    if (logWrite(router, router->transfer_count, 1) != 0) {
+        router->transfer_count = 0;   // nothing prepared; the replies stay BANK_ERR_IO
+        return;
+    }
+
+    for (size_t i = 0; i < router->transfer_count; i++) {
+        const RouterTransfer *t = &router->transfers[i];
+
+        memset(&req, 0, sizeof(req));
+        req.op = BANK_OP_PREPARE_DEBIT;
+        req.tag = t->index << 1;
+        req.account_number = t->from_account;
+        req.related_account = t->to_account;
+        req.amount = t->amount;
+        req.idempotency_key = t->txid;
+        snprintf(req.password, sizeof(req.password), "%s", t->password);
+        forward(router, bankShardOf(t->from_account, router->shards), &req);
+
+        req.op = BANK_OP_PREPARE_CREDIT;
+        req.tag = (uint32_t)(i << 1 | 1);
+        req.account_number = t->to_account;
+        req.related_account = t->from_account;
+        snprintf(req.password, sizeof(req.password), "%s", router->admin_password);
+        forward(router, bankShardOf(t->to_account, router->shards), &req);
+    }
+}
+
+// Commits the transfers whose legs both prepared and aborts the rest; the
+// client sees the first leg's failure
+static void decideTransfers(BankRouter *router) {
+    int logged;
+
+    if (reserveArray((void **)&router->decisions, &router->decision_cap, router->transfer_count,
+                     sizeof(RouterDecision)) != 0) {
+        // Left undecided: the legs are aborted at the next start
+        for (size_t i = 0; i < router->transfer_count; i++) {
+            router->replies[router->transfers[i].index].status = BANK_ERR_IO;
+        }
+        return;
+    }
+    for (size_t i = 0; i < router->transfer_count; i++) {
+        const RouterTransfer *t = &router->transfers[i];
+        BankResponse *reply = &router->replies[t->index];
+        RouterDecision *d = &router->decisions[i];
+
+        d->txid = t->txid;
+        d->from_account = t->from_account;
+        d->to_account = t->to_account;
+        d->result = reply->status != BANK_OK ? reply->status : t->credit_status;
+        d->settled = 0;
+        logAppend(router, ROUTER_DECIDED, d->txid, d->from_account, d->to_account, d->result);
+    }
+    router->decision_count = router->transfer_count;
+
+    // Undecided transfers are aborted by recovery, so without the log
+    // record no transfer may commit
+    logged = logWrite(router, router->decision_count, 1) == 0;
+    for (size_t i = 0; i < router->decision_count; i++) {
+        RouterDecision *d = &router->decisions[i];
+        BankResponse *reply = &router->replies[router->transfers[i].index];
+
+        if (!logged && d->result == BANK_OK) {
+            d->result = BANK_ERR_IO;
+        }
+        if (d->result != BANK_OK) {
+            reply->status = (uint8_t)d->result;
+            reply->balance = 0.0;
+            router->aborted++;
+        }
+        router->cross_shard++;
+    }
+    settle(router);
+}
+
+// Forwards a client request to its shard, or queues it as a cross-shard
+// transfer; returns -1 when out of memory
+static int routeRequest(BankRouter *router, BankRequest *req, BankResponse *reply, size_t index) {
+    req->tag = (uint32_t)index << 1;
+
+    switch (req->op) {
+        case BANK_OP_PING:
+            reply->status = BANK_OK;
+            return 0;
+        case BANK_OP_CREATE:
+            forward(router, (int)(router->next_create++ % (unsigned)router->shards), req);
+            return 0;
+        case BANK_OP_BALANCE:
+        case BANK_OP_DEPOSIT:
+        case BANK_OP_WITHDRAW:
+            forward(router, bankShardOf(req->account_number, router->shards), req);
+            return 0;
+        case BANK_OP_TRANSFER:
+            break;
+        default:
+            // The shards' own steps are the router's to send
+            reply->status = BANK_ERR_INVALID_REQUEST;
+            return 0;
+    }
+
+    int from = bankShardOf(req->account_number, router->shards);
+    if (from == bankShardOf(req->related_account, router->shards)) {
+        forward(router, from, req);
+        return 0;
+    }
+    if (reserveArray((void **)&router->transfers, &router->transfer_cap, router->transfer_count + 1,
+                     sizeof(RouterTransfer)) != 0) {
+        return -1;
+    }
+
+    // A client's retry key doubles as the transaction id, so the shards
+    // answer a retried transfer with the original outcome
+    RouterTransfer *t = &router->transfers[router->transfer_count++];
+    t->txid = req->idempotency_key != 0 ? req->idempotency_key : nextTxid(router);
+    t->index = (uint32_t)index;
+    t->from_account = req->account_number;
+    t->to_account = req->related_account;
+    t->amount = req->amount;
+    t->credit_status = BANK_ERR_IO;
+    snprintf(t->password, sizeof(t->password), "%s", req->password);
+    return 0;
+}
+
+int routerServeBatch(BankRouter *router, const unsigned char *in, size_t len, size_t *consumed,
+                     BankBuffer *out) {
+    BankRequest req;
+    size_t offset = 0, used, count = 0;
+    int rc;
+
+    reconnectShards(router);
+    if (router->unsettled_count > 0) {
+        retryUnsettled(router);
+    }
+
+    router->phase = PHASE_FORWARD;
+    router->transfer_count = 0;
+    while ((rc = bankDecodeRequest(in + offset, len - offset, &req, &used)) == 1) {
+        if (reserveArray((void **)&router->replies, &router->reply_cap, count + 1, sizeof(BankResponse)) != 0) {
+            break;   // served on the next call
+        }
+        BankResponse *reply = &router->replies[count];
+        reply->tag = req.tag;
+        reply->status = BANK_ERR_IO;
+        reply->account_number = req.account_number;
+        reply->balance = 0.0;
+        if (routeRequest(router, &req, reply, count) != 0) {
+            break;
+        }
+        offset += used;
+        count++;
+    }
+
+    if (router->transfer_count > 0) {
+        prepareTransfers(router);
+    }
+    exchange(router);
+    if (router->transfer_count > 0) {
+        decideTransfers(router);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (bankEncodeResponse(out, &router->replies[i]) != 0) {
+            rc = -1;
+            break;
+        }
+    }
+    if (router->log_size > ROUTER_LOG_LIMIT) {
+        rewriteLog(router);
+    }
+
+    *consumed = offset;
+    return rc < 0 ? -1 : (int)count;
+}
+
+// ---------------------------------------------------------------------------
+// Lifecycle and recovery
+// ---------------------------------------------------------------------------
+
+static int compareRecords(const void *a, const void *b) {
+    const RouterLogRecord *x = a, *y = b;
+    if (x->txid != y->txid) {
+        return x->txid < y->txid ? -1 : 1;
+    }
+    return (int)x->state - (int)y->state;
+}
+
+int routerRecover(BankRouter *router, const char *path) {
+    RouterLogRecord *records;
+    struct stat st;
+    size_t count = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? BANK_OK : BANK_ERR_IO;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return BANK_ERR_IO;
+    }
+    records = malloc((size_t)st.st_size + 1);
+    if (records == NULL) {
+        close(fd);
+        return BANK_ERR_IO;
+    }
+
+    // A torn record at the end was never acted on
+    ssize_t n = pread(fd, records, (size_t)st.st_size, 0);
+    close(fd);
+    while (n > 0 && count < (size_t)n / sizeof(RouterLogRecord) && records[count].magic == ROUTER_LOG_MAGIC) {
+        count++;
+    }
+
+    // Each transaction's records sort together, most advanced last
+    qsort(records, count, sizeof(RouterLogRecord), compareRecords);
+    router->decision_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        const RouterLogRecord *r = &records[i];
+        if ((i + 1 < count && records[i + 1].txid == r->txid) || r->state == ROUTER_DONE) {
+            continue;
+        }
+        if (reserveArray((void **)&router->decisions, &router->decision_cap, router->decision_count + 1,
+                         sizeof(RouterDecision)) != 0) {
+            free(records);
+            return BANK_ERR_IO;
+        }
+        RouterDecision *d = &router->decisions[router->decision_count++];
+        d->txid = r->txid;
+        d->from_account = r->from_account;
+        d->to_account = r->to_account;
+        d->result = r->state == ROUTER_DECIDED ? r->result : BANK_ERR_IO;
+        d->settled = 0;
+    }
+    free(records);
+
+    if (router->decision_count > 0) {
+        settle(router);
+    }
+    if (rewriteLog(router) != 0) {
+        return BANK_ERR_IO;
+    }
+    if (strcmp(path, router->log_path) != 0) {
+        unlink(path);
+    }
+    return BANK_OK;
+}
+
+int routerOpen(BankRouter *router, int shards, const char *dir, int instance, int wait_seconds) {
+    struct timespec ts;
+    const char *admin = getenv(ROUTER_ADMIN_ENV);
+
+    memset(router, 0, sizeof(*router));
+    router->log_fd = -1;
+    for (int k = 0; k < SHARD_MAX; k++) {
+        router->shard[k].fd = -1;
+    }
+    if (shards < 1 || shards > SHARD_MAX || instance < 0 || instance >= SHARD_MAX) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    router->shards = shards;
+    router->instance = instance;
+    snprintf(router->dir, sizeof(router->dir), "%s", dir);
+    snprintf(router->log_path, sizeof(router->log_path), ROUTER_LOG, dir, instance);
+    snprintf(router->admin_password, sizeof(router->admin_password), "%s", admin != NULL ? admin : "");
+
+    // Transaction ids start from the clock, one residue class per instance,
+    // so no two routers and no two runs hand out the same id
+    clock_gettime(CLOCK_REALTIME, &ts);
+    router->next_txid = (((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec) & ~(uint64_t)(SHARD_MAX - 1)) |
+                        (uint64_t)instance;
+
+    // The shard servers may still be starting
+    for (int tries = 0; reconnectShards(router) < shards; tries++) {
+        struct timespec pause = {0, 100000000};
+        if (tries >= wait_seconds * 10) {
+            routerClose(router);
+            return BANK_ERR_IO;
+        }
+        nanosleep(&pause, NULL);
+    }
+
+    router->log_fd = open(router->log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (router->log_fd < 0 || routerRecover(router, router->log_path) != BANK_OK) {
+        routerClose(router);
+        return BANK_ERR_IO;
+    }
+    return BANK_OK;
+}
+
+void routerClose(BankRouter *router) {
+    for (int k = 0; k < SHARD_MAX; k++) {
+        dropShard(&router->shard[k]);
+        bankBufferFree(&router->shard[k].tx);
+        bankBufferFree(&router->shard[k].rx);
+    }
+    if (router->log_fd >= 0) {
+        close(router->log_fd);
+        router->log_fd = -1;
+    }
+    bankBufferFree(&router->log_pending);
+    free(router->replies);
+    free(router->transfers);
+    free(router->decisions);
+    free(router->unsettled);
+    router->replies = NULL;
+    router->transfers = NULL;
+    router->decisions = NULL;
+    router->unsettled = NULL;
+}
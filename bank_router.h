@@ -0,0 +1,116 @@
+#ifndef BANK_ROUTER_H
+#define BANK_ROUTER_H
+
+#include <stdint.h>
+
+#include "bank_protocol.h"
+#include "bank_shard.h"
+
+// Front end of a sharded bank: speaks the client protocol and forwards each
+// request to the shard server owning its account (see bank_shard.h), all
+// shards of a client batch in parallel. New accounts go to the shards in
+// turn. A transfer between shards is run as a two-phase commit: both legs
+// are prepared, the decision is logged, then both are resolved.
+//
+// The decision log is this router's record of transfers in flight. A
+// transfer is logged as begun before any leg is prepared and decided before
+// any is resolved, so after a crash every shard can be told the outcome: a
+// decided transfer is resolved as decided, and one begun but undecided is
+// aborted. Like the shards' journals, the log is written before replies go
+// out and is not forced to disk, so it survives the process but not the
+// machine. Legs a shard could not be told about are retried before each
+// batch and kept in the log until settled.
+#define ROUTER_SHARD_DIR "%s/shard-%d"          // data directory of shard K
+#define ROUTER_SHARD_SOCKET "%s/shard-%d.sock"  // and its socket
+#define ROUTER_LOG "%s/router-%d.2pc"           // decision log of router instance I
+#define ROUTER_LOG_MAGIC 0x43505242u            // "BRPC"
+#define ROUTER_LOG_LIMIT (1024 * 1024)          // rewrite the log once it grows past this
+#define ROUTER_ADMIN_ENV "BANK_ADMIN_PASSWORD"  // authorises the steps shards only take from a router
+
+typedef enum {
+    ROUTER_BEGIN = 1,
+    ROUTER_DECIDED = 2,
+    ROUTER_DONE = 3
+} RouterState;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t state;                 // RouterState
+    uint64_t txid;
+    int32_t from_account;
+    int32_t to_account;
+    int32_t result;                 // BANK_OK commits, anything else aborts
+    int32_t reserved;
+} RouterLogRecord;
+
+// A decided transfer and the legs that have acknowledged it
+typedef struct {
+    uint64_t txid;
+    int32_t from_account;
+    int32_t to_account;
+    int32_t result;
+    int32_t settled;                // bit 0: debit leg, bit 1: credit leg
+} RouterDecision;
+
+// A cross-shard transfer of the batch being served
+typedef struct {
+    uint64_t txid;
+    uint32_t index;                 // position of the request in the batch
+    int32_t from_account;
+    int32_t to_account;
+    int32_t credit_status;          // reply to the credit leg's prepare
+    double amount;
+    char password[PASSWORD_LENGTH]; // the payer's, for the debit leg
+} RouterTransfer;
+
+typedef struct {
+    int fd;                         // -1 while disconnected
+    BankBuffer tx;
+    BankBuffer rx;
+    int expected;                   // replies outstanding
+} RouterShard;
+
+typedef struct {
+    int shards;
+    RouterShard shard[SHARD_MAX];
+    char dir[BANK_PATH_LENGTH];
+    char log_path[BANK_PATH_LENGTH + 32];
+    int log_fd;
+    uint64_t log_size;
+    BankBuffer log_pending;         // records written with the next logWrite
+    uint64_t next_txid;
+    int instance;
+    unsigned next_create;
+    char admin_password[PASSWORD_LENGTH];
+    int phase;                      // what replies being collected belong to
+    BankResponse *replies;          // per request of the batch
+    size_t reply_cap;
+    RouterTransfer *transfers;
+    size_t transfer_count;
+    size_t transfer_cap;
+    RouterDecision *decisions;
+    size_t decision_count;
+    size_t decision_cap;
+    RouterDecision *unsettled;      // decisions some shard has not acknowledged
+    size_t unsettled_count;
+    size_t unsettled_cap;
+    uint64_t forwarded;
+    uint64_t cross_shard;
+    uint64_t aborted;
+} BankRouter;
+
+// Connects to the shard sockets under `dir`, waiting up to `wait_seconds`
+// for them to appear, and settles what the log of router `instance` left
+// in flight. Returns BANK_OK or BANK_ERR_IO.
+int routerOpen(BankRouter *router, int shards, const char *dir, int instance, int wait_seconds);
+void routerClose(BankRouter *router);
+
+// Settles the transfers left in the decision log at `path`, written by a
+// router instance no longer running, then removes it
+int routerRecover(BankRouter *router, const char *path);
+
+// Same contract as bankServeBatch
+int routerServeBatch(BankRouter *router, const unsigned char *in, size_t len, size_t *consumed,
+                     BankBuffer *out);
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bank_rules.h"
+
+// Default limits, per hour
+#define RULES_WINDOW 3600
+#define RULES_MAX_OUTFLOWS 20
+#define RULES_MAX_OUTFLOW_TOTAL 10000.0
+#define RULES_MAX_NEW_PAYEES 3
+
+// Account numbers are dense, so they are mixed before picking a set
+static uint32_t mixAccount(int account_number) {
+    uint32_t x = (uint32_t)account_number;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+int rulesInit(RulesEngine *engine, size_t accounts) {
+    size_t sets = 1;
+
+    memset(engine, 0, sizeof(*engine));
+    while (sets * RULES_WAYS < accounts) {
+        sets <<= 1;
+    }
+    engine->accounts = calloc(sets * RULES_WAYS, sizeof(RulesAccount));
+    if (engine->accounts == NULL) {
+        return -1;
+    }
+    engine->set_mask = sets - 1;
+
+    engine->config.action = RULES_REJECT;
+    engine->config.window = RULES_WINDOW;
+    engine->config.max_outflows = RULES_MAX_OUTFLOWS;
+    engine->config.max_outflow_total = RULES_MAX_OUTFLOW_TOTAL;
+    engine->config.max_new_payees = RULES_MAX_NEW_PAYEES;
+    return 0;
+}
+
+void rulesFree(RulesEngine *engine) {
+    free(engine->accounts);
+    memset(engine, 0, sizeof(*engine));
+}
+
+static RulesAccount *rulesSet(RulesEngine *engine, int account_number) {
+    return engine->accounts + (mixAccount(account_number) & engine->set_mask) * RULES_WAYS;
+}
+
+static RulesAccount *rulesFind(RulesEngine *engine, int account_number) {
+    RulesAccount *set = rulesSet(engine, account_number);
+
+    for (int way = 0; way < RULES_WAYS; way++) {
+        if (set[way].account_number == account_number) {
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+static int knownPayee(const RulesAccount *entry, int payee) {
+    for (int i = 0; i < RULES_PAYEES; i++) {
+        if (entry->payees[i] == payee) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int rulesCheck(RulesEngine *engine, int account_number, int64_t now, double amount, int payee) {
+    const RulesConfig *config = &engine->config;
+    const RulesAccount *entry;
+    int violations = 0;
+    int outflows = 1;
+    double total = amount;
+
+    if (config->action == RULES_OFF) {
+        return 0;
+    }
+    engine->checked++;
+
+    // Times are stored as unsigned seconds; 0 marks an unused ring slot
+    uint32_t since = now > config->window ? (uint32_t)(now - config->window) : 1;
+
+    entry = rulesFind(engine, account_number);
+    if (entry != NULL) {
+        for (int i = 0; i < RULES_EVENTS; i++) {
+            if (entry->event_times[i] > since) {
+                outflows++;
+                total += entry->event_amounts[i];
+            }
+        }
+    }
+    if (outflows > config->max_outflows) {
+        violations |= RULE_OUTFLOW_COUNT;
+    }
+    if (total > config->max_outflow_total) {
+        violations |= RULE_OUTFLOW_TOTAL;
+    }
+
+    if (payee != 0 && (entry == NULL || !knownPayee(entry, payee))) {
+        int fresh = 1;
+        for (int i = 0; entry != NULL && i < RULES_NEW_PAYEES; i++) {
+            fresh += entry->new_payee_times[i] > since;
+        }
+        if (fresh > config->max_new_payees) {
+            violations |= RULE_NEW_PAYEES;
+        }
+    }
+    return violations;
+}
+
+void rulesRecord(RulesEngine *engine, int account_number, int64_t when, double amount, int payee) {
+    RulesAccount *set = rulesSet(engine, account_number);
+    RulesAccount *entry = &set[0];
+
+    for (int way = 0; way < RULES_WAYS; way++) {
+        if (set[way].account_number == account_number || set[way].account_number == 0) {
+            entry = &set[way];
+            break;
+        }
+        if (engine->clock - set[way].stamp > engine->clock - entry->stamp) {
+            entry = &set[way];
+        }
+    }
+    if (entry->account_number != account_number) {
+        if (entry->account_number != 0) {
+            engine->evictions++;
+        }
+        memset(entry, 0, sizeof(*entry));
+        entry->account_number = account_number;
+    }
+    entry->stamp = engine->clock++;
+
+    entry->event_times[entry->event_next] = (uint32_t)when;
+    entry->event_amounts[entry->event_next] = amount;
+    entry->event_next = (uint8_t)((entry->event_next + 1) % RULES_EVENTS);
+
+    if (payee != 0 && !knownPayee(entry, payee)) {
+        entry->payees[entry->payee_next] = payee;
+        entry->payee_next = (uint8_t)((entry->payee_next + 1) % RULES_PAYEES);
+        entry->new_payee_times[entry->new_next] = (uint32_t)when;
+        entry->new_next = (uint8_t)((entry->new_next + 1) % RULES_NEW_PAYEES);
+    }
+}
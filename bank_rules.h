@@ -0,0 +1,73 @@
+#ifndef BANK_RULES_H
+#define BANK_RULES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming velocity rules screened on every withdrawal and outgoing
+// transfer. Each tracked account keeps its recent outflows and payees in
+// small fixed rings, so a check reads one cache-friendly entry and never
+// allocates. Accounts live in a set-associative table like the idempotency
+// table: memory is fixed at open and the least recently active account in a
+// full set is forgotten. The table is rebuilt from the journal at startup.
+#define RULES_WAYS 4
+#define RULES_DEFAULT_ACCOUNTS 16384  // accounts tracked at once
+#define RULES_EVENTS 32               // outflows remembered per account
+#define RULES_PAYEES 8                // distinct recent payees per account
+#define RULES_NEW_PAYEES 8            // first-time payee transfers remembered
+
+// Violations reported by rulesCheck
+#define RULE_OUTFLOW_COUNT 0x1        // too many withdrawals and transfers out
+#define RULE_OUTFLOW_TOTAL 0x2        // too much money out
+#define RULE_NEW_PAYEES 0x4           // too many transfers to unfamiliar accounts
+
+typedef enum {
+    RULES_OFF,                        // no screening
+    RULES_FLAG,                       // allow, but mark the journal and log entry
+    RULES_REJECT                      // refuse with BANK_ERR_RISK_LIMIT
+} RulesAction;
+
+// May be changed after bankOpen
+typedef struct {
+    RulesAction action;
+    int64_t window;                   // seconds every limit looks back over
+    int max_outflows;                 // per window, at most RULES_EVENTS - 1
+    double max_outflow_total;         // per window
+    int max_new_payees;               // per window, at most RULES_NEW_PAYEES - 1
+} RulesConfig;
+
+typedef struct {
+    int32_t account_number;           // 0 marks an empty way
+    uint32_t stamp;                   // last activity clock, oldest way is evicted first
+    uint8_t event_next;
+    uint8_t payee_next;
+    uint8_t new_next;
+    uint8_t reserved;
+    uint32_t event_times[RULES_EVENTS];
+    double event_amounts[RULES_EVENTS];
+    int32_t payees[RULES_PAYEES];
+    uint32_t new_payee_times[RULES_NEW_PAYEES];
+} RulesAccount;
+
+typedef struct {
+    RulesConfig config;
+    RulesAccount *accounts;
+    size_t set_mask;
+    uint32_t clock;
+    uint64_t checked;
+    uint64_t flagged;
+    uint64_t rejected;
+    uint64_t evictions;
+} RulesEngine;
+
+int rulesInit(RulesEngine *engine, size_t accounts);
+void rulesFree(RulesEngine *engine);
+
+// Returns the RULE_* bits the outflow would break, counting itself. `payee`
+// is the receiving account of a transfer, 0 for a withdrawal.
+int rulesCheck(RulesEngine *engine, int account_number, int64_t now, double amount, int payee);
+
+// Adds an outflow that went through, live or replayed from the journal
+void rulesRecord(RulesEngine *engine, int account_number, int64_t when, double amount, int payee);
+
+#endif
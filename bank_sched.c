@@ -0,0 +1,628 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bank_sched.h"
+#include "bank_internal.h"
+
+// Four wheels of 256 one-second slots cover 2^32 seconds. An order sits on
+// the lowest wheel whose span reaches its due time and moves down a level
+// each time the wheel below wraps around to it.
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define NO_ORDER UINT32_MAX
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t generation;            // bumped by every change to the orders
+    uint64_t applied_lsn;           // journal end when the orders file was last in step
+} OrdersHeader;
+
+struct BankScheduler {
+    int fd;
+    StandingOrder *orders;          // indexed by order id
+    uint32_t *link;                 // next order in the same wheel slot
+    size_t count;
+    size_t capacity;
+    uint32_t generation;            // of the orders file when last read or written here
+    uint32_t wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+    int64_t now;                    // last tick processed
+    uint32_t *due;                  // orders collected by the current advance
+    size_t due_count;
+    size_t due_cap;
+};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Journal key of one occurrence of an order
+static uint64_t occurrenceKey(const StandingOrder *order) {
+    uint64_t key = mix64(((uint64_t)order->id << 32) ^ (uint64_t)order->next_due ^ 0x4f52444552ULL);
+    return key != 0 ? key : 1;
+}
+
+// ---- timer wheel ----
+
+static void wheelInsert(BankScheduler *sched, uint32_t id) {
+    int64_t due = sched->orders[id].next_due;
+    int64_t horizon = ((int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    int level = 0;
+
+    if (due <= sched->now) {
+        due = sched->now + 1;          // overdue: fire on the next tick
+    }
+    if (due - sched->now > horizon) {
+        due = sched->now + horizon;    // re-examined when it comes round
+    }
+    while (level < WHEEL_LEVELS - 1 && due - sched->now >= ((int64_t)1 << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    uint32_t *head = &sched->wheel[level][(due >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    sched->link[id] = *head;
+    *head = id;
+}
+
+static int dueAppend(BankScheduler *sched, uint32_t id) {
+    if (sched->due_count == sched->due_cap) {
+        size_t cap = sched->due_cap ? sched->due_cap * 2 : 1024;
+        uint32_t *grown = realloc(sched->due, cap * sizeof(uint32_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        sched->due = grown;
+        sched->due_cap = cap;
+    }
+    sched->due[sched->due_count++] = id;
+    return 0;
+}
+
+// Moves one tick forward: refills lower wheels from the higher wheel slots
+// that just came due, then collects the orders in the current slot
+static void wheelTick(BankScheduler *sched) {
+    sched->now++;
+
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if ((sched->now & (((int64_t)1 << (WHEEL_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        uint32_t *slot = &sched->wheel[level][(sched->now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+        uint32_t id = *slot;
+        *slot = NO_ORDER;
+        while (id != NO_ORDER) {
+            uint32_t next = sched->link[id];
+            wheelInsert(sched, id);
+            id = next;
+        }
+    }
+
+    uint32_t *slot = &sched->wheel[0][sched->now & WHEEL_MASK];
+    uint32_t id = *slot;
+    *slot = NO_ORDER;
+    while (id != NO_ORDER) {
+        uint32_t next = sched->link[id];
+        StandingOrder *order = &sched->orders[id];
+        // Cancelled orders are dropped here instead of being unlinked
+        if (order->status == ORDER_ACTIVE) {
+            if (order->next_due <= sched->now) {
+                if (dueAppend(sched, id) != 0) {
+                    wheelInsert(sched, id);   // retried next tick
+                }
+            } else {
+                wheelInsert(sched, id);
+            }
+        }
+        id = next;
+    }
+}
+
+// ---- persistence ----
+
+static off_t orderOffset(uint32_t id) {
+    return (off_t)sizeof(OrdersHeader) + (off_t)id * (off_t)sizeof(StandingOrder);
+}
+
+static int writeHeader(BankScheduler *sched, uint64_t applied_lsn) {
+    OrdersHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ORDERS_MAGIC;
+    header.version = ORDERS_VERSION;
+    header.count = (uint32_t)sched->count;
+    header.generation = sched->generation;
+    header.applied_lsn = applied_lsn;
+    return pwrite(sched->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) ? 0 : -1;
+}
+
+static int compareIds(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Stores the given orders, one write per run of consecutive ids
+static int writeOrders(BankScheduler *sched, uint32_t *ids, size_t count) {
+    qsort(ids, count, sizeof(uint32_t), compareIds);
+    for (size_t i = 0; i < count;) {
+        size_t j = i + 1;
+        while (j < count && ids[j] == ids[j - 1] + 1) {
+            j++;
+        }
+        size_t bytes = (ids[j - 1] - ids[i] + 1) * sizeof(StandingOrder);
+        if (pwrite(sched->fd, &sched->orders[ids[i]], bytes, orderOffset(ids[i])) != (ssize_t)bytes) {
+            return -1;
+        }
+        i = j;
+    }
+    return 0;
+}
+
+static int reserveOrders(BankScheduler *sched, size_t count) {
+    if (count <= sched->capacity) {
+        return 0;
+    }
+    size_t capacity = sched->capacity ? sched->capacity : 1024;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    StandingOrder *orders = realloc(sched->orders, capacity * sizeof(StandingOrder));
+    if (orders == NULL) {
+        return -1;
+    }
+    sched->orders = orders;
+    uint32_t *link = realloc(sched->link, capacity * sizeof(uint32_t));
+    if (link == NULL) {
+        return -1;
+    }
+    sched->link = link;
+    sched->capacity = capacity;
+    return 0;
+}
+
+// Blocks until the orders file is held, or releases it with F_UNLCK
+static int lockOrders(BankScheduler *sched, short type) {
+    struct flock lock;
+#ifdef F_OFD_SETLKW
+    int command = F_OFD_SETLKW;
+#else
+    int command = F_SETLKW;
+#endif
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(sched->fd, command, &lock) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void rebuildWheel(BankScheduler *sched) {
+    memset(sched->wheel, 0xff, sizeof(sched->wheel));
+    for (uint32_t id = 0; id < sched->count; id++) {
+        if (sched->orders[id].status == ORDER_ACTIVE) {
+            wheelInsert(sched, id);
+        }
+    }
+}
+
+// Holds the orders file and picks up the orders other processes created,
+// cancelled or fired since this one last looked
+static int takeOrders(BankScheduler *sched) {
+    OrdersHeader header;
+
+    if (lockOrders(sched, F_WRLCK) != 0) {
+        return -1;
+    }
+    if (pread(sched->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        lockOrders(sched, F_UNLCK);
+        return -1;
+    }
+    if (header.generation == sched->generation && header.count == sched->count) {
+        return 0;
+    }
+    size_t bytes = (size_t)header.count * sizeof(StandingOrder);
+    if (reserveOrders(sched, (size_t)header.count) != 0 ||
+        pread(sched->fd, sched->orders, bytes, sizeof(header)) != (ssize_t)bytes) {
+        lockOrders(sched, F_UNLCK);
+        return -1;
+    }
+    sched->count = (size_t)header.count;
+    sched->generation = header.generation;
+    rebuildWheel(sched);
+    return 0;
+}
+
+static void releaseOrders(BankScheduler *sched) {
+    lockOrders(sched, F_UNLCK);
+}
+
+// Records a change written to the orders file, for other processes to see
+static int changedOrders(Bank *bank, BankScheduler *sched) {
+    sched->generation++;
+    return writeHeader(sched, bank->journal.end);
+}
+
+// Moves an order past the occurrence that just fired (or was skipped)
+static void advanceOrder(StandingOrder *order) {
+    if (order->remaining > 0) {
+        order->remaining--;
+    }
+    if (order->remaining == 0 || order->interval <= 0) {
+        order->status = ORDER_FINISHED;
+    } else {
+        order->next_due += order->interval;
+    }
+}
+
+// Transfers journaled after the orders file was last written belong to
+// occurrences that fired just before a crash; mark those as done
+static int recoverFired(Bank *bank, BankScheduler *sched, uint64_t applied_lsn) {
+    JournalReader reader;
+    JournalRecord record;
+    uint32_t *table = NULL, *fired = NULL;
+    size_t mask = 0, fired_count = 0;
+    int result = 0;
+
+    if (applied_lsn >= bank->journal.end || journalReaderOpen(&reader, &bank->storage) != 0) {
+        return 0;
+    }
+    journalReaderSeek(&reader, applied_lsn);
+
+    while (journalReaderNext(&reader, &record)) {
+        if (record.type != TRANSACTION_TRANSFER_OUT || record.idempotency_key == 0) {
+            continue;
+        }
+        if (table == NULL) {
+            // Key -> order for every active occurrence, built on first need
+            size_t size = 16;
+            while (size < sched->count * 2) {
+                size <<= 1;
+            }
+            mask = size - 1;
+            table = malloc(size * sizeof(uint32_t));
+            fired = malloc((sched->count ? sched->count : 1) * sizeof(uint32_t));
+            if (table == NULL || fired == NULL) {
+                result = -1;
+                break;
+            }
+            memset(table, 0xff, size * sizeof(uint32_t));
+            for (uint32_t id = 0; id < sched->count; id++) {
+                if (sched->orders[id].status == ORDER_ACTIVE) {
+                    size_t i = mix64(occurrenceKey(&sched->orders[id])) & mask;
+                    while (table[i] != NO_ORDER) {
+                        i = (i + 1) & mask;
+                    }
+                    table[i] = id;
+                }
+            }
+        }
+        for (size_t i = mix64(record.idempotency_key) & mask; table[i] != NO_ORDER; i = (i + 1) & mask) {
+            if (table[i] >= sched->count) {
+                continue;   // already matched
+            }
+            StandingOrder *order = &sched->orders[table[i]];
+            if (order->status == ORDER_ACTIVE && occurrenceKey(order) == record.idempotency_key &&
+                order->from_account == record.account_number) {
+                advanceOrder(order);
+                fired[fired_count++] = table[i];
+                table[i] = NO_ORDER - 1;   // keeps the probe chain intact
+                break;
+            }
+        }
+    }
+    journalReaderClose(&reader);
+
+    if (result == 0 && fired_count > 0) {
+        result = writeOrders(sched, fired, fired_count) != 0 || changedOrders(bank, sched) != 0 ? -1 : 0;
+    }
+    free(table);
+    free(fired);
+    return result;
+}
+
+int schedOpen(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(ORDERS_SUFFIX)];
+    OrdersHeader header;
+    BankScheduler *sched = calloc(1, sizeof(BankScheduler));
+
+    if (sched == NULL) {
+        return BANK_ERR_IO;
+    }
+    memset(sched->wheel, 0xff, sizeof(sched->wheel));
+    // One second behind, so orders already overdue fire on the first run
+    sched->now = (int64_t)time(NULL) - 1;
+
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, ORDERS_SUFFIX);
+    sched->fd = storageOpenSide(&bank->storage, path, O_RDWR | O_CREAT);
+    if (sched->fd < 0) {
+        free(sched);
+        return BANK_ERR_IO;
+    }
+
+    if (lockOrders(sched, F_WRLCK) != 0) {
+        close(sched->fd);
+        free(sched);
+        return BANK_ERR_IO;
+    }
+    bank->scheduler = sched;
+    if (pread(sched->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        // New file: nothing in the journal predates it
+        if (writeHeader(sched, bank->journal.end) != 0) {
+            schedClose(bank);
+            return BANK_ERR_IO;
+        }
+        releaseOrders(sched);
+        return BANK_OK;
+    }
+    if (header.magic != ORDERS_MAGIC || (header.version != ORDERS_VERSION && header.version != 1) ||
+        reserveOrders(sched, (size_t)header.count) != 0) {
+        schedClose(bank);
+        return BANK_ERR_IO;
+    }
+
+    size_t bytes = (size_t)header.count * sizeof(StandingOrder);
+    if (pread(sched->fd, sched->orders, bytes, sizeof(header)) != (ssize_t)bytes) {
+        schedClose(bank);
+        return BANK_ERR_IO;
+    }
+    sched->count = (size_t)header.count;
+    sched->generation = header.generation;
+
+    if (recoverFired(bank, sched, header.applied_lsn) != 0) {
+        schedClose(bank);
+        return BANK_ERR_IO;
+    }
+    rebuildWheel(sched);
+    releaseOrders(sched);
+    return BANK_OK;
+}
+
+void schedClose(Bank *bank) {
+    BankScheduler *sched = bank->scheduler;
+    if (sched == NULL) {
+        return;
+    }
+    // Every fired occurrence is on disk by now, so the journal so far is
+    // settled. Closing the file releases it if it is held.
+    if (takeOrders(sched) == 0) {
+        writeHeader(sched, bank->journal.end);
+    }
+    close(sched->fd);
+    free(sched->orders);
+    free(sched->link);
+    free(sched->due);
+    free(sched);
+    bank->scheduler = NULL;
+}
+
+// ---- public API ----
+
+static int createOrder(Bank *bank, int from_account, int to_account, double amount, int64_t first_due,
+                       int64_t interval, int remaining, StandingOrder *created) {
+    BankScheduler *sched = bank->scheduler;
+    Account account;
+
+    if (sched == NULL) {
+        return BANK_ERR_IO;
+    }
+    if (amount <= 0 || interval < 0 || remaining < 0) {
+        return BANK_ERR_INVALID_AMOUNT;
+    }
+    if (from_account == to_account) {
+        return BANK_ERR_SAME_ACCOUNT;
+    }
+    if (bankFindAccount(bank, from_account, &account) != BANK_OK ||
+        bankFindAccount(bank, to_account, &account) != BANK_OK) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (takeOrders(sched) != 0) {
+        return BANK_ERR_IO;
+    }
+    if (sched->count >= NO_ORDER - 1 || reserveOrders(sched, sched->count + 1) != 0) {
+        releaseOrders(sched);
+        return BANK_ERR_IO;
+    }
+
+    uint32_t id = (uint32_t)sched->count;
+    StandingOrder *order = &sched->orders[id];
+    memset(order, 0, sizeof(*order));
+    order->id = id;
+    order->status = ORDER_ACTIVE;
+    order->from_account = from_account;
+    order->to_account = to_account;
+    order->amount = amount;
+    order->next_due = first_due;
+    order->interval = interval;
+    order->remaining = interval == 0 ? 1 : remaining == 0 ? -1 : remaining;
+    order->created = (int64_t)time(NULL);
+
+    int stored = pwrite(sched->fd, order, sizeof(*order), orderOffset(id)) == (ssize_t)sizeof(*order);
+    if (stored) {
+        sched->count++;
+        if (changedOrders(bank, sched) != 0) {
+            sched->count--;
+            sched->generation--;
+            stored = 0;
+        }
+    }
+    releaseOrders(sched);
+    if (!stored) {
+        return BANK_ERR_IO;
+    }
+
+    wheelInsert(sched, id);
+    if (created != NULL) {
+        *created = *order;
+    }
+    return BANK_OK;
+}
+
+int bankCreateOrder(Bank *bank, int from_account, int to_account, double amount, int64_t first_due,
+                    int64_t interval, int remaining, StandingOrder *created) {
+    uint64_t began = traceBegin(bank);
+    int result = createOrder(bank, from_account, to_account, amount, first_due, interval, remaining, created);
+    TraceRecord record;
+
+    if (began != 0) {
+        memset(&record, 0, sizeof(record));
+        record.op = TRACE_ORDER_CREATE;
+        record.result = result;
+        record.account_number = from_account;
+        record.related = to_account;
+        record.amount = amount;
+        record.arg = first_due - (int64_t)time(NULL);
+        record.limit = (double)interval;
+        record.count = remaining;
+        traceEnd(bank, began, &record);
+    }
+    return result;
+}
+
+static int cancelOrder(Bank *bank, int account_number, uint32_t order_id) {
+    BankScheduler *sched = bank->scheduler;
+    int result = BANK_OK;
+
+    if (sched == NULL || takeOrders(sched) != 0) {
+        return BANK_ERR_IO;
+    }
+    if (order_id >= sched->count || sched->orders[order_id].from_account != account_number ||
+        sched->orders[order_id].status != ORDER_ACTIVE) {
+        result = BANK_ERR_NOT_FOUND;
+    } else {
+        sched->orders[order_id].status = ORDER_CANCELLED;
+        if (pwrite(sched->fd, &sched->orders[order_id], sizeof(StandingOrder), orderOffset(order_id)) !=
+                (ssize_t)sizeof(StandingOrder) ||
+            changedOrders(bank, sched) != 0) {
+            result = BANK_ERR_IO;
+        }
+    }
+    releaseOrders(sched);
+    return result;
+}
+
+int bankCancelOrder(Bank *bank, int account_number, uint32_t order_id) {
+    uint64_t began = traceBegin(bank);
+    int result = cancelOrder(bank, account_number, order_id);
+    traceOp(bank, began, TRACE_ORDER_CANCEL, result, account_number, 0, 0.0, (int64_t)order_id);
+    return result;
+}
+
+int bankListOrders(Bank *bank, int account_number, StandingOrder *orders, int max_orders) {
+    BankScheduler *sched = bank->scheduler;
+    uint64_t began = traceBegin(bank);
+    int found = 0;
+    TraceRecord record;
+
+    // Without the file, the orders as this process last saw them
+    int held = sched != NULL && takeOrders(sched) == 0;
+    for (size_t id = 0; sched != NULL && id < sched->count && found < max_orders; id++) {
+        const StandingOrder *order = &sched->orders[id];
+        if (order->status == ORDER_ACTIVE && (account_number == 0 || order->from_account == account_number)) {
+            orders[found++] = *order;
+        }
+    }
+    if (held) {
+        releaseOrders(sched);
+    }
+    if (began != 0) {
+        memset(&record, 0, sizeof(record));
+        record.op = TRACE_ORDER_LIST;
+        record.account_number = account_number;
+        record.count = max_orders;
+        record.result = found;
+        traceEnd(bank, began, &record);
+    }
+    return found;
+}
+
+// Executes the collected orders, up to ORDERS_BATCH_MAX per commit
+static int fireDue(Bank *bank, BankScheduler *sched, BankOrderStats *stats) {
+    int result = BANK_OK;
+
+    for (size_t first = 0; first < sched->due_count && result == BANK_OK; first += ORDERS_BATCH_MAX) {
+        size_t last = sched->due_count - first > ORDERS_BATCH_MAX ? first + ORDERS_BATCH_MAX : sched->due_count;
+
+        bankBeginBatch(bank);
+        for (size_t i = first; i < last; i++) {
+            StandingOrder *order = &sched->orders[sched->due[i]];
+            int transfer = bankApplyTransfer(bank, occurrenceKey(order), order->from_account,
+                                             order->to_account, order->amount);
+            if (transfer == BANK_OK) {
+                stats->fired++;
+            } else {
+                order->failures++;
+                stats->failed++;
+            }
+            // An order between accounts that no longer take transfers ends here
+            if (transfer == BANK_ERR_ACCOUNT_CLOSED || transfer == BANK_ERR_NOT_FOUND) {
+                order->status = ORDER_CANCELLED;
+            } else {
+                advanceOrder(order);
+            }
+        }
+        result = bankCommitBatch(bank);
+
+        // Orders are written only once their transfers are in the journal;
+        // a crash in between is settled by recoverFired on the next open
+        if (result == BANK_OK && (writeOrders(sched, sched->due + first, last - first) != 0 ||
+                                  changedOrders(bank, sched) != 0)) {
+            result = BANK_ERR_IO;
+        }
+        stats->commits++;
+
+        for (size_t i = first; i < last; i++) {
+            if (sched->orders[sched->due[i]].status == ORDER_ACTIVE) {
+                wheelInsert(sched, sched->due[i]);
+            }
+        }
+    }
+    sched->due_count = 0;
+    return result;
+}
+
+static int runDueOrders(Bank *bank, int64_t now, BankOrderStats *stats) {
+    BankScheduler *sched = bank->scheduler;
+    BankOrderStats local;
+    int result = BANK_OK;
+
+    if (stats == NULL) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(*stats));
+    if (sched == NULL || takeOrders(sched) != 0) {
+        return BANK_ERR_IO;
+    }
+
+    while (sched->now < now && result == BANK_OK) {
+        wheelTick(sched);
+        if (sched->due_count > 0) {
+            result = fireDue(bank, sched, stats);
+        }
+    }
+    releaseOrders(sched);
+    return result;
+}
+
+int bankRunDueOrders(Bank *bank, int64_t now, BankOrderStats *stats) {
+    uint64_t began = traceBegin(bank);
+    int result = runDueOrders(bank, now, stats);
+    traceOp(bank, began, TRACE_RUN_DUE, result, 0, 0, 0.0, now - (int64_t)time(NULL));
+    return result;
+}
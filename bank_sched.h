@@ -0,0 +1,56 @@
+#ifndef BANK_SCHED_H
+#define BANK_SCHED_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Standing orders: transfers repeated on a schedule, kept in <store>.orders
+// and driven by a hierarchical timer wheel. Orders due at the same tick are
+// executed together under one commit. Processes sharing a store hold the
+// orders file exclusively to change or run its orders, and first reload
+// whatever another process changed, so each occurrence fires once.
+#define ORDERS_SUFFIX ".orders"
+#define ORDERS_MAGIC 0x44524f42u    // "BORD"
+#define ORDERS_VERSION 2            // 1 had no generation, and reads as generation 0
+#define ORDERS_BATCH_MAX 65536      // transfers per commit when a tick is larger
+
+typedef enum {
+    ORDER_CANCELLED = 0,
+    ORDER_ACTIVE = 1,
+    ORDER_FINISHED = 2
+} OrderStatus;
+
+typedef struct {
+    uint32_t id;
+    int32_t status;                 // OrderStatus
+    int32_t from_account;
+    int32_t to_account;
+    double amount;
+    int64_t next_due;               // unix time of the next transfer
+    int64_t interval;               // seconds between transfers, 0 for a one-off
+    int32_t remaining;              // transfers left, -1 until cancelled
+    int32_t failures;               // occurrences that could not be paid
+    int64_t created;
+} StandingOrder;
+
+typedef struct {
+    long fired;                     // transfers executed
+    long failed;                    // occurrences that could not be paid
+    long commits;
+} BankOrderStats;
+
+// `remaining` of 0 repeats until cancelled; an `interval` of 0 makes a
+// single scheduled transfer
+int bankCreateOrder(Bank *bank, int from_account, int to_account, double amount, int64_t first_due,
+                    int64_t interval, int remaining, StandingOrder *created);
+int bankCancelOrder(Bank *bank, int account_number, uint32_t order_id);
+
+// Fills up to `max_orders` active orders paying from `account_number`, or
+// from any account when it is 0; returns how many were found
+int bankListOrders(Bank *bank, int account_number, StandingOrder *orders, int max_orders);
+
+// Fires every order due at or before `now`
+int bankRunDueOrders(Bank *bank, int64_t now, BankOrderStats *stats);
+
+#endif
@@ -0,0 +1,528 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bank_shard.h"
+#include "bank_internal.h"
+
+// A prepared leg, held from its prepare record until the record resolving it
+typedef struct {
+    uint64_t txid;
+    int32_t account_number;
+    int32_t related_account;
+    double amount;
+    int outgoing;                 // the debit leg; the credit leg otherwise
+} PendingLeg;
+
+// Held legs are what the journal says: every process sharing the store
+// reads the leg records the others append (followLegs), and its own as it
+// writes them (shardWritten), so a leg prepared anywhere is seen everywhere
+struct BankTwoPhase {
+    PendingLeg *legs;
+    size_t count;
+    size_t cap;
+    uint64_t journal_id;          // journal the legs were read from
+    uint64_t lsn;                 // every leg record before this position is applied
+};
+
+void bankShardRange(int shard, int shards, int *first, int *last) {
+    long long span = (long long)MAX_ACCOUNT_NUMBER - MIN_ACCOUNT_NUMBER + 1;
+
+    // Rounding up keeps the ranges exactly the numbers bankShardOf maps to them
+    *first = MIN_ACCOUNT_NUMBER + (int)((span * shard + shards - 1) / shards);
+    *last = MIN_ACCOUNT_NUMBER + (int)((span * (shard + 1) + shards - 1) / shards) - 1;
+}
+
+int bankShardOf(int account_number, int shards) {
+    long long span = (long long)MAX_ACCOUNT_NUMBER - MIN_ACCOUNT_NUMBER + 1;
+
+    if (account_number < MIN_ACCOUNT_NUMBER || account_number > MAX_ACCOUNT_NUMBER) {
+        return 0;   // not an account; any shard reports it missing
+    }
+    return (int)((long long)(account_number - MIN_ACCOUNT_NUMBER) * shards / span);
+}
+
+int bankSetShard(Bank *bank, int shard, int shards) {
+    if (shards < 1 || shards > SHARD_MAX || shard < 0 || shard >= shards) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    bank->shard = shard;
+    bank->shards = shards;
+    return BANK_OK;
+}
+
+static PendingLeg *findLeg(Bank *bank, uint64_t txid) {
+    BankTwoPhase *tp = bank->twophase;
+
+    for (size_t i = 0; tp != NULL && i < tp->count; i++) {
+        if (tp->legs[i].txid == txid) {
+            return &tp->legs[i];
+        }
+    }
+    return NULL;
+}
+
+static BankTwoPhase *twoPhase(Bank *bank) {
+    if (bank->twophase == NULL) {
+        bank->twophase = calloc(1, sizeof(BankTwoPhase));
+    }
+    return bank->twophase;
+}
+
+static int holdLeg(Bank *bank, uint64_t txid, int account_number, int related_account, double amount,
+                   int outgoing) {
+    BankTwoPhase *tp = twoPhase(bank);
+
+    if (tp == NULL) {
+        return -1;
+    }
+    if (tp->count == tp->cap) {
+        size_t cap = tp->cap ? tp->cap * 2 : 16;
+        PendingLeg *legs = realloc(tp->legs, cap * sizeof(PendingLeg));
+        if (legs == NULL) {
+            return -1;
+        }
+        tp->legs = legs;
+        tp->cap = cap;
+    }
+    PendingLeg *leg = &tp->legs[tp->count++];
+    leg->txid = txid;
+    leg->account_number = account_number;
+    leg->related_account = related_account;
+    leg->amount = amount;
+    leg->outgoing = outgoing;
+    return 0;
+}
+
+static void releaseLeg(Bank *bank, PendingLeg *leg) {
+    BankTwoPhase *tp = bank->twophase;
+
+    if (leg != NULL) {
+        *leg = tp->legs[--tp->count];
+    }
+}
+
+int shardLegRecord(const JournalRecord *record) {
+    return (record->flags & JOURNAL_PREPARED) || record->type == TRANSACTION_PREPARED ||
+           record->type == TRANSACTION_RESOLVED;
+}
+
+// Under the journal lock: applies the leg records appended since the legs
+// were last brought up to date, by any process. A journal emptied or
+// replaced since (a replica resynchronising) is read again from the start.
+static int followLegs(Bank *bank) {
+    BankTwoPhase *tp = twoPhase(bank);
+    uint64_t size = storageJournalSize(&bank->storage);
+    JournalReader reader;
+    JournalRecord record;
+
+    if (tp == NULL) {
+        return -1;
+    }
+    if (tp->journal_id != bank->journal.id || tp->lsn > size) {
+        tp->count = 0;
+        tp->journal_id = bank->journal.id;
+        tp->lsn = sizeof(JournalHeader);
+    }
+    if (tp->lsn + sizeof(JournalRecord) > size) {
+        return 0;
+    }
+    if (journalReaderOpen(&reader, &bank->storage) != 0) {
+        return -1;
+    }
+    journalReaderSeek(&reader, tp->lsn);
+    while (journalReaderNext(&reader, &record)) {
+        if (shardLegRecord(&record)) {
+            shardReplay(bank, &record);
+        }
+    }
+    tp->lsn = reader.offset;
+    journalReaderClose(&reader);
+    return 0;
+}
+
+static int syncLegs(Bank *bank) {
+    int failed;
+
+    if (storageLockJournal(&bank->storage, STORAGE_LOCK_SHARED) != 0) {
+        return BANK_ERR_IO;
+    }
+    failed = followLegs(bank) != 0;
+    storageLockJournal(&bank->storage, STORAGE_UNLOCK);
+    return failed ? BANK_ERR_IO : BANK_OK;
+}
+
+void shardReplayed(Bank *bank, uint64_t lsn) {
+    BankTwoPhase *tp = twoPhase(bank);
+
+    if (tp != NULL) {
+        tp->journal_id = bank->journal.id;
+        tp->lsn = lsn;
+    }
+}
+
+void shardWritten(Bank *bank, const void *records, size_t count) {
+    BankTwoPhase *tp = twoPhase(bank);
+    JournalRecord record;
+
+    if (tp == NULL || count == 0) {
+        return;
+    }
+    memcpy(&record, records, sizeof(record));
+    if (tp->journal_id != bank->journal.id || tp->lsn != record.lsn) {
+        followLegs(bank);   // the batch is in the file already
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&record, (const unsigned char *)records + i * sizeof(record), sizeof(record));
+        if (shardLegRecord(&record)) {
+            shardReplay(bank, &record);
+        }
+    }
+    tp->lsn = record.lsn + sizeof(JournalRecord);
+}
+
+int bankPendingTransfers(Bank *bank, int account_number) {
+    BankTwoPhase *tp;
+    int pending = 0;
+
+    syncLegs(bank);
+    tp = bank->twophase;
+
+    for (size_t i = 0; tp != NULL && i < tp->count; i++) {
+        if (account_number == 0 || tp->legs[i].account_number == account_number) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+void shardReplay(Bank *bank, const JournalRecord *record) {
+    PendingLeg *leg = findLeg(bank, record->idempotency_key);
+
+    // A leg this process holds already is met again as its record is written
+    switch (record->type) {
+        case TRANSACTION_TRANSFER_OUT:
+            if (leg == NULL) {
+                holdLeg(bank, record->idempotency_key, record->account_number, record->related_account,
+                        record->amount, 1);
+            }
+            break;
+        case TRANSACTION_PREPARED:
+            if (leg == NULL) {
+                holdLeg(bank, record->idempotency_key, record->account_number, record->related_account,
+                        record->amount, 0);
+            }
+            break;
+        default: {
+            int result = (record->flags >> JOURNAL_RESULT_SHIFT) & 0xff;
+            if (leg == NULL) {
+                break;
+            }
+            if (result != BANK_OK) {
+                idemRemember(&bank->idempotency, leg->txid,
+                             leg->outgoing ? TRANSACTION_TRANSFER_OUT : TRANSACTION_PREPARED,
+                             leg->account_number, leg->related_account, leg->amount, result, 0.0);
+            }
+            releaseLeg(bank, leg);
+            break;
+        }
+    }
+}
+
+void shardClose(Bank *bank) {
+    if (bank->twophase != NULL) {
+        free(bank->twophase->legs);
+        free(bank->twophase);
+        bank->twophase = NULL;
+    }
+}
+
+// Journal-only record: the text log shows money moving, not protocol steps
+static int journalMark(Bank *bank, uint64_t txid, int account_number, TransactionType type,
+                       double amount, double balance_after, int related_account, const char *description,
+                       int flags) {
+    JournalRecord record;
+
+    bankFillJournalRecord(&record, txid, account_number, type, amount, balance_after, related_account,
+                          description);
+    record.flags = flags;
+    return bankAppendJournal(bank, &record, 1);
+}
+
+// A prepare resent once its transaction id has left the retry table, or
+// sent to another process sharing the store, finds the leg it prepared:
+// the same leg is already done, anything else under its id is refused
+static int heldAlready(Bank *bank, uint64_t txid, int account_number, int related_account, double amount,
+                       int outgoing, int *result) {
+    const PendingLeg *leg;
+
+    if (syncLegs(bank) != BANK_OK) {
+        *result = BANK_ERR_IO;
+        return 1;
+    }
+    leg = findLeg(bank, txid);
+    if (leg == NULL) {
+        return 0;
+    }
+    *result = leg->account_number == account_number && leg->related_account == related_account &&
+              leg->amount == amount && leg->outgoing == outgoing ? BANK_OK : BANK_ERR_INVALID_REQUEST;
+    return 1;
+}
+
+// A prepared leg has to outlive a crash once the coordinator hears of it.
+// Inside a batch the sync waits for the commit, ahead of the replies.
+static int syncPrepared(Bank *bank) {
+    if (bank->batch_depth > 0) {
+        bank->journal_sync = 1;
+        return BANK_OK;
+    }
+    return journalSync(&bank->journal) != 0 ? BANK_ERR_IO : BANK_OK;
+}
+
+static int debitAt(Bank *bank, uint64_t txid, long slot, int account_number, int to_account, double amount,
+                   Account *account) {
+    char desc[100];
+
+    int loaded = bankReadRecord(bank, slot, account);
+    int held;
+
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+    if (heldAlready(bank, txid, account_number, to_account, amount, 1, &held)) {
+        return held;
+    }
+    if (bankRequireActive(account) != BANK_OK) {
+        return bankRequireActive(account);
+    }
+    if (amount > account->balance) {
+        return BANK_ERR_INSUFFICIENT_FUNDS;
+    }
+
+    snprintf(desc, sizeof(desc), "Transfer to account %d", to_account);
+    int screened = bankScreenOutflow(bank, account_number, amount, to_account, desc, sizeof(desc));
+    if (screened != BANK_OK) {
+        return screened;
+    }
+    if (holdLeg(bank, txid, account_number, to_account, amount, 1) != 0) {
+        return BANK_ERR_IO;
+    }
+
+    Account before = *account;
+    account->balance -= amount;
+    account->last_accessed = time(NULL);
+    if (bankWriteRecord(bank, slot, account) != BANK_OK) {
+        releaseLeg(bank, findLeg(bank, txid));
+        return BANK_ERR_IO;
+    }
+
+    if (bankLogTransaction(bank, account_number, TRANSACTION_TRANSFER_OUT, amount, account->balance,
+                           to_account, desc, txid, JOURNAL_PREPARED) != BANK_OK) {
+        bankWriteRecord(bank, slot, &before);
+        releaseLeg(bank, findLeg(bank, txid));
+        return BANK_ERR_IO;
+    }
+    rulesRecord(&bank->rules, account_number, account->last_accessed, amount, to_account);
+    return syncPrepared(bank);
+}
+
+static int prepareDebit(Bank *bank, uint64_t txid, int account_number, int to_account, double amount,
+                        Account *account) {
+    long slot;
+    int result;
+
+    if (amount <= 0) {
+        return BANK_ERR_INVALID_AMOUNT;
+    }
+    if (account_number == to_account) {
+        return BANK_ERR_SAME_ACCOUNT;
+    }
+
+    slot = bankFindSlot(bank, account_number);
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = debitAt(bank, txid, slot, account_number, to_account, amount, account);
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+int bankPrepareDebit(Bank *bank, uint64_t txid, int account_number, int to_account, double amount,
+                     Account *updated) {
+    Account account;
+    int result;
+
+    if (txid == 0) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    if (bankReplayKeyed(bank, txid, TRANSACTION_TRANSFER_OUT, account_number, to_account, amount, &result,
+                        updated)) {
+        return result;
+    }
+
+    account.balance = 0.0;
+    result = prepareDebit(bank, txid, account_number, to_account, amount, &account);
+    bankRememberKeyed(bank, txid, TRANSACTION_TRANSFER_OUT, account_number, to_account, amount, result,
+                      account.balance);
+    if (result == BANK_OK && updated != NULL) {
+        *updated = account;
+    }
+    return result;
+}
+
+// Under the payee's record lock, so a credit prepared and the account
+// closed at once, by any two processes, each see the other
+static int creditAt(Bank *bank, uint64_t txid, long slot, int account_number, int from_account, double amount,
+                    Account *account) {
+    int loaded = bankReadRecord(bank, slot, account);
+    int held;
+
+    if (loaded != BANK_OK) {
+        return loaded;
+    }
+    if (heldAlready(bank, txid, account_number, from_account, amount, 0, &held)) {
+        return held;
+    }
+    if (bankRequireActive(account) != BANK_OK) {
+        return bankRequireActive(account);
+    }
+    if (holdLeg(bank, txid, account_number, from_account, amount, 0) != 0) {
+        return BANK_ERR_IO;
+    }
+    if (journalMark(bank, txid, account_number, TRANSACTION_PREPARED, amount, account->balance,
+                    from_account, "Transfer prepared", 0) != BANK_OK) {
+        releaseLeg(bank, findLeg(bank, txid));
+        return BANK_ERR_IO;
+    }
+    return syncPrepared(bank);
+}
+
+static int prepareCredit(Bank *bank, uint64_t txid, int account_number, int from_account, double amount,
+                         Account *account) {
+    long slot;
+    int result;
+
+    if (amount <= 0) {
+        return BANK_ERR_INVALID_AMOUNT;
+    }
+
+    slot = bankFindSlot(bank, account_number);
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = creditAt(bank, txid, slot, account_number, from_account, amount, account);
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+int bankPrepareCredit(Bank *bank, uint64_t txid, int account_number, int from_account, double amount) {
+    Account account;
+    int result;
+
+    if (txid == 0) {
+        return BANK_ERR_INVALID_REQUEST;
+    }
+    if (bankReplayKeyed(bank, txid, TRANSACTION_PREPARED, account_number, from_account, amount, &result, NULL)) {
+        return result;
+    }
+
+    account.balance = 0.0;
+    result = prepareCredit(bank, txid, account_number, from_account, amount, &account);
+    bankRememberKeyed(bank, txid, TRANSACTION_PREPARED, account_number, from_account, amount, result,
+                      account.balance);
+    return result;
+}
+
+// Pays the leg's amount into its account whatever the account's status:
+// once the coordinator has decided, the money has to land. Another process
+// may have paid it first, which the record lock lets this one see.
+static int creditLeg(Bank *bank, const PendingLeg *leg, TransactionType type, const char *description,
+                     int flags, Account *account) {
+    long slot = bankFindSlot(bank, leg->account_number);
+    int result;
+
+    if (slot == -1) {
+        return BANK_ERR_NOT_FOUND;
+    }
+    if (bankLockRecord(bank, slot) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    result = bankReadRecord(bank, slot, account);
+    if (result == BANK_OK && (result = syncLegs(bank)) == BANK_OK && findLeg(bank, leg->txid) == NULL) {
+        bankUnlockRecord(bank, slot);
+        return BANK_OK;
+    }
+    if (result == BANK_OK) {
+        Account before = *account;
+        account->balance += leg->amount;
+        account->last_accessed = time(NULL);
+        result = bankWriteRecord(bank, slot, account);
+        if (result == BANK_OK &&
+            bankLogTransaction(bank, leg->account_number, type, leg->amount, account->balance,
+                               leg->related_account, description, leg->txid, flags) != BANK_OK) {
+            bankWriteRecord(bank, slot, &before);
+            result = BANK_ERR_IO;
+        }
+    }
+    bankUnlockRecord(bank, slot);
+    return result;
+}
+
+int bankResolveTransfer(Bank *bank, uint64_t txid, int result, Account *updated) {
+    int flags = JOURNAL_PREPARED | ((result & 0xff) << JOURNAL_RESULT_SHIFT);
+    int commit = result == BANK_OK;
+    PendingLeg held, *leg = &held;
+    Account account;
+    char desc[100];
+    int resolved;
+
+    if (syncLegs(bank) != BANK_OK) {
+        return BANK_ERR_IO;
+    }
+    if (findLeg(bank, txid) == NULL) {
+        return BANK_OK;   // settled before, or never prepared on this store
+    }
+    // A copy: the table changes under it as the resolving record is written
+    held = *findLeg(bank, txid);
+
+    if (leg->outgoing == commit) {
+        // The debit already left; the credit was never paid
+        resolved = bankFindAccount(bank, leg->account_number, &account);
+        if (resolved == BANK_OK) {
+            resolved = journalMark(bank, txid, leg->account_number, TRANSACTION_RESOLVED, leg->amount,
+                                   account.balance, leg->related_account,
+                                   commit ? "Transfer committed" : "Transfer aborted", flags);
+        }
+    } else if (commit) {
+        snprintf(desc, sizeof(desc), "Transfer from account %d", leg->related_account);
+        resolved = creditLeg(bank, leg, TRANSACTION_TRANSFER_IN, desc, flags, &account);
+    } else {
+        snprintf(desc, sizeof(desc), "Transfer to account %d cancelled", leg->related_account);
+        resolved = creditLeg(bank, leg, TRANSACTION_TRANSFER_CANCELLED, desc, flags, &account);
+    }
+    if (resolved != BANK_OK) {
+        return resolved;
+    }
+
+    // Unlike a client failure, an abort is remembered even when it came from
+    // an I/O error: the prepare it overrides would otherwise replay as a success
+    if (!commit) {
+        idemRemember(&bank->idempotency, txid, leg->outgoing ? TRANSACTION_TRANSFER_OUT : TRANSACTION_PREPARED,
+                     leg->account_number, leg->related_account, leg->amount, result, account.balance);
+    }
+    releaseLeg(bank, findLeg(bank, txid));
+    if (updated != NULL) {
+        *updated = account;
+    }
+    return BANK_OK;
+}
@@ -0,0 +1,47 @@
+#ifndef BANK_SHARD_H
+#define BANK_SHARD_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Horizontal sharding. The account number space is split into `shards`
+// contiguous ranges, one per store; each shard has its own files, journal and
+// server process, and only issues numbers from its own range, so the owner of
+// any account is known from its number alone.
+#define SHARD_MAX 64
+
+// First and last account number of `shard`
+void bankShardRange(int shard, int shards, int *first, int *last);
+int bankShardOf(int account_number, int shards);
+
+// Restricts new account numbers to the range of `shard` of `shards`
+int bankSetShard(Bank *bank, int shard, int shards);
+
+// Participant side of a transfer between shards, run as a two-phase commit
+// by a coordinator (see bank_router.h) under a transaction id.
+//
+// Preparing the debit checks and takes the money from the payer, as a
+// transfer would; preparing the credit checks the payee can receive it and
+// changes nothing. Each prepared leg is journaled and held until resolved:
+// committing the debit and aborting the credit only settle the record,
+// committing the credit pays the payee, and aborting the debit returns the
+// money. An account with a leg held cannot be closed. A prepared leg is
+// synced to disk before its prepare returns, or inside a batch before the
+// batch commits.
+//
+// Every step is idempotent under its transaction id, so the coordinator can
+// resend any of them after a crash: a repeated prepare returns the original
+// outcome and resolving an unknown or settled id succeeds without effect.
+// Resolving with BANK_OK commits; any other result aborts, and is what a
+// later prepare under the same id reports, so a retried transfer whose
+// first attempt was aborted can never pay out on one side only.
+int bankPrepareDebit(Bank *bank, uint64_t txid, int account_number, int to_account, double amount,
+                     Account *updated);
+int bankPrepareCredit(Bank *bank, uint64_t txid, int account_number, int from_account, double amount);
+int bankResolveTransfer(Bank *bank, uint64_t txid, int result, Account *updated);
+
+// Legs prepared and not yet resolved, on one account or (0) on any
+int bankPendingTransfers(Bank *bank, int account_number);
+
+#endif
@@ -0,0 +1,549 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bank_snapshot.h"
+#include "bank_internal.h"
+
+#define SNAPSHOT_WAIT_SECONDS 5   // a version still being written after this is abandoned
+#define IMAGES_INITIAL 1024       // slots a snapshot's version table starts with
+
+struct BankVersions {
+    int fd;
+    SnapshotHeader *header;
+    SnapshotVersion *ring;
+    size_t map_len;
+    int writer;                   // this bank's writer entry while an operation is open, else -1
+    uint64_t seq;                 // the open operation's sequence
+    int preserve;                 // snapshots were pinned when it began
+};
+
+static uint64_t load64(const uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static void store64(uint64_t *p, uint64_t value) {
+    __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+static void raiseTo(uint64_t *p, uint64_t value) {
+    uint64_t seen = load64(p);
+    while (seen < value && !__atomic_compare_exchange_n(p, &seen, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    }
+}
+
+static int alive(int32_t pid) {
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+// Takes a free entry; its sequence was left at 0 by whoever released it
+static int claimEntry(SnapshotEntry *table, int size) {
+    int32_t pid = (int32_t)getpid();
+
+    for (int i = 0; i < size; i++) {
+        int32_t expected = 0;
+        if (__atomic_compare_exchange_n(&table[i].pid, &expected, pid, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void releaseEntry(SnapshotEntry *entry) {
+    store64(&entry->seq, 0);
+    __atomic_store_n(&entry->pid, 0, __ATOMIC_SEQ_CST);
+}
+
+// Frees the entry of a process that died holding it; returns whether this
+// caller was the one to free it. The entry is held at -1 meanwhile, so no
+// one claims it before its sequence is cleared.
+static int releaseDead(SnapshotEntry *entry, int32_t pid) {
+    if (pid <= 0 || alive(pid) ||
+        !__atomic_compare_exchange_n(&entry->pid, &pid, -1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return 0;
+    }
+    releaseEntry(entry);
+    return 1;
+}
+
+static void backOff(void) {
+    struct timespec ts = { 0, 50000 };
+    nanosleep(&ts, NULL);
+}
+
+// Creates the file, or checks the one another process made, under a lock
+// on the whole file
+static int initFile(int fd, size_t len) {
+    SnapshotHeader header;
+    struct flock lock;
+    struct stat st;
+    int result = -1;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (fstat(fd, &st) == 0) {
+        if (st.st_size >= (off_t)sizeof(header) && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION &&
+            header.record_size == sizeof(Account) && header.capacity == SNAPSHOT_RING && st.st_size == (off_t)len) {
+            result = 0;
+        } else {
+            memset(&header, 0, sizeof(header));
+            header.magic = SNAPSHOT_MAGIC;
+            header.version = SNAPSHOT_VERSION;
+            header.record_size = sizeof(Account);
+            header.capacity = SNAPSHOT_RING;
+            if (ftruncate(fd, 0) == 0 && ftruncate(fd, (off_t)len) == 0 &&
+                pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)) {
+                result = 0;
+            }
+        }
+    }
+    lock.l_type = F_UNLCK;
+    fcntl(fd, F_SETLK, &lock);
+    return result;
+}
+
+int snapshotOpen(Bank *bank) {
+    char path[BANK_PATH_LENGTH + sizeof(SNAPSHOT_SUFFIX)];
+    BankVersions *v = calloc(1, sizeof(*v));
+    size_t len = SNAPSHOT_HEADER_BYTES + SNAPSHOT_RING * sizeof(SnapshotVersion);
+
+    if (v == NULL) {
+        return BANK_ERR_IO;
+    }
+    snprintf(path, sizeof(path), "%s%s", bank->accounts_path, SNAPSHOT_SUFFIX);
+    v->fd = storageOpenSide(&bank->storage, path, O_RDWR | O_CREAT);
+    if (v->fd < 0 || initFile(v->fd, len) != 0) {
+        if (v->fd >= 0) {
+            close(v->fd);
+        }
+        free(v);
+        return BANK_ERR_IO;
+    }
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, v->fd, 0);
+    if (map == MAP_FAILED) {
+        close(v->fd);
+        free(v);
+        return BANK_ERR_IO;
+    }
+    v->header = map;
+    v->ring = (SnapshotVersion *)((unsigned char *)map + SNAPSHOT_HEADER_BYTES);
+    v->map_len = len;
+    v->writer = -1;
+    bank->versions = v;
+    return BANK_OK;
+}
+
+void snapshotClose(Bank *bank) {
+    BankVersions *v = bank->versions;
+
+    if (v == NULL) {
+        return;
+    }
+    snapshotEndWrite(bank);
+    munmap(v->header, v->map_len);
+    close(v->fd);
+    free(v);
+    bank->versions = NULL;
+}
+
+// ---- writers ----
+
+static void beginWrite(BankVersions *v) {
+    SnapshotHeader *h = v->header;
+
+    while ((v->writer = claimEntry(h->writers, SNAPSHOT_WRITERS)) < 0) {
+        backOff();
+    }
+    // The entry is visible before the sequence is drawn, so a reader that
+    // sees the sequence waits for this operation; one pinned after it is
+    // counted in `pinned` before this reads it, so its versions are kept
+    v->seq = __atomic_add_fetch(&h->next_seq, 1, __ATOMIC_SEQ_CST);
+    store64(&h->writers[v->writer].seq, v->seq);
+    v->preserve = load64(&h->pinned) > 0;
+}
+
+// Drops the oldest version to make room, failing any snapshot that needed it
+static void overwriteOldest(BankVersions *v, uint64_t tail) {
+    SnapshotHeader *h = v->header;
+    const SnapshotVersion *oldest = &v->ring[tail % h->capacity];
+    uint64_t seq = load64(&oldest->seq);
+
+    raiseTo(&h->overwritten_seq, seq != 0 ? seq : load64(&h->next_seq));
+    __atomic_compare_exchange_n(&h->tail, &tail, tail + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static void appendVersion(BankVersions *v, long slot, const Account *image) {
+    SnapshotHeader *h = v->header;
+    uint64_t position = __atomic_fetch_add(&h->head, 1, __ATOMIC_SEQ_CST);
+    SnapshotVersion *version = &v->ring[position % h->capacity];
+    uint64_t tail;
+
+    while (position >= (tail = load64(&h->tail)) + h->capacity) {
+        overwriteOldest(v, tail);
+    }
+    store64(&version->seq, 0);
+    version->slot = slot;
+    memcpy(&version->image, image, sizeof(Account));
+    store64(&version->position, position);
+    store64(&version->seq, v->seq);
+}
+
+int snapshotBeforeWrite(Bank *bank, long slot, long n) {
+    BankVersions *v = bank->versions;
+    Account page[32];
+
+    if (v == NULL) {
+        return 0;
+    }
+    if (v->writer < 0) {
+        beginWrite(v);
+    }
+    if (!v->preserve) {
+        return 0;
+    }
+    // Records past the end are new: a snapshot's count already leaves them out
+    long count = bankRecordCount(bank);
+    if (slot + n > count) {
+        n = count - slot;
+    }
+    for (long done = 0; done < n; done += 32) {
+        long chunk = n - done < 32 ? n - done : 32;
+        if (storageGet(&bank->storage, slot + done, chunk, page) != 0) {
+            return -1;
+        }
+        for (long i = 0; i < chunk; i++) {
+            appendVersion(v, slot + done + i, &page[i]);
+        }
+    }
+    return 0;
+}
+
+void snapshotEndWrite(Bank *bank) {
+    BankVersions *v = bank->versions;
+
+    if (v == NULL || v->writer < 0) {
+        return;
+    }
+    releaseEntry(&v->header->writers[v->writer]);
+    v->writer = -1;
+    if (v->preserve || load64(&v->header->tail) != load64(&v->header->head)) {
+        snapshotCollect(bank);
+    }
+}
+
+void snapshotCollect(Bank *bank) {
+    BankVersions *v = bank->versions;
+    SnapshotHeader *h;
+    uint64_t horizon = UINT64_MAX;
+
+    if (v == NULL) {
+        return;
+    }
+    h = v->header;
+
+    // Only versions handed out before the readers are looked at: a later one
+    // may belong to a snapshot pinned meanwhile
+    uint64_t head = load64(&h->head);
+    for (int i = 0; i < SNAPSHOT_READERS; i++) {
+        int32_t pid = __atomic_load_n(&h->readers[i].pid, __ATOMIC_SEQ_CST);
+        if (pid == 0) {
+            continue;
+        }
+        if (releaseDead(&h->readers[i], pid)) {
+            __atomic_sub_fetch(&h->pinned, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        uint64_t seq = load64(&h->readers[i].seq);
+        horizon = seq < horizon ? seq : horizon;
+    }
+
+    uint64_t tail = load64(&h->tail);
+    while (tail < head) {
+        const SnapshotVersion *version = &v->ring[tail % h->capacity];
+        uint64_t seq = load64(&version->seq);
+        if (seq == 0 || seq > horizon || load64(&version->position) != tail) {
+            break;
+        }
+        if (!__atomic_compare_exchange_n(&h->tail, &tail, tail + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            continue;   // another process moved it; `tail` now holds where to
+        }
+        tail++;
+    }
+}
+
+void snapshotRenumbered(Bank *bank) {
+    BankVersions *v = bank->versions;
+
+    if (v == NULL) {
+        return;
+    }
+    uint64_t seq = __atomic_add_fetch(&v->header->next_seq, 1, __ATOMIC_SEQ_CST);
+    raiseTo(&v->header->overwritten_seq, seq);
+    store64(&v->header->tail, load64(&v->header->head));
+}
+
+// ---- readers ----
+
+// Where the version a snapshot sees for `slot` sits in the ring
+typedef struct {
+    int64_t slot;                 // -1 marks a free bucket
+    uint64_t position;
+} SnapshotImage;
+
+// Each read gathers only the versions added since the last one, so the ring
+// is walked once per snapshot, not once per read. The scan threads of one
+// report share the snapshot, hence the mutex.
+struct SnapshotImages {
+    pthread_mutex_t mutex;
+    uint64_t scanned;             // ring positions before this are gathered
+    SnapshotImage *table;         // open addressing, a power of two in size
+    size_t mask;
+    size_t used;
+};
+
+static size_t imageBucket(int64_t slot, size_t mask) {
+    return (size_t)((uint64_t)slot * 0x9e3779b97f4a7c15ULL >> 32) & mask;
+}
+
+static int growImages(SnapshotImages *images) {
+    size_t size = images->table == NULL ? IMAGES_INITIAL : (images->mask + 1) * 2;
+    SnapshotImage *table = malloc(size * sizeof(SnapshotImage));
+
+    if (table == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        table[i].slot = -1;
+    }
+    for (size_t i = 0; images->table != NULL && i <= images->mask; i++) {
+        if (images->table[i].slot >= 0) {
+            size_t b = imageBucket(images->table[i].slot, size - 1);
+            while (table[b].slot >= 0) {
+                b = (b + 1) & (size - 1);
+            }
+            table[b] = images->table[i];
+        }
+    }
+    free(images->table);
+    images->table = table;
+    images->mask = size - 1;
+    return 0;
+}
+
+static const SnapshotImage *findImage(const SnapshotImages *images, int64_t slot) {
+    if (images->table == NULL) {
+        return NULL;
+    }
+    for (size_t b = imageBucket(slot, images->mask); images->table[b].slot >= 0; b = (b + 1) & images->mask) {
+        if (images->table[b].slot == slot) {
+            return &images->table[b];
+        }
+    }
+    return NULL;
+}
+
+// Versions of one record appear in the order they were made, each holding
+// the record under a lock; the first after the snapshot holds the image it
+// sees, and later ones are passed over
+static int keepImage(SnapshotImages *images, int64_t slot, uint64_t position) {
+    if ((images->table == NULL || (images->used + 1) * 2 > images->mask + 1) && growImages(images) != 0) {
+        return -1;
+    }
+    size_t b = imageBucket(slot, images->mask);
+    while (images->table[b].slot >= 0) {
+        if (images->table[b].slot == slot) {
+            return 0;
+        }
+        b = (b + 1) & images->mask;
+    }
+    images->table[b].slot = slot;
+    images->table[b].position = position;
+    images->used++;
+    return 0;
+}
+
+int bankSnapshotOpen(Bank *bank, BankSnapshot *snapshot) {
+    BankVersions *v = bank->versions;
+    SnapshotHeader *h;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->bank = bank;
+    snapshot->reader = -1;
+    if (v == NULL) {
+        return BANK_ERR_IO;
+    }
+    h = v->header;
+    while ((snapshot->reader = claimEntry(h->readers, SNAPSHOT_READERS)) < 0) {
+        snapshotCollect(bank);   // frees the entries of readers that died
+        backOff();
+    }
+    __atomic_add_fetch(&h->pinned, 1, __ATOMIC_SEQ_CST);
+
+    // Operations with this sequence or an earlier one finish first; later
+    // ones see `pinned` and keep the images they replace
+    uint64_t seq = load64(&h->next_seq);
+    for (int i = 0; i < SNAPSHOT_WRITERS; i++) {
+        int32_t pid;
+        while ((pid = __atomic_load_n(&h->writers[i].pid, __ATOMIC_SEQ_CST)) != 0) {
+            uint64_t writing = load64(&h->writers[i].seq);
+            if ((writing != 0 && writing > seq) || releaseDead(&h->writers[i], pid)) {
+                break;
+            }
+            backOff();
+        }
+    }
+    store64(&h->readers[snapshot->reader].seq, seq);
+    snapshot->seq = seq;
+
+    // Versions it needs are all made from here on
+    snapshot->images = calloc(1, sizeof(SnapshotImages));
+    if (snapshot->images == NULL) {
+        bankSnapshotClose(snapshot);
+        return BANK_ERR_IO;
+    }
+    pthread_mutex_init(&snapshot->images->mutex, NULL);
+    snapshot->images->scanned = load64(&h->tail);
+
+    storageRefresh(&bank->storage);
+    snapshot->count = bankRecordCount(bank);
+    return BANK_OK;
+}
+
+// The version at `position` if it belongs to a record in [first, last) and
+// was made after sequence `after`; 0 otherwise, or if it has been reused
+// since. One not yet written is waited for: the operation writing it has
+// not reached the store yet, and a later version of the same record may
+// follow. The image is only copied for a version that is wanted, and only
+// when `image` is set.
+static int readVersion(const SnapshotVersion *version, uint64_t position, uint64_t after, long first,
+                       long last, int image, SnapshotVersion *copy) {
+    double deadline = 0.0;
+
+    for (;;) {
+        uint64_t seq = load64(&version->seq);
+        uint64_t at = load64(&version->position);
+        if (at > position) {
+            return 0;
+        }
+        if (seq != 0 && at == position) {
+            copy->slot = __atomic_load_n(&version->slot, __ATOMIC_SEQ_CST);
+            if (seq <= after || copy->slot < first || copy->slot >= last) {
+                return 0;
+            }
+            if (image) {
+                memcpy(&copy->image, &version->image, sizeof(Account));
+            }
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            copy->seq = seq;
+            copy->position = at;
+            if (load64(&version->seq) == seq && load64(&version->position) == position) {
+                return 1;
+            }
+            continue;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double t = now.tv_sec + now.tv_nsec / 1e9;
+        if (deadline == 0.0) {
+            deadline = t + SNAPSHOT_WAIT_SECONDS;
+        } else if (t > deadline) {
+            return 0;   // its writer died mid-copy; the store was never touched
+        }
+        backOff();
+    }
+}
+
+// Files the versions made since the last read under their slots
+static int gatherVersions(BankSnapshot *snapshot) {
+    BankVersions *v = snapshot->bank->versions;
+    SnapshotHeader *h = v->header;
+    SnapshotImages *images = snapshot->images;
+    SnapshotVersion copy;
+
+    uint64_t head = load64(&h->head);
+    uint64_t position = load64(&h->tail);
+    if (position < images->scanned) {
+        position = images->scanned;
+    }
+    for (; position < head; position++) {
+        const SnapshotVersion *version = &v->ring[position % h->capacity];
+        if (readVersion(version, position, snapshot->seq, 0, snapshot->count, 0, &copy) &&
+            keepImage(images, copy.slot, position) != 0) {
+            images->scanned = position;
+            return BANK_ERR_IO;
+        }
+    }
+    images->scanned = head;
+    return BANK_OK;
+}
+
+int bankSnapshotRead(BankSnapshot *snapshot, long slot, long n, Account *records) {
+    BankVersions *v = snapshot->bank->versions;
+    SnapshotHeader *h = v->header;
+    SnapshotImages *images = snapshot->images;
+    SnapshotVersion copy;
+    int result;
+
+    if (slot < 0 || n < 0 || slot + n > snapshot->count) {
+        return BANK_ERR_IO;
+    }
+    if (n == 0) {
+        return BANK_OK;
+    }
+    if (storageGet(&snapshot->bank->storage, slot, n, records) != 0) {
+        return BANK_ERR_IO;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // A version reused since it was filed leaves the record as stored; the
+    // snapshot is then too old, which the check below reports
+    pthread_mutex_lock(&images->mutex);
+    result = gatherVersions(snapshot);
+    for (long i = 0; result == BANK_OK && images->used > 0 && i < n; i++) {
+        const SnapshotImage *found = findImage(images, slot + i);
+        if (found != NULL &&
+            readVersion(&v->ring[found->position % h->capacity], found->position, snapshot->seq, slot + i,
+                        slot + i + 1, 1, &copy)) {
+            records[i] = copy.image;
+        }
+    }
+    pthread_mutex_unlock(&images->mutex);
+    if (result != BANK_OK) {
+        return result;
+    }
+    return load64(&h->overwritten_seq) > snapshot->seq ? BANK_ERR_SNAPSHOT_TOO_OLD : BANK_OK;
+}
+
+void bankSnapshotClose(BankSnapshot *snapshot) {
+    BankVersions *v = snapshot->bank != NULL ? snapshot->bank->versions : NULL;
+
+    if (v != NULL && snapshot->reader >= 0) {
+        releaseEntry(&v->header->readers[snapshot->reader]);
+        __atomic_sub_fetch(&v->header->pinned, 1, __ATOMIC_SEQ_CST);
+        snapshotCollect(snapshot->bank);
+    }
+    snapshot->reader = -1;
+    if (snapshot->images != NULL) {
+        pthread_mutex_destroy(&snapshot->images->mutex);
+        free(snapshot->images->table);
+        free(snapshot->images);
+        snapshot->images = NULL;
+    }
+}
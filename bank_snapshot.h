@@ -0,0 +1,80 @@
+#ifndef BANK_SNAPSHOT_H
+#define BANK_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Multi-version reads of the account store. Every write operation draws a
+// commit sequence; while any snapshot is pinned, the image a write replaces
+// is copied into the version file first, tagged with that sequence. A reader
+// pins the sequence it will see, reads records from the store as usual, then
+// puts back, for every record a later operation changed, the image the
+// earliest such operation replaced. A transfer is one operation, so a
+// snapshot never shows it half applied.
+//
+// Writers never wait for readers: a reader waits, when it pins, for the
+// operations already under way to finish. The version file is shared by
+// every process with the store open, which map it; it holds the sequence
+// counter, a table of the writers and readers active, and a ring of versions.
+// Versions no pinned snapshot needs are reclaimed from the back of the ring
+// as writers finish. A snapshot held so long that the ring fills loses the
+// oldest versions to the writers and then fails its reads with
+// BANK_ERR_SNAPSHOT_TOO_OLD.
+#define SNAPSHOT_SUFFIX ".versions"
+#define SNAPSHOT_MAGIC 0x53524556u      // "VERS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_RING 131072            // record versions kept: two posting chunks
+#define SNAPSHOT_WRITERS 64             // operations under way at once, across processes
+#define SNAPSHOT_READERS 64             // snapshots pinned at once
+#define SNAPSHOT_HEADER_BYTES 4096
+
+// A writer or reader entry; pid 0 marks a free one. A writer's sequence is
+// 0 while it is being drawn; a reader's while its snapshot is being pinned,
+// which holds every version until it is.
+typedef struct {
+    int32_t pid;
+    int32_t reserved;
+    uint64_t seq;
+} SnapshotEntry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t record_size;
+    uint64_t capacity;                  // versions in the ring
+    uint64_t next_seq;                  // last sequence drawn
+    uint64_t head;                      // ring positions handed out
+    uint64_t tail;                      // oldest position still kept
+    uint64_t overwritten_seq;           // newest sequence whose version a full ring lost
+    uint64_t pinned;                    // reader entries in use
+    SnapshotEntry writers[SNAPSHOT_WRITERS];
+    SnapshotEntry readers[SNAPSHOT_READERS];
+} SnapshotHeader;
+
+// The image of `slot` that operation `seq` replaced. `seq` is 0 while the
+// version is being written; `position` tells a reused ring entry from the
+// one a reader was looking for.
+typedef struct {
+    uint64_t position;
+    uint64_t seq;
+    int64_t slot;
+    Account image;
+} SnapshotVersion;
+
+int snapshotOpen(Bank *bank);
+void snapshotClose(Bank *bank);
+
+// Writers: called before records [slot, slot + n) are overwritten. The first
+// call draws the operation's sequence; snapshotEndWrite ends it, and the
+// next write starts another.
+int snapshotBeforeWrite(Bank *bank, long slot, long n);
+void snapshotEndWrite(Bank *bank);
+
+// Reclaims the versions no pinned snapshot needs
+void snapshotCollect(Bank *bank);
+
+// Slots now name other records (compaction): every snapshot pinned so far fails
+void snapshotRenumbered(Bank *bank);
+
+#endif
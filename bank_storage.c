@@ -0,0 +1,1019 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bank_storage.h"
+
+static int readFully(int fd, void *data, size_t len, off_t offset) {
+    unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int writeFully(int fd, const void *data, size_t len, off_t offset) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+static off_t recordOffset(const BankStorage *storage, long slot) {
+    return (off_t)slot * (off_t)storage->record_size;
+}
+
+// ---- flat file ----
+
+static int fileOpen(BankStorage *storage, const char *path, const char *journal_path) {
+    storage->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (storage->fd < 0) {
+        return -1;
+    }
+    if (journal_path != NULL) {
+        storage->journal_fd = open(journal_path, O_RDWR | O_CREAT, 0644);
+        if (storage->journal_fd < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void fileClose(BankStorage *storage) {
+    if (storage->fd >= 0) {
+        close(storage->fd);
+    }
+    if (storage->journal_fd >= 0) {
+        close(storage->journal_fd);
+    }
+}
+
+static long fileCount(BankStorage *storage) {
+    struct stat st;
+    if (fstat(storage->fd, &st) != 0) {
+        return 0;
+    }
+    return (long)(st.st_size / (off_t)storage->record_size);
+}
+
+static int fileGet(BankStorage *storage, long slot, long n, void *records) {
+    return readFully(storage->fd, records, (size_t)n * storage->record_size, recordOffset(storage, slot));
+}
+
+static int filePut(BankStorage *storage, long slot, long n, const void *records) {
+    return writeFully(storage->fd, records, (size_t)n * storage->record_size, recordOffset(storage, slot));
+}
+
+static int fileTruncate(BankStorage *storage, long count) {
+    return ftruncate(storage->fd, recordOffset(storage, count));
+}
+
+static int fileSync(BankStorage *storage) {
+    return fdatasync(storage->fd);
+}
+
+static int fileAdopt(BankStorage *storage, int fd) {
+    close(storage->fd);
+    storage->fd = fd;
+    return 0;
+}
+
+static uint64_t fileJournalSize(BankStorage *storage) {
+    struct stat st;
+    if (storage->journal_fd < 0 || fstat(storage->journal_fd, &st) != 0) {
+        return 0;
+    }
+    return (uint64_t)st.st_size;
+}
+
+static size_t fileJournalRead(BankStorage *storage, void *data, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(storage->journal_fd, (unsigned char *)data + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return done;
+}
+
+static int fileJournalWrite(BankStorage *storage, const void *data, size_t len, uint64_t offset) {
+    return writeFully(storage->journal_fd, data, len, (off_t)offset);
+}
+
+static int fileJournalTruncate(BankStorage *storage, uint64_t size) {
+    return ftruncate(storage->journal_fd, (off_t)size);
+}
+
+static int fileJournalSync(BankStorage *storage) {
+    return fdatasync(storage->journal_fd);
+}
+
+static int fileOpenSide(BankStorage *storage, const char *path, int flags) {
+    (void)storage;
+    return open(path, flags, 0644);
+}
+
+static const StorageOps file_ops = {
+    "file", 1, 1, fileOpen, fileClose, fileCount, fileGet, filePut, fileTruncate, fileSync, fileAdopt,
+    fileJournalSize, fileJournalRead, fileJournalWrite, fileJournalTruncate, fileJournalSync, fileOpenSide
+};
+
+// ---- mmap ----
+
+// Maps the whole reservation; pages past the end of the file are never touched
+static int mapStore(BankStorage *storage) {
+    struct stat st;
+
+    if (fstat(storage->fd, &st) != 0) {
+        return -1;
+    }
+    storage->count = (long)(st.st_size / (off_t)storage->record_size);
+    storage->capacity = STORAGE_MMAP_RESERVE;
+    storage->data = mmap(NULL, storage->capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE,
+                         storage->fd, 0);
+    if (storage->data == MAP_FAILED) {
+        storage->data = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static int mmapOpen(BankStorage *storage, const char *path, const char *journal_path) {
+    if (fileOpen(storage, path, journal_path) != 0) {
+        return -1;
+    }
+    return mapStore(storage);
+}
+
+static void mmapClose(BankStorage *storage) {
+    if (storage->data != NULL) {
+        munmap(storage->data, storage->capacity);
+    }
+    fileClose(storage);
+}
+
+static long mmapCount(BankStorage *storage) {
+    return storage->count;
+}
+
+static int mmapGet(BankStorage *storage, long slot, long n, void *records) {
+    if (slot < 0 || n < 0 || slot + n > storage->count) {
+        return -1;
+    }
+    memcpy(records, storage->data + (size_t)slot * storage->record_size, (size_t)n * storage->record_size);
+    return 0;
+}
+
+static int mmapPut(BankStorage *storage, long slot, long n, const void *records) {
+    size_t end = (size_t)(slot + n) * storage->record_size;
+
+    if (slot < 0 || n < 0 || slot > storage->count || end > storage->capacity) {
+        return -1;
+    }
+    // The file grows first, so the stores below land on backed pages
+    if (slot + n > storage->count) {
+        if (ftruncate(storage->fd, (off_t)end) != 0) {
+            return -1;
+        }
+        storage->count = slot + n;
+    }
+    memcpy(storage->data + (size_t)slot * storage->record_size, records, (size_t)n * storage->record_size);
+    return 0;
+}
+
+static int mmapTruncate(BankStorage *storage, long count) {
+    if (ftruncate(storage->fd, recordOffset(storage, count)) != 0) {
+        return -1;
+    }
+    storage->count = count;
+    return 0;
+}
+
+static int mmapSync(BankStorage *storage) {
+    if (storage->count == 0) {
+        return 0;
+    }
+    return msync(storage->data, (size_t)storage->count * storage->record_size, MS_SYNC);
+}
+
+static int mmapAdopt(BankStorage *storage, int fd) {
+    munmap(storage->data, storage->capacity);
+    storage->data = NULL;
+    close(storage->fd);
+    storage->fd = fd;
+    return mapStore(storage);
+}
+
+static const StorageOps mmap_ops = {
+    "mmap", 1, 1, mmapOpen, mmapClose, mmapCount, mmapGet, mmapPut, mmapTruncate, mmapSync, mmapAdopt,
+    fileJournalSize, fileJournalRead, fileJournalWrite, fileJournalTruncate, fileJournalSync, fileOpenSide
+};
+
+// ---- memory ----
+
+static int reserveBytes(unsigned char **data, uint64_t *capacity, uint64_t need) {
+    if (need <= *capacity) {
+        return 0;
+    }
+    uint64_t cap = *capacity ? *capacity : 65536;
+    while (cap < need) {
+        cap *= 2;
+    }
+    unsigned char *grown = realloc(*data, (size_t)cap);
+    if (grown == NULL) {
+        return -1;
+    }
+    *data = grown;
+    *capacity = cap;
+    return 0;
+}
+
+static int memoryOpen(BankStorage *storage, const char *path, const char *journal_path) {
+    (void)storage;
+    (void)path;
+    (void)journal_path;
+    return 0;
+}
+
+static void memoryClose(BankStorage *storage) {
+    free(storage->data);
+    free(storage->journal);
+    for (int i = 0; i < STORAGE_MEMORY_FILES; i++) {
+        if (storage->files[i].path != NULL) {
+            close(storage->files[i].fd);
+            free(storage->files[i].path);
+        }
+    }
+}
+
+static int memoryPut(BankStorage *storage, long slot, long n, const void *records) {
+    uint64_t capacity = storage->capacity;
+    size_t end = (size_t)(slot + n) * storage->record_size;
+
+    if (slot < 0 || n < 0 || slot > storage->count ||
+        reserveBytes(&storage->data, &capacity, end) != 0) {
+        return -1;
+    }
+    storage->capacity = (size_t)capacity;
+    memcpy(storage->data + (size_t)slot * storage->record_size, records, (size_t)n * storage->record_size);
+    if (slot + n > storage->count) {
+        storage->count = slot + n;
+    }
+    return 0;
+}
+
+static int memoryTruncate(BankStorage *storage, long count) {
+    storage->count = count;
+    return 0;
+}
+
+static int memorySync(BankStorage *storage) {
+    (void)storage;
+    return 0;
+}
+
+static int memoryAdopt(BankStorage *storage, int fd) {
+    (void)storage;
+    (void)fd;
+    return -1;
+}
+
+static uint64_t memoryJournalSize(BankStorage *storage) {
+    return storage->journal_len;
+}
+
+static size_t memoryJournalRead(BankStorage *storage, void *data, size_t len, uint64_t offset) {
+    if (offset >= storage->journal_len) {
+        return 0;
+    }
+    if (len > storage->journal_len - offset) {
+        len = (size_t)(storage->journal_len - offset);
+    }
+    memcpy(data, storage->journal + offset, len);
+    return len;
+}
+
+static int memoryJournalWrite(BankStorage *storage, const void *data, size_t len, uint64_t offset) {
+    if (reserveBytes(&storage->journal, &storage->journal_cap, offset + len) != 0) {
+        return -1;
+    }
+    if (offset > storage->journal_len) {
+        memset(storage->journal + storage->journal_len, 0, (size_t)(offset - storage->journal_len));
+    }
+    memcpy(storage->journal + offset, data, len);
+    if (offset + len > storage->journal_len) {
+        storage->journal_len = offset + len;
+    }
+    return 0;
+}
+
+static int memoryJournalTruncate(BankStorage *storage, uint64_t size) {
+    if (size > storage->journal_len) {
+        if (reserveBytes(&storage->journal, &storage->journal_cap, size) != 0) {
+            return -1;
+        }
+        memset(storage->journal + storage->journal_len, 0, (size_t)(size - storage->journal_len));
+    }
+    storage->journal_len = size;
+    return 0;
+}
+
+// Side files are anonymous memory files looked up by path. Each open gets
+// its own file description, so offsets and append mode are not shared.
+static int memoryOpenSide(BankStorage *storage, const char *path, int flags) {
+    StorageMemoryFile *file = NULL;
+    char proc_path[64];
+
+    for (int i = 0; i < STORAGE_MEMORY_FILES && file == NULL; i++) {
+        if (storage->files[i].path != NULL && strcmp(storage->files[i].path, path) == 0) {
+            file = &storage->files[i];
+        }
+    }
+    if (file == NULL) {
+        if ((flags & O_CREAT) == 0) {
+            errno = ENOENT;
+            return -1;
+        }
+        for (int i = 0; i < STORAGE_MEMORY_FILES && file == NULL; i++) {
+            if (storage->files[i].path == NULL) {
+                file = &storage->files[i];
+            }
+        }
+        if (file == NULL || (file->path = strdup(path)) == NULL) {
+            return -1;
+        }
+        file->fd = memfd_create("bank", MFD_CLOEXEC);
+        if (file->fd < 0) {
+            free(file->path);
+            file->path = NULL;
+            return -1;
+        }
+    }
+
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", file->fd);
+    int fd = open(proc_path, flags & ~(O_CREAT | O_EXCL | O_TRUNC));
+    if (fd < 0) {
+        fd = dup(file->fd);
+    }
+    if (fd >= 0 && (flags & O_TRUNC) && ftruncate(fd, 0) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static const StorageOps memory_ops = {
+    "memory", 0, 0, memoryOpen, memoryClose, mmapCount, mmapGet, memoryPut, memoryTruncate, memorySync, memoryAdopt,
+    memoryJournalSize, memoryJournalRead, memoryJournalWrite, memoryJournalTruncate, memorySync, memoryOpenSide
+};
+
+// ---- compact ----
+
+static uint64_t entryOffset(uint64_t entry) {
+    return entry >> 24;
+}
+
+static size_t entrySpace(uint64_t entry) {
+    return (size_t)(entry >> 12) & 0xfff;
+}
+
+static size_t entryLength(uint64_t entry) {
+    return (size_t)entry & 0xfff;
+}
+
+static uint64_t makeEntry(uint64_t offset, size_t space, size_t length) {
+    return offset << 24 | (uint64_t)space << 12 | (uint64_t)length;
+}
+
+static void putLE64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t getLE64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t *slotEntry(BankStorage *storage, long slot) {
+    return &storage->chunks[slot / COMPACT_CHUNK_ENTRIES][slot % COMPACT_CHUNK_ENTRIES];
+}
+
+// Record count and end of the used space, written once the records they cover are
+static int writeCompactHeader(BankStorage *storage) {
+    unsigned char header[32];
+
+    memset(header, 0, sizeof(header));
+    putLE64(header, (uint64_t)COMPACT_MAGIC | (uint64_t)COMPACT_VERSION << 32);
+    putLE64(header + 8, (uint64_t)storage->count);
+    putLE64(header + 16, storage->heap_end);
+    putLE64(header + 24, (uint64_t)storage->chunk_count);
+    return writeFully(storage->fd, header, sizeof(header), 0);
+}
+
+// Writes directory entries [first, last) back to their chunks
+static int writeEntries(BankStorage *storage, long first, long last) {
+    unsigned char buffer[8 * 512];
+
+    while (first < last) {
+        long in_chunk = COMPACT_CHUNK_ENTRIES - first % COMPACT_CHUNK_ENTRIES;
+        long n = last - first;
+        if (n > in_chunk) {
+            n = in_chunk;
+        }
+        if (n > 512) {
+            n = 512;
+        }
+        for (long i = 0; i < n; i++) {
+            putLE64(buffer + 8 * i, *slotEntry(storage, first + i));
+        }
+        uint64_t at = storage->chunk_offsets[first / COMPACT_CHUNK_ENTRIES] +
+                      8 * (uint64_t)(first % COMPACT_CHUNK_ENTRIES);
+        if (writeFully(storage->fd, buffer, (size_t)n * 8, (off_t)at) != 0) {
+            return -1;
+        }
+        first += n;
+    }
+    return 0;
+}
+
+// A new directory chunk at the end of the used space; the file reads back
+// zeros there, so only entries that are written need writing
+static int addChunk(BankStorage *storage) {
+    int chunk = storage->chunk_count;
+    unsigned char offset[8];
+
+    if (chunk == COMPACT_MAX_CHUNKS) {
+        return -1;
+    }
+    storage->chunks[chunk] = calloc(COMPACT_CHUNK_ENTRIES, sizeof(uint64_t));
+    if (storage->chunks[chunk] == NULL) {
+        return -1;
+    }
+    storage->chunk_offsets[chunk] = storage->heap_end;
+    storage->heap_end += COMPACT_CHUNK_ENTRIES * sizeof(uint64_t);
+    putLE64(offset, storage->chunk_offsets[chunk]);
+    if (ftruncate(storage->fd, (off_t)storage->heap_end) != 0 ||
+        writeFully(storage->fd, offset, sizeof(offset), 32 + 8 * (off_t)chunk) != 0) {
+        free(storage->chunks[chunk]);
+        storage->chunks[chunk] = NULL;
+        return -1;
+    }
+    storage->chunk_count++;
+    return 0;
+}
+
+static int loadCompact(BankStorage *storage) {
+    unsigned char header[COMPACT_HEADER_BYTES];
+    unsigned char *buffer;
+
+    if (readFully(storage->fd, header, sizeof(header), 0) != 0 ||
+        getLE64(header) != ((uint64_t)COMPACT_MAGIC | (uint64_t)COMPACT_VERSION << 32)) {
+        return -1;
+    }
+    storage->count = (long)getLE64(header + 8);
+    storage->heap_end = getLE64(header + 16);
+    int chunks = (int)getLE64(header + 24);
+    if (chunks > COMPACT_MAX_CHUNKS || storage->count > (long)chunks * COMPACT_CHUNK_ENTRIES) {
+        return -1;
+    }
+
+    buffer = malloc(COMPACT_CHUNK_ENTRIES * sizeof(uint64_t));
+    if (buffer == NULL) {
+        return -1;
+    }
+    for (int c = 0; c < chunks; c++) {
+        storage->chunk_offsets[c] = getLE64(header + 32 + 8 * c);
+        storage->chunks[c] = malloc(COMPACT_CHUNK_ENTRIES * sizeof(uint64_t));
+        if (storage->chunks[c] == NULL ||
+            readFully(storage->fd, buffer, COMPACT_CHUNK_ENTRIES * sizeof(uint64_t),
+                      (off_t)storage->chunk_offsets[c]) != 0) {
+            free(buffer);
+            return -1;
+        }
+        storage->chunk_count = c + 1;
+        for (int i = 0; i < COMPACT_CHUNK_ENTRIES; i++) {
+            storage->chunks[c][i] = getLE64(buffer + 8 * i);
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+static void unloadCompact(BankStorage *storage) {
+    for (int c = 0; c < storage->chunk_count; c++) {
+        free(storage->chunks[c]);
+        storage->chunks[c] = NULL;
+    }
+    storage->chunk_count = 0;
+    storage->count = 0;
+}
+
+// Rewrites the flat store at `path` in the compact format, beside it first
+// and then renamed over it, so an interrupted conversion leaves it as it was
+static int convertFlat(BankStorage *storage, const char *path) {
+    char temp_path[4096];
+    BankStorage flat, compact;
+    int failed;
+
+    snprintf(temp_path, sizeof(temp_path), "%s%s", path, COMPACT_CONVERT_SUFFIX);
+    unlink(temp_path);
+    if (storageOpen(&flat, STORAGE_FILE, path, NULL, storage->record_size, NULL) != 0) {
+        return -1;
+    }
+    if (storageClaim(&flat, STORAGE_LOCK_EXCLUSIVE) != 0) {   // nobody may go on writing the flat file
+        storageClose(&flat);
+        return -1;
+    }
+    if (storageOpen(&compact, STORAGE_COMPACT, temp_path, NULL, storage->record_size, storage->codec) != 0) {
+        storageClose(&flat);
+        return -1;
+    }
+
+    long count = storageCount(&flat);
+    long per_chunk = COMPACT_CHUNK_ENTRIES;
+    unsigned char *records = malloc((size_t)per_chunk * storage->record_size);
+    failed = records == NULL;
+    for (long slot = 0; slot < count && !failed; slot += per_chunk) {
+        long n = count - slot < per_chunk ? count - slot : per_chunk;
+        failed = storageGet(&flat, slot, n, records) != 0 || storagePut(&compact, slot, n, records) != 0;
+    }
+    free(records);
+    failed = failed || storageSync(&compact) != 0;
+    storageClose(&compact);
+    storageClose(&flat);
+    if (failed || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static int compactOpen(BankStorage *storage, const char *path, const char *journal_path) {
+    struct stat st;
+
+    if (storage->codec == NULL || pthread_mutex_init(&storage->lock, NULL) != 0) {
+        storage->codec = NULL;
+        return -1;
+    }
+    if (storage->codec->max_encoded > 0xfff) {
+        return -1;
+    }
+    if (fileOpen(storage, path, journal_path) != 0 || fstat(storage->fd, &st) != 0) {
+        return -1;
+    }
+    if (st.st_size == 0) {
+        storage->heap_end = COMPACT_HEADER_BYTES;
+        return ftruncate(storage->fd, COMPACT_HEADER_BYTES) != 0 || writeCompactHeader(storage) != 0 ? -1 : 0;
+    }
+    if (loadCompact(storage) == 0) {
+        return 0;
+    }
+
+    // Not compact yet: a flat store is converted, anything else refused
+    unloadCompact(storage);
+    if (st.st_size % (off_t)storage->record_size != 0 || convertFlat(storage, path) != 0) {
+        return -1;
+    }
+    close(storage->fd);
+    storage->fd = open(path, O_RDWR);
+    return storage->fd >= 0 ? loadCompact(storage) : -1;
+}
+
+static void compactClose(BankStorage *storage) {
+    if (storage->codec != NULL) {
+        unloadCompact(storage);
+        pthread_mutex_destroy(&storage->lock);
+    }
+    fileClose(storage);
+}
+
+static long compactCount(BankStorage *storage) {
+    pthread_mutex_lock(&storage->lock);
+    long count = storage->count;
+    pthread_mutex_unlock(&storage->lock);
+    return count;
+}
+
+// Records lying close together are read with one pread: slots are mostly
+// stored in order, so a run of slots is usually one span of the file
+#define COMPACT_SPAN_BYTES (256u << 10)
+#define COMPACT_SPAN_GAP 4096
+#define COMPACT_RUN_RECORDS 256     // records gathered per write
+
+static int compactGet(BankStorage *storage, long slot, long n, void *records) {
+    uint64_t local[64];
+    uint64_t *entries = n <= 64 ? local : malloc((size_t)n * sizeof(uint64_t));
+    unsigned char *span = NULL;
+    int failed = entries == NULL;
+
+    if (!failed) {
+        pthread_mutex_lock(&storage->lock);
+        failed = slot < 0 || n < 0 || slot + n > storage->count;
+        for (long i = 0; i < n && !failed; i++) {
+            entries[i] = *slotEntry(storage, slot + i);
+        }
+        pthread_mutex_unlock(&storage->lock);
+    }
+    if (!failed && n > 0) {
+        span = malloc(COMPACT_SPAN_BYTES + storage->codec->max_encoded);
+        failed = span == NULL;
+    }
+
+    for (long i = 0; i < n && !failed;) {
+        // Gather the records from i on that fit one span
+        uint64_t start = entryOffset(entries[i]);
+        uint64_t end = start + entryLength(entries[i]);
+        long j = i + 1;
+        while (j < n) {
+            uint64_t at = entryOffset(entries[j]);
+            uint64_t to = at + entryLength(entries[j]);
+            if (at < start || at > end + COMPACT_SPAN_GAP || to - start > COMPACT_SPAN_BYTES) {
+                break;
+            }
+            if (to > end) {
+                end = to;
+            }
+            j++;
+        }
+        if (end > start && readFully(storage->fd, span, (size_t)(end - start), (off_t)start) != 0) {
+            failed = 1;
+            break;
+        }
+        for (; i < j; i++) {
+            unsigned char *record = (unsigned char *)records + (size_t)i * storage->record_size;
+            if (entries[i] == 0) {
+                memset(record, 0, storage->record_size);
+            } else {
+                storage->codec->decode(span + (entryOffset(entries[i]) - start), entryLength(entries[i]), record);
+            }
+        }
+    }
+    free(span);
+    if (entries != local) {
+        free(entries);
+    }
+    return failed ? -1 : 0;
+}
+
+// Lays the encoded records out where they go and writes runs that are
+// adjacent in the file together: records rewritten in place where they
+// still fit, the rest appended at the end
+static int compactPut(BankStorage *storage, long slot, long n, const void *records) {
+    size_t max_space = (storage->codec->max_encoded + COMPACT_ALIGN - 1) & ~(size_t)(COMPACT_ALIGN - 1);
+    size_t run_cap = (size_t)(n < COMPACT_RUN_RECORDS ? (n > 0 ? n : 1) : COMPACT_RUN_RECORDS) * max_space;
+    unsigned char *run = malloc(run_cap);
+    uint64_t run_start = 0;
+    size_t run_len = 0;
+    long dirty_first = -1, dirty_last = -1;
+    int failed = run == NULL;
+
+    pthread_mutex_lock(&storage->lock);
+    if (slot < 0 || n < 0 || slot > storage->count) {
+        failed = 1;
+    }
+    for (long i = 0; i < n && !failed; i++) {
+        const unsigned char *record = (const unsigned char *)records + (size_t)i * storage->record_size;
+        long s = slot + i;
+        unsigned char encoded[4096];
+        size_t length = storage->codec->encode(record, encoded);
+
+        while (s >= (long)storage->chunk_count * COMPACT_CHUNK_ENTRIES && !failed) {
+            failed = addChunk(storage) != 0;
+        }
+        if (failed) {
+            break;
+        }
+
+        uint64_t entry = *slotEntry(storage, s);
+        uint64_t at;
+        size_t space;
+        if (entry != 0 && length <= entrySpace(entry) && entrySpace(entry) <= max_space) {
+            at = entryOffset(entry);
+            space = entrySpace(entry);
+        } else {
+            at = storage->heap_end;
+            space = (length + COMPACT_ALIGN - 1) & ~(size_t)(COMPACT_ALIGN - 1);
+            storage->heap_end += space;
+        }
+
+        if (run_len > 0 && (at != run_start + run_len || run_len + space > run_cap)) {
+            failed = writeFully(storage->fd, run, run_len, (off_t)run_start) != 0;
+            run_len = 0;
+        }
+        if (run_len == 0) {
+            run_start = at;
+        }
+        memcpy(run + run_len, encoded, length);
+        memset(run + run_len + length, 0, space - length);
+        run_len += space;
+
+        uint64_t updated = makeEntry(at, space, length);
+        if (updated != entry) {
+            *slotEntry(storage, s) = updated;
+            dirty_first = dirty_first < 0 ? s : dirty_first;
+            dirty_last = s + 1;
+        }
+    }
+    if (!failed && run_len > 0) {
+        failed = writeFully(storage->fd, run, run_len, (off_t)run_start) != 0;
+    }
+
+    // The directory and header follow the records they point at
+    if (!failed && dirty_first >= 0) {
+        failed = writeEntries(storage, dirty_first, dirty_last) != 0;
+    }
+    if (!failed && (slot + n > storage->count || dirty_first >= 0)) {
+        if (slot + n > storage->count) {
+            storage->count = slot + n;
+        }
+        failed = writeCompactHeader(storage) != 0;
+    }
+    pthread_mutex_unlock(&storage->lock);
+    free(run);
+    return failed ? -1 : 0;
+}
+
+static int compactTruncate(BankStorage *storage, long count) {
+    pthread_mutex_lock(&storage->lock);
+    storage->count = count;
+    int result = writeCompactHeader(storage);
+    pthread_mutex_unlock(&storage->lock);
+    return result;
+}
+
+static int compactAdopt(BankStorage *storage, int fd) {
+    unloadCompact(storage);
+    close(storage->fd);
+    storage->fd = fd;
+    return loadCompact(storage);
+}
+
+static const StorageOps compact_ops = {
+    "compact", 1, 0, compactOpen, compactClose, compactCount, compactGet, compactPut, compactTruncate, fileSync,
+    compactAdopt, fileJournalSize, fileJournalRead, fileJournalWrite, fileJournalTruncate, fileJournalSync,
+    fileOpenSide
+};
+
+// ---- interface ----
+
+static const StorageOps *const engines[] = {&file_ops, &mmap_ops, &memory_ops, &compact_ops};
+
+// Whether the file at `path` is already a compact store
+static int compactFile(const char *path) {
+    unsigned char magic[4];
+    int fd = open(path, O_RDONLY);
+    int compact = fd >= 0 && read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) &&
+                  (magic[0] | magic[1] << 8 | magic[2] << 16 | (uint32_t)magic[3] << 24) == COMPACT_MAGIC;
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return compact;
+}
+
+int storageOpen(BankStorage *storage, StorageKind kind, const char *path, const char *journal_path,
+                size_t record_size, const StorageCodec *codec) {
+    memset(storage, 0, sizeof(*storage));
+    storage->fd = -1;
+    storage->journal_fd = -1;
+    storage->record_size = record_size;
+    storage->codec = codec;
+    if ((int)kind < 0 || (size_t)kind >= sizeof(engines) / sizeof(engines[0])) {
+        return -1;
+    }
+    if (engines[kind]->flat && compactFile(path)) {
+        kind = STORAGE_COMPACT;
+    }
+    storage->ops = engines[kind];
+    if (storage->ops->open(storage, path, journal_path) != 0 ||
+        storageClaim(storage, storage->ops->flat ? STORAGE_LOCK_SHARED : STORAGE_LOCK_EXCLUSIVE) != 0) {
+        storageClose(storage);
+        return -1;
+    }
+    return 0;
+}
+
+void storageClose(BankStorage *storage) {
+    if (storage->ops != NULL) {
+        storage->ops->close(storage);
+    }
+    memset(storage, 0, sizeof(*storage));
+    storage->fd = -1;
+    storage->journal_fd = -1;
+}
+
+int storagePersistent(const BankStorage *storage) {
+    return storage->ops != NULL && storage->ops->persistent;
+}
+
+StorageKind storageKind(const BankStorage *storage) {
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (storage->ops == engines[i]) {
+            return (StorageKind)i;
+        }
+    }
+    return STORAGE_FILE;
+}
+
+int storageFlat(const BankStorage *storage) {
+    return storage->ops != NULL && storage->ops->flat;
+}
+
+const char *storageKindName(StorageKind kind) {
+    if ((int)kind < 0 || (size_t)kind >= sizeof(engines) / sizeof(engines[0])) {
+        return "unknown";
+    }
+    return engines[kind]->name;
+}
+
+int storageKindFromName(const char *name) {
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i]->name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+long storageCount(BankStorage *storage) {
+    return storage->ops->count(storage);
+}
+
+int storageGet(BankStorage *storage, long slot, long n, void *records) {
+    return storage->ops->get(storage, slot, n, records);
+}
+
+int storagePut(BankStorage *storage, long slot, long n, const void *records) {
+    return storage->ops->put(storage, slot, n, records);
+}
+
+int storageSync(BankStorage *storage) {
+    return storage->ops->sync(storage);
+}
+
+int storageTruncate(BankStorage *storage, long count) {
+    if (count < 0 || count > storageCount(storage)) {
+        return -1;
+    }
+    return storage->ops->truncate(storage, count);
+}
+
+int storageAdopt(BankStorage *storage, BankStorage *from) {
+    int fd = from->fd;
+
+    from->fd = -1;
+    storageClose(from);
+    if (fd < 0 || storage->ops->adopt(storage, fd) != 0) {
+        if (fd >= 0 && storage->fd != fd) {
+            close(fd);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t storageJournalSize(BankStorage *storage) {
+    return storage->ops->journalSize(storage);
+}
+
+size_t storageJournalRead(BankStorage *storage, void *data, size_t len, uint64_t offset) {
+    return storage->ops->journalRead(storage, data, len, offset);
+}
+
+int storageJournalWrite(BankStorage *storage, const void *data, size_t len, uint64_t offset) {
+    return storage->ops->journalWrite(storage, data, len, offset);
+}
+
+int storageJournalTruncate(BankStorage *storage, uint64_t size) {
+    return storage->ops->journalTruncate(storage, size);
+}
+
+int storageJournalSync(BankStorage *storage) {
+    return storage->ops->journalSync(storage);
+}
+
+// Blocks until the range is granted, unless `wait` is 0; a signal does not
+// give up the wait
+static int setLock(int fd, off_t offset, off_t len, StorageLockMode mode, int wait) {
+    struct flock lock;
+#ifdef F_OFD_SETLKW
+    int command = wait ? F_OFD_SETLKW : F_OFD_SETLK;
+#else
+    int command = wait ? F_SETLKW : F_SETLK;
+#endif
+
+    if (fd < 0) {
+        return 0;
+    }
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = mode == STORAGE_UNLOCK ? F_UNLCK : mode == STORAGE_LOCK_SHARED ? F_RDLCK : F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = offset;
+    lock.l_len = len;
+    while (fcntl(fd, command, &lock) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int lockRange(int fd, off_t offset, off_t len, StorageLockMode mode) {
+    return setLock(fd, offset, len, mode, 1);
+}
+
+int storageLockRecords(BankStorage *storage, long slot, long n, StorageLockMode mode) {
+    if (!storage->ops->persistent || slot < 0 || n <= 0) {
+        return 0;
+    }
+    return lockRange(storage->fd, recordOffset(storage, slot), recordOffset(storage, n), mode);
+}
+
+int storageLockAppend(BankStorage *storage, StorageLockMode mode) {
+    if (!storage->ops->persistent) {
+        return 0;
+    }
+    return lockRange(storage->fd, STORAGE_LOCK_APPEND_OFFSET, 1, mode);
+}
+
+int storageLockJournal(BankStorage *storage, StorageLockMode mode) {
+    if (!storage->ops->persistent) {
+        return 0;
+    }
+    return lockRange(storage->journal_fd, STORAGE_LOCK_JOURNAL_OFFSET, 1, mode);
+}
+
+int storageClaim(BankStorage *storage, StorageLockMode mode) {
+    if (!storage->ops->persistent) {
+        return 0;
+    }
+    return setLock(storage->fd, STORAGE_LOCK_OPEN_OFFSET, 1, mode, 0);
+}
+
+void storageRefresh(BankStorage *storage) {
+    struct stat st;
+
+    // The file engine asks the file every time; the compact engine's
+    // directory is its own and not shared
+    if (storage->ops == &mmap_ops && fstat(storage->fd, &st) == 0) {
+        long count = (long)(st.st_size / (off_t)storage->record_size);
+        if ((size_t)st.st_size <= storage->capacity && count > storage->count) {
+            storage->count = count;
+        }
+    }
+}
+
+int storageOpenSide(BankStorage *storage, const char *path, int flags) {
+    return storage->ops->openSide(storage, path, flags);
+}
+
+FILE *storageOpenStream(BankStorage *storage, const char *path, const char *mode) {
+    if (storage->ops->persistent) {
+        return fopen(path, mode);
+    }
+    int fd = storageOpenSide(storage, path, mode[0] == 'a' ? O_WRONLY | O_CREAT | O_APPEND : O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    FILE *stream = fdopen(fd, mode);
+    if (stream == NULL) {
+        close(fd);
+    }
+    return stream;
+}
@@ -0,0 +1,182 @@
+#ifndef BANK_STORAGE_H
+#define BANK_STORAGE_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Storage engines behind an account store. Records are fixed-size and
+// addressed by slot; the journal is an append-only byte stream beside them.
+// The flat-file engine is the original layout, read and written with
+// pread/pwrite. The mmap engine maps the same file shared, so record access
+// is a memcpy with no system call. The memory engine keeps everything on the
+// heap and never touches the disk, for tests and benchmarks; its side files
+// (log, orders, checkpoints) live in anonymous memory files.
+//
+// The compact engine stores each record in the variable-length encoding of
+// a StorageCodec, packed one after another, behind a slot directory that
+// maps a slot to where its record lies, so access by slot stays O(1). A
+// record that no longer fits its space after an update moves to the end of
+// the file; compaction (bank_compact.h) rewrites the file densely. The file
+// is recognised by its magic, so asking any persistent engine to open it
+// opens it compact, and asking the compact engine to open a flat store
+// converts it in place. Only one opener at a time may have it open.
+typedef enum {
+    STORAGE_FILE,
+    STORAGE_MMAP,
+    STORAGE_MEMORY,
+    STORAGE_COMPACT
+} StorageKind;
+
+// Address space the mmap engine reserves up front; the store can grow to it
+// without remapping, so readers never see the mapping move
+#define STORAGE_MMAP_RESERVE ((size_t)1 << (sizeof(void *) >= 8 ? 36 : 30))
+#define STORAGE_MEMORY_FILES 16     // side files the memory engine can hold
+
+// Compact engine file: a header holding the record count, the end of the
+// used space and the offsets of the directory chunks, then the chunks and
+// the records in the order they were written. A directory entry is a
+// little-endian word: offset << 24 | space << 12 | length, 0 if never written.
+#define COMPACT_MAGIC 0x50434b42u   // "BKCP"
+#define COMPACT_VERSION 1
+#define COMPACT_CHUNK_ENTRIES 8192  // directory entries per chunk
+#define COMPACT_MAX_CHUNKS 4096     // so at most 32M records
+#define COMPACT_HEADER_BYTES (32 + 8 * COMPACT_MAX_CHUNKS)
+#define COMPACT_ALIGN 16            // record space is rounded up to this, leaving room to grow
+#define COMPACT_CONVERT_SUFFIX ".converting"
+
+typedef struct BankStorage BankStorage;
+
+// Encoding of one record for the compact engine. decode fills the record
+// even from damaged bytes, which it reports by returning -1.
+typedef struct {
+    size_t max_encoded;
+    size_t (*encode)(const void *record, unsigned char *out);
+    int (*decode)(const unsigned char *in, size_t len, void *record);
+} StorageCodec;
+
+typedef struct {
+    const char *name;
+    int persistent;                 // data outlives the process
+    int flat;                       // record N is at N * record_size in fd
+    int (*open)(BankStorage *storage, const char *path, const char *journal_path);
+    void (*close)(BankStorage *storage);
+    long (*count)(BankStorage *storage);
+    int (*get)(BankStorage *storage, long slot, long n, void *records);
+    int (*put)(BankStorage *storage, long slot, long n, const void *records);
+    int (*truncate)(BankStorage *storage, long count);
+    int (*sync)(BankStorage *storage);
+    int (*adopt)(BankStorage *storage, int fd);
+    uint64_t (*journalSize)(BankStorage *storage);
+    size_t (*journalRead)(BankStorage *storage, void *data, size_t len, uint64_t offset);
+    int (*journalWrite)(BankStorage *storage, const void *data, size_t len, uint64_t offset);
+    int (*journalTruncate)(BankStorage *storage, uint64_t size);
+    int (*journalSync)(BankStorage *storage);
+    int (*openSide)(BankStorage *storage, const char *path, int flags);
+} StorageOps;
+
+typedef struct {
+    char *path;
+    int fd;
+} StorageMemoryFile;
+
+struct BankStorage {
+    const StorageOps *ops;
+    size_t record_size;
+    int fd;                         // store file, -1 for the memory engine
+    int journal_fd;                 // -1 when opened without a journal
+    long count;                     // records, for the mmap and memory engines
+    unsigned char *data;            // the mapping, or the heap copy of the store
+    size_t capacity;                // bytes reserved at `data`
+    unsigned char *journal;         // memory engine journal
+    uint64_t journal_len;
+    uint64_t journal_cap;
+    StorageMemoryFile files[STORAGE_MEMORY_FILES];
+    const StorageCodec *codec;      // compact engine
+    uint64_t *chunks[COMPACT_MAX_CHUNKS];
+    uint64_t chunk_offsets[COMPACT_MAX_CHUNKS];
+    int chunk_count;
+    uint64_t heap_end;              // end of the used space in the file
+    pthread_mutex_t lock;           // directory and heap_end, across parallel writers
+};
+
+// `journal_path` may be NULL for a store without a journal. `codec` is the
+// record encoding the compact engine needs; other engines keep records as
+// they are in memory and may be given NULL.
+int storageOpen(BankStorage *storage, StorageKind kind, const char *path, const char *journal_path,
+                size_t record_size, const StorageCodec *codec);
+void storageClose(BankStorage *storage);
+int storagePersistent(const BankStorage *storage);
+
+// The engine actually in use, which for a compact file is compact whatever was asked for
+StorageKind storageKind(const BankStorage *storage);
+
+// Whether record N lies at N * record_size in `fd`, for callers that read the file directly
+int storageFlat(const BankStorage *storage);
+
+// "file", "mmap", "memory" or "compact"; storageKindFromName returns -1 for anything else
+const char *storageKindName(StorageKind kind);
+int storageKindFromName(const char *name);
+
+// Records [slot, slot + n). Writing past the end extends the store; a
+// read is complete or fails.
+long storageCount(BankStorage *storage);
+int storageGet(BankStorage *storage, long slot, long n, void *records);
+int storagePut(BankStorage *storage, long slot, long n, const void *records);
+int storageSync(BankStorage *storage);
+
+// Drops every record from `count` on; a store is never grown this way
+int storageTruncate(BankStorage *storage, long count);
+
+// Switches to the record file of `from`, which the caller has renamed over
+// this store's; `from` is left closed. File-backed engines only.
+int storageAdopt(BankStorage *storage, BankStorage *from);
+
+// Journal bytes; a short read means the end was reached
+uint64_t storageJournalSize(BankStorage *storage);
+size_t storageJournalRead(BankStorage *storage, void *data, size_t len, uint64_t offset);
+int storageJournalWrite(BankStorage *storage, const void *data, size_t len, uint64_t offset);
+int storageJournalTruncate(BankStorage *storage, uint64_t size);
+int storageJournalSync(BankStorage *storage);
+
+// Advisory locks shared by every process with the same files open, so
+// several processes can serve one store. A record lock covers the record's
+// bytes in a flat file and the same byte range of a compact one; the append
+// lock serialises adding records at the end, and the journal lock appending
+// to the journal. Both of those lie far past any data. They are open file
+// description locks where the system has them, so two Banks in one process
+// exclude each other too. No-ops for the memory engine, which no other
+// process can see. Returns 0, or -1 if the lock could not be taken.
+typedef enum {
+    STORAGE_UNLOCK,
+    STORAGE_LOCK_SHARED,
+    STORAGE_LOCK_EXCLUSIVE
+} StorageLockMode;
+
+#define STORAGE_LOCK_APPEND_OFFSET ((off_t)1 << 61)
+#define STORAGE_LOCK_JOURNAL_OFFSET ((off_t)1 << 61)
+
+int storageLockRecords(BankStorage *storage, long slot, long n, StorageLockMode mode);
+int storageLockAppend(BankStorage *storage, StorageLockMode mode);
+int storageLockJournal(BankStorage *storage, StorageLockMode mode);
+
+// An open persistent store is claimed on a byte of its own: shared by the
+// flat engines, so several processes can serve it, and exclusive by the
+// compact engine, whose slot directory and end of used space each opener
+// caches. storageOpen fails when its claim conflicts with another opener's,
+// without waiting. Returns 0, or -1 if the claim could not be taken.
+#define STORAGE_LOCK_OPEN_OFFSET (((off_t)1 << 61) + 1)
+
+int storageClaim(BankStorage *storage, StorageLockMode mode);
+
+// Picks up records another process added since the store was opened
+void storageRefresh(BankStorage *storage);
+
+// Side files kept beside the store, opened with open(2) flags; the caller
+// closes the descriptor. Streams are opened with fopen modes "r" and "a".
+int storageOpenSide(BankStorage *storage, const char *path, int flags);
+FILE *storageOpenStream(BankStorage *storage, const char *path, const char *mode);
+
+#endif
@@ -0,0 +1,118 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bank_term.h"
+
+void termInit(TermBuffer *term, int fd) {
+    memset(term, 0, sizeof(*term));
+    term->fd = fd;
+}
+
+void termFree(TermBuffer *term) {
+    free(term->data);
+    term->data = NULL;
+    term->len = term->cap = 0;
+}
+
+// Room for `extra` more bytes; 0 if the buffer could not grow
+static int reserve(TermBuffer *term, size_t extra) {
+    if (term->len + extra <= term->cap) {
+        return 1;
+    }
+    size_t cap = term->cap ? term->cap : TERM_INITIAL_CAPACITY;
+    while (cap < term->len + extra) {
+        cap *= 2;
+    }
+    char *data = realloc(term->data, cap);
+    if (data == NULL) {
+        return 0;
+    }
+    term->data = data;
+    term->cap = cap;
+    return 1;
+}
+
+static int writeAll(TermBuffer *term, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(term->fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        term->flushes++;
+        term->bytes += (uint64_t)n;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+void termWrite(TermBuffer *term, const void *data, size_t len) {
+    if (!reserve(term, len)) {
+        // Out of memory: fall back to writing straight through
+        termFlush(term);
+        writeAll(term, data, len);
+        return;
+    }
+    memcpy(term->data + term->len, data, len);
+    term->len += len;
+}
+
+void termPrintf(TermBuffer *term, const char *format, ...) {
+    char line[512];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(line)) {
+        termWrite(term, line, (size_t)n);
+        return;
+    }
+
+    // Longer than a line: format again straight into the buffer
+    if (!reserve(term, (size_t)n + 1)) {
+        termWrite(term, line, sizeof(line) - 1);
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(term->data + term->len, (size_t)n + 1, format, args);
+    va_end(args);
+    term->len += (size_t)n;
+}
+
+void termRepeat(TermBuffer *term, char c, int count) {
+    if (count <= 0) {
+        return;
+    }
+    if (!reserve(term, (size_t)count)) {
+        while (count-- > 0) {
+            termWrite(term, &c, 1);
+        }
+        return;
+    }
+    memset(term->data + term->len, c, (size_t)count);
+    term->len += (size_t)count;
+}
+
+void termClear(TermBuffer *term) {
+    term->len = 0;
+    termWrite(term, TERM_CLEAR, sizeof(TERM_CLEAR) - 1);
+}
+
+int termFlush(TermBuffer *term) {
+    int result = writeAll(term, term->data, term->len);
+    term->len = 0;
+    return result;
+}
@@ -0,0 +1,41 @@
+#ifndef BANK_TERM_H
+#define BANK_TERM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Screen composition for the terminal front-end. Everything a screen shows,
+// the clear included, is appended to one buffer and reaches the terminal
+// with a single write when the screen waits for input, instead of a write
+// per line and a shell per clear.
+#define TERM_CLEAR "\x1b[H\x1b[2J\x1b[3J"  // home, erase the screen and the scrollback
+#define TERM_INITIAL_CAPACITY 16384
+
+typedef struct {
+    int fd;
+    char *data;
+    size_t len;
+    size_t cap;
+    uint64_t flushes;               // writes issued
+    uint64_t bytes;                 // bytes written
+} TermBuffer;
+
+void termInit(TermBuffer *term, int fd);
+void termFree(TermBuffer *term);
+
+void termWrite(TermBuffer *term, const void *data, size_t len);
+void termPrintf(TermBuffer *term, const char *format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+void termRepeat(TermBuffer *term, char c, int count);
+
+// Starts a new screen: whatever is pending is dropped, since it would be
+// erased anyway
+void termClear(TermBuffer *term);
+
+// Writes out the pending output. Returns 0, or -1 if the terminal is gone.
+int termFlush(TermBuffer *term);
+
+#endif
@@ -0,0 +1,188 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bank_trace.h"
+#include "bank_internal.h"
+
+struct BankTrace {
+    FILE *file;
+    uint64_t origin;              // monotonic nanoseconds when the trace began
+    int depth;                    // traced operations under way, outermost first
+    int failed;                   // a write failed; nothing more is written
+    uint8_t menu;
+    int buffered;
+    TraceRecord buffer[TRACE_BUFFER_RECORDS];
+};
+
+static uint64_t monotonicNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int bankTraceStart(Bank *bank, const char *path) {
+    BankTrace *trace = calloc(1, sizeof(BankTrace));
+    TraceHeader header;
+
+    if (trace == NULL) {
+        return BANK_ERR_IO;
+    }
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL) {
+        free(trace);
+        return BANK_ERR_IO;
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.started = (int64_t)time(NULL);
+    if (fwrite(&header, sizeof(header), 1, trace->file) != 1 || fflush(trace->file) != 0) {
+        fclose(trace->file);
+        free(trace);
+        return BANK_ERR_IO;
+    }
+    trace->origin = monotonicNanos();
+    trace->menu = TRACE_NO_MENU;
+    bankTraceStop(bank);
+    bank->trace = trace;
+    return BANK_OK;
+}
+
+void traceFlush(Bank *bank) {
+    BankTrace *trace = bank->trace;
+
+    if (trace == NULL || trace->buffered == 0) {
+        return;
+    }
+    if (!trace->failed &&
+        (fwrite(trace->buffer, sizeof(TraceRecord), (size_t)trace->buffered, trace->file) != (size_t)trace->buffered ||
+         fflush(trace->file) != 0)) {
+        trace->failed = 1;
+    }
+    trace->buffered = 0;
+}
+
+void bankTraceStop(Bank *bank) {
+    if (bank->trace == NULL) {
+        return;
+    }
+    traceFlush(bank);
+    fclose(bank->trace->file);
+    free(bank->trace);
+    bank->trace = NULL;
+}
+
+static void append(BankTrace *trace, uint64_t began, TraceRecord *record) {
+    record->start = began - trace->origin;
+    record->menu = trace->menu;
+    trace->buffer[trace->buffered++] = *record;
+}
+
+void bankTraceMenu(Bank *bank, int choice) {
+    TraceRecord record;
+
+    if (bank->trace == NULL) {
+        return;
+    }
+    bank->trace->menu = choice >= 0 && choice < TRACE_NO_MENU ? (uint8_t)choice : TRACE_NO_MENU;
+    memset(&record, 0, sizeof(record));
+    record.op = TRACE_MENU;
+    append(bank->trace, monotonicNanos(), &record);
+    traceFlush(bank);
+}
+
+uint64_t traceBegin(Bank *bank) {
+    if (bank->trace == NULL) {
+        return 0;
+    }
+    bank->trace->depth++;
+    return monotonicNanos();
+}
+
+void traceEnd(Bank *bank, uint64_t began, TraceRecord *record) {
+    BankTrace *trace = bank->trace;
+
+    if (began == 0 || trace == NULL) {
+        return;
+    }
+    if (--trace->depth > 0) {
+        return;
+    }
+    record->latency = monotonicNanos() - began;
+    append(trace, began, record);
+    if (trace->buffered == TRACE_BUFFER_RECORDS) {
+        traceFlush(bank);
+    }
+}
+
+void traceOp(Bank *bank, uint64_t began, int op, int result, int account_number, int related, double amount,
+             int64_t arg) {
+    TraceRecord record;
+
+    if (began == 0) {
+        return;
+    }
+    memset(&record, 0, sizeof(record));
+    record.op = (uint8_t)op;
+    record.result = result;
+    record.account_number = account_number;
+    record.related = related;
+    record.amount = amount;
+    record.arg = arg;
+    traceEnd(bank, began, &record);
+}
+
+uint64_t traceStamp(Bank *bank) {
+    return bank->trace != NULL ? monotonicNanos() : 0;
+}
+
+void traceSpan(Bank *bank, uint64_t began, TraceRecord *record) {
+    BankTrace *trace = bank->trace;
+
+    if (began == 0 || trace == NULL || trace->depth > 0) {
+        return;
+    }
+    record->latency = monotonicNanos() - began;
+    append(trace, began, record);
+    if (trace->buffered == TRACE_BUFFER_RECORDS) {
+        traceFlush(bank);
+    }
+}
+
+int traceReaderOpen(TraceReader *reader, const char *path) {
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        return -1;
+    }
+    if (fread(&reader->header, sizeof(reader->header), 1, reader->file) != 1 ||
+        reader->header.magic != TRACE_MAGIC || reader->header.version != TRACE_VERSION ||
+        reader->header.record_size != sizeof(TraceRecord)) {
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int traceReaderNext(TraceReader *reader, TraceRecord *record) {
+    return fread(record, sizeof(*record), 1, reader->file) == 1;
+}
+
+void traceReaderClose(TraceReader *reader) {
+    if (reader->file != NULL) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+const char *traceOpName(int op) {
+    static const char *const names[TRACE_OPS] = {
+        "menu", "find", "create", "auth", "touch", "deposit", "withdraw", "transfer", "password",
+        "suspend", "reactivate", "close", "search", "history", "query", "order", "cancel", "orders",
+        "run-due", "begin", "commit"};
+    return op >= 0 && op < TRACE_OPS ? names[op] : "unknown";
+}
@@ -0,0 +1,111 @@
+#ifndef BANK_TRACE_H
+#define BANK_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bank_core.h"
+
+// Workload traces. A traced bank appends one fixed-size record per operation
+// to a trace file: what was asked (account numbers, amounts, retry keys and
+// the like), its result, when it started and how long it took, and the menu
+// choice it was made under. Names, emails, phone numbers and passwords are
+// never written; a search records only which field it read, the key's length
+// and the first account it found, and an authentication only whether it
+// succeeded.
+//
+// Operations made by another traced operation (the lookups inside a
+// transfer, the batch inside a standing order run) are part of it and not
+// recorded on their own. Records are buffered and written at each commit,
+// each menu choice and close, so a trace is as current as the transaction
+// log.
+//
+// bankbench replay re-executes a trace against a copy of the data directory
+// whose passwords have all been set to TRACE_REPLAY_PASSWORD, so the same
+// authentications succeed and fail without the trace holding any secret.
+#define BANK_TRACE_ENV "BANK_TRACE"     // banking_system traces to this file when set
+#define TRACE_MAGIC 0x43525442u         // "BTRC"
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_RECORDS 256        // records buffered between writes
+#define TRACE_NO_MENU 0xff              // operations not made from the menu, as in bankd
+#define TRACE_REPLAY_PASSWORD "trace-replay"
+
+typedef enum {
+    TRACE_MENU,                         // a menu choice was made; `menu` holds it
+    TRACE_FIND,
+    TRACE_CREATE,                       // account_number: the account created
+    TRACE_AUTH,
+    TRACE_TOUCH,
+    TRACE_DEPOSIT,                      // arg: retry key
+    TRACE_WITHDRAW,                     // arg: retry key
+    TRACE_TRANSFER,                     // related: payee, arg: retry key
+    TRACE_PASSWORD,
+    TRACE_SUSPEND,
+    TRACE_REACTIVATE,
+    TRACE_CLOSE,
+    TRACE_SEARCH,                       // related: field | prefix << 8, count: key length,
+                                        // account_number: first found, result: found
+    TRACE_HISTORY,                      // count: lines read, timed from open to close
+    TRACE_QUERY,                        // see TRACE_QUERY_* below
+    TRACE_ORDER_CREATE,                 // related: payee, arg: seconds until first due,
+                                        // limit: interval in seconds, count: transfers
+    TRACE_ORDER_CANCEL,                 // arg: order id
+    TRACE_ORDER_LIST,                   // count: orders asked for, result: found
+    TRACE_RUN_DUE,                      // arg: seconds the run was ahead of the clock
+    TRACE_BEGIN,
+    TRACE_COMMIT,
+    TRACE_OPS
+} TraceOp;
+
+// A listing records its filters in `related`, its page size in `count`,
+// balance bounds in `amount` and `limit`, and how long before the clock its
+// last-access bound was in `arg` (0 for none)
+#define TRACE_QUERY_ORDER_SHIFT 4
+#define TRACE_QUERY_DESCENDING 0x40
+#define TRACE_QUERY_NEXT_PAGE 0x80      // continued from the previous listing's cursor
+#define TRACE_QUERY_THREADS_SHIFT 8
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    int64_t started;                    // wall clock seconds when the trace began
+    int64_t reserved2;
+} TraceHeader;
+
+typedef struct {
+    uint64_t start;                     // nanoseconds since the trace began
+    uint64_t latency;                   // nanoseconds
+    double amount;
+    double limit;
+    int64_t arg;
+    int32_t account_number;
+    int32_t related;
+    int32_t count;
+    int32_t result;                     // BankResult, or a count for operations that return one
+    uint8_t op;                         // TraceOp
+    uint8_t menu;                       // choice in effect, or TRACE_NO_MENU
+    uint8_t reserved[6];
+} TraceRecord;
+
+typedef struct {
+    FILE *file;
+    TraceHeader header;
+} TraceReader;
+
+// Starts tracing every operation on `bank` to a new file at `path`;
+// bankClose stops it
+int bankTraceStart(Bank *bank, const char *path);
+void bankTraceStop(Bank *bank);
+
+// Operations from here on are made under menu choice `choice`
+void bankTraceMenu(Bank *bank, int choice);
+
+int traceReaderOpen(TraceReader *reader, const char *path);
+int traceReaderNext(TraceReader *reader, TraceRecord *record);   // 1, or 0 at the end
+void traceReaderClose(TraceReader *reader);
+
+const char *traceOpName(int op);
+
+#endif
@@ -0,0 +1,175 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "bank_uring.h"
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+static int ioUringSetup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+int bankUringInit(BankUring *ring, unsigned entries) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    ring->ring_fd = ioUringSetup(entries, &params);
+    if (ring->ring_fd < 0) {
+        return -1;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        bankUringExit(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+    return 0;
+}
+
+void bankUringExit(BankUring *ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->ring_fd >= 0) {
+        close(ring->ring_fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+}
+
+static int queueEntry(BankUring *ring, int opcode, int fd, const void *buf, size_t len,
+                      uint64_t offset, uint64_t user_data) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail;
+    if (tail - head >= ring->entries) {
+        return -1;
+    }
+
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)ring->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (unsigned)len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->inflight++;
+    return 0;
+}
+
+int bankUringQueueRead(BankUring *ring, int fd, void *buf, size_t len, uint64_t offset, uint64_t user_data) {
+    return queueEntry(ring, IORING_OP_READ, fd, buf, len, offset, user_data);
+}
+
+int bankUringQueueWrite(BankUring *ring, int fd, const void *buf, size_t len, uint64_t offset, uint64_t user_data) {
+    return queueEntry(ring, IORING_OP_WRITE, fd, buf, len, offset, user_data);
+}
+
+int bankUringSubmit(BankUring *ring, unsigned wait_nr) {
+    unsigned pending = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    if (pending == 0 && wait_nr == 0) {
+        return 0;
+    }
+    while (ioUringEnter(ring->ring_fd, pending, wait_nr, flags) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int bankUringComplete(BankUring *ring, uint64_t *user_data, int *res) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    struct io_uring_cqe *cqe = (struct io_uring_cqe *)ring->cqes + (head & *ring->cq_mask);
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    ring->inflight--;
+    return 1;
+}
+
+#else
+
+int bankUringInit(BankUring *ring, unsigned entries) {
+    (void)entries;
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+    errno = ENOSYS;
+    return -1;
+}
+
+void bankUringExit(BankUring *ring) {
+    (void)ring;
+}
+
+int bankUringQueueRead(BankUring *ring, int fd, void *buf, size_t len, uint64_t offset, uint64_t user_data) {
+    (void)ring; (void)fd; (void)buf; (void)len; (void)offset; (void)user_data;
+    return -1;
+}
+
+int bankUringQueueWrite(BankUring *ring, int fd, const void *buf, size_t len, uint64_t offset, uint64_t user_data) {
+    (void)ring; (void)fd; (void)buf; (void)len; (void)offset; (void)user_data;
+    return -1;
+}
+
+int bankUringSubmit(BankUring *ring, unsigned wait_nr) {
+    (void)ring; (void)wait_nr;
+    return -1;
+}
+
+int bankUringComplete(BankUring *ring, uint64_t *user_data, int *res) {
+    (void)ring; (void)user_data; (void)res;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef BANK_URING_H
+#define BANK_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal io_uring submission/completion ring built directly on the kernel
+// interface (no liburing). Used by the core for asynchronous log appends and
+// account page reads when a server opts in with bankAttachUring().
+typedef struct {
+    int ring_fd;
+    unsigned entries;
+    unsigned inflight;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *sqes;
+    void *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} BankUring;
+
+// Returns 0 on success or -1 when io_uring is unavailable (old kernel,
+// non-Linux build, or blocked by a seccomp policy)
+int bankUringInit(BankUring *ring, unsigned entries);
+void bankUringExit(BankUring *ring);
+
+// Queue a read or write at an explicit offset; returns -1 when the
+// submission queue is full
+int bankUringQueueRead(BankUring *ring, int fd, void *buf, size_t len, uint64_t offset, uint64_t user_data);
+int bankUringQueueWrite(BankUring *ring, int fd, const void *buf, size_t len, uint64_t offset, uint64_t user_data);
+
+// Submits queued entries, optionally waiting for `wait_nr` completions
+int bankUringSubmit(BankUring *ring, unsigned wait_nr);
+
+// Pops one completion; returns 1 when one was available
+int bankUringComplete(BankUring *ring, uint64_t *user_data, int *res);
+
+#endif
@@ -0,0 +1,752 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bank_core.h"
+#include "bank_bulk.h"
+#include "bank_compact.h"
+#include "bank_crc.h"
+#include "bank_daily.h"
+#include "bank_dormancy.h"
+#include "bank_fsck.h"
+#include "bank_post.h"
+#include "bank_query.h"
+#include "bank_sched.h"
+
+// Administrative batch jobs run against the account store, normally during
+// the batch window while the interactive front-ends are stopped
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *optionValue(int argc, char **argv, const char *name, const char *fallback) {
+    for (int i = 0; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return fallback;
+}
+
+static int hasFlag(int argc, char **argv, const char *name) {
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The store named by --accounts, else the one in --data-dir or its default
+static int openStore(Bank *bank, int argc, char **argv) {
+    const char *accounts_path = optionValue(argc, argv, "--accounts", NULL);
+    int kind = storageKindFromName(optionValue(argc, argv, "--storage", "file"));
+    int result;
+
+    if (kind < 0) {
+        result = BANK_ERR_INVALID_REQUEST;
+    } else if (accounts_path != NULL) {
+        result = bankOpenStorage(bank, (StorageKind)kind, accounts_path, optionValue(argc, argv, "--log", NULL));
+    } else {
+        result = bankOpenDir(bank, (StorageKind)kind, optionValue(argc, argv, "--data-dir", NULL));
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: %s\n", bankResultMessage(result));
+    }
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// post: interest or fee posting to every active account
+// ---------------------------------------------------------------------------
+
+static int commandPost(int argc, char **argv) {
+    const char *interest = optionValue(argc, argv, "--interest", NULL);
+    const char *fee = optionValue(argc, argv, "--fee", NULL);
+    const char *run = optionValue(argc, argv, "--run", NULL);
+    BankPosting posting;
+    BankPostStats stats;
+    Bank bank;
+
+    if ((interest == NULL) == (fee == NULL) || run == NULL) {
+        fprintf(stderr, "Usage: bankadm post (--interest PERCENT | --fee AMOUNT) --run ID "
+                        "[--threads N] [--data-dir DIR | --accounts FILE [--log FILE]]\n");
+        return 2;
+    }
+
+    memset(&posting, 0, sizeof(posting));
+    posting.kind = interest != NULL ? POST_INTEREST : POST_FEE;
+    posting.amount = atof(interest != NULL ? interest : fee);
+    posting.threads = atoi(optionValue(argc, argv, "--threads", "0"));
+    snprintf(posting.run_id, sizeof(posting.run_id), "%s", run);
+
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        return 1;
+    }
+
+    double start = nowSeconds();
+    int result = bankPostBatch(&bank, &posting, &stats);
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    if (result == BANK_ERR_INVALID_REQUEST) {
+        fprintf(stderr, "bankadm: run '%s' conflicts with the unfinished or differently defined run "
+                        "recorded in the checkpoint\n", run);
+        return 1;
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: posting stopped: %s (rerun to resume)\n", bankResultMessage(result));
+        return 1;
+    }
+    if (stats.already_done) {
+        printf("run %s already completed; nothing posted\n", run);
+    } else if (stats.first_slot > 0) {
+        printf("resumed run %s at record %ld\n", run, stats.first_slot);
+    }
+
+    printf("posted:     %ld\n", stats.posted);
+    printf("skipped:    %ld\n", stats.skipped);
+    printf("total:      $%.2f\n", stats.total);
+    printf("scanned:    %ld\n", stats.scanned);
+    printf("elapsed:    %.3f s\n", elapsed);
+    if (stats.scanned > 0 && elapsed > 0) {
+        printf("throughput: %.0f accounts/sec\n", stats.scanned / elapsed);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// orders: list standing orders or fire the ones that are due
+// ---------------------------------------------------------------------------
+
+#define ORDERS_LIST_MAX 1000
+
+static int commandOrders(int argc, char **argv) {
+    const char *action = argc >= 2 ? argv[1] : "";
+    Bank bank;
+
+    if (strcmp(action, "run") != 0 && strcmp(action, "list") != 0) {
+        fprintf(stderr, "Usage: bankadm orders (run | list [--account N]) "
+                        "[--data-dir DIR | --accounts FILE [--log FILE]]\n");
+        return 2;
+    }
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        return 1;
+    }
+
+    if (strcmp(action, "list") == 0) {
+        static StandingOrder orders[ORDERS_LIST_MAX];
+        int count = bankListOrders(&bank, atoi(optionValue(argc, argv, "--account", "0")),
+                                   orders, ORDERS_LIST_MAX);
+        bankClose(&bank);
+
+        printf("%-8s %-8s %-8s %12s %-20s %10s %8s %8s\n", "ID", "From", "To", "Amount", "Next Due",
+               "Every (d)", "Left", "Failed");
+        for (int i = 0; i < count; i++) {
+            char due[32];
+            time_t next = (time_t)orders[i].next_due;
+            strftime(due, sizeof(due), "%Y-%m-%d %H:%M:%S", localtime(&next));
+            printf("%-8u %-8d %-8d %12.2f %-20s %10.1f %8d %8d\n", orders[i].id, orders[i].from_account,
+                   orders[i].to_account, orders[i].amount, due, orders[i].interval / 86400.0,
+                   orders[i].remaining, orders[i].failures);
+        }
+        return 0;
+    }
+
+    BankOrderStats stats;
+    double start = nowSeconds();
+    int result = bankRunDueOrders(&bank, (int64_t)time(NULL), &stats);
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: firing stopped: %s (rerun to resume)\n", bankResultMessage(result));
+        return 1;
+    }
+    printf("fired:      %ld\n", stats.fired);
+    printf("failed:     %ld\n", stats.failed);
+    printf("commits:    %ld\n", stats.commits);
+    printf("elapsed:    %.3f s\n", elapsed);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// account: suspend, reactivate or close one account
+// ---------------------------------------------------------------------------
+
+static int commandAccount(int argc, char **argv) {
+    int account_number = argc >= 3 ? atoi(argv[1]) : 0;
+    const char *action = argc >= 3 ? argv[2] : "";
+    int (*change)(Bank *, int) = strcmp(action, "suspend") == 0      ? bankSuspendAccount
+                                 : strcmp(action, "reactivate") == 0 ? bankReactivateAccount
+                                 : strcmp(action, "close") == 0      ? bankCloseAccount
+                                                                     : NULL;
+    Bank bank;
+
+    if (account_number == 0 || change == NULL) {
+        fprintf(stderr, "Usage: bankadm account NUMBER (suspend | reactivate | close) "
+                        "[--data-dir DIR | --accounts FILE [--log FILE]]\n");
+        return 2;
+    }
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        return 1;
+    }
+
+    int result = change(&bank, account_number);
+    bankClose(&bank);
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: %s\n", bankResultMessage(result));
+        return 1;
+    }
+    printf("account %d: %s\n", account_number, action);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// compact: move closed accounts to the archive and rewrite the store densely
+// ---------------------------------------------------------------------------
+
+static int commandCompact(int argc, char **argv) {
+    BankCompactStats stats;
+    Bank bank;
+
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        return 1;
+    }
+
+    double start = nowSeconds();
+    int result = bankCompact(&bank, &stats);
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    if (result == BANK_ERR_INVALID_REQUEST) {
+        fprintf(stderr, "bankadm: a posting run is unfinished, or the store is not on disk\n");
+        return 1;
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: compaction failed, store unchanged: %s\n", bankResultMessage(result));
+        return 1;
+    }
+    printf("scanned:    %ld\n", stats.scanned);
+    printf("archived:   %ld\n", stats.archived);
+    printf("live:       %ld\n", stats.live);
+    printf("elapsed:    %.3f s\n", elapsed);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// fsck: verify every record and journal entry, optionally quarantining damage
+// ---------------------------------------------------------------------------
+
+static int commandFsck(int argc, char **argv) {
+    static const char *const kinds[] = {"", "record", "entry", "tail"};
+    int quarantine = hasFlag(argc, argv, "--quarantine");
+    BankFsckStats stats;
+    Bank bank;
+
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        return 1;
+    }
+
+    double start = nowSeconds();
+    int result = bankFsck(&bank, atoi(optionValue(argc, argv, "--threads", "0")), quarantine, &stats);
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: fsck stopped: %s\n", bankResultMessage(result));
+        return 1;
+    }
+    for (int i = 0; i < stats.issue_count; i++) {
+        const BankFsckIssue *issue = &stats.issues[i];
+        printf("corrupt %-6s at %-12llu account %d\n", kinds[issue->kind], (unsigned long long)issue->position,
+               issue->account_number);
+    }
+
+    long problems = stats.corrupt_records + (long)stats.corrupt_entries + (stats.torn_bytes > 0);
+    printf("records:    %ld (%ld corrupt, %ld unsealed)\n", stats.records, stats.corrupt_records, stats.unsealed);
+    printf("entries:    %llu (%llu corrupt, %llu void)\n", (unsigned long long)stats.entries,
+           (unsigned long long)stats.corrupt_entries, (unsigned long long)stats.void_entries);
+    if (stats.torn_bytes > 0) {
+        printf("torn tail:  %llu bytes\n", (unsigned long long)stats.torn_bytes);
+    }
+    if (quarantine) {
+        printf("quarantined: %ld, sealed: %ld\n", stats.quarantined, stats.sealed);
+    }
+    printf("checksum:   crc32c (%s)\n", crc32cImplementation());
+    printf("elapsed:    %.3f s\n", elapsed);
+    if (elapsed > 0) {
+        printf("throughput: %.0f MB/s\n", stats.bytes / elapsed / 1e6);
+    }
+    return problems > 0 && !quarantine ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// list: filtered, sorted accounts a page at a time, or the top K
+// ---------------------------------------------------------------------------
+
+// YYYY-MM-DD, local midnight; -1 if malformed
+static int64_t parseDate(const char *text) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(text, "%d-%d-%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) != 3) {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return (int64_t)mktime(&tm);
+}
+
+static int parseStatuses(const char *text, unsigned *statuses) {
+    char copy[64];
+    snprintf(copy, sizeof(copy), "%s", text);
+    *statuses = 0;
+    for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (strcmp(name, "active") == 0) {
+            *statuses |= QUERY_ACTIVE;
+        } else if (strcmp(name, "suspended") == 0) {
+            *statuses |= QUERY_SUSPENDED;
+        } else if (strcmp(name, "closed") == 0) {
+            *statuses |= QUERY_CLOSED;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int commandList(int argc, char **argv) {
+    const char *status = optionValue(argc, argv, "--status", NULL);
+    const char *sort = optionValue(argc, argv, "--sort", "store");
+    const char *after = optionValue(argc, argv, "--accessed-after", NULL);
+    const char *before = optionValue(argc, argv, "--accessed-before", NULL);
+    const char *cursor_token = optionValue(argc, argv, "--after", NULL);
+    int limit = atoi(optionValue(argc, argv, "--limit", "50"));
+    BankQueryCursor cursor;
+    BankQueryStats stats;
+    BankQuery query;
+    Bank bank;
+    int usage = 0;
+
+    bankQueryInit(&query);
+    memset(&cursor, 0, sizeof(cursor));
+    query.min_balance = atof(optionValue(argc, argv, "--min-balance", "-1e308"));
+    query.max_balance = atof(optionValue(argc, argv, "--max-balance", "1e308"));
+    query.descending = hasFlag(argc, argv, "--desc");
+    query.threads = atoi(optionValue(argc, argv, "--threads", "0"));
+    if (status != NULL && parseStatuses(status, &query.statuses) != 0) {
+        usage = 1;
+    }
+    if (after != NULL && (query.accessed_from = parseDate(after)) < 0) {
+        usage = 1;
+    }
+    if (before != NULL && (query.accessed_to = parseDate(before)) < 0) {
+        usage = 1;
+    } else if (before != NULL) {
+        query.accessed_to--;   // before that day begins
+    }
+    if (strcmp(sort, "balance") == 0) {
+        query.order = QUERY_ORDER_BALANCE;
+    } else if (strcmp(sort, "created") == 0) {
+        query.order = QUERY_ORDER_CREATED;
+    } else if (strcmp(sort, "store") != 0) {
+        usage = 1;
+    }
+    if (cursor_token != NULL) {
+        cursor.started = sscanf(cursor_token, "%lf/%ld", &cursor.key, &cursor.slot) == 2;
+        usage |= !cursor.started;
+    }
+    if (usage || limit < 1 || limit > QUERY_PAGE_MAX) {
+        fprintf(stderr, "Usage: bankadm list [--status active,suspended,closed] [--min-balance X] "
+                        "[--max-balance X]\n"
+                        "       [--accessed-after YYYY-MM-DD] [--accessed-before YYYY-MM-DD] "
+                        "[--sort store|balance|created] [--desc]\n"
+                        "       [--limit N (1-%d)] [--after CURSOR] [--threads N] "
+                        "[--data-dir DIR | --accounts FILE]\n", QUERY_PAGE_MAX);
+        return 2;
+    }
+
+    Account *rows = malloc((size_t)limit * sizeof(Account));
+    if (rows == NULL) {
+        fprintf(stderr, "bankadm: out of memory\n");
+        return 1;
+    }
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        free(rows);
+        return 1;
+    }
+
+    double start = nowSeconds();
+    int found = bankQuery(&bank, &query, &cursor, rows, limit, &stats);
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    if (found < 0) {
+        fprintf(stderr, "bankadm: %s\n", bankResultMessage(BANK_ERR_IO));
+        free(rows);
+        return 1;
+    }
+    printf("%-10s %-25s %12s %-10s %-10s %-10s\n", "account", "name", "balance", "status", "opened", "accessed");
+    for (int i = 0; i < found; i++) {
+        char opened[16], accessed[16];
+        strftime(opened, sizeof(opened), "%Y-%m-%d", localtime(&rows[i].created_date));
+        strftime(accessed, sizeof(accessed), "%Y-%m-%d", localtime(&rows[i].last_accessed));
+        printf("%-10d %-25s %12.2f %-10s %-10s %-10s\n", rows[i].account_number, rows[i].name, rows[i].balance,
+               accountStatusName(rows[i].status), opened, accessed);
+    }
+    free(rows);
+
+    printf("scanned:    %ld\n", stats.scanned);
+    if (stats.complete) {
+        printf("matched:    %ld (%.2f)\n", stats.matched, stats.matched_balance);
+    }
+    if (stats.corrupt > 0) {
+        printf("corrupt:    %ld skipped, run bankadm fsck\n", stats.corrupt);
+    }
+    if (found == limit) {
+        printf("next page:  --after %.17g/%ld\n", cursor.key, cursor.slot);
+    }
+    printf("elapsed:    %.3f s\n", elapsed);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// daily: per-day totals from the materialized aggregates
+// ---------------------------------------------------------------------------
+
+// YYYY-MM-DD as YYYYMMDD; -1 if malformed
+static int parseDay(const char *text) {
+    int year, month, mday;
+    if (sscanf(text, "%d-%d-%d", &year, &month, &mday) != 3 || month < 1 || month > 12 || mday < 1 ||
+        mday > 31) {
+        return -1;
+    }
+    return year * 10000 + month * 100 + mday;
+}
+
+static int localDay(time_t when) {
+    struct tm tm;
+    localtime_r(&when, &tm);
+    return (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+}
+
+static int commandDaily(int argc, char **argv) {
+    const char *from_text = optionValue(argc, argv, "--from", NULL);
+    const char *to_text = optionValue(argc, argv, "--to", NULL);
+    int from = from_text ? parseDay(from_text) : localDay(time(NULL) - 29 * 86400);
+    int to = to_text ? parseDay(to_text) : localDay(time(NULL));
+    BankDay total;
+    Bank bank;
+
+    if (from < 0 || to < 0 || from > to) {
+        fprintf(stderr, "Usage: bankadm daily [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--rebuild] "
+                        "[--data-dir DIR | --accounts FILE]\n"
+                        "       Shows the last 30 days by default; --rebuild recounts them from the journal first\n");
+        return 2;
+    }
+    BankDay *days = malloc(DAILY_RANGE_MAX * sizeof(BankDay));
+    if (days == NULL) {
+        fprintf(stderr, "bankadm: out of memory\n");
+        return 1;
+    }
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        free(days);
+        return 1;
+    }
+
+    double start = nowSeconds();
+    int result = hasFlag(argc, argv, "--rebuild") ? bankDailyRebuild(&bank) : BANK_OK;
+    if (result == BANK_OK && hasFlag(argc, argv, "--rebuild")) {
+        printf("rebuilt from the journal in %.3f s\n", nowSeconds() - start);
+    }
+    start = nowSeconds();
+    int found = result == BANK_OK ? bankDailyRange(&bank, from, to, days, DAILY_RANGE_MAX) : -1;
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+    if (found < 0) {
+        fprintf(stderr, "bankadm: %s\n", bankResultMessage(BANK_ERR_IO));
+        free(days);
+        return 1;
+    }
+
+    memset(&total, 0, sizeof(total));
+    printf("%-10s %19s %19s %19s %19s %6s %6s %13s\n", "date", "deposits", "withdrawals", "transfers in",
+           "transfers out", "opened", "closed", "net");
+    for (int i = 0; i <= found; i++) {
+        BankDay *day = i < found ? &days[i] : &total;
+        char date[16];
+        if (i < found) {
+            snprintf(date, sizeof(date), "%04d-%02d-%02d", day->date / 10000, day->date / 100 % 100, day->date % 100);
+            for (int t = 0; t < DAILY_TYPES; t++) {
+                total.totals[t].count += day->totals[t].count;
+                total.totals[t].cents += day->totals[t].cents;
+            }
+        } else {
+            snprintf(date, sizeof(date), "total");
+        }
+        // Returned cross-shard debits are money coming back in
+        DailyTotal in = day->totals[TRANSACTION_TRANSFER_IN];
+        in.count += day->totals[TRANSACTION_TRANSFER_CANCELLED].count;
+        in.cents += day->totals[TRANSACTION_TRANSFER_CANCELLED].cents;
+        printf("%-10s %6lld %12.2f %6lld %12.2f %6lld %12.2f %6lld %12.2f %6lld %6lld %13.2f\n", date,
+               (long long)day->totals[TRANSACTION_DEPOSIT].count, day->totals[TRANSACTION_DEPOSIT].cents / 100.0,
+               (long long)day->totals[TRANSACTION_WITHDRAWAL].count,
+               day->totals[TRANSACTION_WITHDRAWAL].cents / 100.0, (long long)in.count, in.cents / 100.0,
+               (long long)day->totals[TRANSACTION_TRANSFER_OUT].count,
+               day->totals[TRANSACTION_TRANSFER_OUT].cents / 100.0,
+               (long long)day->totals[TRANSACTION_ACCOUNT_CREATED].count,
+               (long long)day->totals[TRANSACTION_CLOSED].count,
+               (bankDayCredits(day) - bankDayDebits(day)) / 100.0);
+    }
+    free(days);
+
+    printf("days:       %d with activity\n", found);
+    printf("elapsed:    %.6f s\n", elapsed);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// dormant: suspend accounts unused for N months
+// ---------------------------------------------------------------------------
+
+static int commandDormant(int argc, char **argv) {
+    int months = atoi(optionValue(argc, argv, "--months", "0"));
+    int limit = atoi(optionValue(argc, argv, "--limit", "50"));
+    int dry_run = hasFlag(argc, argv, "--dry-run");
+    BankDormancyStats stats;
+    Bank bank;
+
+    if (months < 1 || limit < 0) {
+        fprintf(stderr, "Usage: bankadm dormant --months N [--dry-run] [--limit N] "
+                        "[--data-dir DIR | --accounts FILE [--log FILE]]\n"
+                        "       Suspends active accounts not accessed in the N calendar months before this one;\n"
+                        "       --dry-run lists them instead, up to --limit\n");
+        return 2;
+    }
+    Account *found = malloc((size_t)(limit > 0 ? limit : 1) * sizeof(Account));
+    if (found == NULL) {
+        fprintf(stderr, "bankadm: out of memory\n");
+        return 1;
+    }
+    if (openStore(&bank, argc, argv) != BANK_OK) {
+        free(found);
+        return 1;
+    }
+
+    double start = nowSeconds();
+    int result = bankSweepDormant(&bank, months, time(NULL), dry_run, found, limit, &stats);
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    long shown = stats.dormant < limit ? stats.dormant : limit;
+    if (shown > 0) {
+        printf("%-10s %-25s %12s %-10s\n", "account", "name", "balance", "accessed");
+    }
+    for (long i = 0; i < shown; i++) {
+        char accessed[16];
+        strftime(accessed, sizeof(accessed), "%Y-%m-%d", localtime(&found[i].last_accessed));
+        printf("%-10d %-25s %12.2f %-10s\n", found[i].account_number, found[i].name, found[i].balance,
+               found[i].last_accessed > 0 ? accessed : "never");
+    }
+    free(found);
+
+    printf("months:     %ld walked\n", stats.months);
+    printf("candidates: %ld\n", stats.candidates);
+    printf("dormant:    %ld%s\n", stats.dormant, dry_run ? " (dry run, nothing changed)" : "");
+    printf("suspended:  %ld\n", stats.suspended);
+    printf("recent:     %ld refiled\n", stats.recent);
+    printf("elapsed:    %.3f s\n", elapsed);
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: sweep incomplete: %s\n", bankResultMessage(result));
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// import: postings or new customers from a comma-separated file
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    Bank *bank;                           // NULL when only checking
+    const BulkFile *file;
+    BulkKind kind;
+    BulkLines lines;
+    long applied;
+    long rejected;                        // checked, then refused by the store
+    int result;                           // a commit that failed
+} ImportContext;
+
+static void reportRow(ImportContext *import, const BulkItem *item, int result) {
+    fprintf(stderr, "line %ld: %s\n", bulkLineOf(import->file, &import->lines, item->offset),
+            bankResultMessage(result));
+}
+
+static int applyCustomer(Bank *bank, const BulkItem *item, Account *created) {
+    char name[MAX_NAME_LENGTH];
+    char email[MAX_NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    char password[PASSWORD_LENGTH];
+
+    // Checked rows fit these, so nothing is cut short
+    snprintf(name, sizeof(name), "%.*s", (int)item->length[0], item->field[0]);
+    snprintf(email, sizeof(email), "%.*s", (int)item->length[1], item->field[1]);
+    snprintf(phone, sizeof(phone), "%.*s", (int)item->length[2], item->field[2]);
+    snprintf(password, sizeof(password), "%.*s", (int)item->length[3], item->field[3]);
+    return bankCreateAccount(bank, name, email, phone, password, created);
+}
+
+// Applies one window of rows as one batch, reporting refusals by line
+static int importRows(void *ctx, const BulkItem *items, long count) {
+    ImportContext *import = ctx;
+
+    if (import->bank != NULL) {
+        bankBeginBatch(import->bank);
+    }
+    for (long i = 0; i < count; i++) {
+        const BulkItem *item = &items[i];
+        Account account;
+        int result = item->result;
+
+        if (result != BANK_OK) {
+            reportRow(import, item, result);
+            continue;
+        }
+        if (import->bank == NULL) {
+            continue;
+        }
+        if (import->kind == BULK_CUSTOMERS) {
+            result = applyCustomer(import->bank, item, &account);
+        } else if (item->cents > 0) {
+            result = bankDeposit(import->bank, item->account_number, item->cents / 100.0, &account);
+        } else {
+            result = bankWithdraw(import->bank, item->account_number, -item->cents / 100.0, &account);
+        }
+        if (result != BANK_OK) {
+            reportRow(import, item, result);
+            import->rejected++;
+            continue;
+        }
+        import->applied++;
+        if (import->kind == BULK_CUSTOMERS) {
+            printf("%ld\t%d\n", bulkLineOf(import->file, &import->lines, item->offset), account.account_number);
+        }
+    }
+    if (import->bank != NULL && bankCommitBatch(import->bank) != BANK_OK) {
+        import->result = BANK_ERR_IO;
+        return 1;
+    }
+    return 0;
+}
+
+static int commandImport(int argc, char **argv) {
+    const char *kind_name = argc >= 2 ? argv[1] : "";
+    const char *path = argc >= 3 ? argv[2] : NULL;
+    int check = hasFlag(argc, argv, "--check");
+    int threads = atoi(optionValue(argc, argv, "--threads", "0"));
+    ImportContext import;
+    BulkStats stats;
+    BulkFile file;
+    Bank bank;
+
+    memset(&import, 0, sizeof(import));
+    if (strcmp(kind_name, "postings") == 0) {
+        import.kind = BULK_POSTINGS;
+    } else if (strcmp(kind_name, "customers") == 0) {
+        import.kind = BULK_CUSTOMERS;
+    } else {
+        path = NULL;
+    }
+    if (path == NULL || path[0] == '-' || threads < 0) {
+        fprintf(stderr, "Usage: bankadm import postings|customers FILE [--check] [--threads N] "
+                        "[--data-dir DIR | --accounts FILE [--log FILE]]\n"
+                        "       postings:  ACCOUNT,AMOUNT per line, negative amounts withdraw\n"
+                        "       customers: NAME,EMAIL,PHONE,PASSWORD per line, new account numbers on stdout\n"
+                        "       --check validates the file without opening the store\n");
+        return 2;
+    }
+    if (bulkOpen(&file, path) != 0) {
+        perror(path);
+        return 1;
+    }
+    if (!check) {
+        if (openStore(&bank, argc, argv) != BANK_OK) {
+            bulkClose(&file);
+            return 1;
+        }
+        import.bank = &bank;
+    }
+    import.file = &file;
+
+    double start = nowSeconds();
+    int result = bulkRun(&file, import.kind, threads, importRows, &import, &stats);
+    double elapsed = nowSeconds() - start;
+    if (!check) {
+        bankClose(&bank);
+    }
+    bulkClose(&file);
+
+    printf("rows:       %ld\n", stats.rows);
+    printf("accepted:   %ld%s\n", stats.accepted, check ? " (check only, nothing applied)" : "");
+    printf("refused:    %ld\n", stats.refused);
+    if (!check) {
+        printf("applied:    %ld\n", import.applied);
+        printf("rejected:   %ld by the store\n", import.rejected);
+    }
+    if (import.kind == BULK_POSTINGS) {
+        printf("net:        $%.2f over accepted rows\n", stats.cents / 100.0);
+    }
+    printf("elapsed:    %.3f s\n", elapsed);
+    if (stats.bytes > 0 && elapsed > 0) {
+        printf("throughput: %.1f MB/s, %.0f rows/sec\n", stats.bytes / elapsed / 1e6, stats.rows / elapsed);
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankadm: import stopped: %s\n",
+                bankResultMessage(import.result != BANK_OK ? import.result : result));
+        return 1;
+    }
+    return stats.refused > 0 || import.rejected > 0 ? 1 : 0;
+}
+
+typedef struct {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *summary;
+} AdminCommand;
+
+static const AdminCommand commands[] = {
+    {"post", commandPost, "post interest or a fee to every active account"},
+    {"orders", commandOrders, "list standing orders or fire the ones that are due"},
+    {"account", commandAccount, "suspend, reactivate or close an account"},
+    {"compact", commandCompact, "archive closed accounts and rewrite the store densely"},
+    {"list", commandList, "list accounts by status, balance and activity, sorted and paged"},
+    {"fsck", commandFsck, "check records and journal entries; --quarantine moves damage aside"},
+    {"daily", commandDaily, "per-day deposits, withdrawals, transfers and net flow; --rebuild recounts"},
+    {"dormant", commandDormant, "suspend active accounts unused for N months; --dry-run lists them"},
+    {"import", commandImport, "apply postings or create customers from a comma-separated file"},
+};
+
+int main(int argc, char **argv) {
+    if (argc >= 2) {
+        for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+            if (strcmp(argv[1], commands[i].name) == 0) {
+                return commands[i].run(argc - 1, argv + 1);
+            }
+        }
+    }
+
+    fprintf(stderr, "Usage: %s <command> [options]\n\nCommands:\n", argv[0]);
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        fprintf(stderr, "  %-10s %s\n", commands[i].name, commands[i].summary);
+    }
+    fprintf(stderr, "\nThe store is in --data-dir DIR, else $%s, else the working directory.\n"
+                    "--storage file|mmap|compact picks the engine used to open it.\n", BANK_DATA_DIR_ENV);
+    return 2;
+}
@@ -0,0 +1,3169 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "bank_core.h"
+#include "bank_protocol.h"
+#include "bank_post.h"
+#include "bank_compact.h"
+#include "bank_sched.h"
+#include "bank_router.h"
+#include "bank_term.h"
+#include "bank_record.h"
+#include "bank_snapshot.h"
+#include "bank_daily.h"
+#include "bank_dormancy.h"
+#include "bank_query.h"
+#include "bank_trace.h"
+#include "bank_bulk.h"
+
+#define LOAD_PASSWORD "loadtest"
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *optionValue(int argc, char **argv, const char *name, const char *fallback) {
+    for (int i = 0; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return fallback;
+}
+
+// ---------------------------------------------------------------------------
+// load: pipelined load generator for bankd
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int in_fd;
+    int out_fd;
+    pid_t child;
+    BankBuffer rx;
+    BankBuffer tx;
+} LoadConnection;
+
+static int connectUnix(const char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Starts the server as a child process talking over a pair of pipes
+static int spawnServer(LoadConnection *conn, const char *command) {
+    int to_child[2], from_child[2];
+    if (pipe(to_child) != 0 || pipe(from_child) != 0) {
+        return -1;
+    }
+
+    conn->child = fork();
+    if (conn->child < 0) {
+        return -1;
+    }
+    if (conn->child == 0) {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        close(to_child[1]);
+        close(from_child[0]);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    conn->out_fd = to_child[1];
+    conn->in_fd = from_child[0];
+    return 0;
+}
+
+static int flushRequests(LoadConnection *conn) {
+    size_t off = 0;
+    while (off < conn->tx.len) {
+        ssize_t n = write(conn->out_fd, conn->tx.data + off, conn->tx.len - off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    conn->tx.len = 0;
+    return 0;
+}
+
+// Blocks until at least one response is available, then decodes all of them
+static int readResponses(LoadConnection *conn, BankResponse *resps, int max) {
+    int count = 0;
+    size_t used;
+
+    while (1) {
+        size_t off = 0;
+        while (count < max &&
+               bankDecodeResponse(conn->rx.data + off, conn->rx.len - off, &resps[count], &used) == 1) {
+            off += used;
+            count++;
+        }
+        bankBufferConsume(&conn->rx, off);
+        if (count > 0) {
+            return count;
+        }
+
+        if (bankBufferReserve(&conn->rx, 65536) != 0) {
+            return -1;
+        }
+        ssize_t n = read(conn->in_fd, conn->rx.data + conn->rx.len, conn->rx.cap - conn->rx.len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        conn->rx.len += (size_t)n;
+    }
+}
+
+// Sends `total` requests produced by `next`, keeping at most `depth` in flight
+typedef void (*RequestFactory)(BankRequest *req, long index, void *ctx);
+
+static int runPipelined(LoadConnection *conn, long total, int depth, RequestFactory next, void *ctx,
+                        BankResponse *results, long *errors) {
+    BankResponse *resps = malloc(sizeof(BankResponse) * depth);
+    BankRequest req;
+    long sent = 0, received = 0;
+
+    if (resps == NULL) {
+        return -1;
+    }
+    while (received < total) {
+        while (sent < total && sent - received < depth) {
+            next(&req, sent, ctx);
+            req.tag = (uint32_t)sent;
+            bankEncodeRequest(&conn->tx, &req);
+            sent++;
+        }
+        if (flushRequests(conn) != 0) {
+            free(resps);
+            return -1;
+        }
+
+        int n = readResponses(conn, resps, depth);
+        if (n < 0) {
+            free(resps);
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            if (resps[i].status != BANK_OK) {
+                (*errors)++;
+            }
+            if (results != NULL && resps[i].tag < (uint32_t)total) {
+                results[resps[i].tag] = resps[i];
+            }
+        }
+        received += n;
+    }
+
+    free(resps);
+    return 0;
+}
+
+typedef struct {
+    int *accounts;
+    int account_count;
+    uint8_t priority;      // BankPriority of the mixed requests
+} LoadContext;
+
+// Fresh idempotency key for a mutation, as a retrying client would send
+static uint64_t randomKey(void) {
+    uint64_t key = 0;
+    for (int i = 0; i < 4; i++) {
+        key = (key << 16) ^ (uint64_t)(rand() & 0xffff);
+    }
+    return key != 0 ? key : 1;
+}
+
+static void makeCreate(BankRequest *req, long index, void *ctx) {
+    (void)ctx;
+    memset(req, 0, sizeof(*req));
+    req->op = BANK_OP_CREATE;
+    snprintf(req->name, sizeof(req->name), "Load Client %ld", index);
+    snprintf(req->email, sizeof(req->email), "load%ld@example.com", index);
+    snprintf(req->phone, sizeof(req->phone), "555%07ld", index);
+    snprintf(req->password, sizeof(req->password), "%s", LOAD_PASSWORD);
+}
+
+static void makeSeedDeposit(BankRequest *req, long index, void *ctx) {
+    LoadContext *load = ctx;
+    memset(req, 0, sizeof(*req));
+    req->op = BANK_OP_DEPOSIT;
+    req->account_number = load->accounts[index];
+    req->amount = 100000.0;
+    req->idempotency_key = randomKey();
+    snprintf(req->password, sizeof(req->password), "%s", LOAD_PASSWORD);
+}
+
+// Operation mix: 40% deposit, 30% balance, 20% withdrawal, 10% transfer
+static void makeMixed(BankRequest *req, long index, void *ctx) {
+    LoadContext *load = ctx;
+    int r = rand() % 100;
+    (void)index;
+
+    memset(req, 0, sizeof(*req));
+    req->priority = load->priority;
+    req->account_number = load->accounts[rand() % load->account_count];
+    req->amount = 1.0 + rand() % 100;
+    snprintf(req->password, sizeof(req->password), "%s", LOAD_PASSWORD);
+
+    if (r < 40) {
+        req->op = BANK_OP_DEPOSIT;
+    } else if (r < 70) {
+        req->op = BANK_OP_BALANCE;
+        return;
+    } else if (r < 90) {
+        req->op = BANK_OP_WITHDRAW;
+    } else {
+        req->op = BANK_OP_TRANSFER;
+        do {
+            req->related_account = load->accounts[rand() % load->account_count];
+        } while (load->account_count > 1 && req->related_account == req->account_number);
+    }
+    req->idempotency_key = randomKey();
+}
+
+// Runs one client: sets up its accounts, then issues `ops` mixed requests of
+// the given priority. Returns the number of rejected requests, or -1 if the
+// connection failed.
+static long runLoadClient(const char *socket_path, const char *command, long ops, int depth,
+                          int account_count, int priority, double *elapsed_out) {
+    LoadConnection conn;
+    LoadContext load;
+    long errors = 0;
+
+    memset(&conn, 0, sizeof(conn));
+    bankBufferInit(&conn.rx);
+    bankBufferInit(&conn.tx);
+    if (socket_path != NULL) {
+        conn.in_fd = conn.out_fd = connectUnix(socket_path);
+        if (conn.in_fd < 0) {
+            perror("bankbench: connect");
+            return -1;
+        }
+    } else if (spawnServer(&conn, command) != 0) {
+        perror("bankbench: spawn");
+        return -1;
+    }
+
+    // Set up the working set of accounts
+    BankResponse *created = calloc(account_count, sizeof(BankResponse));
+    load.accounts = calloc(account_count, sizeof(int));
+    load.account_count = account_count;
+    load.priority = (uint8_t)priority;
+    if (created == NULL || load.accounts == NULL ||
+        runPipelined(&conn, account_count, depth, makeCreate, NULL, created, &errors) != 0) {
+        fprintf(stderr, "bankbench: account setup failed\n");
+        return -1;
+    }
+    for (int i = 0; i < account_count; i++) {
+        load.accounts[i] = created[i].account_number;
+    }
+    runPipelined(&conn, account_count, depth, makeSeedDeposit, &load, NULL, &errors);
+    if (errors > 0) {
+        fprintf(stderr, "bankbench: %ld setup requests failed\n", errors);
+        return -1;
+    }
+
+    double start = nowSeconds();
+    if (runPipelined(&conn, ops, depth, makeMixed, &load, NULL, &errors) != 0) {
+        fprintf(stderr, "bankbench: connection lost\n");
+        return -1;
+    }
+    *elapsed_out = nowSeconds() - start;
+
+    close(conn.out_fd);
+    if (conn.in_fd != conn.out_fd) {
+        close(conn.in_fd);
+    }
+    if (conn.child > 0) {
+        waitpid(conn.child, NULL, 0);
+    }
+    bankBufferFree(&conn.rx);
+    bankBufferFree(&conn.tx);
+    free(created);
+    free(load.accounts);
+    return errors;
+}
+
+// Runs `clients` load clients against the socket, one process each; the
+// total of their rejected requests goes to *errors
+static int runClients(const char *socket_path, int clients, long ops, int depth, int account_count,
+                      int priority, long *errors, double *elapsed) {
+    pid_t *pids = calloc((size_t)clients, sizeof(pid_t));
+    int results[2];
+
+    if (pids == NULL || pipe(results) != 0) {
+        perror("bankbench: pipe");
+        free(pids);
+        return -1;
+    }
+    double start = nowSeconds();
+    for (int c = 0; c < clients; c++) {
+        if ((pids[c] = fork()) == 0) {
+            double client_elapsed;
+            srand(time(NULL) ^ (getpid() << 8));
+            long client_errors = runLoadClient(socket_path, NULL, ops / clients, depth,
+                                               account_count, priority, &client_elapsed);
+            (void)!write(results[1], &client_errors, sizeof(client_errors));
+            _exit(client_errors < 0);
+        }
+    }
+    close(results[1]);
+
+    int failed = 0;
+    for (int c = 0; c < clients; c++) {
+        long client_errors;
+        if (read(results[0], &client_errors, sizeof(client_errors)) != sizeof(client_errors) ||
+            client_errors < 0) {
+            failed = 1;
+            break;
+        }
+        *errors += client_errors;
+    }
+    close(results[0]);
+    // Only the clients: the caller may have a server among its children
+    for (int c = 0; c < clients; c++) {
+        if (pids[c] > 0) {
+            waitpid(pids[c], NULL, 0);
+        }
+    }
+    free(pids);
+    *elapsed = nowSeconds() - start;
+    if (failed) {
+        fprintf(stderr, "bankbench: a client failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int benchLoad(int argc, char **argv) {
+    const char *socket_path = optionValue(argc, argv, "--socket", NULL);
+    const char *command = optionValue(argc, argv, "--exec", NULL);
+    long ops = atol(optionValue(argc, argv, "--ops", "100000"));
+    int depth = atoi(optionValue(argc, argv, "--depth", "64"));
+    int account_count = atoi(optionValue(argc, argv, "--accounts", "100"));
+    int clients = atoi(optionValue(argc, argv, "--clients", "1"));
+    const char *class_name = optionValue(argc, argv, "--priority", "interactive");
+    int priority = strcmp(class_name, "batch") == 0 ? BANK_PRIORITY_BATCH : BANK_PRIORITY_INTERACTIVE;
+    long errors = 0;
+    double elapsed = 0.0;
+
+    if ((socket_path == NULL) == (command == NULL) || ops <= 0 || depth <= 0 ||
+        account_count <= 0 || clients <= 0 || (command != NULL && clients > 1) ||
+        (strcmp(class_name, "batch") != 0 && strcmp(class_name, "interactive") != 0)) {
+        fprintf(stderr, "Usage: bankbench load (--socket PATH [--clients C] | --exec CMD) "
+                        "[--ops N] [--depth D] [--accounts K] [--priority interactive|batch]\n");
+        return 2;
+    }
+
+    if (clients == 1) {
+        errors = runLoadClient(socket_path, command, ops, depth, account_count, priority, &elapsed);
+        if (errors < 0) {
+            return 1;
+        }
+    } else {
+        // One process per client; each reports its rejects through a pipe
+        if (runClients(socket_path, clients, ops, depth, account_count, priority, &errors, &elapsed) != 0) {
+            return 1;
+        }
+        ops = (ops / clients) * clients;
+    }
+
+    printf("ops:        %ld\n", ops);
+    printf("clients:    %d\n", clients);
+    printf("depth:      %d\n", depth);
+    printf("accounts:   %d per client\n", account_count);
+    printf("rejected:   %ld\n", errors);
+    printf("elapsed:    %.3f s\n", elapsed);
+    printf("throughput: %.0f ops/sec\n", ops / elapsed);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// shard: the load mix against an unsharded bankd, then against the same
+// server split into N shard processes behind a router
+// ---------------------------------------------------------------------------
+
+// Starts bankd serving `socket_path` and waits until it accepts clients;
+// `shards` of 0 runs it unsharded. `option` and its `value`, if given, are
+// passed on as well. Returns the pid, or -1.
+static pid_t startServer(const char *bankd, const char *dir, const char *socket_path, int shards,
+                         const char *threads, const char *option, const char *value) {
+    char shard_arg[16];
+    const char *args[16];
+    int n = 0;
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        snprintf(shard_arg, sizeof(shard_arg), "%d", shards);
+        args[n++] = bankd;
+        if (shards > 0) {
+            args[n++] = "--shards";
+            args[n++] = shard_arg;
+        }
+        if (option != NULL) {
+            args[n++] = option;
+            args[n++] = value;
+        }
+        args[n++] = "--data-dir";
+        args[n++] = dir;
+        args[n++] = "--socket";
+        args[n++] = socket_path;
+        args[n++] = "--threads";
+        args[n++] = threads;
+        args[n++] = "--rules";
+        args[n++] = "off";
+        args[n] = NULL;
+        execv(bankd, (char *const *)args);
+        _exit(127);
+    }
+
+    for (int tries = 0; tries < 200; tries++) {
+        struct timespec pause = {0, 50000000};
+        int fd = connectUnix(socket_path);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        nanosleep(&pause, NULL);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static int benchShard(int argc, char **argv) {
+    const char *bankd = optionValue(argc, argv, "--bankd", "./bankd");
+    const char *dir = optionValue(argc, argv, "--dir", "bench_shards");
+    const char *list = optionValue(argc, argv, "--shards", "1,2,4");
+    const char *threads = optionValue(argc, argv, "--threads", "2");
+    long ops = atol(optionValue(argc, argv, "--ops", "200000"));
+    int depth = atoi(optionValue(argc, argv, "--depth", "64"));
+    int account_count = atoi(optionValue(argc, argv, "--accounts", "100"));
+    int clients = atoi(optionValue(argc, argv, "--clients", "4"));
+    char run_dir[BANK_PATH_LENGTH];
+    char socket_path[BANK_PATH_LENGTH + 16];
+
+    if (ops <= 0 || depth <= 0 || account_count <= 0 || clients <= 0) {
+        fprintf(stderr, "Usage: bankbench shard [--shards 1,2,4] [--clients C] [--ops N] [--depth D] "
+                        "[--accounts K] [--threads T] [--bankd PATH] [--dir DIR]\n");
+        return 2;
+    }
+    if (getenv(ROUTER_ADMIN_ENV) == NULL) {
+        fprintf(stderr, "bankbench: set %s to the admin password; routers need it\n", ROUTER_ADMIN_ENV);
+        return 2;
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("bankbench: mkdir");
+        return 1;
+    }
+
+    printf("%d clients, %ld ops, depth %d, %d accounts per client\n\n", clients, ops, depth, account_count);
+    printf("%-10s %12s %10s %10s\n", "shards", "ops/sec", "elapsed", "rejected");
+
+    // A run of 0 shards is the unsharded server, the baseline
+    const char *next = list;
+    for (int run = 0; next != NULL; run++) {
+        int shards = 0;
+        if (run > 0) {
+            shards = atoi(next);
+            next = strchr(next, ',');
+            next = next != NULL ? next + 1 : NULL;
+            if (shards < 1 || shards > SHARD_MAX) {
+                continue;
+            }
+        }
+
+        snprintf(run_dir, sizeof(run_dir), "%s/run-%d", dir, shards);
+        snprintf(socket_path, sizeof(socket_path), "%s/client.sock", run_dir);
+        if (mkdir(run_dir, 0755) != 0 && errno != EEXIST) {
+            perror("bankbench: mkdir");
+            return 1;
+        }
+        pid_t server = startServer(bankd, run_dir, socket_path, shards, threads, NULL, NULL);
+        if (server < 0) {
+            fprintf(stderr, "bankbench: %s did not start\n", bankd);
+            return 1;
+        }
+
+        long errors = 0;
+        double elapsed = 0.0;
+        int failed = runClients(socket_path, clients, ops, depth, account_count, BANK_PRIORITY_INTERACTIVE,
+                                &errors, &elapsed);
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+        if (failed != 0) {
+            return 1;
+        }
+
+        char label[16];
+        snprintf(label, sizeof(label), shards == 0 ? "none" : "%d", shards);
+        long done = (ops / clients) * clients;
+        printf("%-10s %12.0f %9.3fs %10ld\n", label, done / elapsed, elapsed, errors);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// replica: balance reads served by the primary alone, then spread over N
+// read-only replicas, while writers load the primary
+// ---------------------------------------------------------------------------
+
+#define REPLICA_MAX 16
+#define REPLICA_WAIT_TRIES 400   // 50 ms apart
+
+static void makeBalance(BankRequest *req, long index, void *ctx) {
+    LoadContext *load = ctx;
+    (void)index;
+    memset(req, 0, sizeof(*req));
+    req->op = BANK_OP_BALANCE;
+    req->account_number = load->accounts[rand() % load->account_count];
+    snprintf(req->password, sizeof(req->password), "%s", LOAD_PASSWORD);
+}
+
+static void makeReplicaStatus(BankRequest *req, long index, void *ctx) {
+    (void)index;
+    (void)ctx;
+    memset(req, 0, sizeof(*req));
+    req->op = BANK_OP_REPLICA_STATUS;
+}
+
+static int openLoad(LoadConnection *conn, const char *socket_path) {
+    memset(conn, 0, sizeof(*conn));
+    bankBufferInit(&conn->rx);
+    bankBufferInit(&conn->tx);
+    conn->in_fd = conn->out_fd = connectUnix(socket_path);
+    return conn->in_fd >= 0 ? 0 : -1;
+}
+
+static void closeLoad(LoadConnection *conn) {
+    close(conn->in_fd);
+    bankBufferFree(&conn->rx);
+    bankBufferFree(&conn->tx);
+}
+
+// Creates and funds `count` accounts through the primary
+static int seedAccounts(const char *socket_path, int count, int depth, LoadContext *load) {
+    LoadConnection conn;
+    BankResponse *created = calloc((size_t)count, sizeof(BankResponse));
+    long errors = 0;
+
+    if (created == NULL || openLoad(&conn, socket_path) != 0) {
+        free(created);
+        return -1;
+    }
+    int failed = runPipelined(&conn, count, depth, makeCreate, NULL, created, &errors) != 0;
+    for (int i = 0; i < count && !failed; i++) {
+        load->accounts[i] = created[i].account_number;
+    }
+    failed = failed || runPipelined(&conn, count, depth, makeSeedDeposit, load, NULL, &errors) != 0;
+    closeLoad(&conn);
+    free(created);
+    return failed || errors > 0 ? -1 : 0;
+}
+
+// Journal records a replica has still to apply, and its lag in seconds; -1
+// when it does not answer
+static long replicaBehind(const char *socket_path, double *seconds) {
+    LoadConnection conn;
+    BankResponse status;
+    long errors = 0;
+
+    if (openLoad(&conn, socket_path) != 0) {
+        return -1;
+    }
+    int failed = runPipelined(&conn, 1, 1, makeReplicaStatus, NULL, &status, &errors) != 0 || errors > 0;
+    closeLoad(&conn);
+    if (failed) {
+        return -1;
+    }
+    *seconds = status.balance;
+    return status.account_number;
+}
+
+// Waits until the replica has applied everything its primary reported
+static double waitCaughtUp(const char *socket_path) {
+    double start = nowSeconds(), seconds;
+
+    for (int tries = 0; tries < REPLICA_WAIT_TRIES; tries++) {
+        struct timespec pause = {0, 50000000};
+        if (replicaBehind(socket_path, &seconds) == 0) {
+            return nowSeconds() - start;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return -1.0;
+}
+
+// One reader process: `ops` balance reads on `socket_path`
+static void runReader(const char *socket_path, LoadContext *load, long ops, int depth, int report) {
+    LoadConnection conn;
+    long errors = 0;
+    double elapsed = -1.0;
+
+    srand(time(NULL) ^ (getpid() << 8));
+    if (openLoad(&conn, socket_path) == 0) {
+        double start = nowSeconds();
+        if (runPipelined(&conn, ops, depth, makeBalance, load, NULL, &errors) == 0) {
+            elapsed = nowSeconds() - start;
+        }
+        closeLoad(&conn);
+    }
+    (void)!write(report, &elapsed, sizeof(elapsed));
+    _exit(elapsed < 0);
+}
+
+static int benchReplica(int argc, char **argv) {
+    const char *bankd = optionValue(argc, argv, "--bankd", "./bankd");
+    const char *dir = optionValue(argc, argv, "--dir", "bench_replicas");
+    const char *list = optionValue(argc, argv, "--replicas", "1,2");
+    const char *threads = optionValue(argc, argv, "--threads", "2");
+    long reads = atol(optionValue(argc, argv, "--reads", "200000"));
+    long writes = atol(optionValue(argc, argv, "--writes", "100000"));
+    int readers = atoi(optionValue(argc, argv, "--readers", "4"));
+    int writers = atoi(optionValue(argc, argv, "--writers", "1"));
+    int depth = atoi(optionValue(argc, argv, "--depth", "64"));
+    int account_count = atoi(optionValue(argc, argv, "--accounts", "1000"));
+    char run_dir[BANK_PATH_LENGTH];
+    char path[REPLICA_MAX + 2][BANK_PATH_LENGTH + 32];
+    char repl_socket[BANK_PATH_LENGTH + 32];
+    LoadContext load;
+
+    if (reads <= 0 || writes < 0 || readers <= 0 || writers <= 0 || depth <= 0 || account_count <= 0) {
+        fprintf(stderr, "Usage: bankbench replica [--replicas 1,2] [--readers R] [--writers W] [--reads N] "
+                        "[--writes N] [--depth D] [--accounts K] [--threads T] [--bankd PATH] [--dir DIR]\n");
+        return 2;
+    }
+    load.accounts = calloc((size_t)account_count, sizeof(int));
+    load.account_count = account_count;
+    load.priority = BANK_PRIORITY_INTERACTIVE;
+    if (load.accounts == NULL || (mkdir(dir, 0755) != 0 && errno != EEXIST)) {
+        perror("bankbench: mkdir");
+        free(load.accounts);
+        return 1;
+    }
+
+    printf("%d readers, %ld reads over %d accounts; %d writers, %ld writes, depth %d\n\n", readers, reads,
+           account_count, writers, writes, depth);
+    printf("%-9s %12s %12s %10s %11s\n", "replicas", "reads/sec", "writes/sec", "lag", "catch-up");
+
+    // A run of 0 replicas reads from the primary, the baseline
+    const char *next = list;
+    for (int run = 0; next != NULL; run++) {
+        pid_t servers[REPLICA_MAX + 1];
+        int replicas = 0, started = 0, failed = 0;
+
+        if (run > 0) {
+            replicas = atoi(next);
+            next = strchr(next, ',');
+            next = next != NULL ? next + 1 : NULL;
+            if (replicas < 1 || replicas > REPLICA_MAX) {
+                continue;
+            }
+        }
+
+        // path[0] is the primary's client socket, path[1 + i] replica i's
+        snprintf(run_dir, sizeof(run_dir), "%s/run-%d", dir, replicas);
+        snprintf(repl_socket, sizeof(repl_socket), "%s/replication.sock", run_dir);
+        snprintf(path[0], sizeof(path[0]), "%s/primary.sock", run_dir);
+        if (mkdir(run_dir, 0755) != 0 && errno != EEXIST) {
+            perror("bankbench: mkdir");
+            return 1;
+        }
+        servers[started] = startServer(bankd, run_dir, path[0], 0, threads, "--replicate", repl_socket);
+        failed = servers[started] < 0;
+        started += !failed;
+        failed = failed || seedAccounts(path[0], account_count, depth, &load) != 0;
+
+        for (int i = 0; i < replicas && !failed; i++) {
+            char replica_dir[BANK_PATH_LENGTH + 32];
+            snprintf(replica_dir, sizeof(replica_dir), "%s/replica-%d", run_dir, i);
+            snprintf(path[1 + i], sizeof(path[1 + i]), "%s/replica-%d.sock", run_dir, i);
+            servers[started] = startServer(bankd, replica_dir, path[1 + i], 0, threads, "--replica-of",
+                                           repl_socket);
+            failed = servers[started] < 0 || waitCaughtUp(path[1 + i]) < 0;
+            started += servers[started] >= 0;
+        }
+
+        // Readers spread over the replicas, writers on the primary
+        int results[2];
+        double read_elapsed = 0.0, write_elapsed = 0.0;
+        long errors = 0;
+        pid_t *pids = calloc((size_t)readers, sizeof(pid_t));
+        failed = failed || pids == NULL || pipe(results) != 0;
+        for (int c = 0; c < readers && !failed; c++) {
+            if ((pids[c] = fork()) == 0) {
+                runReader(path[replicas > 0 ? 1 + c % replicas : 0], &load, reads / readers, depth, results[1]);
+            }
+        }
+        if (!failed) {
+            close(results[1]);
+            if (writes > 0 && runClients(path[0], writers, writes, depth, 100, BANK_PRIORITY_INTERACTIVE,
+                                         &errors, &write_elapsed) != 0) {
+                failed = 1;
+            }
+            for (int c = 0; c < readers; c++) {
+                double elapsed;
+                if (read(results[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed) || elapsed < 0) {
+                    failed = 1;
+                } else if (elapsed > read_elapsed) {
+                    read_elapsed = elapsed;
+                }
+            }
+            close(results[0]);
+            for (int c = 0; c < readers; c++) {
+                waitpid(pids[c], NULL, 0);
+            }
+        }
+        free(pids);
+
+        // How far the replicas trail once writing stops, and how long they take to catch up
+        double lag = 0.0, catch_up = 0.0;
+        for (int i = 0; i < replicas && !failed; i++) {
+            double seconds = 0.0, waited;
+            if (replicaBehind(path[1 + i], &seconds) < 0 || (waited = waitCaughtUp(path[1 + i])) < 0) {
+                failed = 1;
+                break;
+            }
+            lag = seconds > lag ? seconds : lag;
+            catch_up = waited > catch_up ? waited : catch_up;
+        }
+
+        for (int i = started - 1; i >= 0; i--) {
+            kill(servers[i], SIGTERM);
+            waitpid(servers[i], NULL, 0);
+        }
+        if (failed) {
+            fprintf(stderr, "bankbench: replica run with %d replicas failed\n", replicas);
+            free(load.accounts);
+            return 1;
+        }
+
+        long done_reads = (reads / readers) * readers;
+        long done_writes = (writes / writers) * writers;
+        printf("%-9d %12.0f %12.0f %8.1fms %9.1fms\n", replicas, done_reads / read_elapsed,
+               write_elapsed > 0 ? done_writes / write_elapsed : 0.0, lag * 1e3, catch_up * 1e3);
+        fflush(stdout);
+    }
+    free(load.accounts);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// index: secondary index build and lookup speed on a synthetic store
+// ---------------------------------------------------------------------------
+
+#define SYNTH_CHUNK 4096   // records written per call while generating
+
+static const char *const first_names[] = {"Ava", "Ben", "Chloe", "Dan", "Emma", "Finn", "Grace", "Hugo"};
+static const char *const last_names[] = {"Ahmed", "Brown", "Chen", "Diaz", "Evans", "Khan", "Lee", "Silva"};
+
+// Writes `count` plausible account records through a storage engine
+static int fillSynthetic(BankStorage *storage, long count) {
+    Account *chunk = calloc(SYNTH_CHUNK, sizeof(Account));
+    int failed = chunk == NULL;
+
+    for (long base = 0; base < count && !failed; base += SYNTH_CHUNK) {
+        long n = count - base < SYNTH_CHUNK ? count - base : SYNTH_CHUNK;
+        for (long i = 0; i < n; i++) {
+            Account *acc = &chunk[i];
+            long id = base + i;
+            acc->account_number = MIN_ACCOUNT_NUMBER + (int)id;
+            snprintf(acc->name, sizeof(acc->name), "%s %s %ld", first_names[rand() % 8],
+                     last_names[rand() % 8], id);
+            snprintf(acc->email, sizeof(acc->email), "user%ld@example.com", id);
+            snprintf(acc->phone, sizeof(acc->phone), "555%07d", rand() % 10000000);
+            acc->balance = 100.0 + rand() % 100000 / 100.0;
+            acc->status = ACCOUNT_ACTIVE;
+            bankSealRecord(acc);
+        }
+        failed = storagePut(storage, base, n, chunk) != 0;
+    }
+    free(chunk);
+    return failed ? -1 : 0;
+}
+
+// Writes `count` synthetic accounts straight to a store file
+static int writeSyntheticStore(const char *path, long count) {
+    BankStorage storage;
+
+    unlink(path);
+    if (storageOpen(&storage, STORAGE_FILE, path, NULL, sizeof(Account), NULL) != 0) {
+        return -1;
+    }
+    int failed = fillSynthetic(&storage, count) != 0;
+    storageClose(&storage);
+    return failed ? -1 : 0;
+}
+
+// Engine named by --storage, or -1 after printing the choices
+static int storageOption(int argc, char **argv) {
+    const char *name = optionValue(argc, argv, "--storage", "file");
+    int kind = storageKindFromName(name);
+    if (kind < 0) {
+        fprintf(stderr, "bankbench: unknown storage engine '%s' (file, mmap, memory or compact)\n", name);
+    }
+    return kind;
+}
+
+// Opens a bank over `count` synthetic accounts. File-backed engines get the
+// store written to `path` first; the memory engine is filled once open, and
+// its index built then.
+static int openSynthetic(Bank *bank, StorageKind kind, const char *path, const char *log_path, long count) {
+    if (kind != STORAGE_MEMORY) {
+        if (writeSyntheticStore(path, count) != 0) {
+            return -1;
+        }
+        return bankOpenStorage(bank, kind, path, log_path) == BANK_OK ? 0 : -1;
+    }
+    if (bankOpenStorage(bank, kind, path, log_path) != BANK_OK) {
+        return -1;
+    }
+    if (fillSynthetic(&bank->storage, count) != 0 || indexBuild(&bank->index, &bank->storage, count, 0) != 0) {
+        bankClose(bank);
+        return -1;
+    }
+    return 0;
+}
+
+static int benchIndex(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_index.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "1000000"));
+    int threads = atoi(optionValue(argc, argv, "--threads", "0"));
+    long lookups = atol(optionValue(argc, argv, "--lookups", "100000"));
+    int kind = storageOption(argc, argv);
+    BankStorage storage;
+    BankIndex index;
+    uint32_t slots[16];
+    char key[MAX_NAME_LENGTH];
+
+    if (count <= 0 || threads < 0 || lookups <= 0 || kind < 0) {
+        fprintf(stderr, "Usage: bankbench index [--accounts N] [--threads T] [--lookups L] [--file PATH]"
+                        " [--storage ENGINE]\n");
+        return 2;
+    }
+
+    printf("generating %ld accounts in %s (%s storage)\n", count, path, storageKindName((StorageKind)kind));
+    if ((kind != STORAGE_MEMORY && writeSyntheticStore(path, count) != 0) ||
+        storageOpen(&storage, (StorageKind)kind, path, NULL, sizeof(Account), bankRecordCodec()) != 0 ||
+        (kind == STORAGE_MEMORY && fillSynthetic(&storage, count) != 0)) {
+        perror("bankbench: synthetic store");
+        return 1;
+    }
+
+    indexInit(&index);
+    int runs[2] = {1, threads};
+    for (int r = 0; r < 2; r++) {
+        double start = nowSeconds();
+        if (indexBuild(&index, &storage, count, runs[r]) != 0) {
+            fprintf(stderr, "bankbench: index build failed\n");
+            storageClose(&storage);
+            unlink(path);
+            return 1;
+        }
+        double elapsed = nowSeconds() - start;
+        printf("build (%s): %.3f s, %.0f accounts/sec\n",
+               runs[r] == 0 ? "all cpus" : runs[r] == 1 ? "1 thread" : "threads",
+               elapsed, count / elapsed);
+    }
+
+    double start = nowSeconds();
+    long hits = 0;
+    for (long i = 0; i < lookups; i++) {
+        long id = rand() % count;
+        hits += indexFindNumber(&index, MIN_ACCOUNT_NUMBER + (int)id) >= 0;
+        snprintf(key, sizeof(key), "USER%ld@example.com", id);
+        hits += indexSearch(&index, INDEX_EMAIL, key, 0, slots, 16) > 0;
+    }
+    double elapsed = nowSeconds() - start;
+    printf("exact number+email: %.0f lookups/sec (%ld hits)\n", 2 * lookups / elapsed, hits);
+
+    start = nowSeconds();
+    size_t matched = 0;
+    for (long i = 0; i < lookups; i++) {
+        snprintf(key, sizeof(key), "%s %s", first_names[rand() % 8], last_names[rand() % 8]);
+        matched += indexSearch(&index, INDEX_NAME, key, 1, slots, 16);
+        snprintf(key, sizeof(key), "555%04d", rand() % 10000);
+        matched += indexSearch(&index, INDEX_PHONE, key, 1, slots, 16);
+    }
+    elapsed = nowSeconds() - start;
+    printf("prefix name+phone:  %.0f lookups/sec (%zu matches)\n", 2 * lookups / elapsed, matched);
+
+    indexFree(&index);
+    storageClose(&storage);
+    unlink(path);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// post: batch interest posting over a synthetic store
+// ---------------------------------------------------------------------------
+
+static int benchPost(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_post.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "1000000"));
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, POST_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    int kind = storageOption(argc, argv);
+    BankPosting posting;
+    BankPostStats stats;
+    Bank bank;
+
+    if (count <= 0 || kind < 0) {
+        fprintf(stderr, "Usage: bankbench post [--accounts N] [--threads T] [--file PATH] [--storage ENGINE]\n");
+        return 2;
+    }
+
+    printf("generating %ld accounts in %s (%s storage)\n", count, path, storageKindName((StorageKind)kind));
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    if (openSynthetic(&bank, (StorageKind)kind, path, log_path, count) != 0) {
+        perror("bankbench: synthetic store");
+        return 1;
+    }
+
+    memset(&posting, 0, sizeof(posting));
+    posting.kind = POST_INTEREST;
+    posting.amount = 0.25;
+    posting.threads = atoi(optionValue(argc, argv, "--threads", "0"));
+    snprintf(posting.run_id, sizeof(posting.run_id), "bench-%ld", (long)time(NULL));
+
+    double start = nowSeconds();
+    int result = bankPostBatch(&bank, &posting, &stats);
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankbench: posting failed: %s\n", bankResultMessage(result));
+        return 1;
+    }
+
+    printf("posted:     %ld (%ld skipped)\n", stats.posted, stats.skipped);
+    printf("elapsed:    %.3f s\n", elapsed);
+    printf("throughput: %.0f accounts/sec\n", stats.scanned / elapsed);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// sched: standing orders spread over a minute, fired through the timer wheel
+// ---------------------------------------------------------------------------
+
+#define SCHED_SPREAD 60    // seconds the bench orders are spread across
+
+static int benchSched(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_sched.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "10000"));
+    long orders = atol(optionValue(argc, argv, "--orders", "1000000"));
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    int kind = storageOption(argc, argv);
+    BankOrderStats stats;
+    Bank bank;
+    int result = BANK_OK;
+
+    if (count < 2 || orders <= 0 || kind < 0) {
+        fprintf(stderr, "Usage: bankbench sched [--orders N] [--accounts N] [--file PATH] [--storage ENGINE]\n");
+        return 2;
+    }
+
+    printf("generating %ld accounts in %s (%s storage)\n", count, path, storageKindName((StorageKind)kind));
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    if (openSynthetic(&bank, (StorageKind)kind, path, log_path, count) != 0) {
+        perror("bankbench: synthetic store");
+        return 1;
+    }
+
+    // Daily orders for a cent, first due somewhere in the next minute
+    int64_t base = (int64_t)time(NULL) + 1;
+    double start = nowSeconds();
+    for (long i = 0; i < orders && result == BANK_OK; i++) {
+        long from = rand() % count;
+        result = bankCreateOrder(&bank, MIN_ACCOUNT_NUMBER + (int)from,
+                                 MIN_ACCOUNT_NUMBER + (int)((from + 1) % count), 0.01,
+                                 base + i % SCHED_SPREAD, 86400, 0, NULL);
+    }
+    double scheduled = nowSeconds() - start;
+
+    if (result == BANK_OK) {
+        start = nowSeconds();
+        result = bankRunDueOrders(&bank, base + SCHED_SPREAD, &stats);
+    }
+    double elapsed = nowSeconds() - start;
+    bankClose(&bank);
+
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankbench: scheduling failed: %s\n", bankResultMessage(result));
+        return 1;
+    }
+
+    printf("scheduled:  %ld orders in %.3f s (%.0f orders/sec)\n", orders, scheduled, orders / scheduled);
+    printf("fired:      %ld (%ld failed) in %ld commits\n", stats.fired, stats.failed, stats.commits);
+    printf("elapsed:    %.3f s\n", elapsed);
+    printf("throughput: %.0f transfers/sec\n", (stats.fired + stats.failed) / elapsed);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// compact: scan cost before and after archiving closed accounts
+// ---------------------------------------------------------------------------
+
+// Marks `percent` of a synthetic store's accounts closed, spread evenly
+static int closeSynthetic(const char *path, long count, int percent) {
+    Account *chunk = malloc(SYNTH_CHUNK * sizeof(Account));
+    int fd = open(path, O_RDWR);
+    int failed = chunk == NULL || fd < 0;
+
+    for (long base = 0; base < count && !failed; base += SYNTH_CHUNK) {
+        long n = count - base < SYNTH_CHUNK ? count - base : SYNTH_CHUNK;
+        size_t bytes = (size_t)n * sizeof(Account);
+        off_t offset = (off_t)base * (off_t)sizeof(Account);
+
+        failed = pread(fd, chunk, bytes, offset) != (ssize_t)bytes;
+        for (long i = 0; i < n && !failed; i++) {
+            if ((base + i) * percent / 100 != (base + i + 1) * percent / 100) {
+                chunk[i].status = ACCOUNT_CLOSED;
+                chunk[i].balance = 0.0;
+            }
+        }
+        failed = failed || pwrite(fd, chunk, bytes, offset) != (ssize_t)bytes;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(chunk);
+    return failed ? -1 : 0;
+}
+
+// Seconds to read every record the way reports and admin listings do
+static double timeScan(Bank *bank, long *records) {
+    BankAccountIter accounts;
+    Account account;
+    double start = nowSeconds();
+
+    *records = 0;
+    if (bankAccountsOpen(bank, &accounts) == BANK_OK) {
+        while (bankAccountsNext(&accounts, &account)) {
+            (*records)++;
+        }
+        bankAccountsClose(&accounts);
+    }
+    return nowSeconds() - start;
+}
+
+static int benchCompact(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_compact.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "1000000"));
+    int closed = atoi(optionValue(argc, argv, "--closed", "50"));
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ARCHIVE_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    BankCompactStats stats;
+    Bank bank;
+    long records;
+
+    if (count <= 0 || closed < 0 || closed > 100) {
+        fprintf(stderr, "Usage: bankbench compact [--accounts N] [--closed PERCENT] [--file PATH]\n");
+        return 2;
+    }
+
+    printf("generating %ld accounts in %s, %d%% closed\n", count, path, closed);
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    if (writeSyntheticStore(path, count) != 0 || closeSynthetic(path, count, closed) != 0 ||
+        bankOpen(&bank, path, log_path) != BANK_OK) {
+        perror("bankbench: synthetic store");
+        return 1;
+    }
+
+    double before = timeScan(&bank, &records);
+    printf("scan before: %.3f s over %ld records\n", before, records);
+
+    double start = nowSeconds();
+    int result = bankCompact(&bank, &stats);
+    double elapsed = nowSeconds() - start;
+
+    if (result == BANK_OK) {
+        double after = timeScan(&bank, &records);
+        printf("compaction:  %.3f s, %ld archived, %ld live\n", elapsed, stats.archived, stats.live);
+        printf("scan after:  %.3f s over %ld records (%.1fx faster)\n", after, records,
+               after > 0 ? before / after : 0.0);
+    }
+    bankClose(&bank);
+
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankbench: compaction failed: %s\n", bankResultMessage(result));
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// boot: time to the first request with the index rebuilt versus mapped
+// ---------------------------------------------------------------------------
+
+// Opens the bank and answers one lookup; returns the seconds that took
+static double timeFirstRequest(Bank *bank, const char *path, const char *log_path, long count) {
+    Account account;
+    double start = nowSeconds();
+
+    if (bankOpen(bank, path, log_path) != BANK_OK) {
+        return -1.0;
+    }
+    if (bankFindAccount(bank, MIN_ACCOUNT_NUMBER + (int)(rand() % count), &account) != BANK_OK) {
+        bankClose(bank);
+        return -1.0;
+    }
+    return nowSeconds() - start;
+}
+
+static int benchBoot(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_boot.dat");
+    char sizes[256];
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ARCHIVE_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    struct stat st;
+    Bank bank;
+    int failed = 0;
+
+    snprintf(sizes, sizeof(sizes), "%s", optionValue(argc, argv, "--sizes", "10000,100000,1000000"));
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    snprintf(side_path, sizeof(side_path), "%s%s", path, INDEX_SUFFIX);
+
+    printf("%10s %10s %12s %12s %12s\n", "accounts", "index MB", "rebuilt ms", "mapped ms", "check ms");
+    for (char *size = strtok(sizes, ","); size != NULL && !failed; size = strtok(NULL, ",")) {
+        long count = atol(size);
+        if (count <= 0) {
+            fprintf(stderr, "Usage: bankbench boot [--sizes N,N,...] [--file PATH]\n");
+            return 2;
+        }
+        if (writeSyntheticStore(path, count) != 0) {
+            perror("bankbench: synthetic store");
+            return 1;
+        }
+
+        // No index on disk: it is built from the store, then saved
+        unlink(side_path);
+        double rebuilt = timeFirstRequest(&bank, path, log_path, count);
+        if (rebuilt >= 0) {
+            bankClose(&bank);
+        }
+
+        // The saved index is mapped, and checked only afterwards
+        double mapped = timeFirstRequest(&bank, path, log_path, count);
+        double check = 0.0;
+        if (mapped >= 0) {
+            double start = nowSeconds();
+            failed = indexVerify(&bank.index, SIZE_MAX) != 1;
+            check = nowSeconds() - start;
+            bankClose(&bank);
+        }
+        failed |= rebuilt < 0 || mapped < 0 || stat(side_path, &st) != 0;
+
+        if (!failed) {
+            printf("%10ld %10.1f %12.2f %12.2f %12.2f\n", count, st.st_size / 1048576.0, rebuilt * 1000,
+                   mapped * 1000, check * 1000);
+        }
+    }
+
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    if (failed) {
+        fprintf(stderr, "bankbench: boot failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// storage: the same scan, lookup and deposit workload on every engine
+// ---------------------------------------------------------------------------
+
+#define STORAGE_BATCH 64   // deposits per commit, as bankd commits a pipelined read
+
+static int benchStorage(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_storage.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "100000"));
+    long ops = atol(optionValue(argc, argv, "--ops", "200000"));
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    StorageKind kinds[] = {STORAGE_FILE, STORAGE_MMAP, STORAGE_MEMORY, STORAGE_COMPACT};
+
+    if (count <= 0 || ops <= 0) {
+        fprintf(stderr, "Usage: bankbench storage [--accounts N] [--ops N] [--file PATH]\n");
+        return 2;
+    }
+
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    printf("%ld accounts, %ld lookups and deposits (%d per commit)\n", count, ops, STORAGE_BATCH);
+    printf("%-8s %10s %14s %14s %12s\n", "engine", "scan", "lookups/sec", "deposits/sec", "bytes/record");
+
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        Bank bank;
+        Account account;
+        long records;
+        int result = BANK_OK;
+
+        if (openSynthetic(&bank, kinds[k], path, log_path, count) != 0) {
+            perror("bankbench: synthetic store");
+            return 1;
+        }
+
+        double scan = timeScan(&bank, &records);
+
+        double start = nowSeconds();
+        for (long i = 0; i < ops && result == BANK_OK; i++) {
+            result = bankFindAccount(&bank, MIN_ACCOUNT_NUMBER + (int)(rand() % count), &account);
+        }
+        double lookups = nowSeconds() - start;
+
+        start = nowSeconds();
+        for (long i = 0; i < ops && result == BANK_OK; i++) {
+            if (i % STORAGE_BATCH == 0) {
+                bankBeginBatch(&bank);
+            }
+            result = bankDeposit(&bank, MIN_ACCOUNT_NUMBER + (int)(rand() % count), 1.0, NULL);
+            if ((i + 1) % STORAGE_BATCH == 0 || i + 1 == ops) {
+                bankCommitBatch(&bank);
+            }
+        }
+        double deposits = nowSeconds() - start;
+        bankClose(&bank);
+
+        // The store file as the deposits left it; the memory engine has none
+        struct stat st;
+        double per_record = kinds[k] != STORAGE_MEMORY && stat(path, &st) == 0 ? (double)st.st_size / count : 0.0;
+
+        unlink(path);
+        unlink(log_path);
+        for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+            snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+            unlink(side_path);
+        }
+        if (result != BANK_OK) {
+            fprintf(stderr, "bankbench: %s storage failed: %s\n", storageKindName(kinds[k]),
+                    bankResultMessage(result));
+            return 1;
+        }
+        printf("%-8s %9.3fs %14.0f %14.0f %12.1f\n", storageKindName(kinds[k]), scan, ops / lookups, ops / deposits,
+               per_record);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// terminals: teller processes sharing one store under record locks
+// ---------------------------------------------------------------------------
+
+#define TERMINAL_MAX 64
+
+typedef struct {
+    long deposits;      // successful, each 1.00
+    long transfers;     // successful, each moving 0.01
+    long created;
+} TerminalCounts;
+
+static long long storeCents(Bank *bank, long *accounts) {
+    BankAccountIter it;
+    Account account;
+    long long cents = 0;
+
+    *accounts = 0;
+    if (bankAccountsOpen(bank, &it) != BANK_OK) {
+        return -1;
+    }
+    while (bankAccountsNext(&it, &account)) {
+        cents += (long long)(account.balance * 100.0 + (account.balance < 0 ? -0.5 : 0.5));
+        (*accounts)++;
+    }
+    bankAccountsClose(&it);
+    return cents;
+}
+
+// One teller: opens the store for itself and mixes deposits and transfers
+// over the first `count` accounts, reporting what succeeded on `fd`
+static int runTerminal(int fd, StorageKind kind, const char *path, const char *log_path, long count,
+                       long ops, unsigned seed) {
+    TerminalCounts counts = {0, 0, 0};
+    Bank bank;
+    int failed = 0;
+
+    srand(seed);
+    if (bankOpenStorage(&bank, kind, path, log_path) != BANK_OK) {
+        return 1;
+    }
+    bank.rules.config.action = RULES_OFF;   // a few accounts take every transfer
+    if (bankCreateAccount(&bank, "Terminal Test", "teller@example.com", "5550000000", LOAD_PASSWORD,
+                          NULL) == BANK_OK) {
+        counts.created++;
+    }
+    for (long i = 0; i < ops && !failed; i++) {
+        int from = MIN_ACCOUNT_NUMBER + rand() % (int)count;
+        int to = MIN_ACCOUNT_NUMBER + rand() % (int)count;
+        int result;
+
+        if (i % 2 == 0) {
+            result = bankDeposit(&bank, from, 1.0, NULL);
+            counts.deposits += result == BANK_OK;
+        } else {
+            result = bankTransfer(&bank, from, to, 0.01, NULL, NULL);
+            counts.transfers += result == BANK_OK;
+            if (result == BANK_ERR_SAME_ACCOUNT || result == BANK_ERR_INSUFFICIENT_FUNDS) {
+                result = BANK_OK;
+            }
+        }
+        if (result != BANK_OK) {
+            fprintf(stderr, "bankbench: terminal %d: %s\n", (int)getpid(), bankResultMessage(result));
+            failed = 1;
+        }
+    }
+    bankClose(&bank);
+    failed |= write(fd, &counts, sizeof(counts)) != (ssize_t)sizeof(counts);
+    return failed;
+}
+
+static int benchTerminals(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_terminals.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "16"));
+    long ops = atol(optionValue(argc, argv, "--ops", "5000"));
+    int max_terminals = atoi(optionValue(argc, argv, "--terminals", "8"));
+    int kind = storageOption(argc, argv);
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    int lost = 0;
+
+    if (count <= 1 || ops <= 0 || max_terminals <= 0 || max_terminals > TERMINAL_MAX || kind < 0 ||
+        kind == STORAGE_MEMORY || kind == STORAGE_COMPACT) {
+        fprintf(stderr, "Usage: bankbench terminals [--accounts N] [--ops N] [--terminals N (max %d)]"
+                        " [--storage file|mmap] [--file PATH]\n", TERMINAL_MAX);
+        return 2;
+    }
+
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    printf("%ld accounts, %ld deposits and transfers per terminal, one process each\n", count, ops);
+    printf("%-9s %10s %12s %12s %10s %8s\n", "terminals", "seconds", "ops/sec", "journaled", "accounts", "lost");
+
+    for (int terminals = 1; terminals <= max_terminals; terminals *= 2) {
+        TerminalCounts total = {0, 0, 0};
+        pid_t children[TERMINAL_MAX];
+        int pipes[2];
+        int failed = 0;
+        long accounts, entries = 0;
+        Bank bank;
+
+        unlink(log_path);
+        for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+            snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+            unlink(side_path);
+        }
+        if (writeSyntheticStore(path, count) != 0 || bankOpenStorage(&bank, (StorageKind)kind, path, log_path) != BANK_OK) {
+            perror("bankbench: synthetic store");
+            return 1;
+        }
+        long long before = storeCents(&bank, &accounts);
+        bankClose(&bank);
+        if (before < 0 || pipe(pipes) != 0) {
+            perror("bankbench: terminals");
+            return 1;
+        }
+
+        double start = nowSeconds();
+        for (int t = 0; t < terminals; t++) {
+            children[t] = fork();
+            if (children[t] == 0) {
+                close(pipes[0]);
+                _exit(runTerminal(pipes[1], (StorageKind)kind, path, log_path, count, ops,
+                                  (unsigned)time(NULL) * 31u + (unsigned)t));
+            }
+            failed |= children[t] < 0;
+        }
+        close(pipes[1]);
+        for (int t = 0; t < terminals; t++) {
+            TerminalCounts counts;
+            int status;
+            if (read(pipes[0], &counts, sizeof(counts)) == (ssize_t)sizeof(counts)) {
+                total.deposits += counts.deposits;
+                total.transfers += counts.transfers;
+                total.created += counts.created;
+            } else {
+                failed = 1;
+            }
+            if (children[t] > 0 && (waitpid(children[t], &status, 0) < 0 || !WIFEXITED(status) ||
+                                    WEXITSTATUS(status) != 0)) {
+                failed = 1;
+            }
+        }
+        double elapsed = nowSeconds() - start;
+        close(pipes[0]);
+
+        // Every deposit adds a dollar and every transfer moves money within
+        // the store, so the total tells whether an update was lost; the
+        // journal must hold one entry per creation and deposit, two per transfer
+        long long expected = before + total.deposits * 100;
+        long long after = -1;
+        long created = accounts;
+        if (!failed && bankOpenStorage(&bank, (StorageKind)kind, path, log_path) == BANK_OK) {
+            JournalReader reader;
+            JournalRecord record;
+            after = storeCents(&bank, &created);
+            if (journalReaderOpen(&reader, &bank.storage) == 0) {
+                while (journalReaderNext(&reader, &record)) {
+                    entries++;
+                }
+                failed |= reader.corrupt != 0;
+                journalReaderClose(&reader);
+            }
+            bankClose(&bank);
+        }
+        long want_entries = total.created + total.deposits + 2 * total.transfers;
+        if (failed || after < 0) {
+            fprintf(stderr, "bankbench: a terminal failed\n");
+            return 1;
+        }
+        int bad = after != expected || entries != want_entries || created != accounts + total.created;
+        lost |= bad;
+        printf("%-9d %9.3fs %12.0f %5ld/%-6ld %4ld/%-5ld %8.2f%s\n", terminals, elapsed,
+               terminals * ops / elapsed, entries, want_entries, created, accounts + total.created,
+               (expected - after) / 100.0, bad ? "  MISMATCH" : "");
+    }
+
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    return lost ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// snapshot: reports beside transfers, read raw and through a snapshot
+// ---------------------------------------------------------------------------
+
+#define SNAPSHOT_WRITERS_MAX 16
+#define SNAPSHOT_SAMPLES 200000   // transfer latencies kept per writer
+
+typedef struct {
+    long transfers;
+    double p50;
+    double p99;
+} SnapshotWriterStats;
+
+static int compareSeconds(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static long long centsOf(double balance) {
+    return (long long)(balance * 100.0 + (balance < 0 ? -0.5 : 0.5));
+}
+
+// One writer process: random transfers for `seconds`, timing each
+static int runTransfers(int fd, StorageKind kind, const char *path, const char *log_path, long count,
+                        double seconds, unsigned seed) {
+    SnapshotWriterStats stats = {0, 0.0, 0.0};
+    double *samples = malloc(SNAPSHOT_SAMPLES * sizeof(double));
+    long kept = 0;
+    Bank bank;
+
+    srand(seed);
+    if (samples == NULL || bankOpenStorage(&bank, kind, path, log_path) != BANK_OK) {
+        return 1;
+    }
+    bank.rules.config.action = RULES_OFF;
+    double end = nowSeconds() + seconds;
+    for (double now = nowSeconds(); now < end;) {
+        int from = MIN_ACCOUNT_NUMBER + rand() % (int)count;
+        int to = MIN_ACCOUNT_NUMBER + rand() % (int)count;
+        int result = bankTransfer(&bank, from, to, 0.01 * (1 + rand() % 500), NULL, NULL);
+        double done = nowSeconds();
+        if (result == BANK_OK) {
+            if (kept < SNAPSHOT_SAMPLES) {
+                samples[kept++] = done - now;
+            }
+            stats.transfers++;
+        }
+        now = done;
+    }
+    bankClose(&bank);
+    if (kept > 0) {
+        qsort(samples, (size_t)kept, sizeof(double), compareSeconds);
+        stats.p50 = samples[kept / 2];
+        stats.p99 = samples[kept * 99 / 100];
+    }
+    free(samples);
+    return write(fd, &stats, sizeof(stats)) != (ssize_t)sizeof(stats);
+}
+
+// Sums every balance reading the store directly, as reports did
+static long long rawTotal(Bank *bank, Account *page) {
+    long count = storageCount(&bank->storage);
+    long long cents = 0;
+
+    for (long slot = 0; slot < count; slot += SYNTH_CHUNK) {
+        long n = count - slot < SYNTH_CHUNK ? count - slot : SYNTH_CHUNK;
+        if (storageGet(&bank->storage, slot, n, page) != 0) {
+            return -1;
+        }
+        for (long i = 0; i < n; i++) {
+            cents += centsOf(page[i].balance);
+        }
+    }
+    return cents;
+}
+
+static long long snapshotTotal(Bank *bank, Account *page) {
+    BankSnapshot snapshot;
+    long long cents = 0;
+
+    if (bankSnapshotOpen(bank, &snapshot) != BANK_OK) {
+        return -1;
+    }
+    for (long slot = 0; slot < snapshot.count && cents >= 0; slot += SYNTH_CHUNK) {
+        long n = snapshot.count - slot < SYNTH_CHUNK ? snapshot.count - slot : SYNTH_CHUNK;
+        if (bankSnapshotRead(&snapshot, slot, n, page) != BANK_OK) {
+            cents = -1;
+            break;
+        }
+        for (long i = 0; i < n; i++) {
+            cents += centsOf(page[i].balance);
+        }
+    }
+    bankSnapshotClose(&snapshot);
+    return cents;
+}
+
+static int benchSnapshot(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_snapshot.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "20000"));
+    int writers = atoi(optionValue(argc, argv, "--writers", "2"));
+    double seconds = atof(optionValue(argc, argv, "--seconds", "2"));
+    int kind = storageOption(argc, argv);
+    const char *phases[] = {"transfers only", "raw scans", "snapshot reports"};
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    Account *page = malloc(SYNTH_CHUNK * sizeof(Account));
+    int inconsistent_snapshots = 0;
+    Bank bank;
+
+    if (count <= 1 || writers <= 0 || writers > SNAPSHOT_WRITERS_MAX || seconds <= 0 || kind < 0 ||
+        kind == STORAGE_MEMORY || kind == STORAGE_COMPACT || page == NULL) {
+        fprintf(stderr, "Usage: bankbench snapshot [--accounts N] [--writers N (max %d)] [--seconds S]"
+                        " [--storage file|mmap] [--file PATH]\n", SNAPSHOT_WRITERS_MAX);
+        free(page);
+        return 2;
+    }
+
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    unlink(log_path);
+    if (writeSyntheticStore(path, count) != 0 || bankOpenStorage(&bank, (StorageKind)kind, path, log_path) != BANK_OK) {
+        perror("bankbench: synthetic store");
+        free(page);
+        return 1;
+    }
+    long long expected = rawTotal(&bank, page);
+
+    printf("%ld accounts, %d writer process(es) transferring for %.1fs per phase; the total never changes\n",
+           count, writers, seconds);
+    printf("%-17s %14s %10s %10s %9s %13s\n", "reports", "transfers/sec", "p50 us", "p99 us", "reports",
+           "inconsistent");
+
+    for (int phase = 0; phase < 3; phase++) {
+        SnapshotWriterStats total = {0, 0.0, 0.0};
+        pid_t children[SNAPSHOT_WRITERS_MAX];
+        long reports = 0, inconsistent = 0;
+        int pipes[2], failed = 0;
+
+        if (pipe(pipes) != 0) {
+            perror("bankbench: snapshot");
+            break;
+        }
+        for (int w = 0; w < writers; w++) {
+            children[w] = fork();
+            if (children[w] == 0) {
+                close(pipes[0]);
+                _exit(runTransfers(pipes[1], (StorageKind)kind, path, log_path, count, seconds,
+                                   (unsigned)time(NULL) * 17u + (unsigned)(phase * writers + w)));
+            }
+            failed |= children[w] < 0;
+        }
+        close(pipes[1]);
+
+        double end = nowSeconds() + seconds;
+        while (phase > 0 && nowSeconds() < end) {
+            long long seen = phase == 1 ? rawTotal(&bank, page) : snapshotTotal(&bank, page);
+            if (seen < 0) {
+                failed = 1;
+                break;
+            }
+            reports++;
+            inconsistent += seen != expected;
+        }
+
+        for (int w = 0; w < writers; w++) {
+            SnapshotWriterStats stats;
+            int status;
+            if (read(pipes[0], &stats, sizeof(stats)) == (ssize_t)sizeof(stats)) {
+                total.transfers += stats.transfers;
+                total.p50 = stats.p50 > total.p50 ? stats.p50 : total.p50;
+                total.p99 = stats.p99 > total.p99 ? stats.p99 : total.p99;
+            } else {
+                failed = 1;
+            }
+            if (children[w] > 0 && (waitpid(children[w], &status, 0) < 0 || !WIFEXITED(status) ||
+                                    WEXITSTATUS(status) != 0)) {
+                failed = 1;
+            }
+        }
+        close(pipes[0]);
+        if (failed) {
+            fprintf(stderr, "bankbench: %s phase failed\n", phases[phase]);
+            inconsistent_snapshots = 1;
+            break;
+        }
+        if (phase == 2) {
+            inconsistent_snapshots = inconsistent != 0;
+        }
+        printf("%-17s %14.0f %10.1f %10.1f %9ld %13ld\n", phases[phase], total.transfers / seconds,
+               total.p50 * 1e6, total.p99 * 1e6, reports, inconsistent);
+    }
+
+    long long final_total = rawTotal(&bank, page);
+    bankClose(&bank);
+    if (final_total != expected) {
+        fprintf(stderr, "bankbench: the store total moved by %.2f\n", (final_total - expected) / 100.0);
+        inconsistent_snapshots = 1;
+    }
+    free(page);
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    return inconsistent_snapshots ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// daily: dashboard totals from transactions.log versus the daily aggregates
+// ---------------------------------------------------------------------------
+
+#define DAILY_BENCH_TYPES 4   // deposits, withdrawals, transfers out and in
+
+// Deposits, withdrawals and transfers between random accounts, one commit each
+static double runOperations(Bank *bank, long count, long operations) {
+    double start = nowSeconds();
+    for (long i = 0; i < operations; i++) {
+        int account = MIN_ACCOUNT_NUMBER + (int)(rand() % count);
+        double amount = (1 + rand() % 5000) / 100.0;
+        switch (i % 4) {
+            case 0: bankDeposit(bank, account, amount, NULL); break;
+            case 1: bankWithdraw(bank, account, amount, NULL); break;
+            default:
+                bankTransfer(bank, account, MIN_ACCOUNT_NUMBER + (int)((account - MIN_ACCOUNT_NUMBER + 1) % count),
+                             amount, NULL, NULL);
+                break;
+        }
+    }
+    return nowSeconds() - start;
+}
+
+// What a dashboard did before: every line of the log parsed, today's kept
+static int scanLog(const char *log_path, const char *today, DailyTotal *totals) {
+    char line[LOG_LINE_LENGTH], date[16], clock[16], type[32];
+    int account;
+    double amount;
+    FILE *log = fopen(log_path, "r");
+
+    if (log == NULL) {
+        return -1;
+    }
+    memset(totals, 0, DAILY_BENCH_TYPES * sizeof(DailyTotal));
+    while (fgets(line, sizeof(line), log) != NULL) {
+        if (sscanf(line, "Account: %d | %15s %15s | %31[^|]| $%lf", &account, date, clock, type, &amount) != 5 ||
+            strcmp(date, today) != 0) {
+            continue;
+        }
+        for (int t = 0; t < DAILY_BENCH_TYPES; t++) {
+            const char *name = transactionTypeName((TransactionType)t);
+            size_t len = strlen(name);
+            if (strncmp(type, name, len) == 0 && type[len] == ' ') {
+                totals[t].count++;
+                totals[t].cents += (int64_t)(amount * 100.0 + 0.5);
+            }
+        }
+    }
+    fclose(log);
+    return 0;
+}
+
+static int benchDaily(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_daily.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "1000"));
+    long operations = atol(optionValue(argc, argv, "--operations", "50000"));
+    int kind = storageOption(argc, argv);
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX, DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    DailyTotal scanned[DAILY_BENCH_TYPES];
+    BankDay day;
+    char today[16];
+    time_t now;
+    Bank bank;
+    int mismatch = 0;
+
+    if (count < 2 || operations <= 0 || kind < 0 || kind == STORAGE_MEMORY) {
+        fprintf(stderr, "Usage: bankbench daily [--accounts N] [--operations N] [--storage file|mmap|compact]"
+                        " [--file PATH]\n");
+        return 2;
+    }
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    unlink(log_path);
+    if (openSynthetic(&bank, (StorageKind)kind, path, log_path, count) != 0) {
+        perror("bankbench: synthetic store");
+        return 1;
+    }
+    bank.rules.config.action = RULES_OFF;
+
+    printf("%ld operations per phase over %ld accounts, one commit each\n", operations, count);
+    printf("%-22s %12s\n", "commit path", "ops/sec");
+    void (*written)(void *, const void *, size_t) = bank.journal.written;
+    bank.journal.written = NULL;
+    double without = runOperations(&bank, count, operations);
+    printf("%-22s %12.0f\n", "without aggregates", operations / without);
+
+    double start = nowSeconds();
+    int rebuilt = bankDailyRebuild(&bank);
+    double rebuild = nowSeconds() - start;
+    if (rebuilt != BANK_OK) {
+        fprintf(stderr, "bankbench: daily aggregates could not be rebuilt\n");
+        bankClose(&bank);
+        return 1;
+    }
+    bank.journal.written = written;
+    double with = runOperations(&bank, count, operations);
+    printf("%-22s %12.0f\n", "with aggregates", operations / with);
+    printf("rebuild from journal:  %.3f s for %ld operations\n\n", rebuild, operations);
+
+    // A run crossing midnight compares two different days
+    now = time(NULL);
+    strftime(today, sizeof(today), "%Y-%m-%d", localtime(&now));
+    int date = atoi(today) * 10000 + atoi(today + 5) * 100 + atoi(today + 8);
+
+    start = nowSeconds();
+    int found = bankDailyRange(&bank, date, date, &day, 1);
+    double query = nowSeconds() - start;
+    bankClose(&bank);
+    start = nowSeconds();
+    int parsed = scanLog(log_path, today, scanned);
+    double scan = nowSeconds() - start;
+
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    if (found != 1 || parsed != 0) {
+        fprintf(stderr, "bankbench: no totals for today\n");
+        return 1;
+    }
+
+    printf("%-22s %12s %12s %12s %14s\n", "totals for today", "seconds", "deposits", "withdrawals", "transfers");
+    printf("%-22s %12.6f %12lld %12lld %14lld\n", "transactions.log scan", scan, (long long)scanned[0].count,
+           (long long)scanned[1].count, (long long)scanned[2].count);
+    printf("%-22s %12.6f %12lld %12lld %14lld\n", "daily aggregates", query,
+           (long long)day.totals[TRANSACTION_DEPOSIT].count, (long long)day.totals[TRANSACTION_WITHDRAWAL].count,
+           (long long)day.totals[TRANSACTION_TRANSFER_OUT].count);
+    printf("speedup:               %.0fx\n", scan / query);
+    for (int t = 0; t < DAILY_BENCH_TYPES; t++) {
+        if (scanned[t].count != day.totals[t].count || scanned[t].cents != day.totals[t].cents) {
+            fprintf(stderr, "bankbench: %s totals differ: log %lld/%.2f, aggregates %lld/%.2f\n",
+                    transactionTypeName((TransactionType)t), (long long)scanned[t].count, scanned[t].cents / 100.0,
+                    (long long)day.totals[t].count, day.totals[t].cents / 100.0);
+            mismatch = 1;
+        }
+    }
+    return mismatch;
+}
+
+// ---------------------------------------------------------------------------
+// dormant: dormancy sweeps by full scan versus by last-access month
+// ---------------------------------------------------------------------------
+
+#define DORMANT_IDLE_DAYS 400      // how long the dormant share has been unused
+#define DORMANT_RECENT_DAYS 30     // the rest were used within this many days
+
+// Backdates every account's last access: `percent` of them, spread evenly,
+// past the sweep's cutoff and the rest within the last month
+static int ageSynthetic(const char *path, long count, int percent, time_t now) {
+    Account *chunk = malloc(SYNTH_CHUNK * sizeof(Account));
+    int fd = open(path, O_RDWR);
+    int failed = chunk == NULL || fd < 0;
+
+    for (long base = 0; base < count && !failed; base += SYNTH_CHUNK) {
+        long n = count - base < SYNTH_CHUNK ? count - base : SYNTH_CHUNK;
+        size_t bytes = (size_t)n * sizeof(Account);
+        off_t offset = (off_t)base * (off_t)sizeof(Account);
+
+        failed = pread(fd, chunk, bytes, offset) != (ssize_t)bytes;
+        for (long i = 0; i < n && !failed; i++) {
+            int idle = (base + i) * percent / 100 != (base + i + 1) * percent / 100;
+            chunk[i].last_accessed = now - (idle ? DORMANT_IDLE_DAYS * 86400L : rand() % (DORMANT_RECENT_DAYS * 86400));
+            bankSealRecord(&chunk[i]);
+        }
+        failed = failed || pwrite(fd, chunk, bytes, offset) != (ssize_t)bytes;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(chunk);
+    return failed ? -1 : 0;
+}
+
+// How a sweep found dormant accounts before: every record read and checked
+static long scanDormant(Bank *bank, time_t cutoff) {
+    BankAccountIter accounts;
+    Account account;
+    long dormant = 0;
+
+    if (bankAccountsOpen(bank, &accounts) != BANK_OK) {
+        return -1;
+    }
+    while (bankAccountsNext(&accounts, &account)) {
+        dormant += account.status == ACCOUNT_ACTIVE && account.last_accessed < cutoff;
+    }
+    bankAccountsClose(&accounts);
+    return dormant;
+}
+
+// Balance checks on the first `checks` accounts; returns checks per second
+static double runChecks(Bank *bank, long checks) {
+    Account account;
+    double start = nowSeconds();
+
+    for (long i = 0; i < checks; i++) {
+        bankTouchAccount(bank, MIN_ACCOUNT_NUMBER + (int)i, &account);
+    }
+    double elapsed = nowSeconds() - start;
+    return elapsed > 0 ? checks / elapsed : 0.0;
+}
+
+static int benchDormant(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_dormant.dat");
+    long count = atol(optionValue(argc, argv, "--accounts", "1000000"));
+    int percent = atoi(optionValue(argc, argv, "--dormant", "2"));
+    int months = atoi(optionValue(argc, argv, "--months", "12"));
+    long checks = atol(optionValue(argc, argv, "--checks", "20000"));
+    int kind = storageOption(argc, argv);
+    char log_path[BANK_PATH_LENGTH + 8];
+    char side_path[BANK_PATH_LENGTH + 16];
+    const char *suffixes[] = {JOURNAL_SUFFIX, INDEX_SUFFIX, ORDERS_SUFFIX, SNAPSHOT_SUFFIX, DAILY_SUFFIX,
+                              DORMANCY_SUFFIX, LOGINS_SUFFIX, SEALED_SUFFIX};
+    BankDormancyStats dry, swept, again;
+    time_t now = time(NULL);
+    struct tm tm;
+    Bank bank;
+
+    if (count <= 0 || percent < 0 || percent > 100 || months < 1 || months * 30 >= DORMANT_IDLE_DAYS ||
+        checks < 0 || kind < 0 || kind == STORAGE_MEMORY) {
+        fprintf(stderr, "Usage: bankbench dormant [--accounts N] [--dormant PERCENT] [--months N (1-13)]"
+                        " [--checks N] [--storage file|mmap|compact] [--file PATH]\n");
+        return 2;
+    }
+    checks = checks < count ? checks : count;
+    printf("generating %ld accounts in %s, %d%% unused for %d days\n", count, path, percent, DORMANT_IDLE_DAYS);
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    // The compact engine encodes records its own way, so it is aged in a plain
+    // file store first and converted as it is opened
+    if (writeSyntheticStore(path, count) != 0 || ageSynthetic(path, count, percent, now) != 0 ||
+        bankOpenStorage(&bank, (StorageKind)kind, path, log_path) != BANK_OK) {
+        perror("bankbench: synthetic store");
+        return 1;
+    }
+    bank.rules.config.action = RULES_OFF;
+
+    // The cutoff bankSweepDormant uses
+    localtime_r(&now, &tm);
+    tm.tm_mon -= months;
+    tm.tm_isdst = -1;
+    time_t cutoff = mktime(&tm);
+
+    double start = nowSeconds();
+    long scanned = scanDormant(&bank, cutoff);
+    double scan = nowSeconds() - start;
+    start = nowSeconds();
+    int result = bankSweepDormant(&bank, months, now, 1, NULL, 0, &dry);
+    double bucketed = nowSeconds() - start;
+    start = nowSeconds();
+    if (result == BANK_OK) {
+        result = bankSweepDormant(&bank, months, now, 0, NULL, 0, &swept);
+    }
+    double suspend = nowSeconds() - start;
+    start = nowSeconds();
+    if (result == BANK_OK) {
+        result = bankSweepDormant(&bank, months, now, 1, NULL, 0, &again);
+    }
+    double rerun = nowSeconds() - start;
+
+    printf("%-28s %10s %12s %12s\n", "finding dormant accounts", "seconds", "examined", "dormant");
+    printf("%-28s %10.4f %12ld %12ld\n", "full scan", scan, count, scanned);
+    if (result == BANK_OK) {
+        printf("%-28s %10.4f %12ld %12ld\n", "month buckets (dry run)", bucketed, dry.candidates, dry.dormant);
+        printf("%-28s %10.4f %12ld %12ld\n", "month buckets (suspending)", suspend, swept.candidates,
+               swept.suspended);
+        printf("%-28s %10.4f %12ld %12ld\n", "month buckets (next sweep)", rerun, again.candidates, again.dormant);
+        printf("speedup:                     %.0fx finding them\n\n", bucketed > 0 ? scan / bucketed : 0.0);
+    }
+
+    // Checks within ACCESS_COALESCE_SECONDS of the last one are not written
+    // back; the aged accounts were last used long before that
+    double first = result == BANK_OK ? runChecks(&bank, checks) : 0.0;
+    double repeat = result == BANK_OK ? runChecks(&bank, checks) : 0.0;
+    bankClose(&bank);
+    if (result == BANK_OK && checks > 0) {
+        printf("%-28s %12s\n", "balance checks", "checks/sec");
+        printf("%-28s %12.0f\n", "first (access written)", first);
+        printf("%-28s %12.0f\n", "repeat (coalesced)", repeat);
+    }
+
+    unlink(path);
+    unlink(log_path);
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%s%s", path, suffixes[i]);
+        unlink(side_path);
+    }
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankbench: sweep failed: %s\n", bankResultMessage(result));
+        return 1;
+    }
+    if (dry.dormant != scanned || swept.suspended != scanned || again.dormant != 0) {
+        fprintf(stderr, "bankbench: sweeps disagree with the full scan\n");
+        return 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// admit: a teller's latency while bulk clients flood bankd
+// ---------------------------------------------------------------------------
+
+#define ADMIT_SETUP_TRIES 100   // times the teller asks for its account while the server sheds
+
+// One teller: balance checks one at a time, timed, until `checks` are done
+// or the flood process exits. Returns the number timed, or -1.
+static long runTeller(const char *socket_path, pid_t flood, long checks, double *latencies, long *refused) {
+    LoadConnection conn;
+    LoadContext load;
+    BankResponse created;
+    long setup_errors = 0;
+    long done = 0;
+    int account = 0;
+
+    memset(&conn, 0, sizeof(conn));
+    bankBufferInit(&conn.rx);
+    bankBufferInit(&conn.tx);
+    conn.in_fd = conn.out_fd = connectUnix(socket_path);
+    for (int tries = 0; conn.in_fd >= 0 && account == 0 && tries < ADMIT_SETUP_TRIES; tries++) {
+        if (runPipelined(&conn, 1, 1, makeCreate, NULL, &created, &setup_errors) != 0) {
+            break;
+        }
+        account = created.status == BANK_OK ? created.account_number : 0;
+    }
+    load.accounts = &account;
+    load.account_count = 1;
+    load.priority = BANK_PRIORITY_INTERACTIVE;
+
+    while (account != 0 && done < checks) {
+        if (done % 16 == 0 && waitpid(flood, NULL, WNOHANG) != 0) {
+            break;
+        }
+        double start = nowSeconds();
+        if (runPipelined(&conn, 1, 1, makeBalance, &load, NULL, refused) != 0) {
+            account = 0;
+            break;
+        }
+        latencies[done++] = nowSeconds() - start;
+    }
+
+    if (conn.in_fd >= 0) {
+        close(conn.in_fd);
+    }
+    bankBufferFree(&conn.rx);
+    bankBufferFree(&conn.tx);
+    return account != 0 ? done : -1;
+}
+
+static int benchAdmit(int argc, char **argv) {
+    const char *bankd = optionValue(argc, argv, "--bankd", "./bankd");
+    const char *dir = optionValue(argc, argv, "--dir", "bench_admit");
+    const char *threads = optionValue(argc, argv, "--threads", "2");
+    const char *client_rate = optionValue(argc, argv, "--client-rate", "5000");
+    long ops = atol(optionValue(argc, argv, "--ops", "600000"));
+    int depth = atoi(optionValue(argc, argv, "--depth", "1024"));
+    int clients = atoi(optionValue(argc, argv, "--clients", "2"));
+    long checks = atol(optionValue(argc, argv, "--checks", "5000"));
+    const char *phases[] = {"flood interactive", "flood batch", "flood batch, rate limited"};
+    char run_dir[BANK_PATH_LENGTH];
+    char socket_path[BANK_PATH_LENGTH + 16];
+
+    if (ops <= 0 || depth <= 0 || clients <= 0 || checks <= 0 || atof(client_rate) <= 0) {
+        fprintf(stderr, "Usage: bankbench admit [--clients C] [--ops N] [--depth D] [--checks N] "
+                        "[--client-rate N] [--threads T] [--bankd PATH] [--dir DIR]\n");
+        return 2;
+    }
+    double *latencies = malloc((size_t)checks * sizeof(double));
+    if (latencies == NULL || (mkdir(dir, 0755) != 0 && errno != EEXIST)) {
+        perror("bankbench: mkdir");
+        free(latencies);
+        return 1;
+    }
+
+    printf("%d bulk clients, %ld requests at depth %d, against one teller checking balances\n\n", clients, ops,
+           depth);
+    printf("%-26s %8s %9s %9s %9s %12s %10s\n", "", "checks", "p50 ms", "p99 ms", "max ms", "bulk served/s",
+           "refused");
+    for (int phase = 0; phase < 3; phase++) {
+        int priority = phase == 0 ? BANK_PRIORITY_INTERACTIVE : BANK_PRIORITY_BATCH;
+        int results[2];
+
+        snprintf(run_dir, sizeof(run_dir), "%s/run-%d", dir, phase);
+        snprintf(socket_path, sizeof(socket_path), "%s/client.sock", run_dir);
+        if (mkdir(run_dir, 0755) != 0 && errno != EEXIST) {
+            perror("bankbench: mkdir");
+            free(latencies);
+            return 1;
+        }
+        pid_t server = startServer(bankd, run_dir, socket_path, 0, threads, phase == 2 ? "--client-rate" : NULL,
+                                   client_rate);
+        if (server < 0 || pipe(results) != 0) {
+            fprintf(stderr, "bankbench: %s did not start\n", bankd);
+            free(latencies);
+            return 1;
+        }
+
+        // The flood, from a process of its own, reporting through a pipe
+        pid_t flood = fork();
+        if (flood == 0) {
+            double report[2] = {0.0, 0.0};
+            long errors = 0;
+            close(results[0]);
+            if (runClients(socket_path, clients, ops, depth, 100, priority, &errors, &report[1]) == 0) {
+                report[0] = (double)errors;
+            } else {
+                report[1] = -1.0;
+            }
+            (void)!write(results[1], report, sizeof(report));
+            _exit(0);
+        }
+        close(results[1]);
+
+        struct timespec ramp = {0, 200000000};
+        nanosleep(&ramp, NULL);
+        long refused = 0;
+        long timed = flood > 0 ? runTeller(socket_path, flood, checks, latencies, &refused) : -1;
+
+        double report[2] = {0.0, -1.0};
+        if (read(results[0], report, sizeof(report)) != sizeof(report)) {
+            report[1] = -1.0;
+        }
+        close(results[0]);
+        if (flood > 0) {
+            waitpid(flood, NULL, 0);
+        }
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+        if (timed <= 0 || report[1] <= 0) {
+            fprintf(stderr, "bankbench: %s: teller or bulk clients failed\n", phases[phase]);
+            free(latencies);
+            return 1;
+        }
+
+        qsort(latencies, (size_t)timed, sizeof(double), compareSeconds);
+        printf("%-26s %8ld %9.3f %9.3f %9.3f %12.0f %10.0f\n", phases[phase], timed,
+               latencies[timed / 2] * 1e3, latencies[timed * 99 / 100] * 1e3, latencies[timed - 1] * 1e3,
+               ((ops / clients) * clients - report[0]) / report[1], report[0]);
+        if (refused > 0) {
+            printf("%-26s %ld teller checks refused\n", "", refused);
+        }
+        fflush(stdout);
+    }
+    free(latencies);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// replay: a workload trace re-executed against a copy of a data directory
+// ---------------------------------------------------------------------------
+
+#define REPLAY_CHUNK 4096         // records rewritten at a time while scrubbing
+#define REPLAY_ORDERS_MAX 1024    // standing orders listed at once
+#define REPLAY_MENUS 256
+
+// Latencies of one operation kind, or of everything done for one menu choice
+typedef struct {
+    double *recorded;
+    double *replayed;
+    long count;
+    long capacity;
+    long diverged;                // results that differ from the trace's
+} ReplaySeries;
+
+typedef struct {
+    Bank *bank;
+    int *numbers;                 // traced account number to replayed, for accounts the trace created
+    BankQueryCursor cursor;
+    Account *rows;
+    StandingOrder *orders;
+    char key[MAX_NAME_LENGTH];
+} ReplayState;
+
+static int isStoreFile(const char *name) {
+    return strncmp(name, FILENAME, strlen(FILENAME)) == 0 || strcmp(name, TRANSACTION_LOG) == 0;
+}
+
+static int copyFile(const char *from, const char *to) {
+    char buffer[65536];
+    int in = open(from, O_RDONLY);
+    int out = in >= 0 ? open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    ssize_t n = 0;
+
+    while (out >= 0 && (n = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, (size_t)n) != n) {
+            n = -1;
+            break;
+        }
+    }
+    if (in >= 0) {
+        close(in);
+    }
+    if (out >= 0 && close(out) != 0) {
+        n = -1;
+    }
+    return out >= 0 && n == 0 ? 0 : -1;
+}
+
+// Replaces the store files in `to` with copies of those in `from`
+static int copyDataDir(const char *from, const char *to) {
+    char from_path[BANK_PATH_LENGTH * 2];
+    char to_path[BANK_PATH_LENGTH * 2];
+    struct stat from_st, to_st;
+    struct dirent *entry;
+    DIR *dir;
+    int failed = 0;
+
+    if (stat(from, &from_st) != 0 || (mkdir(to, 0755) != 0 && errno != EEXIST) || stat(to, &to_st) != 0) {
+        return -1;
+    }
+    if (from_st.st_dev == to_st.st_dev && from_st.st_ino == to_st.st_ino) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((dir = opendir(to)) == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (isStoreFile(entry->d_name)) {
+            snprintf(to_path, sizeof(to_path), "%s/%s", to, entry->d_name);
+            unlink(to_path);
+        }
+    }
+    closedir(dir);
+
+    if ((dir = opendir(from)) == NULL) {
+        return -1;
+    }
+    while (!failed && (entry = readdir(dir)) != NULL) {
+        if (isStoreFile(entry->d_name)) {
+            snprintf(from_path, sizeof(from_path), "%s/%s", from, entry->d_name);
+            snprintf(to_path, sizeof(to_path), "%s/%s", to, entry->d_name);
+            failed = copyFile(from_path, to_path) != 0;
+        }
+    }
+    closedir(dir);
+    return failed ? -1 : 0;
+}
+
+// Gives every account of the copy TRACE_REPLAY_PASSWORD, keeping its failed
+// sign-ins, so the trace's authentications succeed and fail as they did
+static int scrubPasswords(const char *path) {
+    char hash[HASH_LENGTH];
+    BankStorage storage;
+    Account *chunk = calloc(REPLAY_CHUNK, sizeof(Account));
+    int failed = chunk == NULL;
+
+    if (failed || storageOpen(&storage, STORAGE_FILE, path, NULL, sizeof(Account), bankRecordCodec()) != 0) {
+        free(chunk);
+        return -1;
+    }
+    simple_hash(TRACE_REPLAY_PASSWORD, hash);
+    long count = storageCount(&storage);
+    for (long base = 0; base < count && !failed; base += REPLAY_CHUNK) {
+        long n = count - base < REPLAY_CHUNK ? count - base : REPLAY_CHUNK;
+        failed = storageGet(&storage, base, n, chunk) != 0;
+        for (long i = 0; i < n && !failed; i++) {
+            snprintf(chunk[i].password_hash, sizeof(chunk[i].password_hash), "%s", hash);
+            bankSealRecord(&chunk[i]);
+        }
+        failed = failed || storagePut(&storage, base, n, chunk) != 0;
+    }
+    failed = failed || storageSync(&storage) != 0;
+    storageClose(&storage);
+    free(chunk);
+    return failed ? -1 : 0;
+}
+
+// Opens the copy with the engine asked for. Asking for compact converts a
+// flat copy; the memory engine is loaded from it and keeps nothing else
+// (standing orders, retry keys) from the directory.
+static int openCopy(Bank *bank, StorageKind kind, const char *path, const char *log_path) {
+    BankStorage copy;
+    Account *chunk;
+    int failed;
+
+    if (kind != STORAGE_MEMORY) {
+        return bankOpenStorage(bank, kind, path, log_path) == BANK_OK ? 0 : -1;
+    }
+    if (bankOpenStorage(bank, kind, path, log_path) != BANK_OK) {
+        return -1;
+    }
+    chunk = calloc(REPLAY_CHUNK, sizeof(Account));
+    failed = chunk == NULL;
+    if (!failed && access(path, F_OK) == 0) {
+        if (storageOpen(&copy, STORAGE_FILE, path, NULL, sizeof(Account), bankRecordCodec()) != 0) {
+            failed = 1;
+        } else {
+            long count = storageCount(&copy);
+            for (long base = 0; base < count && !failed; base += REPLAY_CHUNK) {
+                long n = count - base < REPLAY_CHUNK ? count - base : REPLAY_CHUNK;
+                failed = storageGet(&copy, base, n, chunk) != 0 || storagePut(&bank->storage, base, n, chunk) != 0;
+            }
+            storageClose(&copy);
+            failed = failed || indexBuild(&bank->index, &bank->storage, count, 0) != 0;
+        }
+    }
+    free(chunk);
+    if (failed) {
+        bankClose(bank);
+        return -1;
+    }
+    return 0;
+}
+
+static int addSample(ReplaySeries *series, double recorded, double replayed, int diverged) {
+    if (series->count == series->capacity) {
+        long capacity = series->capacity > 0 ? series->capacity * 2 : 1024;
+        double *r = realloc(series->recorded, (size_t)capacity * sizeof(double));
+        if (r == NULL) {
+            return -1;
+        }
+        series->recorded = r;
+        double *p = realloc(series->replayed, (size_t)capacity * sizeof(double));
+        if (p == NULL) {
+            return -1;
+        }
+        series->replayed = p;
+        series->capacity = capacity;
+    }
+    series->recorded[series->count] = recorded;
+    series->replayed[series->count] = replayed;
+    series->count++;
+    series->diverged += diverged;
+    return 0;
+}
+
+static void printSeries(const char *name, ReplaySeries *series) {
+    long n = series->count;
+
+    if (n == 0) {
+        return;
+    }
+    qsort(series->recorded, (size_t)n, sizeof(double), compareSeconds);
+    qsort(series->replayed, (size_t)n, sizeof(double), compareSeconds);
+    printf("%-12s %9ld %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9ld\n", name, n, series->recorded[n / 2] * 1e3,
+           series->recorded[n * 99 / 100] * 1e3, series->replayed[n / 2] * 1e3, series->replayed[n * 99 / 100] * 1e3,
+           series->replayed[n * 999 / 1000] * 1e3, series->replayed[n - 1] * 1e3, series->diverged);
+}
+
+static int replayAccount(const ReplayState *state, int traced) {
+    int mapped = traced >= MIN_ACCOUNT_NUMBER && traced <= MAX_ACCOUNT_NUMBER
+                     ? state->numbers[traced - MIN_ACCOUNT_NUMBER] : 0;
+    return mapped != 0 ? mapped : traced;
+}
+
+// Work done before the clock starts: a search's key, from the account it found
+static void prepareRecord(ReplayState *state, const TraceRecord *record) {
+    Account account;
+    size_t length = record->count < (int)sizeof(state->key) ? (size_t)record->count : sizeof(state->key) - 1;
+
+    if (record->op != TRACE_SEARCH) {
+        return;
+    }
+    memset(state->key, '~', length);
+    state->key[length] = '\0';
+    if (record->account_number != 0 &&
+        bankFindAccount(state->bank, replayAccount(state, record->account_number), &account) == BANK_OK) {
+        IndexField field = (IndexField)(record->related & 0xff);
+        const char *value = field == INDEX_EMAIL ? account.email : field == INDEX_PHONE ? account.phone : account.name;
+        snprintf(state->key, sizeof(state->key), "%s", value);
+        if (record->related >> 8) {
+            state->key[length < strlen(state->key) ? length : strlen(state->key)] = '\0';
+        }
+    }
+}
+
+// Whatever the trace's create failed on, given again
+static int replayCreate(ReplayState *state, const TraceRecord *record) {
+    char email[MAX_NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    Account created;
+    int traced = record->account_number;
+
+    snprintf(email, sizeof(email), "replay%d@example.com", traced);
+    snprintf(phone, sizeof(phone), "555%07d", traced % 10000000);
+    int result = bankCreateAccount(state->bank, record->result == BANK_ERR_INVALID_NAME ? "" : "Replay Customer",
+                                   record->result == BANK_ERR_INVALID_EMAIL ? "replay" : email,
+                                   record->result == BANK_ERR_INVALID_PHONE ? "x" : phone,
+                                   record->result == BANK_ERR_WEAK_PASSWORD ? "short" : TRACE_REPLAY_PASSWORD,
+                                   &created);
+    if (result == BANK_OK && traced >= MIN_ACCOUNT_NUMBER && traced <= MAX_ACCOUNT_NUMBER) {
+        state->numbers[traced - MIN_ACCOUNT_NUMBER] = created.account_number;
+    }
+    return result;
+}
+
+static int replayQuery(ReplayState *state, const TraceRecord *record) {
+    BankQuery query;
+    BankQueryStats stats;
+
+    bankQueryInit(&query);
+    query.statuses = (unsigned)record->related & (QUERY_ACTIVE | QUERY_SUSPENDED | QUERY_CLOSED);
+    query.order = (QueryOrder)((record->related >> TRACE_QUERY_ORDER_SHIFT) & 0x3);
+    query.descending = (record->related & TRACE_QUERY_DESCENDING) != 0;
+    query.threads = record->related >> TRACE_QUERY_THREADS_SHIFT;
+    query.min_balance = record->amount;
+    query.max_balance = record->limit;
+    if (record->arg != 0) {
+        query.accessed_to = (int64_t)time(NULL) - record->arg;
+    }
+    if (!(record->related & TRACE_QUERY_NEXT_PAGE)) {
+        memset(&state->cursor, 0, sizeof(state->cursor));
+    }
+    return bankQuery(state->bank, &query, &state->cursor, state->rows,
+                     record->count < QUERY_PAGE_MAX ? record->count : QUERY_PAGE_MAX, &stats);
+}
+
+// Runs one traced operation; returns its result as the trace records it
+static int replayRecord(ReplayState *state, const TraceRecord *record) {
+    Bank *bank = state->bank;
+    Account account;
+    BankHistoryIter history;
+    int number = replayAccount(state, record->account_number);
+    int related = replayAccount(state, record->related);
+    const char *password = record->result == BANK_ERR_AUTH ? "wrong-password" : TRACE_REPLAY_PASSWORD;
+    int result;
+
+    switch (record->op) {
+        case TRACE_FIND:
+            return bankFindAccount(bank, number, &account);
+        case TRACE_CREATE:
+            return replayCreate(state, record);
+        case TRACE_AUTH:
+            return bankAuthenticate(bank, number, password);
+        case TRACE_TOUCH:
+            return bankTouchAccount(bank, number, &account);
+        case TRACE_DEPOSIT:
+            return bankDepositKeyed(bank, (uint64_t)record->arg, number, record->amount, &account);
+        case TRACE_WITHDRAW:
+            return bankWithdrawKeyed(bank, (uint64_t)record->arg, number, record->amount, &account);
+        case TRACE_TRANSFER:
+            return bankTransferKeyed(bank, (uint64_t)record->arg, number, related, record->amount, &account, NULL);
+        case TRACE_PASSWORD:
+            return bankChangePassword(bank, number, password, TRACE_REPLAY_PASSWORD);
+        case TRACE_SUSPEND:
+            return bankSuspendAccount(bank, number);
+        case TRACE_REACTIVATE:
+            return bankReactivateAccount(bank, number);
+        case TRACE_CLOSE:
+            return bankCloseAccount(bank, number);
+        case TRACE_SEARCH:
+            return bankSearchAccounts(bank, (IndexField)(record->related & 0xff), state->key, record->related >> 8,
+                                      state->rows, QUERY_PAGE_MAX);
+        case TRACE_HISTORY:
+            // Every front-end reads a history to its end
+            if ((result = bankHistoryOpen(bank, number, &history)) == BANK_OK) {
+                while (bankHistoryNext(&history) != NULL) {
+                }
+                bankHistoryClose(&history);
+            }
+            return result;
+        case TRACE_QUERY:
+            return replayQuery(state, record);
+        case TRACE_ORDER_CREATE:
+            return bankCreateOrder(bank, number, related, record->amount, (int64_t)time(NULL) + record->arg,
+                                   (int64_t)record->limit, record->count, NULL);
+        case TRACE_ORDER_CANCEL:
+            return bankCancelOrder(bank, number, (uint32_t)record->arg);
+        case TRACE_ORDER_LIST:
+            return bankListOrders(bank, number, state->orders,
+                                  record->count < REPLAY_ORDERS_MAX ? record->count : REPLAY_ORDERS_MAX);
+        case TRACE_RUN_DUE:
+            return bankRunDueOrders(bank, (int64_t)time(NULL) + record->arg, NULL);
+        case TRACE_BEGIN:
+            bankBeginBatch(bank);
+            return BANK_OK;
+        case TRACE_COMMIT:
+            return bankCommitBatch(bank);
+        default:
+            return BANK_ERR_INVALID_REQUEST;
+    }
+}
+
+static void sleepUntil(double when) {
+    double wait = when - nowSeconds();
+
+    if (wait > 0) {
+        struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int benchReplay(int argc, char **argv) {
+    const char *trace_path = optionValue(argc, argv, "--trace", NULL);
+    const char *data_dir = optionValue(argc, argv, "--data-dir", getenv(BANK_DATA_DIR_ENV));
+    const char *copy_dir = optionValue(argc, argv, "--copy", "bench_replay");
+    const char *speed_name = optionValue(argc, argv, "--speed", "max");
+    double speed = strcmp(speed_name, "max") == 0 ? 0.0 : strcmp(speed_name, "recorded") == 0 ? 1.0 : atof(speed_name);
+    int kind = storageOption(argc, argv);
+    char accounts_path[BANK_PATH_LENGTH + 8];
+    char log_path[BANK_PATH_LENGTH + 8];
+    ReplaySeries ops[TRACE_OPS];
+    ReplaySeries *menus = calloc(REPLAY_MENUS, sizeof(ReplaySeries));
+    ReplayState state;
+    TraceReader reader;
+    TraceRecord record;
+    Bank bank;
+    int failed = 0;
+
+    if (trace_path == NULL || kind < 0 || speed < 0 || (speed == 0 && strcmp(speed_name, "max") != 0)) {
+        fprintf(stderr, "Usage: bankbench replay --trace FILE [--data-dir DIR] [--copy DIR] "
+                        "[--speed max|recorded|N] [--storage file|mmap|memory|compact]\n");
+        free(menus);
+        return 2;
+    }
+    if (data_dir == NULL || data_dir[0] == '\0') {
+        data_dir = ".";
+    }
+    if (traceReaderOpen(&reader, trace_path) != 0) {
+        fprintf(stderr, "bankbench: %s is not a readable trace\n", trace_path);
+        free(menus);
+        return 1;
+    }
+
+    snprintf(accounts_path, sizeof(accounts_path), "%s/%s", copy_dir, FILENAME);
+    snprintf(log_path, sizeof(log_path), "%s/%s", copy_dir, TRANSACTION_LOG);
+    memset(&state, 0, sizeof(state));
+    state.bank = &bank;
+    state.numbers = calloc(MAX_ACCOUNT_NUMBER - MIN_ACCOUNT_NUMBER + 1, sizeof(int));
+    state.rows = malloc(QUERY_PAGE_MAX * sizeof(Account));
+    state.orders = malloc(REPLAY_ORDERS_MAX * sizeof(StandingOrder));
+    if (menus == NULL || state.numbers == NULL || state.rows == NULL || state.orders == NULL) {
+        fprintf(stderr, "bankbench: out of memory\n");
+        failed = 1;
+    } else if (copyDataDir(data_dir, copy_dir) != 0 ||
+               (access(accounts_path, F_OK) == 0 && scrubPasswords(accounts_path) != 0)) {
+        fprintf(stderr, "bankbench: cannot copy %s to %s: %s\n", data_dir, copy_dir, strerror(errno));
+        failed = 1;
+    } else if (openCopy(&bank, (StorageKind)kind, accounts_path, log_path) != 0) {
+        fprintf(stderr, "bankbench: cannot open the copy in %s\n", copy_dir);
+        failed = 1;
+    }
+    if (failed) {
+        traceReaderClose(&reader);
+        free(state.numbers);
+        free(state.rows);
+        free(state.orders);
+        free(menus);
+        return 1;
+    }
+
+    // Everything done for a menu choice adds up to one sample; standing
+    // orders fired between choices are not part of any
+    memset(ops, 0, sizeof(ops));
+    int menu = -1;
+    double menu_recorded = 0.0, menu_replayed = 0.0;
+    int menu_diverged = 0;
+    long replayed = 0;
+    double start = nowSeconds();
+    while (!failed && traceReaderNext(&reader, &record)) {
+        if (record.op >= TRACE_OPS) {
+            continue;
+        }
+        if (record.op == TRACE_MENU) {
+            if (menu >= 0) {
+                failed = addSample(&menus[menu], menu_recorded, menu_replayed, menu_diverged) != 0;
+            }
+            menu = record.menu != TRACE_NO_MENU ? record.menu : -1;
+            menu_recorded = menu_replayed = 0.0;
+            menu_diverged = 0;
+            continue;
+        }
+        if (speed > 0) {
+            sleepUntil(start + record.start / 1e9 / speed);
+        }
+        prepareRecord(&state, &record);
+        double began = nowSeconds();
+        int result = replayRecord(&state, &record);
+        double took = nowSeconds() - began;
+        double recorded = record.latency / 1e9;
+        int diverged = result != record.result;
+
+        failed = addSample(&ops[record.op], recorded, took, diverged) != 0;
+        if (menu >= 0 && record.op != TRACE_RUN_DUE) {
+            menu_recorded += recorded;
+            menu_replayed += took;
+            menu_diverged |= diverged;
+        }
+        replayed++;
+    }
+    if (!failed && menu >= 0) {
+        failed = addSample(&menus[menu], menu_recorded, menu_replayed, menu_diverged) != 0;
+    }
+    double elapsed = nowSeconds() - start;
+    while (bank.batch_depth > 0) {
+        bankCommitBatch(&bank);
+    }
+    bankClose(&bank);
+    traceReaderClose(&reader);
+
+    if (failed) {
+        fprintf(stderr, "bankbench: out of memory\n");
+    } else {
+        char pace[32];
+        if (speed == 0) {
+            snprintf(pace, sizeof(pace), "as fast as possible");
+        } else {
+            snprintf(pace, sizeof(pace), "at %gx recorded speed", speed);
+        }
+        printf("%ld operations from %s replayed on a %s copy of %s in %.3fs (%.0f ops/sec), %s\n\n", replayed,
+               trace_path, storageKindName((StorageKind)kind), data_dir, elapsed,
+               elapsed > 0 ? replayed / elapsed : 0.0, pace);
+        printf("%-12s %9s %9s %9s %9s %9s %9s %9s %9s\n", "", "count", "rec p50", "rec p99", "p50 ms", "p99 ms",
+               "p99.9 ms", "max ms", "diverged");
+        for (int op = 0; op < TRACE_OPS; op++) {
+            printSeries(traceOpName(op), &ops[op]);
+        }
+        for (int choice = 0; choice < REPLAY_MENUS; choice++) {
+            char name[16];
+            snprintf(name, sizeof(name), "menu %d", choice);
+            printSeries(name, &menus[choice]);
+        }
+    }
+    for (int op = 0; op < TRACE_OPS; op++) {
+        free(ops[op].recorded);
+        free(ops[op].replayed);
+    }
+    for (int choice = 0; choice < REPLAY_MENUS; choice++) {
+        free(menus[choice].recorded);
+        free(menus[choice].replayed);
+    }
+    free(menus);
+    free(state.numbers);
+    free(state.rows);
+    free(state.orders);
+    return failed ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// arena: per-request temporaries from malloc/free versus a batch arena
+// ---------------------------------------------------------------------------
+
+#define ARENA_BATCH 64      // requests per batch, as bankd commits them
+#define ARENA_TEMPS 8       // temporaries per request: lines, receipts, keys
+
+// Sizes a request handler would ask for: formatted lines and small keys
+static size_t tempSize(long i) {
+    return i % 4 == 0 ? LOG_LINE_LENGTH : 24 + (size_t)(i * 37 % 200);
+}
+
+// Touches both ends of the buffer so neither allocator is timed on memory
+// it never hands out; formatting is left out as it costs the same either way
+static unsigned long fillTemp(char *buffer, size_t size, long i) {
+    buffer[0] = (char)i;
+    buffer[size - 1] = '\0';
+    return (unsigned char)buffer[0];
+}
+
+static int benchArena(int argc, char **argv) {
+    long requests = atol(optionValue(argc, argv, "--requests", "2000000"));
+    char *held[ARENA_TEMPS];
+    unsigned long checksum = 0;
+    BankArena arena;
+
+    if (requests <= 0) {
+        fprintf(stderr, "Usage: bankbench arena [--requests N]\n");
+        return 2;
+    }
+
+    double start = nowSeconds();
+    for (long r = 0; r < requests; r++) {
+        for (int t = 0; t < ARENA_TEMPS; t++) {
+            long i = r * ARENA_TEMPS + t;
+            held[t] = malloc(tempSize(i));
+            if (held[t] == NULL) {
+                fprintf(stderr, "bankbench: out of memory\n");
+                return 1;
+            }
+            checksum += fillTemp(held[t], tempSize(i), i);
+        }
+        for (int t = 0; t < ARENA_TEMPS; t++) {
+            free(held[t]);
+        }
+    }
+    double heap = nowSeconds() - start;
+
+    arenaInit(&arena, ARENA_DEFAULT_BLOCK);
+    start = nowSeconds();
+    for (long r = 0; r < requests; r++) {
+        for (int t = 0; t < ARENA_TEMPS; t++) {
+            long i = r * ARENA_TEMPS + t;
+            char *buffer = arenaAlloc(&arena, tempSize(i));
+            if (buffer == NULL) {
+                fprintf(stderr, "bankbench: out of memory\n");
+                arenaFree(&arena);
+                return 1;
+            }
+            checksum += fillTemp(buffer, tempSize(i), i);
+        }
+        if ((r + 1) % ARENA_BATCH == 0) {
+            arenaReset(&arena);
+        }
+    }
+    double bumped = nowSeconds() - start;
+
+    long temps = requests * ARENA_TEMPS;
+    printf("temporaries: %ld (%d per request, reset every %d requests)\n", temps, ARENA_TEMPS, ARENA_BATCH);
+    printf("malloc/free: %.3f s, %.1f ns each, %ld mallocs\n", heap, heap * 1e9 / temps, temps);
+    printf("arena:       %.3f s, %.1f ns each, %llu mallocs (peak %zu bytes per batch)\n", bumped,
+           bumped * 1e9 / temps, (unsigned long long)arena.blocks, arena.peak);
+    printf("checksum:    %lu\n", checksum);
+    arenaFree(&arena);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// rules: cost of screening an outflow against the velocity rules
+// ---------------------------------------------------------------------------
+
+static int benchRules(int argc, char **argv) {
+    long count = atol(optionValue(argc, argv, "--accounts", "10000"));
+    long checks = atol(optionValue(argc, argv, "--checks", "10000000"));
+    RulesEngine engine;
+    long violations = 0;
+
+    if (count <= 0 || checks <= 0) {
+        fprintf(stderr, "Usage: bankbench rules [--checks N] [--accounts N]\n");
+        return 2;
+    }
+    if (rulesInit(&engine, RULES_DEFAULT_ACCOUNTS) != 0) {
+        fprintf(stderr, "bankbench: out of memory\n");
+        return 1;
+    }
+
+    // Every outflow is checked and recorded, as the transaction path does;
+    // time advances a second per thousand outflows so windows keep sliding
+    int64_t now = (int64_t)time(NULL);
+    double start = nowSeconds();
+    for (long i = 0; i < checks; i++) {
+        int account = MIN_ACCOUNT_NUMBER + (int)(rand() % count);
+        int payee = i % 2 ? MIN_ACCOUNT_NUMBER + (int)(rand() % count) : 0;
+        double amount = 1.0 + rand() % 50000 / 100.0;
+        int64_t when = now + i / 1000;
+
+        if (rulesCheck(&engine, account, when, amount, payee) != 0) {
+            violations++;
+        }
+        rulesRecord(&engine, account, when, amount, payee);
+    }
+    double elapsed = nowSeconds() - start;
+
+    printf("checks:     %ld over %ld accounts (%ld violations, %llu evictions)\n", checks, count,
+           violations, (unsigned long long)engine.evictions);
+    printf("table:      %zu bytes\n", (engine.set_mask + 1) * RULES_WAYS * sizeof(RulesAccount));
+    printf("elapsed:    %.3f s\n", elapsed);
+    printf("per check:  %.0f ns (check + record)\n", elapsed * 1e9 / checks);
+    rulesFree(&engine);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// import: bulk file checking, line at a time versus vectorized from a mapping
+// ---------------------------------------------------------------------------
+
+#define IMPORT_BAD_EVERY 97               // one generated row in this many is malformed
+
+static int writeImportFile(const char *path, BulkKind kind, long long bytes) {
+    FILE *out = fopen(path, "w");
+    long long written = 0;
+
+    if (out == NULL) {
+        return -1;
+    }
+    fprintf(out, "# bankbench import %s\n", kind == BULK_POSTINGS ? "postings" : "customers");
+    srand(50);
+    for (long i = 0; written < bytes; i++) {
+        int bad = i % IMPORT_BAD_EVERY == IMPORT_BAD_EVERY - 1;
+        int n;
+
+        if (kind == BULK_POSTINGS) {
+            int account = MIN_ACCOUNT_NUMBER + rand() % (MAX_ACCOUNT_NUMBER - MIN_ACCOUNT_NUMBER + 1);
+            long cents = 1 + rand() % 500000;
+            if (bad) {
+                n = fprintf(out, i % 2 ? "%dx,%ld.%02ld\n" : "%d,0.00\n", account, cents / 100, cents % 100);
+            } else {
+                n = fprintf(out, "%d,%s%ld.%02ld\n", account, rand() % 4 == 0 ? "-" : "", cents / 100, cents % 100);
+            }
+        } else {
+            n = fprintf(out, "Customer %ld,%s%ld.example.com,555%07ld,pass%06ld\n", i, bad ? "user." : "user@", i,
+                        i % 10000000, i % 1000000);
+        }
+        if (n < 0) {
+            fclose(out);
+            return -1;
+        }
+        written += n;
+    }
+    return fclose(out);
+}
+
+// The checks bulkRun makes, done the way the teller screens read input
+static int checkPostingLine(char *line, int64_t *cents) {
+    char *comma = strchr(line, ',');
+    char *end;
+
+    if (comma == NULL) {
+        return 0;
+    }
+    *comma = '\0';
+    long account = strtol(line, &end, 10);
+    if (end == line || *end != '\0' || account < MIN_ACCOUNT_NUMBER || account > MAX_ACCOUNT_NUMBER) {
+        return 0;
+    }
+    double amount = strtod(comma + 1, &end);
+    if (end == comma + 1 || *end != '\0') {
+        return 0;
+    }
+    *cents = (int64_t)(amount * 100 + (amount < 0 ? -0.5 : 0.5));
+    return *cents != 0 && *cents <= BULK_MAX_AMOUNT_CENTS && *cents >= -BULK_MAX_AMOUNT_CENTS;
+}
+
+static int checkCustomerLine(char *line) {
+    char *field[BULK_CUSTOMER_FIELDS];
+    int fields = 0;
+
+    for (char *p = line; p != NULL; fields++) {
+        if (fields == BULK_CUSTOMER_FIELDS) {
+            return 0;
+        }
+        field[fields] = p;
+        p = strchr(p, ',');
+        if (p != NULL) {
+            *p++ = '\0';
+        }
+    }
+    return fields == BULK_CUSTOMER_FIELDS && field[0][0] != '\0' && strlen(field[0]) < MAX_NAME_LENGTH &&
+           strlen(field[1]) < MAX_NAME_LENGTH && validateEmail(field[1]) && strlen(field[2]) < PHONE_LENGTH &&
+           validatePhone(field[2]) && strlen(field[3]) >= MIN_PASSWORD_LENGTH && strlen(field[3]) < PASSWORD_LENGTH;
+}
+
+static int checkLines(const char *path, BulkKind kind, BulkStats *stats) {
+    FILE *in = fopen(path, "r");
+    char line[512];
+
+    memset(stats, 0, sizeof(*stats));
+    if (in == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        size_t len = strlen(line);
+        int64_t cents = 0;
+
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        stats->rows++;
+        if (kind == BULK_POSTINGS ? checkPostingLine(line, &cents) : checkCustomerLine(line)) {
+            stats->accepted++;
+            stats->cents += cents;
+        } else {
+            stats->refused++;
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+static double readAll(const char *path) {
+    static char buffer[1 << 20];
+    int fd = open(path, O_RDONLY);
+    double start = nowSeconds();
+
+    if (fd < 0) {
+        return -1;
+    }
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+    close(fd);
+    return nowSeconds() - start;
+}
+
+static void printImportPass(const char *name, double seconds, long long bytes, long rows) {
+    printf("%-28s %10.3f %10.0f %14.0f\n", name, seconds, bytes / seconds / 1e6, rows / seconds);
+}
+
+static int benchImport(int argc, char **argv) {
+    const char *path = optionValue(argc, argv, "--file", "bankbench_import.csv");
+    const char *kind_name = optionValue(argc, argv, "--kind", "postings");
+    long long bytes = atoll(optionValue(argc, argv, "--mb", "256")) << 20;
+    int threads = atoi(optionValue(argc, argv, "--threads", "0"));
+    BulkKind kind = strcmp(kind_name, "customers") == 0 ? BULK_CUSTOMERS : BULK_POSTINGS;
+    BulkStats lines;
+    BulkStats single;
+    BulkStats parallel;
+    BulkFile file;
+    char label[64];
+    int mismatch = 0;
+
+    if (bytes <= 0 || threads < 0 || (kind == BULK_POSTINGS && strcmp(kind_name, "postings") != 0)) {
+        fprintf(stderr, "Usage: bankbench import [--kind postings|customers] [--mb N] [--threads N] [--file PATH]\n");
+        return 2;
+    }
+    if (writeImportFile(path, kind, bytes) != 0) {
+        perror("bankbench: import file");
+        return 1;
+    }
+
+    // The file was just written, so every pass reads it from the page cache
+    double raw = readAll(path);
+    double start = nowSeconds();
+    int failed = checkLines(path, kind, &lines);
+    double stdio = nowSeconds() - start;
+    if (raw < 0 || failed || bulkOpen(&file, path) != 0) {
+        perror("bankbench: import file");
+        unlink(path);
+        return 1;
+    }
+    start = nowSeconds();
+    failed = bulkRun(&file, kind, 1, NULL, NULL, &single) != BANK_OK;
+    double one = nowSeconds() - start;
+    start = nowSeconds();
+    failed |= bulkRun(&file, kind, threads, NULL, NULL, &parallel) != BANK_OK;
+    double all = nowSeconds() - start;
+    bulkClose(&file);
+    unlink(path);
+    if (failed) {
+        fprintf(stderr, "bankbench: out of memory\n");
+        return 1;
+    }
+
+    printf("%s: %.0f MB, %ld rows (%ld malformed)\n", kind_name, single.bytes / 1e6, single.rows, single.refused);
+    printf("%-28s %10s %10s %14s\n", "pass", "seconds", "MB/s", "rows/sec");
+    printImportPass("read() only", raw, (long long)single.bytes, single.rows);
+    printImportPass(kind == BULK_POSTINGS ? "fgets + strtol/strtod" : "fgets + validateEmail/Phone", stdio,
+                    (long long)single.bytes, lines.rows);
+    printImportPass("bulk, 1 thread", one, (long long)single.bytes, single.rows);
+    if (threads > 0) {
+        snprintf(label, sizeof(label), "bulk, %d threads", threads);
+    } else {
+        snprintf(label, sizeof(label), "bulk, every CPU");
+    }
+    printImportPass(label, all, (long long)single.bytes, parallel.rows);
+    printf("speedup:    %.1fx on one thread, %.1fx on all\n", stdio / one, stdio / all);
+
+    const BulkStats *passes[] = {&lines, &parallel};
+    for (int i = 0; i < 2; i++) {
+        if (passes[i]->rows != single.rows || passes[i]->accepted != single.accepted ||
+            passes[i]->cents != single.cents) {
+            fprintf(stderr, "bankbench: %s pass differs: %ld rows, %ld accepted, %lld cents; bulk %ld, %ld, %lld\n",
+                    i == 0 ? "line at a time" : "parallel", passes[i]->rows, passes[i]->accepted,
+                    (long long)passes[i]->cents, single.rows, single.accepted, (long long)single.cents);
+            mismatch = 1;
+        }
+    }
+    return mismatch;
+}
+
+// ---------------------------------------------------------------------------
+// render: terminal output per screen, written as it goes versus composed
+// ---------------------------------------------------------------------------
+
+#define RENDER_WIDTH 112
+#define RENDER_CLEAR "clear >/dev/null 2>&1"
+
+// A counter of this process's I/O, such as "syscw" (write syscalls) or
+// "wchar" (bytes written); -1 where Linux does not report them
+static long long ioCounter(const char *name) {
+    FILE *io = fopen("/proc/self/io", "r");
+    long long count = -1;
+    char line[128], format[32];
+
+    snprintf(format, sizeof(format), "%s: %%lld", name);
+    while (io != NULL && fgets(line, sizeof(line), io) != NULL) {
+        if (sscanf(line, format, &count) == 1) {
+            break;
+        }
+    }
+    if (io != NULL) {
+        fclose(io);
+    }
+    return count;
+}
+
+static void renderAccounts(Account *rows, int count) {
+    for (int i = 0; i < count; i++) {
+        memset(&rows[i], 0, sizeof(Account));
+        rows[i].account_number = MIN_ACCOUNT_NUMBER + i;
+        snprintf(rows[i].name, sizeof(rows[i].name), "%s %s", first_names[i % 8], last_names[(i / 8) % 8]);
+        snprintf(rows[i].email, sizeof(rows[i].email), "user%d@example.com", i);
+        snprintf(rows[i].phone, sizeof(rows[i].phone), "555%07d", i * 7919 % 10000000);
+        rows[i].balance = 100.0 + i * 37.25;
+        rows[i].status = ACCOUNT_ACTIVE;
+    }
+}
+
+// The account listing as the front-end drew it before: a shell for the
+// clear, a printf per separator character and per padding space
+static void legacyScreen(FILE *out, const Account *rows, int count) {
+    const char *title = "ALL ACCOUNTS (ADMIN ACCESS)";
+
+    fflush(out);
+    if (system(RENDER_CLEAR) == -1) {
+        return;
+    }
+    for (int i = 0; i < 60; i++) fprintf(out, "%c", '=');
+    fprintf(out, "\n\x1b[1m\x1b[36m");
+    for (int i = 0; i < (60 - (int)strlen(title)) / 2; i++) fprintf(out, " ");
+    fprintf(out, "%s\n\x1b[0m", title);
+    for (int i = 0; i < 60; i++) fprintf(out, "%c", '=');
+    fprintf(out, "\n\n");
+    for (int i = 0; i < RENDER_WIDTH; i++) fprintf(out, "%c", '=');
+    fprintf(out, "\n%-10s %-25s %-30s %-15s %-12s %-10s\n", "Acc No.", "Name", "Email", "Phone", "Balance", "Status");
+    for (int i = 0; i < RENDER_WIDTH; i++) fprintf(out, "%c", '=');
+    fprintf(out, "\n");
+    for (int r = 0; r < count; r++) {
+        fprintf(out, "%-10d %-25s %-30s %-15s \x1b[32m$%-11.2f\x1b[0m \x1b[32m%-10s\x1b[0m\n",
+                rows[r].account_number, rows[r].name, rows[r].email, rows[r].phone, rows[r].balance,
+                accountStatusName(rows[r].status));
+    }
+    for (int i = 0; i < RENDER_WIDTH; i++) fprintf(out, "%c", '=');
+    fprintf(out, "\n  Page 1\n1. Next page  0. Done: ");
+    fflush(out);
+}
+
+// The same screen composed in a TermBuffer and written once
+static void composedScreen(TermBuffer *term, const Account *rows, int count) {
+    const char *title = "ALL ACCOUNTS (ADMIN ACCESS)";
+
+    termClear(term);
+    termRepeat(term, '=', 60);
+    termPrintf(term, "\n\x1b[1m\x1b[36m");
+    termRepeat(term, ' ', (60 - (int)strlen(title)) / 2);
+    termPrintf(term, "%s\n\x1b[0m", title);
+    termRepeat(term, '=', 60);
+    termPrintf(term, "\n\n");
+    termRepeat(term, '=', RENDER_WIDTH);
+    termPrintf(term, "\n%-10s %-25s %-30s %-15s %-12s %-10s\n", "Acc No.", "Name", "Email", "Phone", "Balance",
+               "Status");
+    termRepeat(term, '=', RENDER_WIDTH);
+    termPrintf(term, "\n");
+    for (int r = 0; r < count; r++) {
+        termPrintf(term, "%-10d %-25s %-30s %-15s \x1b[32m$%-11.2f\x1b[0m \x1b[32m%-10s\x1b[0m\n",
+                   rows[r].account_number, rows[r].name, rows[r].email, rows[r].phone, rows[r].balance,
+                   accountStatusName(rows[r].status));
+    }
+    termRepeat(term, '=', RENDER_WIDTH);
+    termPrintf(term, "\n  Page 1\n1. Next page  0. Done: ");
+    termFlush(term);
+}
+
+static int benchRender(int argc, char **argv) {
+    int screens = atoi(optionValue(argc, argv, "--screens", "200"));
+    int count = atoi(optionValue(argc, argv, "--rows", "20"));
+    Account *rows;
+    TermBuffer term;
+
+    if (screens <= 0 || count <= 0) {
+        fprintf(stderr, "Usage: bankbench render [--screens N] [--rows N]\n");
+        return 2;
+    }
+    // Output goes to /dev/null, line buffered as stdout is on a terminal
+    int fd = open("/dev/null", O_WRONLY);
+    FILE *out = fd < 0 ? NULL : fdopen(dup(fd), "w");
+    rows = calloc((size_t)count, sizeof(Account));
+    if (out == NULL || rows == NULL) {
+        fprintf(stderr, "bankbench: cannot open /dev/null\n");
+        free(rows);
+        return 1;
+    }
+    setvbuf(out, NULL, _IOLBF, BUFSIZ);
+    renderAccounts(rows, count);
+
+    long long calls = ioCounter("syscw"), bytes = ioCounter("wchar");
+    double start = nowSeconds();
+    for (int i = 0; i < screens; i++) {
+        legacyScreen(out, rows, count);
+    }
+    double legacy = nowSeconds() - start;
+    long long legacy_calls = ioCounter("syscw") - calls, legacy_bytes = ioCounter("wchar") - bytes;
+    fclose(out);
+
+    termInit(&term, fd);
+    calls = ioCounter("syscw");
+    start = nowSeconds();
+    for (int i = 0; i < screens; i++) {
+        composedScreen(&term, rows, count);
+    }
+    double composed = nowSeconds() - start;
+    long long composed_calls = ioCounter("syscw") - calls;
+
+    printf("screens:    %d, %d account rows each\n", screens, count);
+    printf("%-10s %12s %12s %12s %12s\n", "", "us/screen", "bytes", "writes", "processes");
+    printf("%-10s %12.1f %12lld %12.1f %12d\n", "per-char", legacy * 1e6 / screens, legacy_bytes / screens,
+           (double)legacy_calls / screens, 2);
+    printf("%-10s %12.1f %12llu %12.1f %12d\n", "composed", composed * 1e6 / screens,
+           (unsigned long long)(term.bytes / (uint64_t)screens), (double)term.flushes / screens, 0);
+    if (calls < 0) {
+        printf("(no /proc/self/io: per-char bytes and writes not measured)\n");
+    } else {
+        printf("kernel:     %.1f write syscalls per composed screen; per-char counts include the clear\n",
+               (double)composed_calls / screens);
+    }
+    termFree(&term);
+    close(fd);
+    free(rows);
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *summary;
+} BenchCommand;
+
+static const BenchCommand commands[] = {
+    {"load", benchLoad, "pipelined load generator for bankd (ops/sec)"},
+    {"post", benchPost, "batch interest posting over a synthetic store (accounts/sec)"},
+    {"index", benchIndex, "parallel secondary index build and lookups (accounts/sec)"},
+    {"arena", benchArena, "per-request temporaries: malloc/free versus a batch arena"},
+    {"compact", benchCompact, "full-scan cost before and after archiving closed accounts"},
+    {"boot", benchBoot, "time to the first request with the index rebuilt or mapped, by store size"},
+    {"render", benchRender, "bytes, writes and time per screen: per-character output versus composed"},
+    {"rules", benchRules, "velocity rule screening cost per outflow (ns)"},
+    {"import", benchImport, "import file checking: fgets and strtod line at a time versus bulk from a mapping (MB/s)"},
+    {"sched", benchSched, "schedule standing orders and fire them through the timer wheel"},
+    {"storage", benchStorage, "scan, lookup, deposit rates and bytes per record for each storage engine"},
+    {"daily", benchDaily, "today's totals parsed from transactions.log versus read from the daily aggregates"},
+    {"dormant", benchDormant, "dormant accounts found by full scan versus by last-access month; access coalescing"},
+    {"snapshot", benchSnapshot, "report totals read raw versus from a snapshot while transfers run"},
+    {"terminals", benchTerminals, "teller processes sharing one store: no lost updates, ops/sec by count"},
+    {"replay", benchReplay, "re-run a workload trace on a copy of a data directory; latency by operation and menu choice"},
+    {"admit", benchAdmit, "a teller's balance check latency while bulk clients flood bankd, by priority class"},
+    {"shard", benchShard, "load throughput unsharded and split over N shard processes (ops/sec)"},
+    {"replica", benchReplica, "balance reads on the primary versus spread over N replicas (reads/sec)"},
+};
+
+int main(int argc, char **argv) {
+    srand(time(NULL));
+    signal(SIGPIPE, SIG_IGN);
+
+    if (argc >= 2) {
+        for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+            if (strcmp(argv[1], commands[i].name) == 0) {
+                return commands[i].run(argc - 1, argv + 1);
+            }
+        }
+    }
+
+    fprintf(stderr, "Usage: %s <command> [options]\n\nCommands:\n", argv[0]);
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        fprintf(stderr, "  %-10s %s\n", commands[i].name, commands[i].summary);
+    }
+    return 2;
+}
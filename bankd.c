@@ -0,0 +1,912 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "bank_core.h"
+#include "bank_admit.h"
+#include "bank_protocol.h"
+#include "bank_sched.h"
+#include "bank_compact.h"
+#include "bank_router.h"
+#include "bank_repl.h"
+#include "bank_trace.h"
+
+#define READ_CHUNK 65536
+#define MAX_EVENTS 256
+#define MAX_THREADS 64
+#define OUTPUT_HIGH_WATER (1024 * 1024)  // stop reading a client with this much unsent
+#define URING_ENTRIES 64
+#define SHARD_START_SECONDS 10           // how long the router waits for shard servers
+#define SERVE_CHUNK 64                   // queued requests served per hold of the store
+#define ROUTED_CHUNK 512                 // or per router batch, each a round trip to the shards
+#define SHED_REPORT_SECONDS 10           // how often shed requests are reported
+
+// A client connection owned by one event loop thread
+typedef struct {
+    int fd;
+    int epfd;
+    uint32_t events;      // current epoll interest set
+    BankRouter *router;   // the loop's router in a sharded bank, else NULL
+    BankBuffer in;
+    BankBuffer out;
+    TokenBucket bucket;   // the client's request rate
+    int queued;           // its requests waiting in the loop's queues
+    int eof;              // hung up after sending them: closed once they are answered
+    int closed;           // gone: freed once its queued requests have run
+    int touched;          // replies added since the last flush
+} Connection;
+
+// An event loop: its connections' admitted requests wait in its queues
+typedef struct {
+    int epfd;
+    BankRouter *router;
+    AdmitQueue queue;
+    AdmitEntry chunk[ROUTED_CHUNK];        // requests served as one batch
+    BankResponse replies[ROUTED_CHUNK];
+    Connection *touched[ROUTED_CHUNK];
+    size_t touched_count;
+    BankBuffer routed;                     // the chunk encoded for the router, and its replies
+    BankBuffer routed_replies;
+    int reporter;                          // this loop reports shed requests
+    double next_report;
+    AdmitStats reported;
+} EventLoop;
+
+static Bank bank;
+static pthread_mutex_t bank_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BankAdmission admission;
+static int loops_started = 0;
+static int listen_fd = -1;
+static pid_t shard_pids[SHARD_MAX];
+static int shard_count = 0;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--socket PATH] [--threads N] [--io-uring] [--rules reject|flag|off]\n"
+            "          [--data-dir DIR] [--storage file|mmap|memory|compact] [--accounts FILE] [--log FILE]\n"
+            "          [--shards N | --shard K/N] [--replicate PATH | --replica-of PATH]\n"
+            "          [--client-rate N] [--account-rate N] [--queue N] [--trace FILE]\n"
+            "Serves the binary banking protocol on stdin/stdout, or on a Unix socket\n"
+            "multiplexed by N epoll event loops. Withdrawals and transfers breaking the\n"
+            "velocity rules are rejected (the default), flagged in the log, or not checked.\n"
+            "SIGUSR1 archives closed accounts and compacts the store while serving.\n"
+            "Data lives in DIR, else $%s, else the working directory, unless\n"
+            "--accounts names the store file; memory storage is discarded on exit.\n"
+            "--shards N splits the accounts by number range over N server processes,\n"
+            "each with its store in DIR/shard-K, behind a router serving the clients;\n"
+            "transfers between shards are committed in two phases, authorised with\n"
+            "$%s. --shard K/N serves shard K alone.\n"
+            "--replicate PATH ships every committed batch to replicas connecting on\n"
+            "PATH, and keeps other processes from opening the store meanwhile;\n"
+            "--replica-of PATH keeps a copy of that primary's store in DIR and\n"
+            "serves it read-only, with its replication lag as a protocol request.\n"
+            "--client-rate and --account-rate limit each connection and each account\n"
+            "to N requests a second; requests over a limit, or finding the queue of\n"
+            "their priority class full (--queue N per event loop, default %d), are\n"
+            "refused as overloaded. Batch-class requests wait behind interactive ones.\n"
+            "--trace FILE records every operation for bankbench replay (not with --shards).\n",
+            prog, BANK_DATA_DIR_ENV, ROUTER_ADMIN_ENV, ADMIT_DEFAULT_QUEUE);
+}
+
+static int writeAll(int fd, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Executes every complete request buffered for a client as one batch.
+// The store is shared by all loops, so batches are serialised here; each
+// loop has a router of its own, so routed batches run side by side.
+static int serveBuffered(BankRouter *router, BankBuffer *in, BankBuffer *out) {
+    size_t consumed;
+    int served;
+
+    if (router != NULL) {
+        served = routerServeBatch(router, in->data, in->len, &consumed, out);
+    } else {
+        pthread_mutex_lock(&bank_mutex);
+        served = bankServeBatch(&bank, in->data, in->len, &consumed, out);
+        pthread_mutex_unlock(&bank_mutex);
+    }
+
+    bankBufferConsume(in, consumed);
+    return served;
+}
+
+// Blocking single-client mode used when driven over a pipe: reads whatever
+// the client has pipelined and answers the whole batch with a single write.
+static void serveStream(BankRouter *router, int in_fd, int out_fd) {
+    BankBuffer in, out;
+    bankBufferInit(&in);
+    bankBufferInit(&out);
+
+    while (1) {
+        if (bankBufferReserve(&in, READ_CHUNK) != 0) {
+            break;
+        }
+        ssize_t n = read(in_fd, in.data + in.len, in.cap - in.len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        in.len += (size_t)n;
+
+        int served = serveBuffered(router, &in, &out);
+        if (out.len > 0) {
+            if (writeAll(out_fd, out.data, out.len) != 0) {
+                break;
+            }
+            out.len = 0;
+        }
+        if (served < 0) {
+            fprintf(stderr, "bankd: malformed frame, closing connection\n");
+            break;
+        }
+    }
+
+    bankBufferFree(&in);
+    bankBufferFree(&out);
+}
+
+// Set by SIGUSR1; picked up by the housekeeping thread
+static volatile sig_atomic_t compact_requested = 0;
+
+static void requestCompaction(int sig) {
+    (void)sig;
+    compact_requested = 1;
+}
+
+// Clients are served throughout: only the first and last steps take the lock
+static void compactOnline(void) {
+    BankCompactStats stats;
+
+    pthread_mutex_lock(&bank_mutex);
+    int result = bankCompactBegin(&bank);
+    pthread_mutex_unlock(&bank_mutex);
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankd: compaction not started: %s\n", bankResultMessage(result));
+        return;
+    }
+
+    bankCompactCopy(&bank);
+
+    pthread_mutex_lock(&bank_mutex);
+    result = bankCompactFinish(&bank, &stats);
+    pthread_mutex_unlock(&bank_mutex);
+    if (result != BANK_OK) {
+        fprintf(stderr, "bankd: compaction failed, store unchanged: %s\n", bankResultMessage(result));
+        return;
+    }
+    fprintf(stderr, "bankd: compacted %ld records: %ld archived, %ld live, %ld copied again\n",
+            stats.scanned, stats.archived, stats.live, stats.recopied);
+}
+
+// Fires due standing orders once a second, between client batches, and runs
+// compactions requested with SIGUSR1
+static void *schedulerLoop(void *arg) {
+    (void)arg;
+    while (1) {
+        sleep(1);
+        pthread_mutex_lock(&bank_mutex);
+        bankRunDueOrders(&bank, (int64_t)time(NULL), NULL);
+        pthread_mutex_unlock(&bank_mutex);
+
+        if (compact_requested) {
+            compact_requested = 0;
+            compactOnline();
+        }
+    }
+    return NULL;
+}
+
+// Reports each resynchronisation the replication thread went through
+static void *replicaWatch(void *arg) {
+    const char *primary_path = arg;
+    BankReplicaStatus status;
+    uint64_t reported = 0;
+
+    while (1) {
+        sleep(1);
+        bankReplicaStatus(&bank, &status);
+        if (status.resyncs > reported) {
+            fprintf(stderr, "bankd: replication frame from %s not applied, resynchronising\n", primary_path);
+            reported = status.resyncs;
+        }
+    }
+    return NULL;
+}
+
+static double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Its requests still queued run all the same; their replies are dropped
+static void closeConnection(Connection *conn) {
+    epoll_ctl(conn->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    bankBufferFree(&conn->in);
+    bankBufferFree(&conn->out);
+    if (conn->queued > 0) {
+        conn->closed = 1;
+        return;
+    }
+    free(conn);
+}
+
+// Waits for writability while output is pending, and stops reading a client
+// that is not draining its replies or has enough requests queued already
+// (backpressure)
+static void updateInterest(Connection *conn) {
+    struct epoll_event ev;
+    uint32_t events = conn->eof ? 0 : EPOLLRDHUP;
+
+    if (!conn->eof && conn->out.len < OUTPUT_HIGH_WATER && conn->queued < ADMIT_CLIENT_QUEUED) {
+        events |= EPOLLIN;
+    }
+    if (conn->out.len > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events == conn->events) {
+        return;
+    }
+    conn->events = events;
+    ev.events = events;
+    ev.data.ptr = conn;
+    epoll_ctl(conn->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Writes as much of the pending output as the socket accepts
+static int flushConnection(Connection *conn) {
+    size_t off = 0;
+    while (off < conn->out.len) {
+        ssize_t n = write(conn->fd, conn->out.data + off, conn->out.len - off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    bankBufferConsume(&conn->out, off);
+    updateInterest(conn);
+    return 0;
+}
+
+static void reply(Connection *conn, const BankRequest *req, int status) {
+    BankResponse resp;
+
+    resp.tag = req->tag;
+    resp.status = (uint8_t)status;
+    resp.account_number = req->account_number;
+    resp.balance = 0.0;
+    bankEncodeResponse(&conn->out, &resp);
+}
+
+// Passes the client's buffered requests through admission control: each is
+// queued, or refused at once. Requests past the client's share of the queue,
+// or arriving faster than it takes its replies, stay buffered.
+static int admitConnection(EventLoop *loop, Connection *conn, double now) {
+    BankRequest req;
+    size_t offset = 0, used;
+    int rc = 0;
+
+    while (conn->queued < ADMIT_CLIENT_QUEUED && conn->out.len < OUTPUT_HIGH_WATER &&
+           (rc = bankDecodeRequest(conn->in.data + offset, conn->in.len - offset, &req, &used)) == 1) {
+        offset += used;
+        int result = admitCheck(&admission, &conn->bucket, &req, now);
+        if (result == BANK_OK) {
+            result = admitPush(&loop->queue, conn, &req, now);
+        }
+        if (result == BANK_OK) {
+            conn->queued++;
+        } else {
+            reply(conn, &req, result);
+        }
+    }
+    bankBufferConsume(&conn->in, offset);
+    return rc < 0 ? -1 : 0;
+}
+
+// Admits what the client has buffered and writes its replies, until neither
+// moves. Returns -1 once it is to be closed: on an error, a malformed frame,
+// or when it has hung up and everything it sent is answered.
+static int pumpConnection(EventLoop *loop, Connection *conn, double now) {
+    while (1) {
+        size_t buffered = conn->in.len;
+        int held = conn->out.len >= OUTPUT_HIGH_WATER;
+
+        if (buffered > 0 && admitConnection(loop, conn, now) != 0) {
+            fprintf(stderr, "bankd: malformed frame, closing connection\n");
+            flushConnection(conn);
+            return -1;
+        }
+        if (flushConnection(conn) != 0) {
+            return -1;
+        }
+        // Again only if replies held requests back and are all written now
+        if (conn->in.len == 0 || conn->out.len > 0 || conn->queued >= ADMIT_CLIENT_QUEUED ||
+            (conn->in.len == buffered && !held)) {
+            break;
+        }
+    }
+    return conn->eof && conn->queued == 0 && conn->out.len == 0 ? -1 : 0;
+}
+
+static int readConnection(EventLoop *loop, Connection *conn) {
+    int eof = 0;
+
+    while (1) {
+        if (bankBufferReserve(&conn->in, READ_CHUNK) != 0) {
+            return -1;
+        }
+        ssize_t n = read(conn->fd, conn->in.data + conn->in.len, conn->in.cap - conn->in.len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            eof = 1;
+            break;
+        }
+        conn->in.len += (size_t)n;
+        if ((size_t)n < READ_CHUNK) {
+            break;
+        }
+    }
+
+    conn->eof = eof;
+    return pumpConnection(loop, conn, monotonicSeconds());
+}
+
+// Runs a chunk of queued requests as one batch: against the store, or
+// through the loop's router
+static void executeChunk(EventLoop *loop, size_t count) {
+    size_t consumed, used, answered = 0;
+
+    if (loop->router == NULL) {
+        pthread_mutex_lock(&bank_mutex);
+        bankBeginBatch(&bank);
+        for (size_t i = 0; i < count; i++) {
+            bankExecuteRequest(&bank, &loop->chunk[i].req, &loop->replies[i]);
+        }
+        // What a batch that failed to commit reported done may not have been kept
+        if (bankCommitBatch(&bank) != BANK_OK) {
+            for (size_t i = 0; i < count; i++) {
+                if (loop->replies[i].status == BANK_OK) {
+                    loop->replies[i].status = BANK_ERR_IO;
+                }
+            }
+        }
+        pthread_mutex_unlock(&bank_mutex);
+        return;
+    }
+
+    loop->routed.len = 0;
+    loop->routed_replies.len = 0;
+    for (size_t i = 0; i < count; i++) {
+        bankEncodeRequest(&loop->routed, &loop->chunk[i].req);
+    }
+    if (routerServeBatch(loop->router, loop->routed.data, loop->routed.len, &consumed, &loop->routed_replies) > 0) {
+        // One reply per request, in order
+        for (size_t off = 0; answered < count && bankDecodeResponse(loop->routed_replies.data + off,
+                                                                    loop->routed_replies.len - off,
+                                                                    &loop->replies[answered], &used) == 1;
+             off += used) {
+            answered++;
+        }
+    }
+    for (; answered < count; answered++) {
+        BankResponse *resp = &loop->replies[answered];
+        resp->tag = loop->chunk[answered].req.tag;
+        resp->status = BANK_ERR_IO;
+        resp->account_number = loop->chunk[answered].req.account_number;
+        resp->balance = 0.0;
+    }
+}
+
+// Hands a reply to the connection that sent the request
+static void deliver(EventLoop *loop, AdmitEntry *entry, const BankResponse *resp) {
+    Connection *conn = entry->owner;
+
+    conn->queued--;
+    if (conn->closed) {
+        if (conn->queued == 0) {
+            free(conn);
+        }
+        return;
+    }
+    if (resp != NULL) {
+        bankEncodeResponse(&conn->out, resp);
+    } else {
+        reply(conn, &entry->req, BANK_ERR_OVERLOADED);
+    }
+    if (!conn->touched) {
+        conn->touched = 1;
+        loop->touched[loop->touched_count++] = conn;
+    }
+}
+
+// Writes the replies of a chunk and takes in what clients held back while
+// their requests were queued
+static void flushTouched(EventLoop *loop, double now) {
+    for (size_t i = 0; i < loop->touched_count; i++) {
+        Connection *conn = loop->touched[i];
+
+        conn->touched = 0;
+        if (pumpConnection(loop, conn, now) != 0) {
+            closeConnection(conn);
+        }
+    }
+    loop->touched_count = 0;
+}
+
+// Serves one chunk of the loop's queues, interactive requests first. The
+// loop polls its clients between chunks, so a request arriving behind a
+// long batch queue still goes next, and loops take turns at the store.
+// Returns the requests taken off the queues.
+static size_t serveChunk(EventLoop *loop) {
+    double now = monotonicSeconds();
+    size_t limit = loop->router != NULL ? ROUTED_CHUNK : SERVE_CHUNK;
+    size_t count = 0, late = 0;
+    int outcome;
+
+    while (count < limit && loop->touched_count + count < limit &&
+           (outcome = admitPop(&loop->queue, now, &loop->chunk[count])) != ADMIT_EMPTY) {
+        if (outcome == ADMIT_LATE) {
+            deliver(loop, &loop->chunk[count], NULL);
+            late++;
+        } else {
+            count++;
+        }
+    }
+    if (count > 0) {
+        executeChunk(loop, count);
+    }
+    for (size_t i = 0; i < count; i++) {
+        deliver(loop, &loop->chunk[i], &loop->replies[i]);
+    }
+    flushTouched(loop, now);
+    return count + late;
+}
+
+// Shed requests since the last report, from one loop
+static void reportShed(EventLoop *loop, double now) {
+    AdmitStats stats;
+
+    if (!loop->reporter || now < loop->next_report) {
+        return;
+    }
+    loop->next_report = now + SHED_REPORT_SECONDS;
+    admitStatsRead(&admission, &stats);
+    if (admitShed(&stats) != admitShed(&loop->reported)) {
+        const AdmitStats *last = &loop->reported;
+        fprintf(stderr,
+                "bankd: shed %llu requests: %llu over the client rate, %llu over an account's, "
+                "%llu with the queue full, %llu waited too long; %llu admitted\n",
+                (unsigned long long)(admitShed(&stats) - admitShed(last)),
+                (unsigned long long)(stats.shed_client - last->shed_client),
+                (unsigned long long)(stats.shed_account - last->shed_account),
+                (unsigned long long)(stats.shed_queue - last->shed_queue),
+                (unsigned long long)(stats.shed_late - last->shed_late),
+                (unsigned long long)(stats.admitted - last->admitted));
+    }
+    loop->reported = stats;
+}
+
+static void acceptClients(EventLoop *loop) {
+    while (1) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // EAGAIN: another loop took it, or the backlog is empty
+        }
+
+        Connection *conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->epfd = loop->epfd;
+        conn->router = loop->router;
+        bankBufferInit(&conn->in);
+        bankBufferInit(&conn->out);
+        admitClientInit(&admission, &conn->bucket, monotonicSeconds());
+
+        struct epoll_event ev;
+        conn->events = EPOLLIN | EPOLLRDHUP;
+        ev.events = conn->events;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+// One event loop: the listener is shared by every loop with EPOLLEXCLUSIVE so a
+// new client wakes a single thread, which then owns the connection. `arg` is
+// the loop's router when the bank is sharded. Each wakeup admits what the
+// ready clients sent, then serves the loop's queues.
+static void *eventLoop(void *arg) {
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event ev;
+    EventLoop *loop = calloc(1, sizeof(EventLoop));
+    size_t served = 0;
+
+    if (loop == NULL || admitQueueInit(&loop->queue, &admission) != 0) {
+        perror("bankd: event loop");
+        free(loop);
+        return NULL;
+    }
+    loop->router = arg;
+    loop->reporter = __atomic_fetch_add(&loops_started, 1, __ATOMIC_RELAXED) == 0;
+    loop->next_report = monotonicSeconds() + SHED_REPORT_SECONDS;
+    bankBufferInit(&loop->routed);
+    bankBufferInit(&loop->routed_replies);
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        perror("bankd: epoll_create1");
+        admitQueueFree(&loop->queue);
+        free(loop);
+        return NULL;
+    }
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, listen_fd, &ev) != 0) {
+        perror("bankd: epoll_ctl");
+        close(loop->epfd);
+        admitQueueFree(&loop->queue);
+        free(loop);
+        return NULL;
+    }
+
+    while (1) {
+        // Queued work only polls for clients; batch work held back for other
+        // loops' interactive requests is retried shortly
+        int timeout = !admitPending(&loop->queue) ? SHED_REPORT_SECONDS * 1000 : served > 0 ? 0 : 1;
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            Connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                acceptClients(loop);
+                continue;
+            }
+
+            int failed = 0;
+            if (events[i].events & EPOLLOUT) {
+                failed = pumpConnection(loop, conn, monotonicSeconds()) != 0;
+            }
+            if (!failed && (events[i].events & EPOLLIN)) {
+                failed = readConnection(loop, conn) != 0;
+            }
+            if (failed || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+                closeConnection(conn);
+            }
+        }
+        served = serveChunk(loop);
+        reportShed(loop, monotonicSeconds());
+    }
+
+    close(loop->epfd);
+    admitQueueFree(&loop->queue);
+    bankBufferFree(&loop->routed);
+    bankBufferFree(&loop->routed_replies);
+    free(loop);
+    return NULL;
+}
+
+static int listenUnix(const char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Serves clients on stdin/stdout, or on the socket with `threads` event
+// loops. `routers` holds a router per loop when the bank is sharded.
+static int serveClients(BankRouter *routers, const char *socket_path, int threads) {
+    pthread_t workers[MAX_THREADS];
+
+    if (socket_path == NULL) {
+        serveStream(routers, STDIN_FILENO, STDOUT_FILENO);
+        return 0;
+    }
+
+    listen_fd = listenUnix(socket_path);
+    if (listen_fd < 0) {
+        perror("bankd: listen");
+        return 1;
+    }
+    fprintf(stderr, "bankd: listening on %s with %d event loop(s)\n", socket_path, threads);
+
+    for (int i = 1; i < threads; i++) {
+        pthread_create(&workers[i], NULL, eventLoop, routers != NULL ? &routers[i] : NULL);
+    }
+    eventLoop(routers != NULL ? &routers[0] : NULL);
+    for (int i = 1; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    close(listen_fd);
+    return 0;
+}
+
+// SIGUSR1 sent to the router compacts every shard
+static void forwardToShards(int sig) {
+    for (int k = 0; k < shard_count; k++) {
+        kill(shard_pids[k], sig);
+    }
+}
+
+// Forks a server per shard. Returns the shard a child is to serve, or -1 in
+// the parent; the children are stopped when the parent exits.
+static int startShards(int shards) {
+    for (int k = 0; k < shards; k++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            return k;
+        }
+        if (pid < 0) {
+            perror("bankd: fork");
+            break;
+        }
+        shard_pids[shard_count++] = pid;
+    }
+    return -1;
+}
+
+static int serveRouted(const char *dir, int shards, const char *socket_path, int threads) {
+    char path[BANK_PATH_LENGTH + 32];
+    int instances = socket_path != NULL ? threads : 1;
+    BankRouter *routers = calloc((size_t)instances, sizeof(BankRouter));
+
+    if (routers == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < instances; i++) {
+        if (routerOpen(&routers[i], shards, dir, i, SHARD_START_SECONDS) != BANK_OK) {
+            fprintf(stderr, "bankd: shard servers in %s unreachable\n", dir);
+            while (i-- > 0) {
+                routerClose(&routers[i]);
+            }
+            free(routers);
+            return 1;
+        }
+    }
+    // Transfers left in flight by router instances this run does not start
+    for (int i = instances; i < MAX_THREADS; i++) {
+        snprintf(path, sizeof(path), ROUTER_LOG, dir, i);
+        routerRecover(&routers[0], path);
+    }
+    signal(SIGUSR1, forwardToShards);
+
+    int result = serveClients(routers, socket_path, threads);
+    for (int i = 0; i < instances; i++) {
+        routerClose(&routers[i]);
+    }
+    free(routers);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    const char *socket_path = NULL;
+    const char *data_dir = NULL;
+    const char *accounts_path = NULL;
+    const char *log_path = NULL;
+    const char *replicate_path = NULL;
+    const char *primary_path = NULL;
+    const char *trace_path = NULL;
+    char shard_dir[BANK_PATH_LENGTH];
+    char shard_socket[BANK_PATH_LENGTH + 32];
+    int storage = STORAGE_FILE;
+    int threads = 2;
+    int use_uring = 0;
+    int routed = 0;
+    int shard = -1, shards = 0;
+    RulesAction rules = RULES_REJECT;
+    AdmitConfig admit;
+
+    admitDefaults(&admit);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            use_uring = 1;
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "reject") == 0) {
+                rules = RULES_REJECT;
+            } else if (strcmp(mode, "flag") == 0) {
+                rules = RULES_FLAG;
+            } else if (strcmp(mode, "off") == 0) {
+                rules = RULES_OFF;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--data-dir") == 0 && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (strcmp(argv[i], "--storage") == 0 && i + 1 < argc) {
+            storage = storageKindFromName(argv[++i]);
+            if (storage < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--accounts") == 0 && i + 1 < argc) {
+            accounts_path = argv[++i];
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shards = atoi(argv[++i]);
+            routed = 1;
+        } else if (strcmp(argv[i], "--replicate") == 0 && i + 1 < argc) {
+            replicate_path = argv[++i];
+        } else if (strcmp(argv[i], "--replica-of") == 0 && i + 1 < argc) {
+            primary_path = argv[++i];
+        } else if (strcmp(argv[i], "--client-rate") == 0 && i + 1 < argc) {
+            admit.client_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--account-rate") == 0 && i + 1 < argc) {
+            admit.account_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+            admit.queue_limit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d/%d", &shard, &shards) != 2) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (threads < 1 || threads > MAX_THREADS || shards < 0 || shards > SHARD_MAX || admit.client_rate < 0 ||
+        admit.account_rate < 0 || admit.queue_limit < 1 ||
+        (routed && (shard >= 0 || shards < 1 || accounts_path != NULL)) ||
+        (shard >= 0 && shard >= shards) || (routed && (replicate_path != NULL || trace_path != NULL)) ||
+        (primary_path != NULL && (replicate_path != NULL || shards > 0 || use_uring))) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, requestCompaction);
+
+    // One server per shard, each with its store in a directory of its own,
+    // and the router in this process
+    if (routed) {
+        const char *dir = data_dir != NULL ? data_dir : getenv(BANK_DATA_DIR_ENV);
+        if (dir == NULL || dir[0] == '\0') {
+            dir = ".";
+        }
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            perror("bankd: data directory");
+            return 1;
+        }
+        shard = startShards(shards);
+        if (shard < 0) {
+            if (admitInit(&admission, &admit) != 0) {
+                fprintf(stderr, "bankd: out of memory\n");
+                return 1;
+            }
+            return serveRouted(dir, shards, socket_path, threads);
+        }
+        // Clients and accounts are rate limited by the router; a shard's one
+        // client is the router
+        admit.client_rate = 0;
+        admit.account_rate = 0;
+        snprintf(shard_dir, sizeof(shard_dir), ROUTER_SHARD_DIR, dir, shard);
+        snprintf(shard_socket, sizeof(shard_socket), ROUTER_SHARD_SOCKET, dir, shard);
+        data_dir = shard_dir;
+        socket_path = shard_socket;
+    }
+    srand(time(NULL) ^ (getpid() << 8));
+
+    if (admitInit(&admission, &admit) != 0) {
+        fprintf(stderr, "bankd: out of memory\n");
+        return 1;
+    }
+
+    int opened = accounts_path != NULL ? bankOpenStorage(&bank, (StorageKind)storage, accounts_path, log_path)
+                                       : bankOpenDir(&bank, (StorageKind)storage, data_dir);
+    if (opened != BANK_OK) {
+        fprintf(stderr, "bankd: %s\n", bankResultMessage(opened));
+        return 1;
+    }
+    if (shard >= 0) {
+        bankSetShard(&bank, shard, shards);
+    }
+    if (trace_path != NULL && bankTraceStart(&bank, trace_path) != BANK_OK) {
+        fprintf(stderr, "bankd: cannot write the trace to %s\n", trace_path);
+        bankClose(&bank);
+        return 1;
+    }
+    bank.rules.config.action = rules;
+    if (use_uring && bankAttachUring(&bank, URING_ENTRIES) != BANK_OK) {
+        fprintf(stderr, "bankd: io_uring unavailable, using synchronous I/O\n");
+    }
+
+    if (replicate_path != NULL && bankReplicationListen(&bank, replicate_path, &bank_mutex) != BANK_OK) {
+        fprintf(stderr, "bankd: cannot listen for replicas on %s (is the store open elsewhere?)\n",
+                replicate_path);
+        bankClose(&bank);
+        return 1;
+    }
+    if (primary_path != NULL && bankReplicaFollow(&bank, primary_path, &bank_mutex) != BANK_OK) {
+        fprintf(stderr, "bankd: cannot follow %s\n", primary_path);
+        bankClose(&bank);
+        return 1;
+    }
+
+    // A replica changes nothing itself: standing orders and compactions run
+    // on its primary and arrive with the stream, so its thread only watches
+    // the replication
+    pthread_t scheduler;
+    if (pthread_create(&scheduler, NULL, primary_path == NULL ? schedulerLoop : replicaWatch,
+                       (void *)primary_path) == 0) {
+        pthread_detach(scheduler);
+    }
+
+    int result = serveClients(NULL, socket_path, threads);
+    bankClose(&bank);
+    return result;
+}
@@ -1,1380 +1,1344 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <time.h>
-
-#ifdef _WIN32
-    #include <conio.h>  // For _getch() on Windows
-#endif
-
-#define FILENAME "bank_accounts.dat"
-#define TRANSACTION_LOG "transactions.log"
-#define MAX_ACCOUNTS 10000
-#define MIN_ACCOUNT_NUMBER 100000
-#define MAX_ACCOUNT_NUMBER 999999
-#define MIN_BALANCE 0
-#define MAX_NAME_LENGTH 100
-#define PASSWORD_LENGTH 50
-#define HASH_LENGTH 65  // SHA-256 produces 64 hex characters + null terminator
-#define MAX_LOGIN_ATTEMPTS 3
-
-// Platform-specific clear screen
-#ifdef _WIN32
-    #define CLEAR_SCREEN "cls"
-#else
-    #define CLEAR_SCREEN "clear"
-#endif
-
-// ANSI Color codes for better UI (works on most modern terminals)
-#define COLOR_RESET   "\x1b[0m"
-#define COLOR_RED     "\x1b[31m"
-#define COLOR_GREEN   "\x1b[32m"
-#define COLOR_YELLOW  "\x1b[33m"
-#define COLOR_BLUE    "\x1b[34m"
-#define COLOR_MAGENTA "\x1b[35m"
-#define COLOR_CYAN    "\x1b[36m"
-#define COLOR_WHITE   "\x1b[37m"
-#define COLOR_BOLD    "\x1b[1m"
-
-// Account status
-typedef enum {
-    ACCOUNT_ACTIVE = 1,
-    ACCOUNT_SUSPENDED = 0,
-    ACCOUNT_CLOSED = -1
-} AccountStatus;
-
-// Transaction types
-typedef enum {
-    TRANSACTION_DEPOSIT,
-    TRANSACTION_WITHDRAWAL,
-    TRANSACTION_TRANSFER_OUT,
-    TRANSACTION_TRANSFER_IN,
-    TRANSACTION_ACCOUNT_CREATED
-} TransactionType;
-
-// Account structure
-typedef struct {
-    int account_number;
-    char name[MAX_NAME_LENGTH];
-    char email[MAX_NAME_LENGTH];
-    char phone[20];
-    double balance;
-    char password_hash[HASH_LENGTH];  // Changed to store hash
-    AccountStatus status;
-    time_t created_date;
-    time_t last_accessed;
-    int failed_login_attempts;
-} Account;
-
-// Transaction structure
-typedef struct {
-    int transaction_id;
-    int account_number;
-    TransactionType type;
-    double amount;
-    double balance_after;
-    int related_account;  // For transfers
-    time_t timestamp;
-    char description[100];
-} Transaction;
-
-// Function prototypes
-void showWelcomeScreen();
-void showMainMenu();
-void createAccount();
-void depositMoney();
-void withdrawMoney();
-void checkBalance();
-void transferFunds();
-void displayAllAccounts();
-void viewAccountDetails();
-void changePassword();
-void viewTransactionHistory();
-void generateAccountStatement();
-
-// Utility functions
-long findAccount(int account_number);
-int authenticateAccount(int account_number, int max_attempts);
-void logTransaction(int account_number, TransactionType type, double amount,
-                   double balance_after, int related_account, const char *description);
-int generateAccountNumber();
-void getCurrentDateTime(char *buffer);
-
-// Password hashing functions
-void sha256_hash(const char *input, char *output);
-void simple_hash(const char *password, char *hash_output);
-
-// Input validation functions
-int getIntInput(const char *prompt, int min, int max);
-double getDoubleInput(const char *prompt, double min, double max);
-void getStringInput(const char *prompt, char *buffer, int max_length);
-void getEmailInput(const char *prompt, char *buffer, int max_length);
-void getPhoneInput(const char *prompt, char *buffer, int max_length);
-void getPasswordInput(const char *prompt, char *buffer, int max_length);
-int validateEmail(const char *email);
-int validatePhone(const char *phone);
-
-// UI functions
-void clearInputBuffer();
-void initializeFile();
-void clearScreen();
-void pauseScreen();
-void printHeader(const char *title);
-void printSeparator(char c, int length);
-void printSuccess(const char *message);
-void printError(const char *message);
-void printWarning(const char *message);
-void printInfo(const char *message);
-
-// Simple SHA-256 implementation for password hashing
-void simple_hash(const char *password, char *hash_output) {
-    // This is a simplified hash function for demonstration
-    // In production, use a proper library like OpenSSL or libsodium
-    unsigned long hash = 5381;
-    int c;
-    const char *str = password;
-
-    // DJB2 hash algorithm (simple but effective for demonstration)
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c;
-    }
-
-    // Add a salt-like component based on password length and characters
-    unsigned long salt = 0;
-    for (int i = 0; password[i] != '\0'; i++) {
-        salt += (unsigned char)password[i] * (i + 1);
-    }
-    hash ^= salt;
-
-    // Convert to hex string (64 characters to simulate SHA-256 length)
-    snprintf(hash_output, HASH_LENGTH, "%016lx%016lx%016lx%016lx",
-             hash, hash ^ 0xDEADBEEF, hash ^ 0xCAFEBABE, hash ^ 0xFEEDFACE);
-}
-
-int main() {
-    int choice;
-
-    // Initialize random seed once
-    srand(time(NULL));
-
-    // Initialize files
-    initializeFile();
-
-    showWelcomeScreen();
-
-    while (1) {
-        showMainMenu();
-
-        if (scanf("%d", &choice) != 1) {
-            clearInputBuffer();
-            printError("Invalid input! Please enter a number.");
-            pauseScreen();
-            continue;
-        }
-        clearInputBuffer();
-
-        switch (choice) {
-            case 1:
-                clearScreen();
-                createAccount();
-                pauseScreen();
-                break;
-            case 2:
-                clearScreen();
-                depositMoney();
-                pauseScreen();
-                break;
-            case 3:
-                clearScreen();
-                withdrawMoney();
-                pauseScreen();
-                break;
-            case 4:
-                clearScreen();
-                checkBalance();
-                pauseScreen();
-                break;
-            case 5:
-                clearScreen();
-                transferFunds();
-                pauseScreen();
-                break;
-            case 6:
-                clearScreen();
-                viewAccountDetails();
-                pauseScreen();
-                break;
-            case 7:
-                clearScreen();
-                changePassword();
-                pauseScreen();
-                break;
-            case 8:
-                clearScreen();
-                viewTransactionHistory();
-                pauseScreen();
-                break;
-            case 9:
-                clearScreen();
-                generateAccountStatement();
-                pauseScreen();
-                break;
-            case 10:
-                clearScreen();
-                displayAllAccounts();
-                pauseScreen();
-                break;
-            case 0:
-                clearScreen();
-                printHeader("THANK YOU");
-                printf("\n");
-                printInfo("Thank you for banking with us!");
-                printInfo("Your security is our priority.");
-                printf("\n");
-                printSeparator('=', 60);
-                printf("\n");
-                exit(0);
-            default:
-                printError("Invalid choice! Please select a valid option.");
-                pauseScreen();
-        }
-    }
-
-    return 0;
-}
-
-void showWelcomeScreen() {
-    clearScreen();
-    printf("\n");
-    printSeparator('=', 70);
-    printf("\n");
-    printf("%s%s", COLOR_CYAN, COLOR_BOLD);
-    printf("               PROFESSIONAL BANKING MANAGEMENT SYSTEM\n");
-    printf("%s", COLOR_RESET);
-    printSeparator('=', 70);
-    printf("\n\n");
-    printf("%s", COLOR_YELLOW);
-    printf("                    Secure And Reliable\n");
-    printf("%s", COLOR_RESET);
-    printf("\n");
-    printInfo("System initializing with enhanced security...");
-    printf("\n");
-    time_t now = time(NULL);
-    char datetime[50];
-    strftime(datetime, sizeof(datetime), "%A, %B %d, %Y - %I:%M %p", localtime(&now));
-    printf("                    %s\n", datetime);
-    printf("\n");
-    printSeparator('=', 70);
-    printf("\n");
-    pauseScreen();
-}
-
-void showMainMenu() {
-    clearScreen();
-    printHeader("MAIN MENU");
-    printf("\n");
-    printf("  %s[ACCOUNT OPERATIONS]%s\n", COLOR_CYAN, COLOR_RESET);
-    printf("  1. Create New Account\n");
-    printf("  2. Deposit Money\n");
-    printf("  3. Withdraw Money\n");
-    printf("  4. Check Balance\n");
-    printf("  5. Transfer Funds\n");
-    printf("\n");
-    printf("  %s[ACCOUNT MANAGEMENT]%s\n", COLOR_CYAN, COLOR_RESET);
-    printf("  6. View Account Details\n");
-    printf("  7. Change Password\n");
-    printf("  8. Transaction History\n");
-    printf("  9. Generate Statement\n");
-    printf("\n");
-    printf("  %s[ADMINISTRATION]%s\n", COLOR_CYAN, COLOR_RESET);
-    printf("  10. Display All Accounts (Admin)\n");
-    printf("\n");
-    printf("  %s0. Exit%s\n", COLOR_RED, COLOR_RESET);
-    printf("\n");
-    printSeparator('-', 60);
-    printf("\n%sEnter your choice:%s ", COLOR_BOLD, COLOR_RESET);
-}
-
-void clearScreen() {
-    system(CLEAR_SCREEN);
-}
-
-void pauseScreen() {
-    printf("\n");
-    printSeparator('-', 60);
-    printf("\n%sPress Enter to continue...%s", COLOR_YELLOW, COLOR_RESET);
-    getchar();
-}
-
-void printHeader(const char *title) {
-    printSeparator('=', 60);
-    printf("\n");
-    printf("%s%s", COLOR_BOLD, COLOR_CYAN);
-    int padding = (60 - strlen(title)) / 2;
-    for (int i = 0; i < padding; i++) printf(" ");
-    printf("%s\n", title);
-    printf("%s", COLOR_RESET);
-    printSeparator('=', 60);
-}
-
-void printSeparator(char c, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", c);
-    }
-    printf("\n");
-}
-
-void printSuccess(const char *message) {
-    printf("%s%s%s\n", COLOR_GREEN, message, COLOR_RESET);
-}
-
-void printError(const char *message) {
-    printf("%sERROR: %s%s\n", COLOR_RED, message, COLOR_RESET);
-}
-
-void printWarning(const char *message) {
-    printf("%sWARNING: %s%s\n", COLOR_YELLOW, message, COLOR_RESET);
-}
-
-void printInfo(const char *message) {
-    printf("%s%s%s\n", COLOR_BLUE, message, COLOR_RESET);
-}
-
-void initializeFile() {
-    FILE *file = fopen(FILENAME, "ab");
-    if (file != NULL) {
-        fclose(file);
-    }
-
-    FILE *log = fopen(TRANSACTION_LOG, "a");
-    if (log != NULL) {
-        fclose(log);
-    }
-}
-
-int generateAccountNumber() {
-    int account_number;
-    do {
-        account_number = MIN_ACCOUNT_NUMBER + (rand() % (MAX_ACCOUNT_NUMBER - MIN_ACCOUNT_NUMBER + 1));
-    } while (findAccount(account_number) != -1);
-
-    return account_number;
-}
-
-void createAccount() {
-    Account new_account;
-    FILE *file;
-    char password[PASSWORD_LENGTH];
-
-    printHeader("CREATE NEW ACCOUNT");
-    printf("\n");
-
-    // Generate unique account number
-    new_account.account_number = generateAccountNumber();
-
-    // Get account holder details
-    getStringInput("Full Name: ", new_account.name, MAX_NAME_LENGTH);
-    getEmailInput("Email Address: ", new_account.email, MAX_NAME_LENGTH);
-    getPhoneInput("Phone Number: ", new_account.phone, 20);
-
-    // Set initial values
-    new_account.balance = 0.0;
-    new_account.status = ACCOUNT_ACTIVE;
-    new_account.created_date = time(NULL);
-    new_account.last_accessed = time(NULL);
-    new_account.failed_login_attempts = 0;
-
-    printf("\n");
-    printInfo("Setting up secure password...");
-    getPasswordInput("Set Password (min 6 characters): ", password, PASSWORD_LENGTH);
-
-    if (strlen(password) < 6) {
-        printError("Password must be at least 6 characters long!");
-        return;
-    }
-
-    // Hash the password before storing
-    simple_hash(password, new_account.password_hash);
-    printSuccess("Password encrypted successfully!");
-
-    // Open file in append binary mode
-    file = fopen(FILENAME, "ab");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    // Write account to file
-    if (fwrite(&new_account, sizeof(Account), 1, file) == 1) {
-        fclose(file);
-
-        // Log transaction
-        logTransaction(new_account.account_number, TRANSACTION_ACCOUNT_CREATED,
-                      0.0, 0.0, 0, "Account created");
-
-        printf("\n");
-        printSeparator('=', 60);
-        printf("\n");
-        printSuccess("ACCOUNT CREATED SUCCESSFULLY!");
-        printf("\n");
-        printSeparator('-', 60);
-        printf("\n");
-        printf("  %sAccount Number:%s %d\n", COLOR_BOLD, COLOR_RESET, new_account.account_number);
-        printf("  %sAccount Holder:%s %s\n", COLOR_BOLD, COLOR_RESET, new_account.name);
-        printf("  %sEmail:%s %s\n", COLOR_BOLD, COLOR_RESET, new_account.email);
-        printf("  %sPhone:%s %s\n", COLOR_BOLD, COLOR_RESET, new_account.phone);
-        printf("  %sInitial Balance:%s $%.2f\n", COLOR_BOLD, COLOR_RESET, new_account.balance);
-        printf("  %sAccount Status:%s Active\n", COLOR_BOLD, COLOR_RESET);
-        printf("  %sSecurity:%s Password encrypted with hash\n", COLOR_BOLD, COLOR_RESET);
-
-        char date_str[50];
-        strftime(date_str, sizeof(date_str), "%Y-%m-%d %H:%M:%S",
-                localtime(&new_account.created_date));
-        printf("  %sCreated On:%s %s\n", COLOR_BOLD, COLOR_RESET, date_str);
-        printf("\n");
-        printSeparator('-', 60);
-        printf("\n");
-        printWarning("IMPORTANT: Please remember your account number and password!");
-        printInfo("Keep your credentials secure and confidential.");
-    } else {
-        fclose(file);
-        printError("Unable to create account!");
-    }
-}
-
-void depositMoney() {
-    int account_number;
-    double amount;
-    Account account;
-    FILE *file;
-    long position;
-
-    printHeader("DEPOSIT MONEY");
-    printf("\n");
-
-    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
-        printError("Authentication failed!");
-        return;
-    }
-
-    position = findAccount(account_number);
-    if (position == -1) {
-        printError("Account not found!");
-        return;
-    }
-
-    amount = getDoubleInput("\nDeposit Amount: $", 0.01, 1000000.0);
-
-    // Open file for reading and writing
-    file = fopen(FILENAME, "r+b");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, position, SEEK_SET);
-    fread(&account, sizeof(Account), 1, file);
-
-    double old_balance = account.balance;
-    account.balance += amount;
-    account.last_accessed = time(NULL);
-
-    fseek(file, position, SEEK_SET);
-    fwrite(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    // Log transaction
-    logTransaction(account_number, TRANSACTION_DEPOSIT, amount,
-                  account.balance, 0, "Cash deposit");
-
-    printf("\n");
-    printSeparator('=', 60);
-    printf("\n");
-    printSuccess("DEPOSIT SUCCESSFUL!");
-    printf("\n");
-    printSeparator('-', 60);
-    printf("\n");
-    printf("  Transaction Type:    Deposit\n");
-    printf("  Amount Deposited:    %s$%.2f%s\n", COLOR_GREEN, amount, COLOR_RESET);
-    printf("  Previous Balance:    $%.2f\n", old_balance);
-    printf("  Current Balance:     %s$%.2f%s\n", COLOR_BOLD, account.balance, COLOR_RESET);
-
-    char datetime[50];
-    getCurrentDateTime(datetime);
-    printf("  Transaction Time:    %s\n", datetime);
-    printf("\n");
-    printSeparator('=', 60);
-}
-
-void withdrawMoney() {
-    int account_number;
-    double amount;
-    Account account;
-    FILE *file;
-    long position;
-
-    printHeader("WITHDRAW MONEY");
-    printf("\n");
-
-    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
-        printError("Authentication failed!");
-        return;
-    }
-
-    position = findAccount(account_number);
-    if (position == -1) {
-        printError("Account not found!");
-        return;
-    }
-
-    file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, position, SEEK_SET);
-    fread(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    printf("\nAvailable Balance: %s$%.2f%s\n", COLOR_BOLD, account.balance, COLOR_RESET);
-
-    if (account.balance <= 0) {
-        printError("Insufficient funds! Cannot withdraw.");
-        return;
-    }
-
-    amount = getDoubleInput("Withdrawal Amount: $", 0.01, account.balance);
-
-    if (amount > account.balance) {
-        printError("Insufficient funds!");
-        return;
-    }
-
-    file = fopen(FILENAME, "r+b");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    double old_balance = account.balance;
-    account.balance -= amount;
-    account.last_accessed = time(NULL);
-
-    fseek(file, position, SEEK_SET);
-    fwrite(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    // Log transaction
-    logTransaction(account_number, TRANSACTION_WITHDRAWAL, amount,
-                  account.balance, 0, "Cash withdrawal");
-
-    printf("\n");
-    printSeparator('=', 60);
-    printf("\n");
-    printSuccess("WITHDRAWAL SUCCESSFUL!");
-    printf("\n");
-    printSeparator('-', 60);
-    printf("\n");
-    printf("  Transaction Type:    Withdrawal\n");
-    printf("  Amount Withdrawn:    %s$%.2f%s\n", COLOR_RED, amount, COLOR_RESET);
-    printf("  Previous Balance:    $%.2f\n", old_balance);
-    printf("  Current Balance:     %s$%.2f%s\n", COLOR_BOLD, account.balance, COLOR_RESET);
-
-    char datetime[50];
-    getCurrentDateTime(datetime);
-    printf("  Transaction Time:    %s\n", datetime);
-    printf("\n");
-    printSeparator('=', 60);
-}
-
-void checkBalance() {
-    int account_number;
-    Account account;
-    FILE *file;
-    long position;
-
-    printHeader("BALANCE INQUIRY");
-    printf("\n");
-
-    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
-        printError("Authentication failed!");
-        return;
-    }
-
-    position = findAccount(account_number);
-    if (position == -1) {
-        printError("Account not found!");
-        return;
-    }
-
-    file = fopen(FILENAME, "r+b");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, position, SEEK_SET);
-    fread(&account, sizeof(Account), 1, file);
-
-    account.last_accessed = time(NULL);
-    fseek(file, position, SEEK_SET);
-    fwrite(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    printf("\n");
-    printSeparator('=', 60);
-    printf("\n");
-    printf("%s           ACCOUNT BALANCE DETAILS%s\n", COLOR_BOLD, COLOR_RESET);
-    printf("\n");
-    printSeparator('-', 60);
-    printf("\n");
-    printf("  Account Number:      %d\n", account.account_number);
-    printf("  Account Holder:      %s\n", account.name);
-    printf("  Current Balance:     %s$%.2f%s\n", COLOR_GREEN, account.balance, COLOR_RESET);
-    printf("  Account Status:      %sActive%s\n", COLOR_GREEN, COLOR_RESET);
-
-    char datetime[50];
-    getCurrentDateTime(datetime);
-    printf("  Query Time:          %s\n", datetime);
-    printf("\n");
-    printSeparator('=', 60);
-}
-
-void transferFunds() {
-    int from_account, to_account;
-    double amount;
-    Account from_acc, to_acc;
-    FILE *file;
-    long from_position, to_position;
-
-    printHeader("FUND TRANSFER");
-    printf("\n");
-
-    from_account = getIntInput("Your Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    if (!authenticateAccount(from_account, MAX_LOGIN_ATTEMPTS)) {
-        printError("Authentication failed!");
-        return;
-    }
-
-    from_position = findAccount(from_account);
-    if (from_position == -1) {
-        printError("Your account not found!");
-        return;
-    }
-
-    to_account = getIntInput("\nRecipient Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    to_position = findAccount(to_account);
-    if (to_position == -1) {
-        printError("Recipient account not found!");
-        return;
-    }
-
-    if (from_account == to_account) {
-        printError("Cannot transfer to the same account!");
-        return;
-    }
-
-    file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, from_position, SEEK_SET);
-    fread(&from_acc, sizeof(Account), 1, file);
-
-    fseek(file, to_position, SEEK_SET);
-    fread(&to_acc, sizeof(Account), 1, file);
-    fclose(file);
-
-    printf("\nYour Available Balance: %s$%.2f%s\n", COLOR_BOLD, from_acc.balance, COLOR_RESET);
-    printf("Recipient: %s%s%s\n", COLOR_CYAN, to_acc.name, COLOR_RESET);
-
-    amount = getDoubleInput("\nTransfer Amount: $", 0.01, from_acc.balance);
-
-    if (amount > from_acc.balance) {
-        printError("Insufficient funds!");
-        return;
-    }
-
-    // Confirmation
-    printf("\n");
-    printWarning("Please confirm the transfer details:");
-    printf("  Transfer Amount: $%.2f\n", amount);
-    printf("  To: %s (Account: %d)\n", to_acc.name, to_account);
-    printf("\nConfirm transfer? (Y/N): ");
-
-    char confirm;
-    scanf(" %c", &confirm);
-    clearInputBuffer();
-
-    if (confirm != 'Y' && confirm != 'y') {
-        printWarning("Transfer cancelled by user.");
-        return;
-    }
-
-    double old_from_balance = from_acc.balance;
-    double old_to_balance = to_acc.balance;
-
-    from_acc.balance -= amount;
-    to_acc.balance += amount;
-    from_acc.last_accessed = time(NULL);
-    to_acc.last_accessed = time(NULL);
-
-    file = fopen(FILENAME, "r+b");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, from_position, SEEK_SET);
-    fwrite(&from_acc, sizeof(Account), 1, file);
-
-    fseek(file, to_position, SEEK_SET);
-    fwrite(&to_acc, sizeof(Account), 1, file);
-    fclose(file);
-
-    // Log transactions
-    char desc[100];
-    snprintf(desc, sizeof(desc), "Transfer to account %d", to_account);
-    logTransaction(from_account, TRANSACTION_TRANSFER_OUT, amount,
-                  from_acc.balance, to_account, desc);
-
-    snprintf(desc, sizeof(desc), "Transfer from account %d", from_account);
-    logTransaction(to_account, TRANSACTION_TRANSFER_IN, amount,
-                  to_acc.balance, from_account, desc);
-
-    printf("\n");
-    printSeparator('=', 60);
-    printf("\n");
-    printSuccess("TRANSFER SUCCESSFUL!");
-    printf("\n");
-    printSeparator('-', 60);
-    printf("\n");
-    printf("  Transaction Type:    Fund Transfer\n");
-    printf("  Amount Transferred:  %s$%.2f%s\n", COLOR_YELLOW, amount, COLOR_RESET);
-    printf("  From Account:        %d\n", from_account);
-    printf("  To Account:          %d (%s)\n", to_account, to_acc.name);
-    printf("  Your Previous Bal:   $%.2f\n", old_from_balance);
-    printf("  Your Current Bal:    %s$%.2f%s\n", COLOR_BOLD, from_acc.balance, COLOR_RESET);
-
-    char datetime[50];
-    getCurrentDateTime(datetime);
-    printf("  Transaction Time:    %s\n", datetime);
-    printf("\n");
-    printSeparator('=', 60);
-}
-
-void viewAccountDetails() {
-    int account_number;
-    Account account;
-    FILE *file;
-    long position;
-
-    printHeader("ACCOUNT DETAILS");
-    printf("\n");
-
-    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
-        printError("Authentication failed!");
-        return;
-    }
-
-    position = findAccount(account_number);
-    if (position == -1) {
-        printError("Account not found!");
-        return;
-    }
-
-    file = fopen(FILENAME, "r+b");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, position, SEEK_SET);
-    fread(&account, sizeof(Account), 1, file);
-
-    account.last_accessed = time(NULL);
-    fseek(file, position, SEEK_SET);
-    fwrite(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    printf("\n");
-    printSeparator('=', 60);
-    printf("\n");
-    printf("%s         COMPLETE ACCOUNT INFORMATION%s\n", COLOR_BOLD, COLOR_RESET);
-    printf("\n");
-    printSeparator('-', 60);
-    printf("\n");
-    printf("  %sAccount Details:%s\n", COLOR_CYAN, COLOR_RESET);
-    printf("    Account Number:    %d\n", account.account_number);
-    printf("    Account Holder:    %s\n", account.name);
-    printf("    Email Address:     %s\n", account.email);
-    printf("    Phone Number:      %s\n", account.phone);
-    printf("\n");
-    printf("  %sFinancial Information:%s\n", COLOR_CYAN, COLOR_RESET);
-    printf("    Current Balance:   %s$%.2f%s\n", COLOR_GREEN, account.balance, COLOR_RESET);
-    printf("    Account Status:    %s%s%s\n", COLOR_GREEN, "Active", COLOR_RESET);
-    printf("\n");
-    printf("  %sSecurity:%s\n", COLOR_CYAN, COLOR_RESET);
-    printf("    Password:          %sEncrypted (Hashed)%s\n", COLOR_GREEN, COLOR_RESET);
-    printf("\n");
-    printf("  %sAccount Activity:%s\n", COLOR_CYAN, COLOR_RESET);
-
-    char created[50], accessed[50];
-    strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", localtime(&account.created_date));
-    strftime(accessed, sizeof(accessed), "%Y-%m-%d %H:%M:%S", localtime(&account.last_accessed));
-
-    printf("    Created On:        %s\n", created);
-    printf("    Last Accessed:     %s\n", accessed);
-    printf("\n");
-    printSeparator('=', 60);
-}
-
-void changePassword() {
-    int account_number;
-    Account account;
-    FILE *file;
-    long position;
-    char old_password[PASSWORD_LENGTH];
-    char new_password[PASSWORD_LENGTH];
-    char confirm_password[PASSWORD_LENGTH];
-    char old_hash[HASH_LENGTH];
-
-    printHeader("CHANGE PASSWORD");
-    printf("\n");
-
-    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    position = findAccount(account_number);
-    if (position == -1) {
-        printError("Account not found!");
-        return;
-    }
-
-    file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, position, SEEK_SET);
-    fread(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    getPasswordInput("\nCurrent Password: ", old_password, PASSWORD_LENGTH);
-
-    // Hash the input password and compare
-    simple_hash(old_password, old_hash);
-    if (strcmp(account.password_hash, old_hash) != 0) {
-        printError("Current password is incorrect!");
-        return;
-    }
-
-    getPasswordInput("New Password (min 6 characters): ", new_password, PASSWORD_LENGTH);
-
-    if (strlen(new_password) < 6) {
-        printError("New password must be at least 6 characters long!");
-        return;
-    }
-
-    getPasswordInput("Confirm New Password: ", confirm_password, PASSWORD_LENGTH);
-
-    if (strcmp(new_password, confirm_password) != 0) {
-        printError("Passwords do not match!");
-        return;
-    }
-
-    // Hash the new password
-    simple_hash(new_password, account.password_hash);
-    account.last_accessed = time(NULL);
-
-    file = fopen(FILENAME, "r+b");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, position, SEEK_SET);
-    fwrite(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    printf("\n");
-    printSeparator('=', 60);
-    printf("\n");
-    printSuccess("PASSWORD CHANGED SUCCESSFULLY!");
-    printf("\n");
-    printInfo("Your password has been updated and encrypted securely.");
-    printWarning("Please keep your new password confidential.");
-    printf("\n");
-    printSeparator('=', 60);
-}
-
-void viewTransactionHistory() {
-    int account_number;
-    FILE *log;
-    char line[500];
-    int count = 0;
-
-    printHeader("TRANSACTION HISTORY");
-    printf("\n");
-
-    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
-        printError("Authentication failed!");
-        return;
-    }
-
-    log = fopen(TRANSACTION_LOG, "r");
-    if (log == NULL) {
-        printInfo("No transaction history found.");
-        return;
-    }
-
-    printf("\n");
-    printSeparator('-', 90);
-    printf("%-20s %-15s %-12s %-15s %-25s\n",
-           "Date & Time", "Type", "Amount", "Balance", "Description");
-    printSeparator('-', 90);
-
-    while (fgets(line, sizeof(line), log)) {
-        int acc_num;
-        if (sscanf(line, "Account: %d", &acc_num) == 1 && acc_num == account_number) {
-            printf("%s", line);
-            count++;
-        }
-    }
-
-    fclose(log);
-
-    printSeparator('-', 90);
-    if (count == 0) {
-        printInfo("No transactions found for this account.");
-    } else {
-        printf("Total Transactions: %d\n", count);
-    }
-    printf("\n");
-}
-
-void generateAccountStatement() {
-    int account_number;
-    Account account;
-    FILE *file, *log, *statement;
-    long position;
-    char filename[100];
-    char line[500];
-    int trans_count = 0;
-
-    printHeader("GENERATE ACCOUNT STATEMENT");
-    printf("\n");
-
-    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
-
-    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
-        printError("Authentication failed!");
-        return;
-    }
-
-    position = findAccount(account_number);
-    if (position == -1) {
-        printError("Account not found!");
-        return;
-    }
-
-    file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    fseek(file, position, SEEK_SET);
-    fread(&account, sizeof(Account), 1, file);
-    fclose(file);
-
-    // Create statement file
-    snprintf(filename, sizeof(filename), "statement_%d.txt", account_number);
-    statement = fopen(filename, "w");
-    if (statement == NULL) {
-        printError("Unable to create statement file!");
-        return;
-    }
-
-    // Write statement header
-    fprintf(statement, "===============================================================\n");
-    fprintf(statement, "              BANK ACCOUNT STATEMENT\n");
-    fprintf(statement, "===============================================================\n\n");
-
-    char datetime[50];
-    getCurrentDateTime(datetime);
-    fprintf(statement, "Statement Generated: %s\n\n", datetime);
-
-    fprintf(statement, "ACCOUNT INFORMATION:\n");
-    fprintf(statement, "-----------------------------------------------------------\n");
-    fprintf(statement, "Account Number:    %d\n", account.account_number);
-    fprintf(statement, "Account Holder:    %s\n", account.name);
-    fprintf(statement, "Email:             %s\n", account.email);
-    fprintf(statement, "Phone:             %s\n", account.phone);
-    fprintf(statement, "Current Balance:   $%.2f\n", account.balance);
-    fprintf(statement, "Account Status:    Active\n");
-    fprintf(statement, "Security:          Password Encrypted (Hashed)\n\n");
-
-    fprintf(statement, "TRANSACTION HISTORY:\n");
-    fprintf(statement, "-----------------------------------------------------------\n");
-
-    // Read transaction log
-    log = fopen(TRANSACTION_LOG, "r");
-    if (log != NULL) {
-        while (fgets(line, sizeof(line), log)) {
-            int acc_num;
-            if (sscanf(line, "Account: %d", &acc_num) == 1 && acc_num == account_number) {
-                fprintf(statement, "%s", line);
-                trans_count++;
-            }
-        }
-        fclose(log);
-    }
-
-    if (trans_count == 0) {
-        fprintf(statement, "No transactions found.\n");
-    }
-
-    fprintf(statement, "\n-----------------------------------------------------------\n");
-    fprintf(statement, "Total Transactions: %d\n", trans_count);
-    fprintf(statement, "===============================================================\n");
-    fprintf(statement, "         Thank you for banking with us!\n");
-    fprintf(statement, "===============================================================\n");
-
-    fclose(statement);
-
-    printf("\n");
-    printSeparator('=', 60);
-    printf("\n");
-    printSuccess("STATEMENT GENERATED SUCCESSFULLY!");
-    printf("\n");
-    printInfo("Statement has been saved to:");
-    printf("  %s%s%s\n", COLOR_CYAN, filename, COLOR_RESET);
-    printf("\n");
-    printSeparator('=', 60);
-}
-
-void displayAllAccounts() {
-    Account account;
-    FILE *file;
-    int count = 0;
-    double total_balance = 0.0;
-    char password[PASSWORD_LENGTH];
-    char admin_hash[HASH_LENGTH];
-
-    printHeader("ALL ACCOUNTS (ADMIN ACCESS)");
-    printf("\n");
-
-    printWarning("Administrative access required!");
-    getPasswordInput("Enter Admin Password: ", password, PASSWORD_LENGTH);
-
-    // Hash the admin password and check
-    simple_hash("admin123", admin_hash);
-    char input_hash[HASH_LENGTH];
-    simple_hash(password, input_hash);
-
-    if (strcmp(input_hash, admin_hash) != 0) {
-        printError("Invalid admin password!");
-        return;
-    }
-
-    file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        printError("Unable to access database!");
-        return;
-    }
-
-    printf("\n");
-    printSeparator('=', 100);
-    printf("%-10s %-25s %-30s %-15s %-12s\n",
-           "Acc No.", "Name", "Email", "Phone", "Balance");
-    printSeparator('=', 100);
-
-    while (fread(&account, sizeof(Account), 1, file) == 1) {
-        printf("%-10d %-25s %-30s %-15s %s$%-11.2f%s\n",
-               account.account_number,
-               account.name,
-               account.email,
-               account.phone,
-               COLOR_GREEN,
-               account.balance,
-               COLOR_RESET);
-        count++;
-        total_balance += account.balance;
-    }
-
-    fclose(file);
-
-    printSeparator('=', 100);
-
-    if (count == 0) {
-        printInfo("No accounts found in the system.");
-    } else {
-        printf("\n");
-        printf("  %sTotal Accounts:%s %d\n", COLOR_BOLD, COLOR_RESET, count);
-        printf("  %sTotal Deposits:%s %s$%.2f%s\n", COLOR_BOLD, COLOR_RESET,
-               COLOR_GREEN, total_balance, COLOR_RESET);
-        printf("  %sSecurity Level:%s Password Hashing Enabled\n", COLOR_BOLD, COLOR_RESET);
-        printf("\n");
-    }
-}
-
-long findAccount(int account_number) {
-    Account account;
-    FILE *file;
-
-    file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        return -1;
-    }
-
-    fseek(file, 0, SEEK_SET);
-
-    while (fread(&account, sizeof(Account), 1, file) == 1) {
-        if (account.account_number == account_number) {
-            long found_position = ftell(file) - sizeof(Account);
-            fclose(file);
-            return found_position;
-        }
-    }
-
-    fclose(file);
-    return -1;
-}
-
-int authenticateAccount(int account_number, int max_attempts) {
-    char password[PASSWORD_LENGTH];
-    char input_hash[HASH_LENGTH];
-    Account account;
-    FILE *file;
-    long position;
-    int attempts = 0;
-
-    position = findAccount(account_number);
-    if (position == -1) {
-        return 0;
-    }
-
-    file = fopen(FILENAME, "rb");
-    if (file == NULL) {
-        return 0;
-    }
-
-    fseek(file, position, SEEK_SET);
-    if (fread(&account, sizeof(Account), 1, file) != 1) {
-        fclose(file);
-        return 0;
-    }
-    fclose(file);
-
-    while (attempts < max_attempts) {
-        getPasswordInput("Enter Password: ", password, PASSWORD_LENGTH);
-
-        // Hash the input password
-        simple_hash(password, input_hash);
-
-        if (strcmp(account.password_hash, input_hash) == 0) {
-            printSuccess("Authentication successful!");
-            return 1;
-        } else {
-            attempts++;
-            if (attempts < max_attempts) {
-                printError("Incorrect password!");
-                printf("Attempts remaining: %d\n", max_attempts - attempts);
-            }
-        }
-    }
-
-    printError("Maximum login attempts exceeded!");
-    printWarning("Account temporarily locked for security.");
-    return 0;
-}
-
-void logTransaction(int account_number, TransactionType type, double amount,
-                   double balance_after, int related_account, const char *description) {
-    FILE *log = fopen(TRANSACTION_LOG, "a");
-    if (log == NULL) {
-        return;
-    }
-
-    char datetime[50];
-    getCurrentDateTime(datetime);
-
-    const char *type_str;
-    switch (type) {
-        case TRANSACTION_DEPOSIT: type_str = "DEPOSIT"; break;
-        case TRANSACTION_WITHDRAWAL: type_str = "WITHDRAWAL"; break;
-        case TRANSACTION_TRANSFER_OUT: type_str = "TRANSFER OUT"; break;
-        case TRANSACTION_TRANSFER_IN: type_str = "TRANSFER IN"; break;
-        case TRANSACTION_ACCOUNT_CREATED: type_str = "ACCOUNT CREATED"; break;
-        default: type_str = "UNKNOWN"; break;
-    }
-
-    fprintf(log, "Account: %d | %s | %-15s | $%-10.2f | Balance: $%-10.2f | %s\n",
-            account_number, datetime, type_str, amount, balance_after, description);
-
-    fclose(log);
-}
-
-void getCurrentDateTime(char *buffer) {
-    time_t now = time(NULL);
-    strftime(buffer, 50, "%Y-%m-%d %H:%M:%S", localtime(&now));
-}
-
-// Input validation functions
-int getIntInput(const char *prompt, int min, int max) {
-    int value;
-    while (1) {
-        printf("%s", prompt);
-        if (scanf("%d", &value) == 1) {
-            clearInputBuffer();
-            if (value >= min && value <= max) {
-                return value;
-            }
-        } else {
-            clearInputBuffer();
-        }
-        printf("Invalid input! Please enter a number between %d and %d.\n", min, max);
-    }
-}
-
-double getDoubleInput(const char *prompt, double min, double max) {
-    double value;
-    while (1) {
-        printf("%s", prompt);
-        if (scanf("%lf", &value) == 1) {
-            clearInputBuffer();
-            if (value >= min && value <= max) {
-                return value;
-            }
-        } else {
-            clearInputBuffer();
-        }
-        printf("Invalid amount! Range: $%.2f - $%.2f\n", min, max);
-    }
-}
-
-void getStringInput(const char *prompt, char *buffer, int max_length) {
-    while (1) {
-        printf("%s", prompt);
-        fgets(buffer, max_length, stdin);
-        buffer[strcspn(buffer, "\n")] = '\0';
-
-        // Trim whitespace
-        char *start = buffer;
-        while (isspace((unsigned char)*start)) start++;
-
-        char *end = buffer + strlen(buffer) - 1;
-        while (end > start && isspace((unsigned char)*end)) end--;
-        *(end + 1) = '\0';
-
-        if (start != buffer) {
-            memmove(buffer, start, strlen(start) + 1);
-        }
-
-        if (strlen(buffer) > 0) {
-            return;
-        }
-        printError("Input cannot be empty!");
-    }
-}
-
-void getEmailInput(const char *prompt, char *buffer, int max_length) {
-    while (1) {
-        getStringInput(prompt, buffer, max_length);
-        if (validateEmail(buffer)) {
-            return;
-        }
-        printError("Invalid email format! Please try again.");
-    }
-}
-
-void getPhoneInput(const char *prompt, char *buffer, int max_length) {
-    while (1) {
-        getStringInput(prompt, buffer, max_length);
-        if (validatePhone(buffer)) {
-            return;
-        }
-        printError("Invalid phone format! Use digits only (10-15 digits).");
-    }
-}
-
-void getPasswordInput(const char *prompt, char *buffer, int max_length) {
-    printf("%s", prompt);
-
-    int i = 0;
-    char ch;
-
-    // Read character by character without echoing
-    while (1) {
-        #ifdef _WIN32
-            ch = _getch();  // Windows - no echo
-        #else
-            // Unix/Linux - disable echo
-            system("stty -echo");
-            ch = getchar();
-            system("stty echo");
-        #endif
-
-        if (ch == '\n' || ch == '\r') {  // Enter key
-            break;
-        } else if (ch == 127 || ch == 8) {  // Backspace
-            if (i > 0) {
-                i--;
-                printf("\b \b");  // Erase the last asterisk
-            }
-        } else if (i < max_length - 1) {
-            buffer[i++] = ch;
-            printf("*");  // Print asterisk instead of actual character
-        }
-    }
-
-    buffer[i] = '\0';
-    printf("\n");
-}
-
-int validateEmail(const char *email) {
-    // Simple email validation: contains @ and .
-    const char *at = strchr(email, '@');
-    const char *dot = strrchr(email, '.');
-
-    if (at && dot && at < dot && at != email && dot[1] != '\0') {
-        return 1;
-    }
-    return 0;
-}
-
-int validatePhone(const char *phone) {
-    int len = strlen(phone);
-    if (len < 10 || len > 15) {
-        return 0;
-    }
-
-    for (int i = 0; i < len; i++) {
-        if (!isdigit(phone[i]) && phone[i] != '+' && phone[i] != '-' && phone[i] != ' ') {
-            return 0;
-        }
-    }
-    return 1;
-}
-
-void clearInputBuffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
-}
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #include <conio.h>  // For _getch() on Windows
+#else
+    #include <termios.h>
+    #include <unistd.h>
+#endif
+
+#include "bank_core.h"
+#include "bank_query.h"
+#include "bank_sched.h"
+#include "bank_term.h"
+#include "bank_trace.h"
+
+// ANSI Color codes for better UI (works on most modern terminals)
+#define COLOR_RESET   "\x1b[0m"
+#define COLOR_RED     "\x1b[31m"
+#define COLOR_GREEN   "\x1b[32m"
+#define COLOR_YELLOW  "\x1b[33m"
+#define COLOR_BLUE    "\x1b[34m"
+#define COLOR_MAGENTA "\x1b[35m"
+#define COLOR_CYAN    "\x1b[36m"
+#define COLOR_WHITE   "\x1b[37m"
+#define COLOR_BOLD    "\x1b[1m"
+
+#define SEARCH_RESULTS 50     // accounts shown per search
+#define ACCOUNTS_PER_PAGE 20  // accounts listed per page
+#define ORDERS_SHOWN 50       // standing orders listed per account
+#define SECONDS_PER_DAY 86400
+
+// The account store shared by every menu handler
+static Bank bank;
+
+// The screen being composed; it reaches the terminal when input is read
+static TermBuffer screen;
+
+// Function prototypes
+void showWelcomeScreen();
+void showMainMenu();
+void createAccount();
+void depositMoney();
+void withdrawMoney();
+void checkBalance();
+void transferFunds();
+void displayAllAccounts();
+void searchAccounts();
+void viewAccountDetails();
+void changePassword();
+void viewTransactionHistory();
+void generateAccountStatement();
+void standingOrders();
+void manageAccountStatus();
+
+// Utility functions
+int authenticateAccount(int account_number, int max_attempts);
+const char *statusColor(AccountStatus status);
+
+// Input validation functions
+int getIntInput(const char *prompt, int min, int max);
+double getDoubleInput(const char *prompt, double min, double max);
+void getStringInput(const char *prompt, char *buffer, int max_length);
+void getEmailInput(const char *prompt, char *buffer, int max_length);
+void getPhoneInput(const char *prompt, char *buffer, int max_length);
+void getPasswordInput(const char *prompt, char *buffer, int max_length);
+
+// UI functions
+void clearInputBuffer();
+void initializeFile();
+void clearScreen();
+void pauseScreen();
+void printHeader(const char *title);
+void printSeparator(char c, int length);
+void printSuccess(const char *message);
+void printError(const char *message);
+void printWarning(const char *message);
+void printInfo(const char *message);
+
+int main() {
+    int choice;
+
+    termInit(&screen, STDOUT_FILENO);
+
+    // Initialize random seed once
+    srand(time(NULL));
+
+    // Open the account store
+    initializeFile();
+
+    showWelcomeScreen();
+
+    while (1) {
+        // Standing orders that came due while the menu was idle
+        bankRunDueOrders(&bank, (int64_t)time(NULL), NULL);
+
+        showMainMenu();
+
+        termFlush(&screen);
+        if (scanf("%d", &choice) != 1) {
+            clearInputBuffer();
+            printError("Invalid input! Please enter a number.");
+            pauseScreen();
+            continue;
+        }
+        clearInputBuffer();
+        bankTraceMenu(&bank, choice);
+
+        switch (choice) {
+            case 1:
+                clearScreen();
+                createAccount();
+                pauseScreen();
+                break;
+            case 2:
+                clearScreen();
+                depositMoney();
+                pauseScreen();
+                break;
+            case 3:
+                clearScreen();
+                withdrawMoney();
+                pauseScreen();
+                break;
+            case 4:
+                clearScreen();
+                checkBalance();
+                pauseScreen();
+                break;
+            case 5:
+                clearScreen();
+                transferFunds();
+                pauseScreen();
+                break;
+            case 6:
+                clearScreen();
+                viewAccountDetails();
+                pauseScreen();
+                break;
+            case 7:
+                clearScreen();
+                changePassword();
+                pauseScreen();
+                break;
+            case 8:
+                clearScreen();
+                viewTransactionHistory();
+                pauseScreen();
+                break;
+            case 9:
+                clearScreen();
+                generateAccountStatement();
+                pauseScreen();
+                break;
+            case 12:
+                clearScreen();
+                standingOrders();
+                pauseScreen();
+                break;
+            case 13:
+                clearScreen();
+                manageAccountStatus();
+                pauseScreen();
+                break;
+            case 10:
+                clearScreen();
+                displayAllAccounts();
+                pauseScreen();
+                break;
+            case 11:
+                clearScreen();
+                searchAccounts();
+                pauseScreen();
+                break;
+            case 0:
+                clearScreen();
+                printHeader("THANK YOU");
+                termPrintf(&screen, "\n");
+                printInfo("Thank you for banking with us!");
+                printInfo("Your security is our priority.");
+                termPrintf(&screen, "\n");
+                printSeparator('=', 60);
+                termPrintf(&screen, "\n");
+                termFlush(&screen);
+                termFree(&screen);
+                bankClose(&bank);
+                exit(0);
+            default:
+                printError("Invalid choice! Please select a valid option.");
+                pauseScreen();
+        }
+    }
+
+    return 0;
+}
+
+void showWelcomeScreen() {
+    clearScreen();
+    termPrintf(&screen, "\n");
+    printSeparator('=', 70);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "%s%s", COLOR_CYAN, COLOR_BOLD);
+    termPrintf(&screen, "               PROFESSIONAL BANKING MANAGEMENT SYSTEM\n");
+    termPrintf(&screen, "%s", COLOR_RESET);
+    printSeparator('=', 70);
+    termPrintf(&screen, "\n\n");
+    termPrintf(&screen, "%s", COLOR_YELLOW);
+    termPrintf(&screen, "                    Secure And Reliable\n");
+    termPrintf(&screen, "%s", COLOR_RESET);
+    termPrintf(&screen, "\n");
+    printInfo("System initializing with enhanced security...");
+    termPrintf(&screen, "\n");
+    time_t now = time(NULL);
+    char datetime[50];
+    strftime(datetime, sizeof(datetime), "%A, %B %d, %Y - %I:%M %p", localtime(&now));
+    termPrintf(&screen, "                    %s\n", datetime);
+    termPrintf(&screen, "\n");
+    printSeparator('=', 70);
+    termPrintf(&screen, "\n");
+    pauseScreen();
+}
+
+void showMainMenu() {
+    clearScreen();
+    printHeader("MAIN MENU");
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %s[ACCOUNT OPERATIONS]%s\n", COLOR_CYAN, COLOR_RESET);
+    termPrintf(&screen, "  1. Create New Account\n");
+    termPrintf(&screen, "  2. Deposit Money\n");
+    termPrintf(&screen, "  3. Withdraw Money\n");
+    termPrintf(&screen, "  4. Check Balance\n");
+    termPrintf(&screen, "  5. Transfer Funds\n");
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %s[ACCOUNT MANAGEMENT]%s\n", COLOR_CYAN, COLOR_RESET);
+    termPrintf(&screen, "  6. View Account Details\n");
+    termPrintf(&screen, "  7. Change Password\n");
+    termPrintf(&screen, "  8. Transaction History\n");
+    termPrintf(&screen, "  9. Generate Statement\n");
+    termPrintf(&screen, "  12. Standing Orders\n");
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %s[ADMINISTRATION]%s\n", COLOR_CYAN, COLOR_RESET);
+    termPrintf(&screen, "  10. Display All Accounts (Admin)\n");
+    termPrintf(&screen, "  11. Search Accounts (Admin)\n");
+    termPrintf(&screen, "  13. Suspend / Reactivate / Close Account (Admin)\n");
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %s0. Exit%s\n", COLOR_RED, COLOR_RESET);
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n%sEnter your choice:%s ", COLOR_BOLD, COLOR_RESET);
+}
+
+void clearScreen() {
+    termClear(&screen);
+}
+
+void pauseScreen() {
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n%sPress Enter to continue...%s", COLOR_YELLOW, COLOR_RESET);
+    termFlush(&screen);
+    getchar();
+}
+
+void printHeader(const char *title) {
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "%s%s", COLOR_BOLD, COLOR_CYAN);
+    termRepeat(&screen, ' ', (60 - (int)strlen(title)) / 2);
+    termPrintf(&screen, "%s\n", title);
+    termPrintf(&screen, "%s", COLOR_RESET);
+    printSeparator('=', 60);
+}
+
+void printSeparator(char c, int length) {
+    termRepeat(&screen, c, length);
+    termWrite(&screen, "\n", 1);
+}
+
+void printSuccess(const char *message) {
+    termPrintf(&screen, "%s%s%s\n", COLOR_GREEN, message, COLOR_RESET);
+}
+
+void printError(const char *message) {
+    termPrintf(&screen, "%sERROR: %s%s\n", COLOR_RED, message, COLOR_RESET);
+}
+
+void printWarning(const char *message) {
+    termPrintf(&screen, "%sWARNING: %s%s\n", COLOR_YELLOW, message, COLOR_RESET);
+}
+
+void printInfo(const char *message) {
+    termPrintf(&screen, "%s%s%s\n", COLOR_BLUE, message, COLOR_RESET);
+}
+
+void initializeFile() {
+    // The data directory comes from $BANK_DATA_DIR, else the working directory
+    if (bankOpenDir(&bank, STORAGE_FILE, NULL) != BANK_OK) {
+        printError("Unable to access database!");
+        termFlush(&screen);
+        exit(1);
+    }
+
+    // A workload trace for bankbench replay, when asked for
+    const char *trace_path = getenv(BANK_TRACE_ENV);
+    if (trace_path != NULL && trace_path[0] != '\0' && bankTraceStart(&bank, trace_path) != BANK_OK) {
+        printError("Unable to write the trace file!");
+        termFlush(&screen);
+        bankClose(&bank);
+        exit(1);
+    }
+}
+
+void createAccount() {
+    Account new_account;
+    char name[MAX_NAME_LENGTH];
+    char email[MAX_NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    char password[PASSWORD_LENGTH];
+
+    printHeader("CREATE NEW ACCOUNT");
+    termPrintf(&screen, "\n");
+
+    // Get account holder details
+    getStringInput("Full Name: ", name, MAX_NAME_LENGTH);
+    getEmailInput("Email Address: ", email, MAX_NAME_LENGTH);
+    getPhoneInput("Phone Number: ", phone, PHONE_LENGTH);
+
+    termPrintf(&screen, "\n");
+    printInfo("Setting up secure password...");
+    getPasswordInput("Set Password (min 6 characters): ", password, PASSWORD_LENGTH);
+
+    int result = bankCreateAccount(&bank, name, email, phone, password, &new_account);
+    if (result != BANK_OK) {
+        printError(result == BANK_ERR_IO ? "Unable to create account!" : bankResultMessage(result));
+        return;
+    }
+    printSuccess("Password encrypted successfully!");
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    printSuccess("ACCOUNT CREATED SUCCESSFULLY!");
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %sAccount Number:%s %d\n", COLOR_BOLD, COLOR_RESET, new_account.account_number);
+    termPrintf(&screen, "  %sAccount Holder:%s %s\n", COLOR_BOLD, COLOR_RESET, new_account.name);
+    termPrintf(&screen, "  %sEmail:%s %s\n", COLOR_BOLD, COLOR_RESET, new_account.email);
+    termPrintf(&screen, "  %sPhone:%s %s\n", COLOR_BOLD, COLOR_RESET, new_account.phone);
+    termPrintf(&screen, "  %sInitial Balance:%s $%.2f\n", COLOR_BOLD, COLOR_RESET, new_account.balance);
+    termPrintf(&screen, "  %sAccount Status:%s %s\n", COLOR_BOLD, COLOR_RESET, accountStatusName(new_account.status));
+    termPrintf(&screen, "  %sSecurity:%s Password encrypted with hash\n", COLOR_BOLD, COLOR_RESET);
+
+    char date_str[50];
+    strftime(date_str, sizeof(date_str), "%Y-%m-%d %H:%M:%S",
+            localtime(&new_account.created_date));
+    termPrintf(&screen, "  %sCreated On:%s %s\n", COLOR_BOLD, COLOR_RESET, date_str);
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n");
+    printWarning("IMPORTANT: Please remember your account number and password!");
+    printInfo("Keep your credentials secure and confidential.");
+}
+
+void depositMoney() {
+    int account_number;
+    double amount;
+    Account account;
+
+    printHeader("DEPOSIT MONEY");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    amount = getDoubleInput("\nDeposit Amount: $", 0.01, 1000000.0);
+
+    int result = bankDeposit(&bank, account_number, amount, &account);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    double old_balance = account.balance - amount;
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    printSuccess("DEPOSIT SUCCESSFUL!");
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  Transaction Type:    Deposit\n");
+    termPrintf(&screen, "  Amount Deposited:    %s$%.2f%s\n", COLOR_GREEN, amount, COLOR_RESET);
+    termPrintf(&screen, "  Previous Balance:    $%.2f\n", old_balance);
+    termPrintf(&screen, "  Current Balance:     %s$%.2f%s\n", COLOR_BOLD, account.balance, COLOR_RESET);
+
+    char datetime[50];
+    getCurrentDateTime(datetime);
+    termPrintf(&screen, "  Transaction Time:    %s\n", datetime);
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+}
+
+void withdrawMoney() {
+    int account_number;
+    double amount;
+    Account account;
+
+    printHeader("WITHDRAW MONEY");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    int result = bankFindAccount(&bank, account_number, &account);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    termPrintf(&screen, "\nAvailable Balance: %s$%.2f%s\n", COLOR_BOLD, account.balance, COLOR_RESET);
+
+    if (account.balance <= 0) {
+        printError("Insufficient funds! Cannot withdraw.");
+        return;
+    }
+
+    amount = getDoubleInput("Withdrawal Amount: $", 0.01, account.balance);
+
+    result = bankWithdraw(&bank, account_number, amount, &account);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    double old_balance = account.balance + amount;
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    printSuccess("WITHDRAWAL SUCCESSFUL!");
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  Transaction Type:    Withdrawal\n");
+    termPrintf(&screen, "  Amount Withdrawn:    %s$%.2f%s\n", COLOR_RED, amount, COLOR_RESET);
+    termPrintf(&screen, "  Previous Balance:    $%.2f\n", old_balance);
+    termPrintf(&screen, "  Current Balance:     %s$%.2f%s\n", COLOR_BOLD, account.balance, COLOR_RESET);
+
+    char datetime[50];
+    getCurrentDateTime(datetime);
+    termPrintf(&screen, "  Transaction Time:    %s\n", datetime);
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+}
+
+void checkBalance() {
+    int account_number;
+    Account account;
+
+    printHeader("BALANCE INQUIRY");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    int result = bankTouchAccount(&bank, account_number, &account);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "%s           ACCOUNT BALANCE DETAILS%s\n", COLOR_BOLD, COLOR_RESET);
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  Account Number:      %d\n", account.account_number);
+    termPrintf(&screen, "  Account Holder:      %s\n", account.name);
+    termPrintf(&screen, "  Current Balance:     %s$%.2f%s\n", COLOR_GREEN, account.balance, COLOR_RESET);
+    termPrintf(&screen, "  Account Status:      %s%s%s\n", statusColor(account.status),
+           accountStatusName(account.status), COLOR_RESET);
+
+    char datetime[50];
+    getCurrentDateTime(datetime);
+    termPrintf(&screen, "  Query Time:          %s\n", datetime);
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+}
+
+void transferFunds() {
+    int from_account, to_account;
+    double amount;
+    Account from_acc, to_acc;
+
+    printHeader("FUND TRANSFER");
+    termPrintf(&screen, "\n");
+
+    from_account = getIntInput("Your Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(from_account, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    if (bankFindAccount(&bank, from_account, &from_acc) != BANK_OK) {
+        printError("Your account not found!");
+        return;
+    }
+
+    to_account = getIntInput("\nRecipient Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (bankFindAccount(&bank, to_account, &to_acc) != BANK_OK) {
+        printError("Recipient account not found!");
+        return;
+    }
+
+    if (from_account == to_account) {
+        printError("Cannot transfer to the same account!");
+        return;
+    }
+
+    termPrintf(&screen, "\nYour Available Balance: %s$%.2f%s\n", COLOR_BOLD, from_acc.balance, COLOR_RESET);
+    termPrintf(&screen, "Recipient: %s%s%s\n", COLOR_CYAN, to_acc.name, COLOR_RESET);
+
+    amount = getDoubleInput("\nTransfer Amount: $", 0.01, from_acc.balance);
+
+    // Confirmation
+    termPrintf(&screen, "\n");
+    printWarning("Please confirm the transfer details:");
+    termPrintf(&screen, "  Transfer Amount: $%.2f\n", amount);
+    termPrintf(&screen, "  To: %s (Account: %d)\n", to_acc.name, to_account);
+    termPrintf(&screen, "\nConfirm transfer? (Y/N): ");
+
+    char confirm;
+    termFlush(&screen);
+    scanf(" %c", &confirm);
+    clearInputBuffer();
+
+    if (confirm != 'Y' && confirm != 'y') {
+        printWarning("Transfer cancelled by user.");
+        return;
+    }
+
+    double old_from_balance = from_acc.balance;
+
+    int result = bankTransfer(&bank, from_account, to_account, amount, &from_acc, &to_acc);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    printSuccess("TRANSFER SUCCESSFUL!");
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  Transaction Type:    Fund Transfer\n");
+    termPrintf(&screen, "  Amount Transferred:  %s$%.2f%s\n", COLOR_YELLOW, amount, COLOR_RESET);
+    termPrintf(&screen, "  From Account:        %d\n", from_account);
+    termPrintf(&screen, "  To Account:          %d (%s)\n", to_account, to_acc.name);
+    termPrintf(&screen, "  Your Previous Bal:   $%.2f\n", old_from_balance);
+    termPrintf(&screen, "  Your Current Bal:    %s$%.2f%s\n", COLOR_BOLD, from_acc.balance, COLOR_RESET);
+
+    char datetime[50];
+    getCurrentDateTime(datetime);
+    termPrintf(&screen, "  Transaction Time:    %s\n", datetime);
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+}
+
+void viewAccountDetails() {
+    int account_number;
+    Account account;
+
+    printHeader("ACCOUNT DETAILS");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    int result = bankTouchAccount(&bank, account_number, &account);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "%s         COMPLETE ACCOUNT INFORMATION%s\n", COLOR_BOLD, COLOR_RESET);
+    termPrintf(&screen, "\n");
+    printSeparator('-', 60);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %sAccount Details:%s\n", COLOR_CYAN, COLOR_RESET);
+    termPrintf(&screen, "    Account Number:    %d\n", account.account_number);
+    termPrintf(&screen, "    Account Holder:    %s\n", account.name);
+    termPrintf(&screen, "    Email Address:     %s\n", account.email);
+    termPrintf(&screen, "    Phone Number:      %s\n", account.phone);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %sFinancial Information:%s\n", COLOR_CYAN, COLOR_RESET);
+    termPrintf(&screen, "    Current Balance:   %s$%.2f%s\n", COLOR_GREEN, account.balance, COLOR_RESET);
+    termPrintf(&screen, "    Account Status:    %s%s%s\n", statusColor(account.status),
+           accountStatusName(account.status), COLOR_RESET);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %sSecurity:%s\n", COLOR_CYAN, COLOR_RESET);
+    termPrintf(&screen, "    Password:          %sEncrypted (Hashed)%s\n", COLOR_GREEN, COLOR_RESET);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  %sAccount Activity:%s\n", COLOR_CYAN, COLOR_RESET);
+
+    char created[50], accessed[50];
+    strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", localtime(&account.created_date));
+    strftime(accessed, sizeof(accessed), "%Y-%m-%d %H:%M:%S", localtime(&account.last_accessed));
+
+    termPrintf(&screen, "    Created On:        %s\n", created);
+    termPrintf(&screen, "    Last Accessed:     %s\n", accessed);
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+}
+
+void changePassword() {
+    int account_number;
+    Account account;
+    char old_password[PASSWORD_LENGTH];
+    char new_password[PASSWORD_LENGTH];
+    char confirm_password[PASSWORD_LENGTH];
+
+    printHeader("CHANGE PASSWORD");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    int result = bankFindAccount(&bank, account_number, &account);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    getPasswordInput("\nCurrent Password: ", old_password, PASSWORD_LENGTH);
+
+    if (bankAuthenticate(&bank, account_number, old_password) != BANK_OK) {
+        printError("Current password is incorrect!");
+        return;
+    }
+
+    getPasswordInput("New Password (min 6 characters): ", new_password, PASSWORD_LENGTH);
+
+    if (strlen(new_password) < MIN_PASSWORD_LENGTH) {
+        printError("New password must be at least 6 characters long!");
+        return;
+    }
+
+    getPasswordInput("Confirm New Password: ", confirm_password, PASSWORD_LENGTH);
+
+    if (strcmp(new_password, confirm_password) != 0) {
+        printError("Passwords do not match!");
+        return;
+    }
+
+    result = bankChangePassword(&bank, account_number, old_password, new_password);
+    if (result != BANK_OK) {
+        printError(result == BANK_ERR_AUTH ? "Current password is incorrect!" : bankResultMessage(result));
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    printSuccess("PASSWORD CHANGED SUCCESSFULLY!");
+    termPrintf(&screen, "\n");
+    printInfo("Your password has been updated and encrypted securely.");
+    printWarning("Please keep your new password confidential.");
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+}
+
+void viewTransactionHistory() {
+    int account_number;
+    BankHistoryIter history;
+    const char *line;
+    int count = 0;
+
+    printHeader("TRANSACTION HISTORY");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    if (bankHistoryOpen(&bank, account_number, &history) != BANK_OK) {
+        printInfo("No transaction history found.");
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    printSeparator('-', 90);
+    termPrintf(&screen, "%-20s %-15s %-12s %-15s %-25s\n",
+           "Date & Time", "Type", "Amount", "Balance", "Description");
+    printSeparator('-', 90);
+
+    while ((line = bankHistoryNext(&history)) != NULL) {
+        termPrintf(&screen, "%s", line);
+        count++;
+    }
+
+    bankHistoryClose(&history);
+
+    printSeparator('-', 90);
+    if (count == 0) {
+        printInfo("No transactions found for this account.");
+    } else {
+        termPrintf(&screen, "Total Transactions: %d\n", count);
+    }
+    termPrintf(&screen, "\n");
+}
+
+void generateAccountStatement() {
+    int account_number;
+    Account account;
+    FILE *statement;
+    BankHistoryIter history;
+    const char *line;
+    char filename[100];
+    int trans_count = 0;
+
+    printHeader("GENERATE ACCOUNT STATEMENT");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    int result = bankFindAccount(&bank, account_number, &account);
+    if (result != BANK_OK) {
+        printError(bankResultMessage(result));
+        return;
+    }
+
+    // Create statement file
+    snprintf(filename, sizeof(filename), "statement_%d.txt", account_number);
+    statement = fopen(filename, "w");
+    if (statement == NULL) {
+        printError("Unable to create statement file!");
+        return;
+    }
+
+    // Write statement header
+    fprintf(statement, "===============================================================\n");
+    fprintf(statement, "              BANK ACCOUNT STATEMENT\n");
+    fprintf(statement, "===============================================================\n\n");
+
+    char datetime[50];
+    getCurrentDateTime(datetime);
+    fprintf(statement, "Statement Generated: %s\n\n", datetime);
+
+    fprintf(statement, "ACCOUNT INFORMATION:\n");
+    fprintf(statement, "-----------------------------------------------------------\n");
+    fprintf(statement, "Account Number:    %d\n", account.account_number);
+    fprintf(statement, "Account Holder:    %s\n", account.name);
+    fprintf(statement, "Email:             %s\n", account.email);
+    fprintf(statement, "Phone:             %s\n", account.phone);
+    fprintf(statement, "Current Balance:   $%.2f\n", account.balance);
+    fprintf(statement, "Account Status:    %s\n", accountStatusName(account.status));
+    fprintf(statement, "Security:          Password Encrypted (Hashed)\n\n");
+
+    fprintf(statement, "TRANSACTION HISTORY:\n");
+    fprintf(statement, "-----------------------------------------------------------\n");
+
+    // Read transaction log
+    if (bankHistoryOpen(&bank, account_number, &history) == BANK_OK) {
+        while ((line = bankHistoryNext(&history)) != NULL) {
+            fprintf(statement, "%s", line);
+            trans_count++;
+        }
+        bankHistoryClose(&history);
+    }
+
+    if (trans_count == 0) {
+        fprintf(statement, "No transactions found.\n");
+    }
+
+    fprintf(statement, "\n-----------------------------------------------------------\n");
+    fprintf(statement, "Total Transactions: %d\n", trans_count);
+    fprintf(statement, "===============================================================\n");
+    fprintf(statement, "         Thank you for banking with us!\n");
+    fprintf(statement, "===============================================================\n");
+
+    fclose(statement);
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+    termPrintf(&screen, "\n");
+    printSuccess("STATEMENT GENERATED SUCCESSFULLY!");
+    termPrintf(&screen, "\n");
+    printInfo("Statement has been saved to:");
+    termPrintf(&screen, "  %s%s%s\n", COLOR_CYAN, filename, COLOR_RESET);
+    termPrintf(&screen, "\n");
+    printSeparator('=', 60);
+}
+
+void displayAllAccounts() {
+    static const unsigned statuses[] = {0, QUERY_ACTIVE, QUERY_SUSPENDED, QUERY_CLOSED};
+    Account rows[ACCOUNTS_PER_PAGE];
+    BankQuery query;
+    BankQueryCursor cursor;
+    BankQueryStats stats;
+    int count = 0, page = 0, rows_found;
+    double total_balance = 0.0;
+    char password[PASSWORD_LENGTH];
+
+    printHeader("ALL ACCOUNTS (ADMIN ACCESS)");
+    termPrintf(&screen, "\n");
+
+    printWarning("Administrative access required!");
+    getPasswordInput("Enter Admin Password: ", password, PASSWORD_LENGTH);
+
+    if (bankAuthenticateAdmin(password) != BANK_OK) {
+        printError("Invalid admin password!");
+        return;
+    }
+
+    bankQueryInit(&query);
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  Status:   0. Any  1. Active  2. Suspended  3. Closed\n");
+    query.statuses = statuses[getIntInput("Show: ", 0, 3)];
+    query.min_balance = getDoubleInput("Minimum Balance: $", 0.0, 1e15);
+    double max_balance = getDoubleInput("Maximum Balance (0 for no limit): $", 0.0, 1e15);
+    if (max_balance > 0.0) {
+        query.max_balance = max_balance;
+    }
+    int idle_days = getIntInput("Idle for at least how many days (0 for all): ", 0, 36500);
+    if (idle_days > 0) {
+        query.accessed_to = (int64_t)time(NULL) - (int64_t)idle_days * SECONDS_PER_DAY;
+    }
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  Order:    1. Account opening  2. Highest balance  3. Newest first\n");
+    switch (getIntInput("Sort by: ", 1, 3)) {
+        case 2: query.order = QUERY_ORDER_BALANCE; query.descending = 1; break;
+        case 3: query.order = QUERY_ORDER_CREATED; query.descending = 1; break;
+        default: break;
+    }
+
+    memset(&cursor, 0, sizeof(cursor));
+    do {
+        rows_found = bankQuery(&bank, &query, &cursor, rows, ACCOUNTS_PER_PAGE, &stats);
+        if (rows_found < 0) {
+            printError("Unable to access database!");
+            return;
+        }
+        if (stats.corrupt > 0) {
+            printWarning("Some records failed their checksum and are not shown; run bankadm fsck.");
+        }
+
+        termPrintf(&screen, "\n");
+        printSeparator('=', 112);
+        termPrintf(&screen, "%-10s %-25s %-30s %-15s %-12s %-10s\n",
+               "Acc No.", "Name", "Email", "Phone", "Balance", "Status");
+        printSeparator('=', 112);
+
+        for (int i = 0; i < rows_found; i++) {
+            termPrintf(&screen, "%-10d %-25s %-30s %-15s %s$%-11.2f%s %s%-10s%s\n",
+                   rows[i].account_number,
+                   rows[i].name,
+                   rows[i].email,
+                   rows[i].phone,
+                   COLOR_GREEN,
+                   rows[i].balance,
+                   COLOR_RESET,
+                   statusColor(rows[i].status),
+                   accountStatusName(rows[i].status),
+                   COLOR_RESET);
+            count++;
+            total_balance += rows[i].balance;
+        }
+
+        printSeparator('=', 112);
+        page++;
+        termPrintf(&screen, "  Page %d", page);
+        if (stats.complete) {
+            // A sorted page reads the whole store, so it knows every match
+            count = (int)stats.matched;
+            total_balance = stats.matched_balance;
+            termPrintf(&screen, " of %ld\n", (stats.matched + ACCOUNTS_PER_PAGE - 1) / ACCOUNTS_PER_PAGE);
+        } else {
+            termPrintf(&screen, "\n");
+        }
+    } while (rows_found == ACCOUNTS_PER_PAGE &&
+             getIntInput("1. Next page  0. Done: ", 0, 1) == 1);
+
+    if (count == 0) {
+        printInfo("No accounts match.");
+    } else if (rows_found < ACCOUNTS_PER_PAGE || stats.complete) {
+        termPrintf(&screen, "\n");
+        termPrintf(&screen, "  %sMatching Accounts:%s %d\n", COLOR_BOLD, COLOR_RESET, count);
+        termPrintf(&screen, "  %sTotal Deposits:%s %s$%.2f%s\n", COLOR_BOLD, COLOR_RESET,
+               COLOR_GREEN, total_balance, COLOR_RESET);
+        termPrintf(&screen, "  %sSecurity Level:%s Password Hashing Enabled\n", COLOR_BOLD, COLOR_RESET);
+        termPrintf(&screen, "\n");
+    }
+}
+
+void searchAccounts() {
+    Account results[SEARCH_RESULTS];
+    char password[PASSWORD_LENGTH];
+    char key[MAX_NAME_LENGTH];
+    int field, prefix, count;
+
+    printHeader("SEARCH ACCOUNTS (ADMIN ACCESS)");
+    termPrintf(&screen, "\n");
+
+    printWarning("Administrative access required!");
+    getPasswordInput("Enter Admin Password: ", password, PASSWORD_LENGTH);
+
+    if (bankAuthenticateAdmin(password) != BANK_OK) {
+        printError("Invalid admin password!");
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  1. By Email\n");
+    termPrintf(&screen, "  2. By Phone\n");
+    termPrintf(&screen, "  3. By Name\n");
+    termPrintf(&screen, "\n");
+    field = getIntInput("Search by: ", 1, 3);
+
+    printInfo("End the search text with * to match everything starting with it.");
+    getStringInput("Search for: ", key, MAX_NAME_LENGTH);
+
+    size_t len = strlen(key);
+    prefix = len > 0 && key[len - 1] == '*';
+    if (prefix) {
+        key[len - 1] = '\0';
+    }
+
+    count = bankSearchAccounts(&bank, field == 1 ? INDEX_EMAIL : field == 2 ? INDEX_PHONE : INDEX_NAME,
+                               key, prefix, results, SEARCH_RESULTS);
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 100);
+    termPrintf(&screen, "%-10s %-25s %-30s %-15s %-12s\n",
+           "Acc No.", "Name", "Email", "Phone", "Balance");
+    printSeparator('=', 100);
+
+    for (int i = 0; i < count; i++) {
+        termPrintf(&screen, "%-10d %-25s %-30s %-15s %s$%-11.2f%s\n",
+               results[i].account_number,
+               results[i].name,
+               results[i].email,
+               results[i].phone,
+               COLOR_GREEN,
+               results[i].balance,
+               COLOR_RESET);
+    }
+
+    printSeparator('=', 100);
+
+    if (count == 0) {
+        printInfo("No matching accounts found.");
+    } else if (count == SEARCH_RESULTS) {
+        printWarning("Showing the first matches only; narrow the search to see more.");
+    }
+}
+
+void standingOrders() {
+    StandingOrder orders[ORDERS_SHOWN];
+    StandingOrder order;
+    Account account, to_acc;
+    int account_number, count, choice;
+
+    printHeader("STANDING ORDERS");
+    termPrintf(&screen, "\n");
+
+    account_number = getIntInput("Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+    if (!authenticateAccount(account_number, MAX_LOGIN_ATTEMPTS)) {
+        printError("Authentication failed!");
+        return;
+    }
+
+    if (bankFindAccount(&bank, account_number, &account) != BANK_OK) {
+        printError("Account not found!");
+        return;
+    }
+
+    count = bankListOrders(&bank, account_number, orders, ORDERS_SHOWN);
+
+    termPrintf(&screen, "\n");
+    printSeparator('=', 80);
+    termPrintf(&screen, "%-8s %-10s %12s %-20s %-10s %-10s\n", "ID", "To", "Amount", "Next Due", "Every", "Left");
+    printSeparator('=', 80);
+
+    for (int i = 0; i < count; i++) {
+        char due[32], every[32], left[16];
+        time_t next = (time_t)orders[i].next_due;
+        strftime(due, sizeof(due), "%Y-%m-%d %H:%M", localtime(&next));
+        if (orders[i].interval > 0) {
+            snprintf(every, sizeof(every), "%lld days", (long long)(orders[i].interval / SECONDS_PER_DAY));
+        } else {
+            snprintf(every, sizeof(every), "once");
+        }
+        if (orders[i].remaining < 0) {
+            snprintf(left, sizeof(left), "until stop");
+        } else {
+            snprintf(left, sizeof(left), "%d", orders[i].remaining);
+        }
+        termPrintf(&screen, "%-8u %-10d %s$%-11.2f%s %-20s %-10s %-10s\n", orders[i].id, orders[i].to_account,
+               COLOR_GREEN, orders[i].amount, COLOR_RESET, due, every, left);
+    }
+
+    printSeparator('=', 80);
+    if (count == 0) {
+        printInfo("No standing orders on this account.");
+    }
+
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  1. Create Standing Order\n");
+    termPrintf(&screen, "  2. Cancel Standing Order\n");
+    termPrintf(&screen, "  0. Back\n");
+    termPrintf(&screen, "\n");
+    choice = getIntInput("Choice: ", 0, 2);
+
+    if (choice == 1) {
+        int to_account = getIntInput("\nRecipient Account Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+
+        if (bankFindAccount(&bank, to_account, &to_acc) != BANK_OK) {
+            printError("Recipient account not found!");
+            return;
+        }
+        if (to_account == account_number) {
+            printError("Cannot transfer to the same account!");
+            return;
+        }
+
+        termPrintf(&screen, "Recipient: %s%s%s\n", COLOR_CYAN, to_acc.name, COLOR_RESET);
+        double amount = getDoubleInput("Amount per Transfer: $", 0.01, 1000000.0);
+        int start = getIntInput("First Transfer in How Many Days (0 = today): ", 0, 3650);
+        int every = getIntInput("Repeat Every How Many Days (0 = once): ", 0, 3650);
+        int times = every > 0 ? getIntInput("Number of Transfers (0 = until cancelled): ", 0, 10000) : 1;
+
+        int result = bankCreateOrder(&bank, account_number, to_account, amount,
+                                     (int64_t)time(NULL) + (int64_t)start * SECONDS_PER_DAY,
+                                     (int64_t)every * SECONDS_PER_DAY, times, &order);
+        if (result != BANK_OK) {
+            printError(bankResultMessage(result));
+            return;
+        }
+
+        termPrintf(&screen, "\n");
+        printSuccess("Standing order created!");
+        termPrintf(&screen, "  Order ID:            %u\n", order.id);
+        termPrintf(&screen, "  Amount:              $%.2f\n", order.amount);
+        termPrintf(&screen, "  To Account:          %d (%s)\n", to_account, to_acc.name);
+        printInfo("Transfers that find too little balance are skipped, not retried.");
+    } else if (choice == 2) {
+        int id = getIntInput("\nOrder ID to Cancel: ", 0, 2147483647);
+
+        if (bankCancelOrder(&bank, account_number, (uint32_t)id) != BANK_OK) {
+            printError("No active standing order with that ID on this account!");
+            return;
+        }
+        printSuccess("Standing order cancelled.");
+    }
+}
+
+void manageAccountStatus() {
+    char password[PASSWORD_LENGTH];
+    Account account;
+    int account_number, choice, result;
+
+    printHeader("ACCOUNT STATUS (ADMIN ACCESS)");
+    termPrintf(&screen, "\n");
+
+    printWarning("Administrative access required!");
+    getPasswordInput("Enter Admin Password: ", password, PASSWORD_LENGTH);
+
+    if (bankAuthenticateAdmin(password) != BANK_OK) {
+        printError("Invalid admin password!");
+        return;
+    }
+
+    account_number = getIntInput("\nAccount Number: ", MIN_ACCOUNT_NUMBER, MAX_ACCOUNT_NUMBER);
+    if (bankFindAccount(&bank, account_number, &account) != BANK_OK) {
+        printError("Account not found!");
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  Account Holder:      %s\n", account.name);
+    termPrintf(&screen, "  Current Balance:     $%.2f\n", account.balance);
+    termPrintf(&screen, "  Account Status:      %s%s%s\n", statusColor(account.status),
+           accountStatusName(account.status), COLOR_RESET);
+
+    if (account.status == ACCOUNT_CLOSED) {
+        printInfo("Closed accounts cannot be changed.");
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    termPrintf(&screen, "  1. Suspend Account\n");
+    termPrintf(&screen, "  2. Reactivate Account\n");
+    termPrintf(&screen, "  3. Close Account\n");
+    termPrintf(&screen, "  0. Back\n");
+    termPrintf(&screen, "\n");
+    choice = getIntInput("Choice: ", 0, 3);
+    if (choice == 0) {
+        return;
+    }
+
+    if (choice == 3) {
+        printWarning("Closing is permanent; the account number is never reissued.");
+        termPrintf(&screen, "Confirm closing account %d? (Y/N): ", account_number);
+
+        char confirm;
+        termFlush(&screen);
+        scanf(" %c", &confirm);
+        clearInputBuffer();
+
+        if (confirm != 'Y' && confirm != 'y') {
+            printWarning("Account left open.");
+            return;
+        }
+    }
+
+    result = choice == 1 ? bankSuspendAccount(&bank, account_number)
+           : choice == 2 ? bankReactivateAccount(&bank, account_number)
+                         : bankCloseAccount(&bank, account_number);
+    if (result != BANK_OK) {
+        printError(result == BANK_ERR_INVALID_REQUEST ? "Account is already active!" : bankResultMessage(result));
+        return;
+    }
+
+    termPrintf(&screen, "\n");
+    printSuccess(choice == 1 ? "Account suspended." : choice == 2 ? "Account reactivated." : "Account closed.");
+}
+
+const char *statusColor(AccountStatus status) {
+    switch (status) {
+        case ACCOUNT_ACTIVE: return COLOR_GREEN;
+        case ACCOUNT_SUSPENDED: return COLOR_YELLOW;
+        default: return COLOR_RED;
+    }
+}
+
+int authenticateAccount(int account_number, int max_attempts) {
+    char password[PASSWORD_LENGTH];
+    Account account;
+    int attempts = 0;
+
+    if (bankFindAccount(&bank, account_number, &account) != BANK_OK) {
+        return 0;
+    }
+
+    while (attempts < max_attempts) {
+        getPasswordInput("Enter Password: ", password, PASSWORD_LENGTH);
+
+        int result = bankAuthenticate(&bank, account_number, password);
+        if (result == BANK_OK) {
+            printSuccess("Authentication successful!");
+            return 1;
+        } else if (result == BANK_ERR_LOCKED) {
+            printError(bankResultMessage(result));
+            printInfo("Please try again later.");
+            return 0;
+        } else {
+            attempts++;
+            if (attempts < max_attempts) {
+                printError("Incorrect password!");
+                termPrintf(&screen, "Attempts remaining: %d\n", max_attempts - attempts);
+            }
+        }
+    }
+
+    printError("Maximum login attempts exceeded!");
+    printWarning("Account temporarily locked for security.");
+    return 0;
+}
+
+// Input validation functions
+int getIntInput(const char *prompt, int min, int max) {
+    int value;
+    while (1) {
+        termPrintf(&screen, "%s", prompt);
+        termFlush(&screen);
+        if (scanf("%d", &value) == 1) {
+            clearInputBuffer();
+            if (value >= min && value <= max) {
+                return value;
+            }
+        } else {
+            clearInputBuffer();
+        }
+        termPrintf(&screen, "Invalid input! Please enter a number between %d and %d.\n", min, max);
+    }
+}
+
+double getDoubleInput(const char *prompt, double min, double max) {
+    double value;
+    while (1) {
+        termPrintf(&screen, "%s", prompt);
+        termFlush(&screen);
+        if (scanf("%lf", &value) == 1) {
+            clearInputBuffer();
+            if (value >= min && value <= max) {
+                return value;
+            }
+        } else {
+            clearInputBuffer();
+        }
+        termPrintf(&screen, "Invalid amount! Range: $%.2f - $%.2f\n", min, max);
+    }
+}
+
+void getStringInput(const char *prompt, char *buffer, int max_length) {
+    while (1) {
+        termPrintf(&screen, "%s", prompt);
+        termFlush(&screen);
+        fgets(buffer, max_length, stdin);
+        buffer[strcspn(buffer, "\n")] = '\0';
+
+        // Trim whitespace
+        char *start = buffer;
+        while (isspace((unsigned char)*start)) start++;
+
+        char *end = buffer + strlen(buffer) - 1;
+        while (end > start && isspace((unsigned char)*end)) end--;
+        *(end + 1) = '\0';
+
+        if (start != buffer) {
+            memmove(buffer, start, strlen(start) + 1);
+        }
+
+        if (strlen(buffer) > 0) {
+            return;
+        }
+        printError("Input cannot be empty!");
+    }
+}
+
+void getEmailInput(const char *prompt, char *buffer, int max_length) {
+    while (1) {
+        getStringInput(prompt, buffer, max_length);
+        if (validateEmail(buffer)) {
+            return;
+        }
+        printError("Invalid email format! Please try again.");
+    }
+}
+
+void getPhoneInput(const char *prompt, char *buffer, int max_length) {
+    while (1) {
+        getStringInput(prompt, buffer, max_length);
+        if (validatePhone(buffer)) {
+            return;
+        }
+        printError("Invalid phone format! Use digits only (10-15 digits).");
+    }
+}
+
+void getPasswordInput(const char *prompt, char *buffer, int max_length) {
+    termPrintf(&screen, "%s", prompt);
+    termFlush(&screen);
+
+    int i = 0;
+    int ch;
+
+    // Read character by character without echoing
+    #ifndef _WIN32
+        // Unix/Linux - echo and line editing off until the password is in
+        struct termios saved, raw;
+        int restore = tcgetattr(STDIN_FILENO, &saved) == 0;
+        if (restore) {
+            raw = saved;
+            raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON);
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+        }
+    #endif
+    while (1) {
+        #ifdef _WIN32
+            ch = _getch();  // Windows - no echo
+        #else
+            ch = getchar();
+        #endif
+
+        if (ch == '\n' || ch == '\r' || ch == EOF) {  // Enter key
+            break;
+        } else if (ch == 127 || ch == 8) {  // Backspace
+            if (i > 0) {
+                i--;
+                termWrite(&screen, "\b \b", 3);  // Erase the last asterisk
+            }
+        } else if (i < max_length - 1) {
+            buffer[i++] = (char)ch;
+            termWrite(&screen, "*", 1);  // Print asterisk instead of actual character
+        }
+        termFlush(&screen);
+    }
+    #ifndef _WIN32
+        if (restore) {
+            tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+        }
+    #endif
+
+    buffer[i] = '\0';
+    termPrintf(&screen, "\n");
+}
+
+void clearInputBuffer() {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}